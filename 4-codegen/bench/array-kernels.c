@@ -0,0 +1,52 @@
+// Element-wise kernels and sums over local arrays, the micro-C equivalents
+// of add-two-arrays.c and sum-array.c of 7-llvm-code-transform: integer
+// arrays are added and summed up, and float arrays are scaled and added as
+// in saxpy. The arrays have an odd length, so that the vectorised loops also
+// run a remainder. Each kernel is repeated, and the sums are printed so that
+// the outputs of different compilations can be compared.
+int main()
+{
+    int a[1001];
+    int b[1001];
+    int c[1001];
+    float x[1001];
+    float y[1001];
+    int n = 1001;
+    int repetitions = 20000;
+    int sum = 0;
+    float scale = 0.5;
+    float value = 0.0;
+    float total = 0.0;
+    int i;
+    int r;
+
+    for (i = 0; i < n; i = i + 1) {
+        a[i] = i;
+        b[i] = 3 * i + 1;
+        x[i] = value;
+        y[i] = 1.0;
+        value = value + 0.001;
+    }
+
+    for (r = 0; r < repetitions; r = r + 1) {
+        for (i = 0; i < n; i = i + 1)
+            c[i] = a[i] + b[i];
+
+        for (i = 0; i < n; i = i + 1)
+            sum = sum + c[i] - a[i];
+
+        for (i = 0; i < n; i = i + 1)
+            y[i] = scale * x[i] + y[i];
+
+        for (i = 0; i < n; i = i + 1)
+            x[i] = x[i] * 0.999 - y[i] / 1024.0;
+    }
+
+    for (i = 0; i < n; i = i + 1)
+        total = total + x[i] + y[i];
+
+    print(sum);
+    print_f(total);
+
+    return 0;
+}
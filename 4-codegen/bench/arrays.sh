@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+# Compares the x64 backend with the LLVM backend on programs using arrays.
+# Every program is compiled with both backends, and the outputs of the two
+# executables are checked to be identical. Prints the best run time of each
+# executable, and the speedup of the LLVM backend over the x64 backend.
+#
+# usage: bench/arrays.sh [build-dir] [llvm-build-dir] [program.c ...]
+#
+# The LLVM backend is the microcc of 7-llvm-code-transform, built in
+# llvm-build-dir. By default, the array examples of this lab and of
+# 6-llvm-pass are measured.
+#
+# Environment variables:
+#   RUNS           number of runs of each executable (default: 5)
+#   INPUT          standard input of the programs (default: "10")
+#   MICROCC_FLAGS  extra flags for both compilers (e.g. "-ast-opt")
+#   LLC_FLAGS      flags for llc (default: "-O2")
+set -Eeuo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${1:-build}"
+LLVM_BUILD_DIR="${2:-${ROOT}/../7-llvm-code-transform/build}"
+shift $(($# < 2 ? $# : 2))
+
+RUNS="${RUNS:-5}"
+INPUT="${INPUT:-10}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+LLC_FLAGS="${LLC_FLAGS:--O2}"
+LLC="${LLC:-llc}"
+CXX="${CXX:-c++}"
+
+if [ $# -eq 0 ]; then
+	set -- "${ROOT}/examples/arrays.c" \
+		"${ROOT}/../6-llvm-pass/examples/bubble-sort.c" \
+		"${ROOT}/../6-llvm-pass/extra-tests/gaussian-elimination.c"
+fi
+
+for tool in "${BUILD_DIR}/microcc" "${LLVM_BUILD_DIR}/microcc"; do
+	if [ ! -x "${tool}" ]; then
+		echo "$0: ${tool} not found, build it first" >&2
+		exit 2
+	fi
+done
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+# Prints the best wall-clock time of RUNS runs of an executable, in seconds.
+best_time() {
+	local best=""
+
+	for ((run = 0; run < RUNS; run++)); do
+		local begin end
+		begin="$(date +%s%N)"
+		"$1" <<< "${INPUT}" > /dev/null || true
+		end="$(date +%s%N)"
+
+		if [ -z "${best}" ] || [ $((end - begin)) -lt "${best}" ]; then
+			best=$((end - begin))
+		fi
+	done
+
+	awk -v ns="${best}" 'BEGIN { printf "%.4f", ns / 1e9 }'
+}
+
+printf "%-28s %10s %10s %8s\n" "program" "x64 (s)" "llvm (s)" "speedup"
+
+status=0
+for program in "$@"; do
+	name="$(basename "${program}" .c)"
+	x64="${WORK_DIR}/${name}.x64"
+	llvm="${WORK_DIR}/${name}.llvm"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} "${program}" > "${x64}.s"
+	"${CXX}" -no-pie "${x64}.s" "${BUILD_DIR}/libruntime.a" -o "${x64}"
+
+	# shellcheck disable=SC2086
+	"${LLVM_BUILD_DIR}/microcc" ${MICROCC_FLAGS} "${program}" > "${llvm}.ll"
+	# shellcheck disable=SC2086
+	"${LLC}" ${LLC_FLAGS} -relocation-model=pic "${llvm}.ll" -o "${llvm}.s"
+	"${CXX}" "${llvm}.s" "${LLVM_BUILD_DIR}/libruntime.a" -o "${llvm}"
+
+	if ! cmp -s <("${x64}" <<< "${INPUT}") <("${llvm}" <<< "${INPUT}"); then
+		echo "$0: ${name}: the outputs of the backends differ" >&2
+		status=1
+		continue
+	fi
+
+	x64_time="$(best_time "${x64}")"
+	llvm_time="$(best_time "${llvm}")"
+
+	awk -v name="${name}" -v x64="${x64_time}" -v llvm="${llvm_time}" 'BEGIN {
+		printf "%-28s %10.4f %10.4f %7.2fx\n", name, x64, llvm, x64 / llvm
+	}'
+done
+
+exit "${status}"
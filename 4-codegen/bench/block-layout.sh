@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+# Measures the block layout of the x64 backend: loop rotation, inverted
+# conditional jumps and aligned loop headers. Every program is compiled with
+# and without -x64-block-layout, and the outputs of the two executables are
+# checked to be identical. Prints the best run time of each executable, and
+# the speedup of block layout.
+#
+# usage: bench/block-layout.sh [build-dir] [program.c ...]
+#
+# By default, bench/branchy-loops.c and the Gaussian elimination of
+# 6-llvm-pass are measured.
+#
+# Environment variables:
+#   RUNS           number of runs of each executable (default: 5)
+#   INPUT          standard input of the programs (default: "10")
+#   MICROCC_FLAGS  extra flags for both compilations (e.g. "-ast-opt")
+set -Eeuo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${1:-build}"
+shift $(($# < 1 ? $# : 1))
+
+RUNS="${RUNS:-5}"
+INPUT="${INPUT:-10}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+CXX="${CXX:-c++}"
+
+if [ $# -eq 0 ]; then
+	set -- "${ROOT}/bench/branchy-loops.c" \
+		"${ROOT}/../6-llvm-pass/extra-tests/gaussian-elimination.c"
+fi
+
+if [ ! -x "${BUILD_DIR}/microcc" ]; then
+	echo "$0: ${BUILD_DIR}/microcc not found, build it first" >&2
+	exit 2
+fi
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+# Prints the best wall-clock time of RUNS runs of an executable, in seconds.
+best_time() {
+	local best=""
+
+	for ((run = 0; run < RUNS; run++)); do
+		local begin end
+		begin="$(date +%s%N)"
+		"$1" <<< "${INPUT}" > /dev/null || true
+		end="$(date +%s%N)"
+
+		if [ -z "${best}" ] || [ $((end - begin)) -lt "${best}" ]; then
+			best=$((end - begin))
+		fi
+	done
+
+	awk -v ns="${best}" 'BEGIN { printf "%.4f", ns / 1e9 }'
+}
+
+printf "%-28s %12s %12s %8s\n" "program" "in order (s)" "laid out (s)" "speedup"
+
+status=0
+for program in "$@"; do
+	name="$(basename "${program}" .c)"
+	plain="${WORK_DIR}/${name}.plain"
+	laidout="${WORK_DIR}/${name}.laidout"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} -x64-block-layout=false \
+		"${program}" > "${plain}.s"
+	"${CXX}" -no-pie "${plain}.s" "${BUILD_DIR}/libruntime.a" -o "${plain}"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} "${program}" > "${laidout}.s"
+	"${CXX}" -no-pie "${laidout}.s" "${BUILD_DIR}/libruntime.a" -o "${laidout}"
+
+	if ! cmp -s <("${plain}" <<< "${INPUT}") <("${laidout}" <<< "${INPUT}"); then
+		echo "$0: ${name}: the outputs with and without block layout differ" >&2
+		status=1
+		continue
+	fi
+
+	plain_time="$(best_time "${plain}")"
+	laidout_time="$(best_time "${laidout}")"
+
+	awk -v name="${name}" -v plain="${plain_time}" -v laidout="${laidout_time}" 'BEGIN {
+		printf "%-28s %12.4f %12.4f %7.2fx\n", name, plain, laidout, plain / laidout
+	}'
+done
+
+exit "${status}"
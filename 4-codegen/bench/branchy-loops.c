@@ -0,0 +1,63 @@
+// Tight loops with branches in their bodies: trial division to count
+// primes, a bubble sort, and the Collatz sequence, whose loop conditions
+// and if statements are the jumps that block layout rearranges.
+int main()
+{
+    int values[256];
+    int primes = 0;
+    int steps = 0;
+    int swaps = 0;
+    int round;
+    int i;
+    int j;
+    int n;
+    int t;
+
+    for (n = 2; n < 200000; n = n + 1) {
+        t = 1;
+
+        for (i = 2; i * i <= n; i = i + 1) {
+            if (n % i == 0) {
+                t = 0;
+                i = n;
+            }
+        }
+
+        primes = primes + t;
+    }
+
+    for (round = 0; round < 150; round = round + 1) {
+        for (i = 0; i < 256; i = i + 1)
+            values[i] = (i * 7919 + round * 104729) % 1000;
+
+        for (i = 0; i < 256; i = i + 1) {
+            for (j = 0; j < 255 - i; j = j + 1) {
+                if (values[j] > values[j + 1]) {
+                    t = values[j];
+                    values[j] = values[j + 1];
+                    values[j + 1] = t;
+                    swaps = swaps + 1;
+                }
+            }
+        }
+    }
+
+    for (i = 1; i < 1000000; i = i + 1) {
+        n = i;
+
+        while (n != 1) {
+            if (n % 2 == 0)
+                n = n / 2;
+            else
+                n = 3 * n + 1;
+
+            steps = steps + 1;
+        }
+    }
+
+    print(primes);
+    print(swaps);
+    print(steps);
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+// Multiplication, division and modulo by constants in a hot loop: a linear
+// congruential generator, decimal digit sums and a hash table index.
+int main()
+{
+    int iterations = 10000000;
+    int seed = 1;
+    int digits = 0;
+    int buckets = 0;
+    int i;
+    int n;
+
+    for (i = 0; i < iterations; i = i + 1) {
+        seed = seed * 1103515245 + 12345;
+        n = (seed / 65536) % 32768;
+
+        while (n != 0) {
+            digits = digits + n % 10;
+            n = n / 10;
+        }
+
+        buckets = buckets + (seed * 9) % 1000 + seed / 24 % 7;
+    }
+
+    print(digits);
+    print(buckets);
+
+    return 0;
+}
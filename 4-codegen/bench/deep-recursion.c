@@ -0,0 +1,55 @@
+// Deep recursion in tail position: an accumulating sum, mutual recursion
+// between even and odd, and Euclid's algorithm. Without tail calls, every
+// level of the first two takes a stack frame, about 1.6 MB at the deepest.
+int sum(int n, int acc)
+{
+    if (n == 0)
+        return acc;
+
+    return sum(n - 1, acc + n);
+}
+
+int odd(int n)
+{
+    if (n == 0)
+        return 0;
+
+    return even(n - 1);
+}
+
+int even(int n)
+{
+    if (n == 0)
+        return 1;
+
+    return odd(n - 1);
+}
+
+int gcd(int a, int b)
+{
+    if (b == 0)
+        return a;
+
+    return gcd(b, a % b);
+}
+
+int main()
+{
+    int depth = 100000;
+    int total = 0;
+    int evens = 0;
+    int divisors = 0;
+    int i;
+
+    for (i = 0; i < 1000; i = i + 1) {
+        total = total + sum(depth, i);
+        evens = evens + even(depth + i);
+        divisors = divisors + gcd(depth * i + 1, 1000 + i);
+    }
+
+    print(total);
+    print(evens);
+    print(divisors);
+
+    return 0;
+}
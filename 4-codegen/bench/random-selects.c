@@ -0,0 +1,60 @@
+// Data-dependent selections on pseudo-random numbers: absolute values,
+// maxima and clamps of the values of a linear congruential generator, whose
+// if statements are taken about half of the time, in no pattern that a
+// branch predictor can learn. The negative values are also counted, with an
+// if statement that assigns two different variables and stays a branch.
+int abs(int x)
+{
+    if (x < 0)
+        return -x;
+    return x;
+}
+
+int max(int a, int b)
+{
+    if (a > b)
+        return a;
+    else
+        return b;
+}
+
+int clamp(int x, int low, int high)
+{
+    if (x < low)
+        x = low;
+    if (x > high)
+        x = high;
+    return x;
+}
+
+int main()
+{
+    int iterations = 20000000;
+    int seed = 1;
+    int sum = 0;
+    int largest = 0;
+    int low = 0;
+    int high = 0;
+    int i;
+    int n;
+
+    for (i = 0; i < iterations; i = i + 1) {
+        seed = seed * 1103515245 + 12345;
+        n = seed / 65536 % 2000 - 1000;
+
+        sum = sum + abs(n) + clamp(n, -500, 500);
+        largest = max(largest, n);
+
+        if (n < 0)
+            low = low + 1;
+        else
+            high = high + 1;
+    }
+
+    print(sum);
+    print(largest);
+    print(low);
+    print(high);
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env bash
+# Measures tail calls in the x64 backend. Every program is compiled with and
+# without -x64-tail-calls, and the outputs of the two executables are checked
+# to be identical. Prints the best run time of each executable, and the
+# smallest stack limit under which it runs, found by bisection on ulimit -s.
+#
+# usage: bench/tail-calls.sh [build-dir] [program.c ...]
+#
+# By default, bench/deep-recursion.c is measured.
+#
+# Environment variables:
+#   RUNS           number of runs of each executable (default: 5)
+#   INPUT          standard input of the programs (default: "10")
+#   MICROCC_FLAGS  extra flags for both compilations (e.g. "-ast-opt")
+#   MAX_STACK      largest stack limit tried, in KiB (default: 65536)
+set -Eeuo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${1:-build}"
+shift $(($# < 1 ? $# : 1))
+
+RUNS="${RUNS:-5}"
+INPUT="${INPUT:-10}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+MAX_STACK="${MAX_STACK:-65536}"
+CXX="${CXX:-c++}"
+
+if [ $# -eq 0 ]; then
+	set -- "${ROOT}/bench/deep-recursion.c"
+fi
+
+if [ ! -x "${BUILD_DIR}/microcc" ]; then
+	echo "$0: ${BUILD_DIR}/microcc not found, build it first" >&2
+	exit 2
+fi
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+# Prints the best wall-clock time of RUNS runs of an executable, in seconds.
+best_time() {
+	local best=""
+
+	for ((run = 0; run < RUNS; run++)); do
+		local begin end
+		begin="$(date +%s%N)"
+		"$1" <<< "${INPUT}" > /dev/null || true
+		end="$(date +%s%N)"
+
+		if [ -z "${best}" ] || [ $((end - begin)) -lt "${best}" ]; then
+			best=$((end - begin))
+		fi
+	done
+
+	awk -v ns="${best}" 'BEGIN { printf "%.4f", ns / 1e9 }'
+}
+
+# Runs an executable with a stack limit in KiB, and returns its status. The
+# subshell reports crashes on its standard error, which is discarded.
+run_with_stack() {
+	(ulimit -s "$2" && "$1" <<< "${INPUT}" > /dev/null) 2> /dev/null
+}
+
+# Prints the smallest stack limit in KiB under which an executable exits
+# successfully, or "-" if it fails under MAX_STACK.
+min_stack() {
+	local low=0 high="${MAX_STACK}"
+
+	if ! run_with_stack "$1" "${high}"; then
+		echo "-"
+		return
+	fi
+
+	while [ $((high - low)) -gt 1 ]; do
+		local middle=$(((low + high) / 2))
+
+		if run_with_stack "$1" "${middle}"; then
+			high="${middle}"
+		else
+			low="${middle}"
+		fi
+	done
+
+	echo "${high}"
+}
+
+printf "%-20s %9s %10s %8s %13s %14s\n" "program" "call (s)" "tail (s)" \
+	"speedup" "call (KiB)" "tail (KiB)"
+
+status=0
+for program in "$@"; do
+	name="$(basename "${program}" .c)"
+	plain="${WORK_DIR}/${name}.plain"
+	tail="${WORK_DIR}/${name}.tail"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} -x64-tail-calls=false \
+		"${program}" > "${plain}.s"
+	"${CXX}" -no-pie "${plain}.s" "${BUILD_DIR}/libruntime.a" -o "${plain}"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} "${program}" > "${tail}.s"
+	"${CXX}" -no-pie "${tail}.s" "${BUILD_DIR}/libruntime.a" -o "${tail}"
+
+	if ! cmp -s <("${plain}" <<< "${INPUT}") <("${tail}" <<< "${INPUT}"); then
+		echo "$0: ${name}: the outputs with and without tail calls differ" >&2
+		status=1
+		continue
+	fi
+
+	plain_time="$(best_time "${plain}")"
+	tail_time="$(best_time "${tail}")"
+	plain_stack="$(min_stack "${plain}")"
+	tail_stack="$(min_stack "${tail}")"
+
+	awk -v name="${name}" -v plain="${plain_time}" -v tail="${tail_time}" \
+		-v plain_stack="${plain_stack}" -v tail_stack="${tail_stack}" 'BEGIN {
+		printf "%-20s %9.4f %10.4f %7.2fx %13s %14s\n", name, plain, tail,
+			plain / tail, plain_stack, tail_stack
+	}'
+done
+
+exit "${status}"
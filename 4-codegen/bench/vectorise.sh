@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+# Measures the vectorisation of loops over arrays with SSE2 in the x64
+# backend. Every program is compiled with and without -x64-vectorise, and the
+# outputs of the two executables are checked to be identical. Prints the best
+# run time of each executable, and the speedup of vectorisation.
+#
+# usage: bench/vectorise.sh [build-dir] [program.c ...]
+#
+# By default, bench/array-kernels.c, whose loops are all vectorised, and the
+# Gaussian elimination of 6-llvm-pass, whose loops compute their indices and
+# stay scalar, are measured.
+#
+# Environment variables:
+#   RUNS           number of runs of each executable (default: 5)
+#   INPUT          standard input of the programs (default: "10")
+#   MICROCC_FLAGS  extra flags for both compilations (e.g. "-ast-opt")
+set -Eeuo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${1:-build}"
+shift $(($# < 1 ? $# : 1))
+
+RUNS="${RUNS:-5}"
+INPUT="${INPUT:-10}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+CXX="${CXX:-c++}"
+
+if [ $# -eq 0 ]; then
+	set -- "${ROOT}/bench/array-kernels.c" \
+		"${ROOT}/../6-llvm-pass/extra-tests/gaussian-elimination.c"
+fi
+
+if [ ! -x "${BUILD_DIR}/microcc" ]; then
+	echo "$0: ${BUILD_DIR}/microcc not found, build it first" >&2
+	exit 2
+fi
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+# Prints the best wall-clock time of RUNS runs of an executable, in seconds.
+best_time() {
+	local best=""
+
+	for ((run = 0; run < RUNS; run++)); do
+		local begin end
+		begin="$(date +%s%N)"
+		"$1" <<< "${INPUT}" > /dev/null || true
+		end="$(date +%s%N)"
+
+		if [ -z "${best}" ] || [ $((end - begin)) -lt "${best}" ]; then
+			best=$((end - begin))
+		fi
+	done
+
+	awk -v ns="${best}" 'BEGIN { printf "%.4f", ns / 1e9 }'
+}
+
+printf "%-28s %10s %10s %8s\n" "program" "scalar (s)" "SSE2 (s)" "speedup"
+
+status=0
+for program in "$@"; do
+	name="$(basename "${program}" .c)"
+	scalar="${WORK_DIR}/${name}.scalar"
+	vectorised="${WORK_DIR}/${name}.vectorised"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} -x64-vectorise=false \
+		"${program}" > "${scalar}.s"
+	"${CXX}" -no-pie "${scalar}.s" "${BUILD_DIR}/libruntime.a" -o "${scalar}"
+
+	# shellcheck disable=SC2086
+	"${BUILD_DIR}/microcc" ${MICROCC_FLAGS} "${program}" > "${vectorised}.s"
+	"${CXX}" -no-pie "${vectorised}.s" "${BUILD_DIR}/libruntime.a" -o "${vectorised}"
+
+	if ! cmp -s <("${scalar}" <<< "${INPUT}") <("${vectorised}" <<< "${INPUT}"); then
+		echo "$0: ${name}: the outputs with and without vectorisation differ" >&2
+		status=1
+		continue
+	fi
+
+	scalar_time="$(best_time "${scalar}")"
+	vectorised_time="$(best_time "${vectorised}")"
+
+	awk -v name="${name}" -v scalar="${scalar_time}" -v vectorised="${vectorised_time}" 'BEGIN {
+		printf "%-28s %10.4f %10.4f %7.2fx\n", name, scalar, vectorised, scalar / vectorised
+	}'
+done
+
+exit "${status}"
@@ -0,0 +1,49 @@
+int sum(int n)
+{
+    int values[64];
+    int i;
+    int total = 0;
+
+    for (i = 0; i < n; i = i + 1)
+        values[i] = i * i;
+
+    for (i = 0; i < n; i = i + 1)
+        total = total + values[i];
+
+    return total;
+}
+
+int main()
+{
+    int primes[100]; // sieve of Eratosthenes
+    int large[300000]; // does not fit in a single page
+    int i;
+    int j;
+    int count = 0;
+
+    for (i = 0; i < 100; i = i + 1)
+        primes[i] = 1;
+
+    primes[0] = 0;
+    primes[1] = 0;
+
+    for (i = 2; i < 100; i = i + 1)
+    {
+        if (primes[i])
+        {
+            count = count + 1;
+
+            for (j = i * i; j < 100; j = j + i)
+                primes[j] = 0;
+        }
+    }
+
+    print(count);
+    print(sum(read()));
+
+    large[299999] = primes[97] + primes[98];
+    large[0] = large[299999] = large[299999] * 3;
+    print(large[0]);
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+int f(int a, int b)
+{
+    int k = 4;
+    int unused = 3 * 7;
+    int x = a * b + a * b;
+    if (2 > 3) {
+        print(111);
+    } else {
+        print(a * k + 0);
+    }
+    while (0) {
+        print(5);
+    }
+    return x * 1 + (1 - 1);
+    print(99);
+}
+
+int main()
+{
+    print(2 * 3 + 4);
+    print(f(3, 5));
+    print(8 * f(1, 1));
+    return 0;
+}
@@ -0,0 +1,54 @@
+float average(float a, int n, float b, float c, float d, float e, float f,
+              float g, float h, float i, int m, float j)
+{
+    // 'i' and 'j' do not fit in %xmm0-7, and are passed on the stack.
+    if (n < m)
+        return -1.0;
+
+    return (a + b + c + d + e + f + g + h + i + j) / 10.0;
+}
+
+float polynomial(float x)
+{
+    float coefficients[4];
+    float result = 0.0;
+    int i;
+
+    coefficients[0] = 1.5;
+    coefficients[1] = -2.0;
+    coefficients[2] = 0.25;
+    coefficients[3] = 1.0;
+
+    for (i = 3; i >= 0; i = i - 1)
+        result = result * x + coefficients[i];
+
+    return result;
+}
+
+int compare(float a, float b)
+{
+    return (a < b) + 2 * (a <= b) + 4 * (a > b) + 8 * (a >= b) +
+           16 * (a == b) + 32 * (a != b);
+}
+
+int main()
+{
+    float x = read_f();
+    float zero = 0.0;
+    float nan = zero / zero;
+
+    print_f(x);
+    print_f(-x);
+    print_f(average(1.0, 2, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 1, 11.0));
+    print_f(polynomial(x));
+    print_f(x % 1.5);
+    print_f(x ^ 2.0);
+    print(3 ^ 4);
+
+    print(compare(1.0, 2.0));
+    print(compare(2.0, 1.0));
+    print(compare(x, x));
+    print(compare(x, nan));
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ASTOPTIMISER_HPP
+#define ASTOPTIMISER_HPP
+
+#include "ast/ast.hpp"
+#include "sema/scoperesolutionpass.hpp"
+#include "sema/typecheckingpass.hpp"
+
+namespace ast_opt {
+// Runs the AST-level optimisation pipeline on a type checked program, before
+// it is handed to a code generator. The passes keep the symbol table and the
+// type table up to date for the nodes they create, so the code generators
+// must be given the tables owned by the optimiser afterwards.
+class ASTOptimiser {
+  public:
+    ASTOptimiser(const sema::ScopeResolutionPass::SymbolTable &symbol_table,
+                 const sema::TypeCheckingPass::TypeTable &type_table)
+        : symbol_table(symbol_table), type_table(type_table) {}
+
+    void optimise(ast::Base &root);
+
+    sema::ScopeResolutionPass::SymbolTable getSymbolTable() const {
+        return symbol_table;
+    }
+
+    sema::TypeCheckingPass::TypeTable getTypeTable() const {
+        return type_table;
+    }
+
+  private:
+    // Symbol table, updated with the references created by the passes.
+    sema::ScopeResolutionPass::SymbolTable symbol_table;
+
+    // Type table, updated with the expressions created by the passes.
+    sema::TypeCheckingPass::TypeTable type_table;
+};
+} // namespace ast_opt
+
+#endif /* end of include guard: ASTOPTIMISER_HPP */
@@ -0,0 +1,225 @@
+#include "ast-opt/commonsubexpressionpass.hpp"
+#include "ast-opt/util.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Type.h"
+#include "llvm/Support/Debug.h"
+
+#include <algorithm>
+#include <fmt/core.h>
+#include <iterator>
+#include <unordered_map>
+
+#define DEBUG_TYPE "commonsubexpressionpass"
+
+STATISTIC(NumCommonSubexpressions,
+          "The number of redundant subexpressions that were eliminated");
+STATISTIC(NumTemporaries,
+          "The number of temporaries introduced to hold common subexpressions");
+
+namespace {
+// Returns the expression evaluated by a statement that may contain common
+// subexpressions, or nullptr if there is none.
+ast::Ptr<ast::Expr> *getStatementExpr(ast::Stmt &stmt) {
+    switch (stmt.kind) {
+    case ast::Base::Kind::ExprStmt:
+        return &static_cast<ast::ExprStmt &>(stmt).expr;
+    case ast::Base::Kind::ReturnStmt: {
+        auto &value = static_cast<ast::ReturnStmt &>(stmt).value;
+        return value ? &value : nullptr;
+    }
+    case ast::Base::Kind::VarDecl: {
+        auto &init = static_cast<ast::VarDecl &>(stmt).init;
+        return init ? &init : nullptr;
+    }
+    case ast::Base::Kind::IfStmt:
+        // The condition of an if statement is evaluated exactly once, before
+        // either branch. This is not the case for while statements.
+        return &static_cast<ast::IfStmt &>(stmt).condition;
+    default:
+        return nullptr;
+    }
+}
+
+// Adds all nodes of an expression tree to 'nodes'.
+void collectNodes(ast::Expr &expr, std::set<ast::Base *> &nodes) {
+    nodes.insert(&expr);
+
+    switch (expr.kind) {
+    case ast::Base::Kind::BinaryOpExpr:
+        collectNodes(*static_cast<ast::BinaryOpExpr &>(expr).lhs, nodes);
+        collectNodes(*static_cast<ast::BinaryOpExpr &>(expr).rhs, nodes);
+        break;
+    case ast::Base::Kind::UnaryOpExpr:
+        collectNodes(*static_cast<ast::UnaryOpExpr &>(expr).operand, nodes);
+        break;
+    case ast::Base::Kind::ArrayRefExpr:
+        collectNodes(*static_cast<ast::ArrayRefExpr &>(expr).index, nodes);
+        break;
+    case ast::Base::Kind::FuncCallExpr:
+        for (auto &arg : static_cast<ast::FuncCallExpr &>(expr).arguments)
+            collectNodes(*arg, nodes);
+        break;
+    default:
+        break;
+    }
+}
+} // namespace
+
+void ast_opt::CommonSubexpressionPass::visitCompoundStmt(
+    ast::CompoundStmt &node) {
+    auto &body = node.body;
+
+    for (std::size_t i = 0; i < body.size(); ++i) {
+        // Keep the statement alive, inserting temporaries moves it around.
+        ast::Ptr<ast::Stmt> stmt = body[i];
+
+        if (ast::Ptr<ast::Expr> *expr = getStatementExpr(*stmt)) {
+            auto temporaries = eliminate(*expr);
+            body.insert(std::begin(body) + i, std::begin(temporaries),
+                        std::end(temporaries));
+            i += temporaries.size();
+        }
+
+        visit(*stmt);
+    }
+}
+
+void ast_opt::CommonSubexpressionPass::collectCandidates(
+    ast::Ptr<ast::Expr> &expr, const std::set<ast::Base *> &assigned,
+    std::vector<ast::Ptr<ast::Expr> *> &candidates) {
+    // Visit the subexpressions first, so that candidates are ordered from
+    // left to right, inner to outer.
+    switch (expr->kind) {
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binop = static_cast<ast::BinaryOpExpr &>(*expr);
+        collectCandidates(binop.lhs, assigned, candidates);
+        collectCandidates(binop.rhs, assigned, candidates);
+        if (binop.op.type == TokenType::EQUALS)
+            return;
+        break;
+    }
+    case ast::Base::Kind::UnaryOpExpr:
+        collectCandidates(static_cast<ast::UnaryOpExpr &>(*expr).operand,
+                          assigned, candidates);
+        break;
+    case ast::Base::Kind::ArrayRefExpr:
+        collectCandidates(static_cast<ast::ArrayRefExpr &>(*expr).index,
+                          assigned, candidates);
+        break;
+    case ast::Base::Kind::FuncCallExpr:
+        for (auto &arg : static_cast<ast::FuncCallExpr &>(*expr).arguments)
+            collectCandidates(arg, assigned, candidates);
+        return;
+    default:
+        // Literals and variable references are cheaper to re-evaluate than a
+        // temporary.
+        return;
+    }
+
+    llvm::Type *type = type_table[expr.get()];
+    if (!type || !(type->isIntegerTy() || type->isFloatTy()))
+        return;
+
+    if (!Util::isPure(*expr))
+        return;
+
+    for (ast::Base *decl :
+         Util::collectReferencedDeclarations(*expr, symbol_table))
+        if (assigned.find(decl) != std::end(assigned))
+            return;
+
+    candidates.push_back(&expr);
+}
+
+std::vector<ast::Ptr<ast::Stmt>>
+ast_opt::CommonSubexpressionPass::eliminate(ast::Ptr<ast::Expr> &expr) {
+    std::vector<ast::Ptr<ast::Stmt>> temporaries;
+
+    const std::set<ast::Base *> assigned =
+        Util::collectAssignedDeclarations(*expr, symbol_table);
+
+    std::vector<ast::Ptr<ast::Expr> *> candidates;
+    collectCandidates(expr, assigned, candidates);
+
+    // Partition the candidates into classes of structurally equal
+    // expressions, using the structural hash to find potential matches.
+    std::unordered_map<std::size_t, std::vector<std::size_t>> buckets;
+    std::vector<std::vector<ast::Ptr<ast::Expr> *>> classes;
+
+    for (auto *candidate : candidates) {
+        auto &bucket = buckets[Util::hash(**candidate, symbol_table)];
+
+        auto it = std::find_if(
+            std::begin(bucket), std::end(bucket), [&](std::size_t cls) {
+                return Util::equal(**classes[cls].front(), **candidate,
+                                   symbol_table);
+            });
+
+        if (it != std::end(bucket)) {
+            classes[*it].push_back(candidate);
+        } else {
+            bucket.push_back(classes.size());
+            classes.push_back({candidate});
+        }
+    }
+
+    // Handle the largest expressions first: hoisting those also takes care of
+    // the common subexpressions they contain.
+    std::stable_sort(std::begin(classes), std::end(classes),
+                     [](const auto &lhs, const auto &rhs) {
+                         return Util::size(**lhs.front()) >
+                                Util::size(**rhs.front());
+                     });
+
+    // Nodes that were hoisted or replaced. Candidates overlapping them are no
+    // longer valid.
+    std::set<ast::Base *> handled;
+
+    // Keep replaced subtrees alive while 'candidates' may still point into
+    // them.
+    std::vector<ast::Ptr<ast::Expr>> replaced;
+
+    for (const auto &cls : classes) {
+        if (cls.size() < 2)
+            continue;
+
+        bool overlaps = std::any_of(
+            std::begin(cls), std::end(cls), [&](ast::Ptr<ast::Expr> *member) {
+                return handled.find(member->get()) != std::end(handled);
+            });
+
+        if (overlaps)
+            continue;
+
+        // Declare a temporary holding the value of the first occurrence.
+        ast::Ptr<ast::Expr> value = *cls.front();
+        llvm::Type *type = type_table[value.get()];
+
+        Token type_token{TokenType::IDENTIFIER, Location(), Location(),
+                         type->isFloatTy() ? "float" : "int"};
+        Token name_token{TokenType::IDENTIFIER, Location(), Location(),
+                         fmt::format(".cse{}", temporary_counter++)};
+
+        auto temporary =
+            std::make_shared<ast::VarDecl>(type_token, name_token, value);
+        type_table[temporary.get()] = type;
+        temporaries.push_back(temporary);
+        ++NumTemporaries;
+
+        // Replace all occurrences by a reference to the temporary.
+        for (ast::Ptr<ast::Expr> *member : cls) {
+            collectNodes(**member, handled);
+            replaced.push_back(*member);
+
+            auto ref = std::make_shared<ast::VarRefExpr>(name_token);
+            symbol_table[ref.get()] = temporary.get();
+            type_table[ref.get()] = type;
+            *member = ref;
+        }
+
+        NumCommonSubexpressions += cls.size() - 1;
+    }
+
+    return temporaries;
+}
@@ -0,0 +1,53 @@
+#ifndef COMMONSUBEXPRESSIONPASS_HPP
+#define COMMONSUBEXPRESSIONPASS_HPP
+
+#include "ast/ast.hpp"
+#include "ast/visitor.hpp"
+#include "sema/scoperesolutionpass.hpp"
+#include "sema/typecheckingpass.hpp"
+
+#include <set>
+#include <vector>
+
+namespace ast_opt {
+// AST pass that detects common subexpressions inside a statement using
+// structural hashing, and evaluates them only once by hoisting them into a
+// temporary variable that is declared right before the statement.
+//
+// Only side-effect free subexpressions that do not read a variable or array
+// assigned to in the same expression are considered, so hoisting them cannot
+// change the result.
+class CommonSubexpressionPass : public ast::Visitor<CommonSubexpressionPass> {
+  public:
+    CommonSubexpressionPass(
+        sema::ScopeResolutionPass::SymbolTable &symbol_table,
+        sema::TypeCheckingPass::TypeTable &type_table)
+        : symbol_table(symbol_table), type_table(type_table) {}
+
+    void visitCompoundStmt(ast::CompoundStmt &node);
+
+  private:
+    // Maps each use of a variable to its definition. References to the
+    // temporaries created by this pass are added to it.
+    sema::ScopeResolutionPass::SymbolTable &symbol_table;
+
+    // Maps each expression to its type. Temporaries created by this pass are
+    // added to it.
+    sema::TypeCheckingPass::TypeTable &type_table;
+
+    // Counter to generate unique names for temporaries.
+    unsigned int temporary_counter = 0;
+
+    // Collects the subexpressions of 'expr' that may be hoisted.
+    void collectCandidates(ast::Ptr<ast::Expr> &expr,
+                           const std::set<ast::Base *> &assigned,
+                           std::vector<ast::Ptr<ast::Expr> *> &candidates);
+
+    // Eliminates common subexpressions in 'expr'. Returns the declarations of
+    // the temporaries that must be inserted before the statement containing
+    // 'expr'.
+    std::vector<ast::Ptr<ast::Stmt>> eliminate(ast::Ptr<ast::Expr> &expr);
+};
+} // namespace ast_opt
+
+#endif /* end of include guard: COMMONSUBEXPRESSIONPASS_HPP */
@@ -0,0 +1,125 @@
+#include "ast-opt/deadcodeeliminationpass.hpp"
+#include "ast-opt/util.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Debug.h"
+
+#include <iterator>
+
+#define DEBUG_TYPE "deadcodeeliminationpass"
+
+STATISTIC(NumUnreachableStmtsRemoved,
+          "The number of statements after a return that were removed");
+STATISTIC(NumConstantBranchesRemoved,
+          "The number of if/while statements with a constant condition that "
+          "were removed");
+STATISTIC(NumDeadDeclsRemoved,
+          "The number of unreferenced declarations that were removed");
+
+namespace {
+// Returns the value of a constant condition in 'value', or false if the
+// condition is not a literal.
+bool isConstantCondition(const ast::Expr &condition, bool &value) {
+    if (condition.kind != ast::Base::Kind::IntLiteral)
+        return false;
+
+    value = static_cast<const ast::IntLiteral &>(condition).value != 0;
+    return true;
+}
+} // namespace
+
+void ast_opt::DeadCodeEliminationPass::eliminate(ast::Ptr<ast::Stmt> &stmt) {
+    if (ast::Ptr<ast::Stmt> replacement = visit(*stmt))
+        stmt = replacement;
+}
+
+ast::Ptr<ast::Stmt>
+ast_opt::DeadCodeEliminationPass::visitFuncDecl(ast::FuncDecl &node) {
+    referenced = Util::collectReferencedDeclarations(*node.body, symbol_table);
+
+    visit(*node.body);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Stmt>
+ast_opt::DeadCodeEliminationPass::visitIfStmt(ast::IfStmt &node) {
+    eliminate(node.if_clause);
+    if (node.else_clause)
+        eliminate(node.else_clause);
+
+    bool value;
+    if (!isConstantCondition(*node.condition, value))
+        return nullptr;
+
+    ++NumConstantBranchesRemoved;
+
+    if (value)
+        return node.if_clause;
+
+    if (node.else_clause)
+        return node.else_clause;
+
+    return std::make_shared<ast::EmptyStmt>();
+}
+
+ast::Ptr<ast::Stmt>
+ast_opt::DeadCodeEliminationPass::visitWhileStmt(ast::WhileStmt &node) {
+    eliminate(node.body);
+
+    bool value;
+    if (!isConstantCondition(*node.condition, value) || value)
+        return nullptr;
+
+    ++NumConstantBranchesRemoved;
+    return std::make_shared<ast::EmptyStmt>();
+}
+
+ast::Ptr<ast::Stmt>
+ast_opt::DeadCodeEliminationPass::visitVarDecl(ast::VarDecl &node) {
+    if (referenced.find(&node) != std::end(referenced))
+        return nullptr;
+
+    // The initialiser still has to be evaluated if it has side effects.
+    if (node.init && !Util::isPure(*node.init))
+        return nullptr;
+
+    ++NumDeadDeclsRemoved;
+    return std::make_shared<ast::EmptyStmt>();
+}
+
+ast::Ptr<ast::Stmt>
+ast_opt::DeadCodeEliminationPass::visitArrayDecl(ast::ArrayDecl &node) {
+    if (referenced.find(&node) != std::end(referenced))
+        return nullptr;
+
+    ++NumDeadDeclsRemoved;
+    return std::make_shared<ast::EmptyStmt>();
+}
+
+ast::Ptr<ast::Stmt>
+ast_opt::DeadCodeEliminationPass::visitCompoundStmt(ast::CompoundStmt &node) {
+    auto &body = node.body;
+
+    for (auto it = std::begin(body); it != std::end(body);) {
+        eliminate(*it);
+
+        // Drop empty statements, they do not generate any code.
+        if ((*it)->kind == ast::Base::Kind::EmptyStmt) {
+            it = body.erase(it);
+            continue;
+        }
+
+        // Everything after a statement that always returns is unreachable.
+        if (Util::alwaysReturns(**it)) {
+            NumUnreachableStmtsRemoved +=
+                std::distance(std::next(it), std::end(body));
+            body.erase(std::next(it), std::end(body));
+            break;
+        }
+
+        ++it;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,241 @@
+#include "ast-opt/util.hpp"
+#include "ast/visitor.hpp"
+
+#include <functional>
+
+namespace {
+// Looks up the declaration a variable or array reference resolves to.
+ast::Base *
+resolve(ast::Base &ref,
+        const sema::ScopeResolutionPass::SymbolTable &symbol_table) {
+    auto it = symbol_table.find(&ref);
+    return it == std::end(symbol_table) ? nullptr : it->second;
+}
+
+// Walks an AST and records the declarations of referenced (or only assigned)
+// variables and arrays.
+class DeclarationCollector : public ast::Visitor<DeclarationCollector> {
+  public:
+    DeclarationCollector(
+        const sema::ScopeResolutionPass::SymbolTable &symbol_table,
+        bool assigned_only)
+        : symbol_table(symbol_table), assigned_only(assigned_only) {}
+
+    std::set<ast::Base *> declarations;
+
+    void visitBinaryOpExpr(ast::BinaryOpExpr &node) {
+        if (assigned_only && node.op.type == TokenType::EQUALS) {
+            if (ast::Base *decl = resolve(*node.lhs, symbol_table))
+                declarations.insert(decl);
+        }
+
+        visit(*node.lhs);
+        visit(*node.rhs);
+    }
+
+    void visitVarRefExpr(ast::VarRefExpr &node) {
+        if (!assigned_only) {
+            if (ast::Base *decl = resolve(node, symbol_table))
+                declarations.insert(decl);
+        }
+    }
+
+    void visitArrayRefExpr(ast::ArrayRefExpr &node) {
+        if (!assigned_only) {
+            if (ast::Base *decl = resolve(node, symbol_table))
+                declarations.insert(decl);
+        }
+
+        visit(*node.index);
+    }
+
+  private:
+    const sema::ScopeResolutionPass::SymbolTable &symbol_table;
+    bool assigned_only;
+};
+
+void hashCombine(std::size_t &seed, std::size_t value) {
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+} // namespace
+
+bool ast_opt::Util::isPure(ast::Expr &expr) {
+    switch (expr.kind) {
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binop = static_cast<ast::BinaryOpExpr &>(expr);
+        return binop.op.type != TokenType::EQUALS && isPure(*binop.lhs) &&
+               isPure(*binop.rhs);
+    }
+    case ast::Base::Kind::UnaryOpExpr:
+        return isPure(*static_cast<ast::UnaryOpExpr &>(expr).operand);
+    case ast::Base::Kind::ArrayRefExpr:
+        return isPure(*static_cast<ast::ArrayRefExpr &>(expr).index);
+    case ast::Base::Kind::FuncCallExpr:
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool ast_opt::Util::alwaysReturns(ast::Stmt &stmt) {
+    switch (stmt.kind) {
+    case ast::Base::Kind::ReturnStmt:
+        return true;
+    case ast::Base::Kind::CompoundStmt:
+        for (const auto &child : static_cast<ast::CompoundStmt &>(stmt).body)
+            if (alwaysReturns(*child))
+                return true;
+        return false;
+    case ast::Base::Kind::IfStmt: {
+        auto &if_stmt = static_cast<ast::IfStmt &>(stmt);
+        return if_stmt.else_clause && alwaysReturns(*if_stmt.if_clause) &&
+               alwaysReturns(*if_stmt.else_clause);
+    }
+    default:
+        return false;
+    }
+}
+
+std::set<ast::Base *> ast_opt::Util::collectAssignedDeclarations(
+    ast::Base &node,
+    const sema::ScopeResolutionPass::SymbolTable &symbol_table) {
+    DeclarationCollector collector{symbol_table, true};
+    collector.visit(node);
+    return collector.declarations;
+}
+
+std::set<ast::Base *> ast_opt::Util::collectReferencedDeclarations(
+    ast::Base &node,
+    const sema::ScopeResolutionPass::SymbolTable &symbol_table) {
+    DeclarationCollector collector{symbol_table, false};
+    collector.visit(node);
+    return collector.declarations;
+}
+
+std::size_t ast_opt::Util::hash(
+    ast::Expr &expr,
+    const sema::ScopeResolutionPass::SymbolTable &symbol_table) {
+    std::size_t seed = static_cast<std::size_t>(expr.kind);
+
+    switch (expr.kind) {
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binop = static_cast<ast::BinaryOpExpr &>(expr);
+        hashCombine(seed, static_cast<std::size_t>(binop.op.type));
+        hashCombine(seed, hash(*binop.lhs, symbol_table));
+        hashCombine(seed, hash(*binop.rhs, symbol_table));
+        break;
+    }
+    case ast::Base::Kind::UnaryOpExpr: {
+        auto &unop = static_cast<ast::UnaryOpExpr &>(expr);
+        hashCombine(seed, static_cast<std::size_t>(unop.op.type));
+        hashCombine(seed, hash(*unop.operand, symbol_table));
+        break;
+    }
+    case ast::Base::Kind::IntLiteral:
+        hashCombine(seed, std::hash<int>{}(
+                              static_cast<ast::IntLiteral &>(expr).value));
+        break;
+    case ast::Base::Kind::FloatLiteral:
+        hashCombine(seed, std::hash<float>{}(
+                              static_cast<ast::FloatLiteral &>(expr).value));
+        break;
+    case ast::Base::Kind::StringLiteral:
+        hashCombine(seed, std::hash<std::string>{}(
+                              static_cast<ast::StringLiteral &>(expr).value));
+        break;
+    case ast::Base::Kind::VarRefExpr:
+        hashCombine(seed,
+                    std::hash<ast::Base *>{}(resolve(expr, symbol_table)));
+        break;
+    case ast::Base::Kind::ArrayRefExpr: {
+        auto &ref = static_cast<ast::ArrayRefExpr &>(expr);
+        hashCombine(seed, std::hash<ast::Base *>{}(resolve(ref, symbol_table)));
+        hashCombine(seed, hash(*ref.index, symbol_table));
+        break;
+    }
+    case ast::Base::Kind::FuncCallExpr: {
+        auto &call = static_cast<ast::FuncCallExpr &>(expr);
+        hashCombine(seed, std::hash<std::string>{}(call.name.lexeme));
+        for (const auto &arg : call.arguments)
+            hashCombine(seed, hash(*arg, symbol_table));
+        break;
+    }
+    default:
+        break;
+    }
+
+    return seed;
+}
+
+bool ast_opt::Util::equal(
+    ast::Expr &lhs, ast::Expr &rhs,
+    const sema::ScopeResolutionPass::SymbolTable &symbol_table) {
+    if (lhs.kind != rhs.kind)
+        return false;
+
+    switch (lhs.kind) {
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &l = static_cast<ast::BinaryOpExpr &>(lhs);
+        auto &r = static_cast<ast::BinaryOpExpr &>(rhs);
+        return l.op.type == r.op.type &&
+               equal(*l.lhs, *r.lhs, symbol_table) &&
+               equal(*l.rhs, *r.rhs, symbol_table);
+    }
+    case ast::Base::Kind::UnaryOpExpr: {
+        auto &l = static_cast<ast::UnaryOpExpr &>(lhs);
+        auto &r = static_cast<ast::UnaryOpExpr &>(rhs);
+        return l.op.type == r.op.type &&
+               equal(*l.operand, *r.operand, symbol_table);
+    }
+    case ast::Base::Kind::IntLiteral:
+        return static_cast<ast::IntLiteral &>(lhs).value ==
+               static_cast<ast::IntLiteral &>(rhs).value;
+    case ast::Base::Kind::FloatLiteral:
+        return static_cast<ast::FloatLiteral &>(lhs).value ==
+               static_cast<ast::FloatLiteral &>(rhs).value;
+    case ast::Base::Kind::StringLiteral:
+        return static_cast<ast::StringLiteral &>(lhs).value ==
+               static_cast<ast::StringLiteral &>(rhs).value;
+    case ast::Base::Kind::VarRefExpr:
+        return resolve(lhs, symbol_table) == resolve(rhs, symbol_table);
+    case ast::Base::Kind::ArrayRefExpr:
+        return resolve(lhs, symbol_table) == resolve(rhs, symbol_table) &&
+               equal(*static_cast<ast::ArrayRefExpr &>(lhs).index,
+                     *static_cast<ast::ArrayRefExpr &>(rhs).index,
+                     symbol_table);
+    case ast::Base::Kind::FuncCallExpr: {
+        auto &l = static_cast<ast::FuncCallExpr &>(lhs);
+        auto &r = static_cast<ast::FuncCallExpr &>(rhs);
+        if (l.name.lexeme != r.name.lexeme ||
+            l.arguments.size() != r.arguments.size())
+            return false;
+        for (std::size_t i = 0; i < l.arguments.size(); ++i)
+            if (!equal(*l.arguments[i], *r.arguments[i], symbol_table))
+                return false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+unsigned int ast_opt::Util::size(ast::Expr &expr) {
+    switch (expr.kind) {
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binop = static_cast<ast::BinaryOpExpr &>(expr);
+        return 1 + size(*binop.lhs) + size(*binop.rhs);
+    }
+    case ast::Base::Kind::UnaryOpExpr:
+        return 1 + size(*static_cast<ast::UnaryOpExpr &>(expr).operand);
+    case ast::Base::Kind::ArrayRefExpr:
+        return 1 + size(*static_cast<ast::ArrayRefExpr &>(expr).index);
+    case ast::Base::Kind::FuncCallExpr: {
+        unsigned int total = 1;
+        for (const auto &arg : static_cast<ast::FuncCallExpr &>(expr).arguments)
+            total += size(*arg);
+        return total;
+    }
+    default:
+        return 1;
+    }
+}
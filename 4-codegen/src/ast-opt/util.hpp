@@ -0,0 +1,49 @@
+#ifndef AST_OPT_UTIL_HPP
+#define AST_OPT_UTIL_HPP
+
+#include "ast/ast.hpp"
+#include "sema/scoperesolutionpass.hpp"
+
+#include <cstddef>
+#include <set>
+
+namespace ast_opt {
+struct Util {
+    // Returns true if evaluating 'expr' has no side effects, i.e. it does not
+    // contain any assignments or function calls.
+    static bool isPure(ast::Expr &expr);
+
+    // Returns true if control never falls through 'stmt' (every path through
+    // it ends in a return statement).
+    static bool alwaysReturns(ast::Stmt &stmt);
+
+    // Returns the declarations of all variables and arrays that are assigned
+    // to somewhere in 'node'.
+    static std::set<ast::Base *> collectAssignedDeclarations(
+        ast::Base &node,
+        const sema::ScopeResolutionPass::SymbolTable &symbol_table);
+
+    // Returns the declarations of all variables and arrays that are referenced
+    // (read or assigned) somewhere in 'node'.
+    static std::set<ast::Base *> collectReferencedDeclarations(
+        ast::Base &node,
+        const sema::ScopeResolutionPass::SymbolTable &symbol_table);
+
+    // Structural hash of an expression tree. Variable references hash to their
+    // declaration, so two expressions hash equally if they compute the same
+    // value in the same environment.
+    static std::size_t
+    hash(ast::Expr &expr,
+         const sema::ScopeResolutionPass::SymbolTable &symbol_table);
+
+    // Structural equality of two expression trees (see hash()).
+    static bool
+    equal(ast::Expr &lhs, ast::Expr &rhs,
+          const sema::ScopeResolutionPass::SymbolTable &symbol_table);
+
+    // Returns the number of nodes in an expression tree.
+    static unsigned int size(ast::Expr &expr);
+};
+} // namespace ast_opt
+
+#endif /* end of include guard: AST_OPT_UTIL_HPP */
@@ -0,0 +1,140 @@
+#include "codegen-x64/cfg-x64.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+
+std::vector<codegen_x64::FunctionRange>
+codegen_x64::getFunctions(const Module &module) {
+    std::vector<FunctionRange> functions;
+    unsigned int num_blocks = module.blocks.size();
+
+    for (unsigned int b = 0; b < num_blocks; ++b) {
+        if (b == 0 || module.blocks[b].is_global)
+            functions.push_back({b, num_blocks});
+
+        if (b + 1 < num_blocks && module.blocks[b + 1].is_global)
+            functions.back().end = b + 1;
+    }
+
+    return functions;
+}
+
+codegen_x64::ControlFlowGraph::ControlFlowGraph(Module &module,
+                                                FunctionRange function)
+    : module(module), function(function) {
+    std::unordered_map<Symbol, unsigned int> block_nodes;
+    unsigned int num_instructions = 0;
+
+    // Split the basic blocks after every jump and return.
+    for (unsigned int b = function.begin; b < function.end; ++b) {
+        const auto &instructions = module.blocks[b].instructions;
+        unsigned int first = 0;
+
+        block_nodes.emplace(module.blocks[b].label, nodes.size());
+
+        for (unsigned int i = 0; i < instructions.size(); ++i) {
+            Opcode opcode = instructions[i].opcode;
+
+            if (isJump(opcode) || isReturn(opcode)) {
+                nodes.push_back(CFGNode{b, first, i + 1, {}, {}});
+                first = i + 1;
+            }
+        }
+
+        if (first < instructions.size() || instructions.empty())
+            nodes.push_back(
+                CFGNode{b, first, static_cast<unsigned int>(
+                                      instructions.size()), {}, {}});
+    }
+
+    for (unsigned int n = 0; n < nodes.size(); ++n) {
+        CFGNode &node = nodes[n];
+        instruction_numbers.push_back(num_instructions);
+        num_instructions += node.last - node.first;
+
+        bool falls_through = true;
+
+        if (node.first != node.last) {
+            const Instruction &ins =
+                module.blocks[node.block].instructions[node.last - 1];
+
+            if (isJump(ins.opcode)) {
+                auto it = block_nodes.find(ins.operands[0].symbol);
+                if (it != std::end(block_nodes))
+                    node.successors.push_back(it->second);
+            }
+
+            falls_through =
+                ins.opcode != Opcode::JMP && !isReturn(ins.opcode);
+        }
+
+        if (falls_through && n + 1 < nodes.size() &&
+            std::find(std::begin(node.successors), std::end(node.successors),
+                      n + 1) == std::end(node.successors))
+            node.successors.push_back(n + 1);
+    }
+
+    instruction_numbers.push_back(num_instructions);
+
+    for (unsigned int n = 0; n < nodes.size(); ++n) {
+        for (unsigned int succ : nodes[n].successors)
+            nodes[succ].predecessors.push_back(n);
+    }
+
+    // Depth-first search from the entry point, iteratively so that long
+    // chains of nodes do not overflow the stack.
+    if (nodes.empty())
+        return;
+
+    std::vector<bool> visited(nodes.size(), false);
+    std::vector<std::pair<unsigned int, unsigned int>> stack{{0, 0}};
+    visited[0] = true;
+
+    while (!stack.empty()) {
+        auto &[node, next] = stack.back();
+
+        if (next < nodes[node].successors.size()) {
+            unsigned int succ = nodes[node].successors[next++];
+
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.emplace_back(succ, 0);
+            }
+        } else {
+            reverse_post_order.push_back(node);
+            stack.pop_back();
+        }
+    }
+
+    std::reverse(std::begin(reverse_post_order), std::end(reverse_post_order));
+}
+
+llvm::MutableArrayRef<codegen_x64::Instruction>
+codegen_x64::ControlFlowGraph::getInstructions(unsigned int node) const {
+    const CFGNode &n = nodes[node];
+    auto &instructions = module.blocks[n.block].instructions;
+
+    return llvm::MutableArrayRef<Instruction>(instructions)
+        .slice(n.first, n.last - n.first);
+}
+
+void codegen_x64::ControlFlowGraph::eraseInstructions(
+    const std::vector<bool> &erased) {
+    // Instruction numbers follow the order of the blocks.
+    unsigned int number = 0;
+
+    for (unsigned int b = function.begin; b < function.end; ++b) {
+        auto &instructions = module.blocks[b].instructions;
+        auto it = std::remove_if(
+            std::begin(instructions), std::end(instructions),
+            [&](const Instruction &) { return erased[number++]; });
+
+        instructions.erase(it, std::end(instructions));
+    }
+
+    nodes.clear();
+    instruction_numbers.clear();
+    reverse_post_order.clear();
+}
@@ -0,0 +1,76 @@
+#ifndef CFG_X64_HPP
+#define CFG_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <vector>
+
+namespace codegen_x64 {
+// The basic blocks of one function: the global block that is its entry
+// point, up to the next global block.
+struct FunctionRange {
+    unsigned int begin;
+    unsigned int end;
+};
+
+std::vector<FunctionRange> getFunctions(const Module &module);
+
+// A node of the control-flow graph: a range of instructions in a basic block
+// of the module, which is only entered at the top and only left at the
+// bottom. The code generator emits conditional jumps in the middle of basic
+// blocks, so blocks are split after every jump.
+struct CFGNode {
+    unsigned int block;
+    unsigned int first;
+    unsigned int last;
+
+    llvm::SmallVector<unsigned int, 2> successors;
+    llvm::SmallVector<unsigned int, 2> predecessors;
+};
+
+// Control-flow graph of a function, built from the jumps and the fallthrough
+// between the basic blocks. Node 0 is the entry point. The graph refers to
+// the instructions in the module, and must be rebuilt when instructions are
+// inserted or removed.
+class ControlFlowGraph {
+  public:
+    ControlFlowGraph(Module &module, FunctionRange function);
+
+    unsigned int size() const { return nodes.size(); }
+
+    const CFGNode &operator[](unsigned int node) const { return nodes[node]; }
+
+    llvm::MutableArrayRef<Instruction> getInstructions(unsigned int node) const;
+
+    // Instructions are numbered consecutively over all nodes, in the order
+    // of the nodes. Returns the number of the first instruction of the node.
+    unsigned int getInstructionNumber(unsigned int node) const {
+        return instruction_numbers[node];
+    }
+
+    unsigned int getNumInstructions() const {
+        return instruction_numbers.back();
+    }
+
+    // Returns the reachable nodes in reverse post-order.
+    const std::vector<unsigned int> &getReversePostOrder() const {
+        return reverse_post_order;
+    }
+
+    // Removes the instructions for which 'erased' is set, indexed by
+    // instruction number. This invalidates the graph.
+    void eraseInstructions(const std::vector<bool> &erased);
+
+  private:
+    Module &module;
+    FunctionRange function;
+    std::vector<CFGNode> nodes;
+    std::vector<unsigned int> instruction_numbers;
+    std::vector<unsigned int> reverse_post_order;
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: CFG_X64_HPP */
@@ -1,353 +1,1860 @@
 #include "codegen-x64/codegen-x64.hpp"
 #include "codegen-x64/codegenexception.hpp"
+#include "codegen-x64/framelayout-x64.hpp"
 
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/DivisionByConstantInfo.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <fmt/core.h>
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
 #define DEBUG_TYPE "codegen-x64"
 
-void codegen_x64::CodeGeneratorX64::visitFuncDecl(ast::FuncDecl &node) {
-    const std::string name = node.name.lexeme;
+STATISTIC(NumMultiplicationsReduced,
+          "The number of multiplications by a constant without imulq");
+STATISTIC(NumDivisionsReduced,
+          "The number of divisions and modulos by a constant without idivq");
+STATISTIC(NumTailRecursions,
+          "The number of self-recursive tail calls turned into jumps");
+STATISTIC(NumSiblingCalls, "The number of tail calls emitted as jmp");
+STATISTIC(NumIfConversions, "The number of if statements emitted as cmov");
+STATISTIC(NumLoopsVectorised, "The number of loops vectorised with SSE2");
 
-    // Clear variable declarations
-    variable_declarations.clear();
+llvm::cl::opt<bool> StrengthReduction(
+    "x64-strength-reduction",
+    llvm::cl::desc("Lower multiplication, division and modulo by a constant "
+                   "to shifts, lea and multiplications (default: true)"),
+    llvm::cl::init(true));
 
-    // Create a basic block for the function entry
-    module << BasicBlock{
-        name, fmt::format("Entry point of function '{}'", name), true};
+llvm::cl::opt<bool> TailCalls(
+    "x64-tail-calls",
+    llvm::cl::desc("Turn self-recursive tail calls into loops, and other "
+                   "tail calls into jumps (default: true)"),
+    llvm::cl::init(true));
 
-    // Store the name of the exit basic block so we can refer to it in
-    // ReturnStmt.
-    
-    
-    function_exit = fmt::format(".{}.exit", name);
+llvm::cl::opt<bool> IfConversion(
+    "x64-if-conversion",
+    llvm::cl::desc("Turn if statements that choose between two cheap values "
+                   "into conditional moves (default: true)"),
+    llvm::cl::init(true));
+
+llvm::cl::opt<unsigned int> IfConversionMaxCost(
+    "x64-if-conversion-max-cost",
+    llvm::cl::desc("The largest total cost of the values that an if-converted "
+                   "statement computes, where additions cost 1 and "
+                   "multiplications 3 (default: 4)"),
+    llvm::cl::init(4));
 
-    // ASSIGNMENT: Implement the function prologue here.
-    for (int i=0; i<6; i++){
-        module << Instruction{"pushq",{abi_callee_saved_regs[5-i]},"push callee save regs"};
+llvm::cl::opt<bool> Vectorisation(
+    "x64-vectorise",
+    llvm::cl::desc("Vectorise counted loops over arrays with packed SSE2 "
+                   "instructions (default: true)"),
+    llvm::cl::init(true));
+
+namespace {
+// Returns the statement of a block with a single statement, or nullptr if
+// the block has more statements.
+ast::Stmt *getSingleStatement(ast::Stmt *stmt) {
+    while (stmt && stmt->kind == ast::Base::Kind::CompoundStmt) {
+        auto &body = static_cast<ast::CompoundStmt &>(*stmt).body;
+        stmt = body.size() == 1 ? body[0].get() : nullptr;
     }
 
-    module << Instruction{"pushq", {"%rbp"}, " save base pointer"};
+    return stmt;
+}
 
-    // store stack pointer in base pointer
-    module << Instruction{"movq",{"%rsp","%rbp"}};
+// Returns the assignment 'x = ...' of an expression statement, or nullptr.
+ast::BinaryOpExpr *getAssignment(ast::Stmt *stmt) {
+    if (!stmt || stmt->kind != ast::Base::Kind::ExprStmt)
+        return nullptr;
 
-    // stack is not aligned at the moment
-    aligned = false;
+    ast::Expr &expr = *static_cast<ast::ExprStmt &>(*stmt).expr;
+    if (expr.kind != ast::Base::Kind::BinaryOpExpr)
+        return nullptr;
 
-    // ASSIGNMENT: Implement function parameters here.
-    for (int i = 0; i < node.arguments.size(); i++) {
-        module << Instruction{"pushq", {parameter(i)}, fmt::format("push argument {} on the stack", i)};
-        variable_declarations.insert({&(*node.arguments[i]), -(1+ variable_declarations.size())*8});
+    auto &node = static_cast<ast::BinaryOpExpr &>(expr);
+    if (node.op.type != TokenType::EQUALS ||
+        node.lhs->kind != ast::Base::Kind::VarRefExpr)
+        return nullptr;
 
-        // flip aligned
-        aligned = !aligned;
+    return &node;
+}
+
+// Appends the assignments of a block of expression statements, and returns
+// false if it has other statements.
+bool getAssignments(ast::Stmt &stmt,
+                    std::vector<ast::BinaryOpExpr *> &assignments) {
+    if (stmt.kind == ast::Base::Kind::CompoundStmt) {
+        for (auto &child : static_cast<ast::CompoundStmt &>(stmt).body) {
+            if (!getAssignments(*child, assignments))
+                return false;
+        }
+
+        return true;
     }
 
-    // align bytes, add padding if was not aligned
-    if(!aligned) {
-        module << Instruction{"subq",{"$8","%rsp"},"add padding to align stack again by 16 B"};
-        aligned = true;
-    } else {
-        aligned = false;
+    if (stmt.kind != ast::Base::Kind::ExprStmt)
+        return false;
+
+    ast::Expr &expr = *static_cast<ast::ExprStmt &>(stmt).expr;
+    if (expr.kind != ast::Base::Kind::BinaryOpExpr ||
+        static_cast<ast::BinaryOpExpr &>(expr).op.type != TokenType::EQUALS)
+        return false;
+
+    assignments.push_back(&static_cast<ast::BinaryOpExpr &>(expr));
+    return true;
+}
+
+// Returns the location of a node in the source: the location of its
+// operator or name, or of the expression of a statement. Returns line 0 for
+// nodes without one, e.g. blocks and literals.
+Location getLocation(const ast::Base &node) {
+    switch (node.kind) {
+    case ast::Base::Kind::FuncDecl:
+        return static_cast<const ast::FuncDecl &>(node).name.begin;
+    case ast::Base::Kind::IfStmt:
+        return getLocation(*static_cast<const ast::IfStmt &>(node).condition);
+    case ast::Base::Kind::WhileStmt:
+        return getLocation(
+            *static_cast<const ast::WhileStmt &>(node).condition);
+    case ast::Base::Kind::ReturnStmt: {
+        const auto &value = static_cast<const ast::ReturnStmt &>(node).value;
+        return value ? getLocation(*value) : Location{};
+    }
+    case ast::Base::Kind::ExprStmt:
+        return getLocation(*static_cast<const ast::ExprStmt &>(node).expr);
+    case ast::Base::Kind::VarDecl:
+        return static_cast<const ast::VarDecl &>(node).name.begin;
+    case ast::Base::Kind::ArrayDecl:
+        return static_cast<const ast::ArrayDecl &>(node).name.begin;
+    case ast::Base::Kind::BinaryOpExpr:
+        return static_cast<const ast::BinaryOpExpr &>(node).op.begin;
+    case ast::Base::Kind::UnaryOpExpr:
+        return static_cast<const ast::UnaryOpExpr &>(node).op.begin;
+    case ast::Base::Kind::VarRefExpr:
+        return static_cast<const ast::VarRefExpr &>(node).name.begin;
+    case ast::Base::Kind::ArrayRefExpr:
+        return static_cast<const ast::ArrayRefExpr &>(node).name.begin;
+    case ast::Base::Kind::FuncCallExpr:
+        return static_cast<const ast::FuncCallExpr &>(node).name.begin;
+    default:
+        return {};
+    }
+}
+
+bool isComparison(TokenType type) {
+    return type == TokenType::EQUALS_EQUALS ||
+           type == TokenType::BANG_EQUALS || type == TokenType::LESS_THAN ||
+           type == TokenType::LESS_THAN_EQUALS ||
+           type == TokenType::GREATER_THAN ||
+           type == TokenType::GREATER_THAN_EQUALS;
+}
+} // namespace
+
+codegen_x64::Operand codegen_x64::CodeGeneratorX64::visit(ast::Base &node) {
+    Location location = getLocation(node);
+    if (location.line == 0)
+        return Visitor::visit(node);
+
+    // Restore the location of the parent, e.g. for the jump back to the
+    // condition of a loop after its body.
+    Location parent = module.location;
+    module.location = location;
+    Operand result = Visitor::visit(node);
+    module.location = parent;
+
+    return result;
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitFuncDecl(ast::FuncDecl &node) {
+    const std::string name = node.name.lexeme;
+
+    // The prologue and the epilogue are at the location of the function.
+    module.location = node.name.begin;
+
+    // Clear variable declarations and virtual registers
+    variable_declarations.clear();
+    array_declarations.clear();
+    arrays_size = 0;
+    num_vregs = 0;
+    has_calls = false;
+    function = &node;
+    has_tail_recursion = false;
+
+    // Create a basic block for the function entry
+    std::size_t entry = module.blocks.size();
+    module << BasicBlock{module.getSymbol(name),
+                         fmt::format("Entry point of function '{}'", name),
+                         true};
+
+    // Store the label of the exit basic block so we can refer to it in
+    // ReturnStmt.
+    function_exit = module.getSymbol(fmt::format(".{}.exit", name));
+
+    // Copy the parameters into the virtual registers of their variables.
+    std::vector<bool> is_float;
+    for (const auto &argument : node.arguments)
+        is_float.push_back(isFloat(*argument));
+
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+    std::size_t stack_parameters = 0;
+
+    for (std::size_t i = 0; i < node.arguments.size(); ++i) {
+        Operand vreg = is_float[i] ? newFloatRegister() : newVirtualRegister();
+        Operand location =
+            registers[i] ? registers[i] : getStackParameter(stack_parameters++);
+        variable_declarations[node.arguments[i].get()] = vreg;
+
+        module << Instruction{is_float[i] ? Opcode::MOVSS : Opcode::MOVQ,
+                              {location, vreg},
+                              fmt::format("Load parameter {} [FuncDecl]", i)};
     }
 
+    function_body = module.getSymbol(fmt::format(".{}.body", name));
+    function_body_start = module.blocks[entry].instructions.size();
+
     visit(*node.body);
 
+    // Self-recursive tail calls jump to the body, which must then be split
+    // from the entry block, so that the parameters are not loaded again.
+    if (has_tail_recursion) {
+        auto &entry_instructions = module.blocks[entry].instructions;
+        auto body_begin = std::begin(entry_instructions) + function_body_start;
+        BasicBlock body{function_body,
+                        fmt::format("Body of function '{}'", name)};
+
+        body.instructions.assign(body_begin, std::end(entry_instructions));
+        entry_instructions.erase(body_begin, std::end(entry_instructions));
+        module.blocks.insert(std::begin(module.blocks) + entry + 1,
+                             std::move(body));
+    }
+
     // Create a basic block for the function exit.
     module << BasicBlock{function_exit,
                          fmt::format("Exit point of function '{}'", name)};
 
-    // ASSIGNMENT: Implement the function epilogue here. 
-    module << Instruction{"movq", {"%rbp","%rsp"}, " restore base pointe"};
-    module << Instruction{"popq",{"%rbp"}, "restore base pointer"};
+    finishFunction(module, entry, !has_calls, stack_parameters != 0,
+                   arrays_size);
 
-    for (int i=0; i<6; i++){
-        module << Instruction{"popq",{abi_callee_saved_regs[i]},"pop callee save regs"};
-    }
-    module << Instruction{"retq", {}, "Return to the caller [FuncDecl]"};
+    return {};
 }
 
-void codegen_x64::CodeGeneratorX64::visitIfStmt(ast::IfStmt &node) {
-    // ASSIGNMENT: Implement if and if-else statements here.
-    visit(*node.condition);
-    auto unique_label = label("else");
-    module << Instruction{"popq", {"%r12"}, "pop 1 or 0"};
-    std::string val1 = fmt::format("${}", 1);
-    module << Instruction{"cmpq", {val1,"%r12"},"check statement"};
-    module << Instruction{"jne",{unique_label},"jmp to else claus if not equal"}; // should not be hard coded as l1 
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitIfStmt(ast::IfStmt &node) {
+    if (IfConversion && emitConditionalMove(*node.condition, *node.if_clause,
+                                            node.else_clause.get()))
+        return {};
+
+    auto else_label = label("else");
+    auto end_label = label("endif");
+
+    emitJumpIfFalse(*node.condition, else_label);
     visit(*node.if_clause);
-    auto iftakenlabel = label("iftaken");
-    
-    module << Instruction{"jmp",{iftakenlabel},"jmp to after else claus if equal"}; // should not be hard coded as l0
-    module << BasicBlock{unique_label,"make new bb"};
+    module << Instruction{Opcode::JMP,
+                          {Operand::label(end_label)},
+                          "Skip else clause [IfStmt]"};
+
+    module << BasicBlock{else_label, "Else clause [IfStmt]"};
     if (node.else_clause)
         visit(*node.else_clause);
-    module << BasicBlock{iftakenlabel,"make new bb for if taken"};
-    
-}
-
-void codegen_x64::CodeGeneratorX64::visitWhileStmt(ast::WhileStmt &node) {
-    // ASSIGNMENT: Implement while statements here.
-    auto whilelbl = label("while");
-    auto endlbl = label("endwhile");
-    module << BasicBlock{whilelbl,"new label for while cond"};
-    visit(*node.condition);
-    module << Instruction{"popq", {"%rax"}, "pop 1 or 0"};
-    std::string val1 = fmt::format("${}", 1);
-    module << Instruction{"cmpq", {val1,"%rax"},"check statement"};
-    module << Instruction{"jne",{endlbl},"jmp to endwhile clause if not equal"};
+
+    module << BasicBlock{end_label, "End of if statement [IfStmt]"};
+
+    return {};
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitWhileStmt(ast::WhileStmt &node) {
+    // A vectorised loop is followed by the loop itself, for the remaining
+    // iterations.
+    if (Vectorisation)
+        emitVectorLoop(node);
+
+    auto condition_label = label("while");
+    auto end_label = label("endwhile");
+
+    module << BasicBlock{condition_label, "Loop condition [WhileStmt]"};
+    emitJumpIfFalse(*node.condition, end_label);
     visit(*node.body);
-    module << Instruction{"jmp", {whilelbl}};
-    
-    module << BasicBlock{endlbl,"new label for ending while lp"};
+    module << Instruction{Opcode::JMP,
+                          {Operand::label(condition_label)},
+                          "Back to loop condition [WhileStmt]"};
+
+    module << BasicBlock{end_label, "End of while loop [WhileStmt]"};
+
+    return {};
 }
 
-void codegen_x64::CodeGeneratorX64::visitReturnStmt(ast::ReturnStmt &node) {
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitReturnStmt(ast::ReturnStmt &node) {
+    if (node.value && TailCalls &&
+        node.value->kind == ast::Base::Kind::FuncCallExpr &&
+        emitTailCall(static_cast<ast::FuncCallExpr &>(*node.value)))
+        return {};
+
     if (node.value) {
-        visit(*node.value);
+        Operand value = visit(*node.value);
+        bool is_float = isFloat(*node.value);
 
         module << Instruction{
-            "popq",
-            {abi_return_reg},
-            "Pop return value into return register [ReturnStmt]"};
+            is_float ? Opcode::MOVSS : Opcode::MOVQ,
+            {value, Operand::physical(is_float ? abi_float_return_reg
+                                               : abi_return_reg)},
+            "Move return value into return register [ReturnStmt]"};
     }
 
-    module << Instruction{
-        "jmp", {function_exit}, "Jump to function exit [ReturnStmt]"};
+    module << Instruction{Opcode::JMP,
+                          {Operand::label(function_exit)},
+                          "Jump to function exit [ReturnStmt]"};
+
+    return {};
 }
 
-void codegen_x64::CodeGeneratorX64::visitExprStmt(ast::ExprStmt &node) {
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitExprStmt(ast::ExprStmt &node) {
     visit(*node.expr);
-    module << Instruction{
-        "popq", {"%rax"}, "Discard expression statement [ExprStmt]"};
+    return {};
 }
 
-void codegen_x64::CodeGeneratorX64::visitVarDecl(ast::VarDecl &node) {
-    // if init, initialize with value
-    if (node.init) {
-        if (aligned)
-            module << Instruction{"addq", {"$8", "%rsp"}, "fill up padding space with vardecl"};
-        visit(*node.init);
-    } else {
-        // fill up padding space with variable if aligned,
-        // otherwise allocate space
-        if (!aligned)
-            module << Instruction{"subq",{"$8","%rsp"}, "make space for vardecl on the stack"};
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitCompoundStmt(ast::CompoundStmt &node) {
+    for (std::size_t i = 0; i < node.body.size(); ++i) {
+        ast::Stmt &stmt = *node.body[i];
+
+        // 'if (c) return a; return b;' is if-converted like
+        // 'if (c) return a; else return b;'.
+        if (IfConversion && stmt.kind == ast::Base::Kind::IfStmt &&
+            i + 1 < node.body.size() &&
+            node.body[i + 1]->kind == ast::Base::Kind::ReturnStmt) {
+            auto &if_stmt = static_cast<ast::IfStmt &>(stmt);
+
+            if (!if_stmt.else_clause &&
+                emitConditionalMove(*if_stmt.condition, *if_stmt.if_clause,
+                                    node.body[i + 1].get())) {
+                ++i;
+                continue;
+            }
+        }
+
+        visit(stmt);
     }
 
-    // align bytes, add padding if was not aligned
-    if(!aligned) {
-        module << Instruction{"subq",{"$8","%rsp"},"add padding to align stack again by 16 B"};
-        aligned = true;
-    } else {
-        aligned = false;
+    return {};
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitVarDecl(ast::VarDecl &node) {
+    bool is_float = isFloat(node);
+    Operand vreg = is_float ? newFloatRegister() : newVirtualRegister();
+
+    if (node.init) {
+        Operand init = visit(*node.init);
+        module << Instruction{is_float ? Opcode::MOVSS : Opcode::MOVQ,
+                              {init, vreg},
+                              "Initialise variable [VarDecl]"};
     }
 
-    // put location of the variable relative to the base pointer to the variable declarations member variable
-    variable_declarations.insert({&node , -(1+ variable_declarations.size())*8});
+    variable_declarations[&node] = vreg;
+
+    return {};
 }
 
-void codegen_x64::CodeGeneratorX64::visitArrayDecl(ast::ArrayDecl &node) {
-    throw CodegenException(
-        "Array declarations are not supported by the X64 code generator");
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitArrayDecl(ast::ArrayDecl &node) {
+    if (node.type.lexeme != "int" && node.type.lexeme != "float")
+        throw CodegenException(fmt::format(
+            "Arrays of type '{}' are not supported by the X64 code generator",
+            node.type.lexeme));
+
+    // Arrays are allocated in the stack frame, below the saved %rbp, and are
+    // 8-byte aligned. Integer elements take 8 bytes and float elements 4
+    // bytes, so that every element can be accessed with a scaled index.
+    std::int64_t size =
+        arrays_size + elementSize(node) * std::int64_t{node.size->value};
+    size = (size + 7) & ~std::int64_t{7};
 
-    visit(*node.size);
+    if (node.size->value <= 0 || size > FrameLayoutX64::max_frame_size)
+        throw CodegenException(fmt::format(
+            "Array '{}' does not fit in the stack frame", node.name.lexeme));
+
+    arrays_size = static_cast<int>(size);
+    array_declarations[&node] = -arrays_size;
+
+    return {};
 }
 
-void codegen_x64::CodeGeneratorX64::visitBinaryOpExpr(ast::BinaryOpExpr &node) {
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitBinaryOpExpr(ast::BinaryOpExpr &node) {
     // We need to handle assignment differently.
-    if (node.op.type == TokenType::EQUALS) {
-        handleAssignment(node);
-        return;
+    if (node.op.type == TokenType::EQUALS)
+        return handleAssignment(node);
+
+    if (isFloat(*node.lhs)) {
+        Operand lhs = visit(*node.lhs);
+        Operand rhs = visitOperand(*node.rhs);
+        return handleFloatOperation(node, lhs, rhs);
     }
 
-    // ASSIGNMENT: Implement binary operators here.
-    visit(*node.lhs);
-    visit(*node.rhs);
-    std::string val = fmt::format("${}", 0);
-    std::string val1 = fmt::format("${}", 1);
-    
-    if (node.op.type == TokenType::SLASH || node.op.type == TokenType::PERCENT ){
-        module << Instruction{"popq", {"%r15"}, "pop rhs first"};
-        module << Instruction{"popq", {"%rax"}, "pop lhs second"};
-    }
-    else{
-        module << Instruction{"popq", {"%rax"}, "pop rhs first"};
-        module << Instruction{"popq", {"%r15"}, "pop lhs second"};
-    }
-    switch (node.op.type){
-        case (TokenType::PLUS) : //ok
-            module << Instruction{"addq", {"%r15","%rax"}, "take sum"};
-            module << Instruction{"pushq",{"%rax"}, "push sol on stack of binary op"};
-            break;
-        case (TokenType::MINUS) : //ok
-            module << Instruction{"subq", {"%rax","%r15"}, "take minus, check if this is correct, and not other way round"};
-            module << Instruction{"pushq",{"%r15"}, "push sol on stack of binary op"};
-            break;
-        case (TokenType::STAR) : //ok
-            module << Instruction{"imulq", {"%r15"}, "multiply binary"};
-            module << Instruction{"pushq",{"%rax"}, "push sol on stack of binary op"};
-            break;
-        case (TokenType::SLASH) : //okay
-            module << Instruction{"movq", {val, "%rdx"}, "move 0 top of rax "};
-            module << Instruction{"idivq", {"%r15"}, "divide"};
-            module << Instruction{"pushq",{"%rax"}, "push sol on stack of binary op"};
-            break;
-        case (TokenType::PERCENT) : // okay
-            module << Instruction{"movq", {val, "%rdx"}, "move 0 to top of rax "};
-            module << Instruction{"idivq", {"%r15"}, "first division"};
-            module << Instruction{"pushq",{"%rdx"}, "push sol on stack of binary op"};
-            break;
-        case (TokenType::BANG_EQUALS) : //ok
-            module << Instruction{"movq", {val, "%r12"}, "move 0 to r12 "};
-            module << Instruction{"movq", {val1, "%r13"}, "move 1 to r13 "};
-            module << Instruction{"cmpq", {"%rax","%r15"}, "check equal, check if this is correct, and not other way round"};
-            module << Instruction{"cmove",{"%r12","%r13"}," if r15 and r14 equal, put 0 in r13[bangeq]"};
-            module << Instruction{"pushq",{"%r13"},"push solution"};
-            break;
-        case (TokenType::EQUALS_EQUALS) : //ok
-            module << Instruction{"movq", {val, "%r12"}, "move 0 to r12 "};
-            module << Instruction{"movq", {val1, "%r13"}, "move 1 to r13 "};
-            module << Instruction{"cmpq", {"%rax","%r15"}, "check equal, check if this is correct, and not other way round"};
-            module << Instruction{"cmovne",{"%r12","%r13"}," if r15 and r14 not equal, put 0 in r13[eqeq]"};
-            module << Instruction{"pushq",{"%r13"},"push solution"};
-            break;
-        case (TokenType::LESS_THAN) : //ok
-            module << Instruction{"movq", {val, "%r12"}, "move 0 to r12 "};
-            module << Instruction{"movq", {val1, "%r13"}, "move 1 to r13 "};
-            module << Instruction{"cmpq", {"%rax","%r15"}, "check equal, check if this is correct, and not other way round"};
-            module << Instruction{"cmovae",{"%r12","%r13"},"if higher or equal, move 0 to r13, [less]"};
-            module << Instruction{"pushq",{"%r13"},"push solution"};
-            break;
-        case (TokenType::LESS_THAN_EQUALS) : // ok
-            module << Instruction{"movq", {val, "%r12"}, "move 0 to r12 "};
-            module << Instruction{"movq", {val1, "%r13"}, "move 1 to r13 "};
-            module << Instruction{"cmpq", {"%rax","%r15"}, "check equal, check if this is correct, and not other way round"};
-            module << Instruction{"cmova",{"%r12","%r13"},"if higher, move 0 to r13, [less, or eq]"};
-            module << Instruction{"pushq",{"%r13"},"push solution"};
-            break;
-        case (TokenType::GREATER_THAN) ://ok
-            module << Instruction{"movq", {val, "%r12"}, "move 0 to r12 "};
-            module << Instruction{"movq", {val1, "%r13"}, "move 1 to r13 "};
-            module << Instruction{"cmpq", {"%rax","%r15"}, "check equal, check if this is correct, and not other way round"};
-            module << Instruction{"cmovbe",{"%r12","%r13"},"if lower or equal, move 0 to r13, [greater]"};
-            module << Instruction{"pushq",{"%r13"},"push solution"};
-            break;
-        case (TokenType::GREATER_THAN_EQUALS) ://ok
-            module << Instruction{"movq", {val, "%r12"}, "move 0 to r12 "};
-            module << Instruction{"movq", {val1, "%r13"}, "move 1 to r13 "};
-            module << Instruction{"cmpq", {"%rax","%r15"}, "check equal, check if this is correct, and not other way round"};
-            module << Instruction{"cmovb",{"%r12","%r13"},"if lower, move 0 to r13, [greator eq]"};
-            module << Instruction{"pushq",{"%r13"},"push solution"};
-            break;
-            
+    if (Operand address = selectAddress(node)) {
+        Operand result = newVirtualRegister();
+
+        module << Instruction{Opcode::LEAQ,
+                              {address, result},
+                              fmt::format("Compute '{}' [BinaryOpExpr]",
+                                          node.op.lexeme)};
+        return result;
+    }
+
+    // Multiplication, division and modulo by a constant avoid imulq and
+    // idivq. The AST optimiser moves constant operands of commutative
+    // operators to the right-hand side, so only that side needs to be
+    // checked.
+    if (StrengthReduction && node.rhs->kind == ast::Base::Kind::IntLiteral) {
+        std::int64_t value = static_cast<ast::IntLiteral &>(*node.rhs).value;
+
+        if (node.op.type == TokenType::STAR)
+            return multiplyByConstant(visit(*node.lhs), value);
+
+        if ((node.op.type == TokenType::SLASH ||
+             node.op.type == TokenType::PERCENT) &&
+            value != 0)
+            return divideByConstant(visit(*node.lhs), value,
+                                    node.op.type == TokenType::PERCENT);
     }
-    
 
+    Operand lhs = visit(*node.lhs);
+    Operand rhs = visitOperand(*node.rhs);
+    Operand result = newVirtualRegister();
+
+    switch (node.op.type) {
+    case TokenType::PLUS:
+    case TokenType::MINUS:
+    case TokenType::STAR: {
+        Opcode opcode = node.op.type == TokenType::PLUS    ? Opcode::ADDQ
+                        : node.op.type == TokenType::MINUS ? Opcode::SUBQ
+                                                           : Opcode::IMULQ;
+
+        module << Instruction{
+            Opcode::MOVQ, {lhs, result}, "Load lhs [BinaryOpExpr]"};
+        module << Instruction{opcode,
+                              {rhs, result},
+                              fmt::format("Compute '{}' [BinaryOpExpr]",
+                                          node.op.lexeme)};
+        return result;
+    }
+    case TokenType::SLASH:
+    case TokenType::PERCENT: {
+        // The dividend is sign-extended into %rdx:%rax. The quotient is left
+        // in %rax, and the remainder in %rdx. The divisor may be in memory,
+        // but not an immediate.
+        Operand divisor = rhs.isImmediate() ? materialise(rhs) : rhs;
+
+        module << Instruction{Opcode::MOVQ,
+                              {lhs, Operand::physical(RAX)},
+                              "Load dividend [BinaryOpExpr]"};
+        module << Instruction{
+            Opcode::CQTO, {}, "Sign-extend dividend into %rdx [BinaryOpExpr]"};
+        module << Instruction{
+            Opcode::IDIVQ, {divisor}, "Divide [BinaryOpExpr]"};
+        module << Instruction{
+            Opcode::MOVQ,
+            {Operand::physical(node.op.type == TokenType::SLASH ? RAX : RDX),
+             result},
+            node.op.type == TokenType::SLASH
+                ? "Store quotient [BinaryOpExpr]"
+                : "Store remainder [BinaryOpExpr]"};
+        return result;
+    }
+    case TokenType::EQUALS_EQUALS:
+    case TokenType::BANG_EQUALS:
+    case TokenType::LESS_THAN:
+    case TokenType::LESS_THAN_EQUALS:
+    case TokenType::GREATER_THAN:
+    case TokenType::GREATER_THAN_EQUALS: {
+        static const std::map<TokenType, Opcode> set_opcodes{
+            {TokenType::EQUALS_EQUALS, Opcode::SETE},
+            {TokenType::BANG_EQUALS, Opcode::SETNE},
+            {TokenType::LESS_THAN, Opcode::SETL},
+            {TokenType::LESS_THAN_EQUALS, Opcode::SETLE},
+            {TokenType::GREATER_THAN, Opcode::SETG},
+            {TokenType::GREATER_THAN_EQUALS, Opcode::SETGE}};
+
+        // The second operand of cmp cannot be an immediate.
+        module << Instruction{Opcode::CMPQ,
+                              {rhs, materialise(lhs)},
+                              "Compare lhs with rhs [BinaryOpExpr]"};
+        module << Instruction{set_opcodes.at(node.op.type),
+                              {Operand::physical(RAX, 1)},
+                              fmt::format("Compute '{}' [BinaryOpExpr]",
+                                          node.op.lexeme)};
+        module << Instruction{Opcode::MOVZBQ,
+                              {Operand::physical(RAX, 1), result},
+                              "Zero-extend comparison [BinaryOpExpr]"};
+        return result;
+    }
+    case TokenType::CARET: {
+        // Integer powers are computed in single precision, as in the LLVM
+        // backend.
+        Operand base = newFloatRegister();
+        Operand exponent = newFloatRegister();
+
+        module << Instruction{Opcode::CVTSI2SSQ,
+                              {materialise(lhs), base},
+                              "Convert base to float [BinaryOpExpr]"};
+        module << Instruction{Opcode::CVTSI2SSQ,
+                              {materialise(rhs), exponent},
+                              "Convert exponent to float [BinaryOpExpr]"};
+
+        Operand power = callLibraryFunction("powf", {base, exponent});
+
+        module << Instruction{Opcode::CVTTSS2SIQ,
+                              {power, result},
+                              "Truncate power to integer [BinaryOpExpr]"};
+        return result;
+    }
+    default:
+        throw CodegenException(fmt::format(
+            "Binary operator '{}' is not supported by the X64 code generator",
+            node.op.lexeme));
+    }
 }
 
-void codegen_x64::CodeGeneratorX64::visitUnaryOpExpr(ast::UnaryOpExpr &node) {
-    // ASSIGNMENT: Implement unary operators here. OK!!!!!
-    visit(*node.operand);
-    std::string val = fmt::format("${}", 1);
-    module << Instruction{"movq", {val, "%r12"}, "move 1 to r12 "};
-    
-    module << Instruction{"popq", {"%r15"}, "pop int for unaryop"};
-    if(node.op.type == TokenType::PLUS){
-        module << Instruction{"addq", {"%r12","%r15"}, "push int for unary"};
+codegen_x64::Operand codegen_x64::CodeGeneratorX64::handleFloatOperation(
+    ast::BinaryOpExpr &node, const Operand &lhs, const Operand &rhs) {
+    switch (node.op.type) {
+    case TokenType::PLUS:
+    case TokenType::MINUS:
+    case TokenType::STAR:
+    case TokenType::SLASH: {
+        static const std::map<TokenType, Opcode> opcodes{
+            {TokenType::PLUS, Opcode::ADDSS},
+            {TokenType::MINUS, Opcode::SUBSS},
+            {TokenType::STAR, Opcode::MULSS},
+            {TokenType::SLASH, Opcode::DIVSS}};
+        Operand result = newFloatRegister();
+
+        module << Instruction{
+            Opcode::MOVSS, {lhs, result}, "Load lhs [BinaryOpExpr]"};
+        module << Instruction{opcodes.at(node.op.type),
+                              {rhs, result},
+                              fmt::format("Compute '{}' [BinaryOpExpr]",
+                                          node.op.lexeme)};
+        return result;
     }
-    else{
-        module << Instruction{"subq", {"%r12","%r15"}, "mult with -1"};
-        
+    case TokenType::PERCENT:
+        return callLibraryFunction("fmodf", {lhs, rhs});
+    case TokenType::CARET:
+        return callLibraryFunction("powf", {lhs, rhs});
+    case TokenType::EQUALS_EQUALS:
+    case TokenType::BANG_EQUALS:
+    case TokenType::LESS_THAN:
+    case TokenType::LESS_THAN_EQUALS:
+    case TokenType::GREATER_THAN:
+    case TokenType::GREATER_THAN_EQUALS: {
+        // The comparisons are ordered: they are false if either operand is
+        // NaN. ucomiss sets CF and ZF like an unsigned comparison, and sets
+        // all of ZF, PF and CF if the operands are unordered, so '<' and '<='
+        // swap their operands to test CF = 0, and '==' also tests PF = 0.
+        bool swap = node.op.type == TokenType::LESS_THAN ||
+                    node.op.type == TokenType::LESS_THAN_EQUALS;
+        static const std::map<TokenType, Opcode> set_opcodes{
+            {TokenType::EQUALS_EQUALS, Opcode::SETE},
+            {TokenType::BANG_EQUALS, Opcode::SETNE},
+            {TokenType::LESS_THAN, Opcode::SETA},
+            {TokenType::LESS_THAN_EQUALS, Opcode::SETAE},
+            {TokenType::GREATER_THAN, Opcode::SETA},
+            {TokenType::GREATER_THAN_EQUALS, Opcode::SETAE}};
+        Operand result = newVirtualRegister();
+
+        module << Instruction{
+            Opcode::UCOMISS,
+            {swap ? lhs : rhs, materialise(swap ? rhs : lhs, true)},
+            "Compare lhs with rhs [BinaryOpExpr]"};
+        module << Instruction{set_opcodes.at(node.op.type),
+                              {Operand::physical(RAX, 1)},
+                              fmt::format("Compute '{}' [BinaryOpExpr]",
+                                          node.op.lexeme)};
+        module << Instruction{Opcode::MOVZBQ,
+                              {Operand::physical(RAX, 1), result},
+                              "Zero-extend comparison [BinaryOpExpr]"};
+
+        if (node.op.type == TokenType::EQUALS_EQUALS) {
+            Operand ordered = newVirtualRegister();
+
+            module << Instruction{Opcode::SETNP,
+                                  {Operand::physical(RAX, 1)},
+                                  "Test if ordered [BinaryOpExpr]"};
+            module << Instruction{Opcode::MOVZBQ,
+                                  {Operand::physical(RAX, 1), ordered},
+                                  "Zero-extend comparison [BinaryOpExpr]"};
+            module << Instruction{Opcode::ANDQ,
+                                  {ordered, result},
+                                  "Compute ordered '==' [BinaryOpExpr]"};
+        }
+
+        return result;
+    }
+    default:
+        throw CodegenException(fmt::format(
+            "Binary operator '{}' is not supported by the X64 code generator",
+            node.op.lexeme));
     }
-    module << Instruction{"pushq", {"%r15"}, "push int for unary"};
-    
 }
 
-void codegen_x64::CodeGeneratorX64::visitIntLiteral(ast::IntLiteral &node) {
-    std::string val = fmt::format("${}", node.value);
-    module << Instruction{"pushq", {val}, "Push integer literal [IntLiteral]"};
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitUnaryOpExpr(ast::UnaryOpExpr &node) {
+    Operand operand = visit(*node.operand);
+
+    if (node.op.type == TokenType::PLUS)
+        return operand;
+
+    // As in the LLVM backend, '-x' is computed as '0 - x' for floats.
+    if (isFloat(node)) {
+        Operand result = newFloatRegister();
+        module << Instruction{Opcode::MOVSS,
+                              {floatConstant(0.0f), result},
+                              "Load zero [UnaryOpExpr]"};
+        module << Instruction{
+            Opcode::SUBSS, {operand, result}, "Negate [UnaryOpExpr]"};
+
+        return result;
+    }
+
+    Operand result = newVirtualRegister();
+    module << Instruction{
+        Opcode::MOVQ, {operand, result}, "Load operand [UnaryOpExpr]"};
+    module << Instruction{Opcode::NEGQ, {result}, "Negate [UnaryOpExpr]"};
+
+    return result;
 }
 
-void codegen_x64::CodeGeneratorX64::visitFloatLiteral(ast::FloatLiteral &node) {
-    throw CodegenException(
-        "Float literals are not supported by the X64 code generator");
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitIntLiteral(ast::IntLiteral &node) {
+    return Operand::immediate(node.value);
 }
 
-void codegen_x64::CodeGeneratorX64::visitStringLiteral(
-    ast::StringLiteral &node) {
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitFloatLiteral(ast::FloatLiteral &node) {
+    return floatConstant(node.value);
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitStringLiteral(ast::StringLiteral &) {
     throw CodegenException(
         "String literals are not supported by the X64 code generator");
 }
 
-void codegen_x64::CodeGeneratorX64::visitVarRefExpr(ast::VarRefExpr &node) {
-    // ASSIGNMENT: Implement variable references here.
-    std::string address  = variable(symbol_table[&node]);
-    module << Instruction{"movq", {address, "%r13"}, "load var in r13"};
-    module << Instruction{"pushq",{"%r13"},"push var on stack"};
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitVarRefExpr(ast::VarRefExpr &node) {
+    return variable(symbol_table[&node]);
 }
 
-void codegen_x64::CodeGeneratorX64::visitArrayRefExpr(ast::ArrayRefExpr &node) {
-    throw CodegenException(
-        "Array references are not supported by the X64 code generator");
-    visit(*node.index);
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitArrayRefExpr(ast::ArrayRefExpr &node) {
+    Operand element = arrayElement(node);
+    bool is_float = isFloat(node);
+    Operand result = is_float ? newFloatRegister() : newVirtualRegister();
+
+    module << Instruction{is_float ? Opcode::MOVSS : Opcode::MOVQ,
+                          {element, result},
+                          "Load array element [ArrayRefExpr]"};
+
+    return result;
 }
 
-void codegen_x64::CodeGeneratorX64::visitFuncCallExpr(ast::FuncCallExpr &node) {
-    // ASSIGNMENT: Implement function calls here.
-    std::string name = fmt::format("{}", node.name.lexeme);
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitFuncCallExpr(ast::FuncCallExpr &node) {
+    std::vector<Operand> arguments;
+    std::vector<bool> is_float;
+    for (const auto &argument : node.arguments) {
+        arguments.push_back(visit(*argument));
+        is_float.push_back(isFloat(*argument));
+    }
+
+    // Arguments that do not fit in registers are passed on the stack, in
+    // reverse order. The stack must be 16-byte aligned at the call.
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+    std::vector<std::size_t> stack_arguments;
+
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (!registers[i])
+            stack_arguments.push_back(i);
+    }
+
+    std::size_t stack_size =
+        8 * (stack_arguments.size() + stack_arguments.size() % 2);
+
+    if (stack_arguments.size() % 2 != 0)
+        module << Instruction{Opcode::SUBQ,
+                              {Operand::immediate(8), Operand::physical(RSP)},
+                              "Align stack arguments [FuncCallExpr]"};
 
+    for (auto it = std::rbegin(stack_arguments);
+         it != std::rend(stack_arguments); ++it) {
+        std::size_t i = *it;
+        std::string comment =
+            fmt::format("Pass argument {} on the stack [FuncCallExpr]", i);
 
-    for (int i = node.arguments.size() - 1; i >= 0; i--) {
-        // push value on stack
-        visit(*node.arguments[i]);
-        if (i >= 6) {
-            // keep on stack
+        // There is no push for SSE registers.
+        if (is_float[i]) {
+            Operand value = materialise(arguments[i], true);
+
+            module << Instruction{
+                Opcode::SUBQ,
+                {Operand::immediate(8), Operand::physical(RSP)},
+                comment};
+            module << Instruction{
+                Opcode::MOVSS,
+                {value, Operand::memory(Register::physical(RSP))},
+                comment};
         } else {
-            // put in register
-            module << Instruction{"popq", {abi_param_regs[i]}, "put argument into register (i<6)"};
+            module << Instruction{Opcode::PUSHQ, {arguments[i]}, comment};
+        }
+    }
+
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (registers[i])
+            module << Instruction{
+                is_float[i] ? Opcode::MOVSS : Opcode::MOVQ,
+                {arguments[i], registers[i]},
+                fmt::format("Pass argument {} in a register [FuncCallExpr]",
+                            i)};
+    }
+
+    module << Instruction{Opcode::CALL,
+                          {Operand::label(module.getSymbol(node.name.lexeme))},
+                          "Call function [FuncCallExpr]"};
+    has_calls = true;
+
+    if (stack_size != 0)
+        module << Instruction{Opcode::ADDQ,
+                              {Operand::immediate(stack_size),
+                               Operand::physical(RSP)},
+                              "Pop stack arguments [FuncCallExpr]"};
+
+    // Calls to void functions have no value.
+    auto type = type_table.find(&node);
+    if (type != std::end(type_table) && type->second->isVoidTy())
+        return {};
+
+    if (isFloat(node)) {
+        Operand result = newFloatRegister();
+        module << Instruction{Opcode::MOVSS,
+                              {Operand::physical(abi_float_return_reg), result},
+                              "Store return value [FuncCallExpr]"};
+        return result;
+    }
+
+    Operand result = newVirtualRegister();
+    module << Instruction{Opcode::MOVQ,
+                          {Operand::physical(abi_return_reg), result},
+                          "Store return value [FuncCallExpr]"};
+
+    return result;
+}
+
+bool codegen_x64::CodeGeneratorX64::emitTailCall(ast::FuncCallExpr &node) {
+    std::vector<bool> is_float;
+    for (const auto &argument : node.arguments)
+        is_float.push_back(isFloat(*argument));
+
+    if (node.name.lexeme == function->name.lexeme &&
+        node.arguments.size() == function->arguments.size()) {
+        std::vector<Operand> parameters;
+        for (const auto &parameter : function->arguments)
+            parameters.push_back(variable(parameter.get()));
+
+        // Evaluate all arguments before the parameters are assigned, as they
+        // may read the parameters. Arguments that are parameters themselves
+        // are copied first, e.g. for 'return f(b, a)' in 'f(a, b)'.
+        std::vector<Operand> arguments;
+
+        for (std::size_t i = 0; i < node.arguments.size(); ++i) {
+            Operand value = visit(*node.arguments[i]);
+            bool is_other_parameter =
+                value != parameters[i] &&
+                std::find(std::begin(parameters), std::end(parameters),
+                          value) != std::end(parameters);
+
+            if (is_other_parameter) {
+                Operand copy =
+                    is_float[i] ? newFloatRegister() : newVirtualRegister();
+
+                module << Instruction{
+                    is_float[i] ? Opcode::MOVSS : Opcode::MOVQ,
+                    {value, copy},
+                    fmt::format("Copy argument {} [ReturnStmt]", i)};
+                value = copy;
+            }
+
+            arguments.push_back(value);
+        }
+
+        for (std::size_t i = 0; i < arguments.size(); ++i) {
+            if (arguments[i] != parameters[i])
+                module << Instruction{
+                    is_float[i] ? Opcode::MOVSS : Opcode::MOVQ,
+                    {arguments[i], parameters[i]},
+                    fmt::format("Assign argument {} to parameter [ReturnStmt]",
+                                i)};
         }
+
+        module << Instruction{Opcode::JMP,
+                              {Operand::label(function_body)},
+                              "Tail-recursive call [ReturnStmt]"};
+        has_tail_recursion = true;
+        ++NumTailRecursions;
+
+        return true;
+    }
+
+    // The callee returns directly to our caller, so it must return the same
+    // type, and it cannot take arguments on the stack, where our return
+    // address is.
+    auto type = type_table.find(&node);
+    if (type == std::end(type_table) || type->second->isVoidTy() ||
+        isFloat(node) != (function->returnType.lexeme == "float"))
+        return false;
+
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+
+    if (std::find(std::begin(registers), std::end(registers), Operand{}) !=
+        std::end(registers))
+        return false;
+
+    std::vector<Operand> arguments;
+    for (const auto &argument : node.arguments)
+        arguments.push_back(visit(*argument));
+
+    for (std::size_t i = 0; i < arguments.size(); ++i)
+        module << Instruction{
+            is_float[i] ? Opcode::MOVSS : Opcode::MOVQ,
+            {arguments[i], registers[i]},
+            fmt::format("Pass argument {} in a register [ReturnStmt]", i)};
+
+    module << Instruction{Opcode::TAILJMP,
+                          {Operand::label(module.getSymbol(node.name.lexeme))},
+                          "Tail call [ReturnStmt]"};
+    ++NumSiblingCalls;
+
+    return true;
+}
+
+codegen_x64::Symbol
+codegen_x64::CodeGeneratorX64::label(const std::string &suffix) {
+    return module.getSymbol(fmt::format(".L{}{}", label_counter++, suffix));
+}
+
+codegen_x64::Operand codegen_x64::CodeGeneratorX64::newVirtualRegister() {
+    return Operand::makeRegister(Register::virtualRegister(num_vregs++));
+}
+
+codegen_x64::Operand codegen_x64::CodeGeneratorX64::newFloatRegister() {
+    return Operand::makeRegister(Register::floatRegister(num_vregs++));
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::multiplyByConstant(const Operand &lhs,
+                                                  std::int64_t value) {
+    std::string comment = fmt::format("Multiply by {} [BinaryOpExpr]", value);
+
+    // Returns the scale of 'lea (x,x,scale)' that multiplies by 'factor', or
+    // 0 if the factor is not 3, 5 or 9.
+    auto leaScale = [](std::uint64_t factor) -> std::uint8_t {
+        return factor == 3 || factor == 5 || factor == 9 ? factor - 1 : 0;
+    };
+
+    auto emitLea = [&](const Operand &source, std::uint8_t scale) {
+        Register reg = materialise(source).reg;
+        Operand dest = newVirtualRegister();
+
+        module << Instruction{Opcode::LEAQ,
+                              {Operand::memory(reg, 0, reg, scale), dest},
+                              comment};
+        return dest;
+    };
+
+    auto emitCopy = [&](const Operand &source) {
+        Operand dest = newVirtualRegister();
+
+        module << Instruction{
+            Opcode::MOVQ, {source, dest}, "Load lhs [BinaryOpExpr]"};
+        return dest;
+    };
+
+    auto emitShift = [&](unsigned int amount, const Operand &dest) {
+        module << Instruction{
+            Opcode::SALQ, {Operand::immediate(amount), dest}, comment};
+    };
+
+    // The absolute value of the factor is decomposed into at most two cheap
+    // instructions: 2^k and m * 2^k with m in {3, 5, 9} become lea and a
+    // shift, m1 * m2 two leas, and 2^k + 1 and 2^k - 1 a shift and an
+    // addition or subtraction. A negative factor adds a negation.
+    std::uint64_t factor = value < 0 ? 0 - static_cast<std::uint64_t>(value)
+                                     : static_cast<std::uint64_t>(value);
+    unsigned int shift = factor != 0 ? __builtin_ctzll(factor) : 0;
+    std::uint64_t odd = factor >> shift;
+    Operand product;
+
+    auto splitLea = [&](std::uint64_t m) {
+        return odd % m == 0 && leaScale(odd / m) != 0;
+    };
+
+    if (factor == 0) {
+        product = emitCopy(Operand::immediate(0));
+    } else if (odd == 1) {
+        product = emitCopy(lhs);
+        if (shift != 0)
+            emitShift(shift, product);
+    } else if (std::uint8_t scale = leaScale(odd); scale != 0) {
+        product = emitLea(lhs, scale);
+        if (shift != 0)
+            emitShift(shift, product);
+    } else if (shift == 0 && (splitLea(3) || splitLea(5) || splitLea(9))) {
+        std::uint64_t m = splitLea(3) ? 3 : splitLea(5) ? 5 : 9;
+        product = emitLea(emitLea(lhs, leaScale(m)), leaScale(odd / m));
+    } else if (((factor - 1) & (factor - 2)) == 0 ||
+               ((factor + 1) & factor) == 0) {
+        bool add = ((factor - 1) & (factor - 2)) == 0;
+        Operand source = materialise(lhs);
+
+        product = emitCopy(source);
+        emitShift(__builtin_ctzll(add ? factor - 1 : factor + 1), product);
+        module << Instruction{
+            add ? Opcode::ADDQ : Opcode::SUBQ, {source, product}, comment};
+    } else {
+        product = emitCopy(lhs);
+        module << Instruction{
+            Opcode::IMULQ, {Operand::immediate(value), product}, comment};
+        return product;
+    }
+
+    if (value < 0)
+        module << Instruction{Opcode::NEGQ, {product}, comment};
+
+    ++NumMultiplicationsReduced;
+    return product;
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::divideByConstant(const Operand &lhs,
+                                                std::int64_t value,
+                                                bool remainder) {
+    std::string comment =
+        fmt::format("{} {} [BinaryOpExpr]",
+                    remainder ? "Compute remainder of" : "Divide by", value);
+    Operand dividend = materialise(lhs);
+    std::uint64_t divisor = value < 0 ? 0 - static_cast<std::uint64_t>(value)
+                                      : static_cast<std::uint64_t>(value);
+
+    ++NumDivisionsReduced;
+
+    if (divisor == 1) {
+        Operand result = newVirtualRegister();
+        module << Instruction{Opcode::MOVQ,
+                              {remainder ? Operand::immediate(0) : dividend,
+                               result},
+                              comment};
+        if (!remainder && value < 0)
+            module << Instruction{Opcode::NEGQ, {result}, comment};
+        return result;
+    }
+
+    if ((divisor & (divisor - 1)) == 0) {
+        // Division rounds towards zero, while a shift rounds down, so
+        // 2^k - 1 is added to negative dividends first. The remainder is the
+        // dividend minus the rounded dividend with the low k bits cleared,
+        // and has the sign of the dividend. For k = 1, the bias is the sign
+        // bit.
+        unsigned int shift = __builtin_ctzll(divisor);
+        Operand bias = newVirtualRegister();
+
+        module << Instruction{Opcode::MOVQ, {dividend, bias}, comment};
+        if (shift > 1)
+            module << Instruction{
+                Opcode::SARQ, {Operand::immediate(63), bias}, comment};
+        module << Instruction{
+            Opcode::SHRQ, {Operand::immediate(64 - shift), bias}, comment};
+        module << Instruction{Opcode::ADDQ, {dividend, bias}, comment};
+
+        if (remainder) {
+            module << Instruction{Opcode::ANDQ,
+                                  {Operand::immediate(
+                                       -static_cast<std::int64_t>(divisor)),
+                                   bias},
+                                  comment};
+            Operand result = newVirtualRegister();
+            module << Instruction{Opcode::MOVQ, {dividend, result}, comment};
+            module << Instruction{Opcode::SUBQ, {bias, result}, comment};
+            return result;
+        }
+
+        module << Instruction{
+            Opcode::SARQ, {Operand::immediate(shift), bias}, comment};
+        if (value < 0)
+            module << Instruction{Opcode::NEGQ, {bias}, comment};
+        return bias;
+    }
+
+    // The quotient is the high half of the product with a magic number,
+    // corrected by the dividend if the magic number has the wrong sign,
+    // shifted, and incremented if it is negative (Hacker's Delight, 10-4).
+    // The magic number is loaded straight into %rdx, as it may not fit in
+    // 32 bits, and so could not be stored into a spill slot.
+    auto magic = llvm::SignedDivisionByConstantInfo::get(
+        llvm::APInt(64, static_cast<std::uint64_t>(value), true));
+    std::int64_t multiplier = magic.Magic.getSExtValue();
+    Operand quotient = newVirtualRegister();
+    Operand sign = newVirtualRegister();
+
+    module << Instruction{Opcode::MOVQ,
+                          {Operand::immediate(multiplier),
+                           Operand::physical(RDX)},
+                          "Load magic number [BinaryOpExpr]"};
+    module << Instruction{Opcode::MOVQ,
+                          {dividend, Operand::physical(RAX)},
+                          "Load dividend [BinaryOpExpr]"};
+    module << Instruction{
+        Opcode::IMULQ_WIDE, {Operand::physical(RDX)}, comment};
+    module << Instruction{
+        Opcode::MOVQ, {Operand::physical(RDX), quotient}, comment};
+
+    if (value > 0 && multiplier < 0)
+        module << Instruction{Opcode::ADDQ, {dividend, quotient}, comment};
+    else if (value < 0 && multiplier > 0)
+        module << Instruction{Opcode::SUBQ, {dividend, quotient}, comment};
+
+    if (magic.ShiftAmount != 0)
+        module << Instruction{
+            Opcode::SARQ, {Operand::immediate(magic.ShiftAmount), quotient},
+            comment};
+
+    module << Instruction{Opcode::MOVQ, {quotient, sign}, comment};
+    module << Instruction{
+        Opcode::SHRQ, {Operand::immediate(63), sign}, comment};
+    module << Instruction{Opcode::ADDQ, {sign, quotient}, comment};
+
+    if (!remainder)
+        return quotient;
+
+    module << Instruction{
+        Opcode::IMULQ, {Operand::immediate(value), quotient}, comment};
+    Operand result = newVirtualRegister();
+    module << Instruction{Opcode::MOVQ, {dividend, result}, comment};
+    module << Instruction{Opcode::SUBQ, {quotient, result}, comment};
+    return result;
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::materialise(const Operand &operand,
+                                           bool is_float) {
+    if (operand.isImmediate()) {
+        Operand vreg = newVirtualRegister();
+        module << Instruction{
+            Opcode::MOVQ, {operand, vreg}, "Materialise immediate"};
+
+        return vreg;
+    }
+
+    if (operand.isMemory()) {
+        Operand vreg = is_float ? newFloatRegister() : newVirtualRegister();
+        module << Instruction{is_float ? Opcode::MOVSS : Opcode::MOVQ,
+                              {operand, vreg},
+                              "Materialise memory operand"};
+
+        return vreg;
+    }
+
+    return operand;
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::visitOperand(ast::Expr &node) {
+    if (node.kind == ast::Base::Kind::ArrayRefExpr)
+        return arrayElement(static_cast<ast::ArrayRefExpr &>(node));
+
+    return visit(node);
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::selectAddress(ast::BinaryOpExpr &node) {
+    if (node.op.type != TokenType::PLUS && node.op.type != TokenType::MINUS)
+        return {};
+
+    // Returns the scale of an index of the form 'e * scale', or 0.
+    auto scaleOf = [](ast::Expr &expr) {
+        if (expr.kind != ast::Base::Kind::BinaryOpExpr)
+            return 0;
+
+        auto &mul = static_cast<ast::BinaryOpExpr &>(expr);
+        if (mul.op.type != TokenType::STAR ||
+            mul.rhs->kind != ast::Base::Kind::IntLiteral)
+            return 0;
+
+        int scale = static_cast<ast::IntLiteral &>(*mul.rhs).value;
+        return scale == 2 || scale == 4 || scale == 8 ? scale : 0;
+    };
+
+    // The base and index of the address must be registers.
+    auto reg = [&](ast::Expr &expr) { return materialise(visit(expr)).reg; };
+
+    if (node.op.type == TokenType::MINUS) {
+        // 'e - c' becomes '-c(e)'.
+        if (node.rhs->kind != ast::Base::Kind::IntLiteral)
+            return {};
+
+        std::int64_t disp = static_cast<ast::IntLiteral &>(*node.rhs).value;
+        if (-disp < INT32_MIN || -disp > INT32_MAX)
+            return {};
+
+        return Operand::memory(reg(*node.lhs), -disp);
     }
 
-    module << Instruction{"call",{name},"call the function after pushing all args"};
+    // 'e + c' and 'c + e' become 'c(e)'.
+    if (node.rhs->kind == ast::Base::Kind::IntLiteral)
+        return Operand::memory(
+            reg(*node.lhs), static_cast<ast::IntLiteral &>(*node.rhs).value);
 
-    for (int i = node.arguments.size() - 1; i >=6; i--)
-        module << Instruction{"popq",{"%r12"},"call the function after pushing all args"};
+    if (node.lhs->kind == ast::Base::Kind::IntLiteral)
+        return Operand::memory(
+            reg(*node.rhs), static_cast<ast::IntLiteral &>(*node.lhs).value);
+
+    // 'e1 * s + e2' and 'e1 + e2 * s' become '(e2,e1,s)'. The operands are
+    // evaluated from left to right.
+    if (int scale = scaleOf(*node.lhs); scale != 0) {
+        auto &mul = static_cast<ast::BinaryOpExpr &>(*node.lhs);
+        Register index = reg(*mul.lhs);
+        Register base = reg(*node.rhs);
+
+        return Operand::memory(base, 0, index, scale);
+    }
 
-    //if it has return value
-    module << Instruction{"pushq",{abi_return_reg}, "put return of function on stack"};
+    if (int scale = scaleOf(*node.rhs); scale != 0) {
+        auto &mul = static_cast<ast::BinaryOpExpr &>(*node.rhs);
+        Register base = reg(*node.lhs);
+        Register index = reg(*mul.lhs);
+
+        return Operand::memory(base, 0, index, scale);
+    }
+
+    // 'e1 + e2' becomes '(e1,e2)', unless e2 is better used as a memory
+    // operand of addq.
+    if (node.rhs->kind == ast::Base::Kind::ArrayRefExpr)
+        return {};
+
+    Register base = reg(*node.lhs);
+    Register index = reg(*node.rhs);
+
+    return Operand::memory(base, 0, index);
+}
+
+bool codegen_x64::CodeGeneratorX64::isFloat(ast::Base &node) {
+    auto it = type_table.find(&node);
+
+    return it != std::end(type_table) && it->second != nullptr &&
+           it->second->isFloatTy();
 }
 
-std::string codegen_x64::CodeGeneratorX64::label(const std::string &suffix) {
-    return fmt::format(".L{}{}", label_counter++, suffix);
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::floatConstant(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    auto it = float_constants.find(bits);
+
+    if (it == std::end(float_constants)) {
+        Symbol name =
+            module.getSymbol(fmt::format(".LC{}", float_constants.size()));
+
+        module.constants.push_back(
+            Constant{name, bits, fmt::format("float {}", value)});
+        it = float_constants.emplace(bits, name).first;
+    }
+
+    return Operand::constant(it->second);
 }
 
-std::string codegen_x64::CodeGeneratorX64::variable(ast::Base *var) {
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::variable(ast::Base *var) {
     auto it = variable_declarations.find(var);
 
     if (it == std::end(variable_declarations))
-        throw CodegenException("Variable is not allocated in the stack frame!");
+        throw CodegenException("Variable has no virtual register!");
+
+    return it->second;
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::arrayElement(ast::ArrayRefExpr &node) {
+    auto it = array_declarations.find(symbol_table[&node]);
+
+    if (it == std::end(array_declarations))
+        throw CodegenException("Array has no stack slot!");
+
+    Operand index = visit(*node.index);
+    int scale = elementSize(static_cast<ast::ArrayDecl &>(*it->first));
+    Register rbp = Register::physical(RBP);
+
+    // Constant indices are folded into the displacement, if it fits.
+    if (index.isImmediate()) {
+        std::int64_t offset = it->second + scale * index.value;
+
+        if (offset >= INT32_MIN && offset <= INT32_MAX)
+            return Operand::memory(rbp, offset);
+
+        index = materialise(index);
+    }
+
+    return Operand::memory(rbp, it->second, index.reg, scale);
+}
+
+codegen_x64::Operand codegen_x64::CodeGeneratorX64::callLibraryFunction(
+    const std::string &name, const std::vector<Operand> &operands) {
+    std::vector<Operand> registers =
+        getArgumentRegisters(std::vector<bool>(operands.size(), true));
+
+    for (std::size_t i = 0; i < operands.size(); ++i)
+        module << Instruction{
+            Opcode::MOVSS,
+            {operands[i], registers[i]},
+            fmt::format("Pass argument {} in a register [BinaryOpExpr]", i)};
+
+    module << Instruction{Opcode::CALL,
+                          {Operand::label(module.getSymbol(name))},
+                          fmt::format("Call '{}' [BinaryOpExpr]", name)};
+    has_calls = true;
+
+    Operand result = newFloatRegister();
+    module << Instruction{Opcode::MOVSS,
+                          {Operand::physical(abi_float_return_reg), result},
+                          "Store return value [BinaryOpExpr]"};
+
+    return result;
+}
+
+bool codegen_x64::CodeGeneratorX64::emitConditionalMove(
+    ast::Expr &condition, ast::Stmt &if_clause, ast::Stmt *else_clause) {
+    ast::Stmt *if_stmt = getSingleStatement(&if_clause);
+    ast::Stmt *else_stmt = getSingleStatement(else_clause);
+
+    if (!if_stmt || (else_clause && !else_stmt))
+        return false;
+
+    // The values to choose between, and the variable they are assigned to,
+    // unless they are returned. Without an else clause, the variable keeps
+    // its value.
+    ast::Expr *if_value = nullptr;
+    ast::Expr *else_value = nullptr;
+    ast::Base *target = nullptr;
+
+    if (if_stmt->kind == ast::Base::Kind::ReturnStmt) {
+        if (!else_stmt || else_stmt->kind != ast::Base::Kind::ReturnStmt ||
+            function->returnType.lexeme != "int")
+            return false;
+
+        if_value = static_cast<ast::ReturnStmt &>(*if_stmt).value.get();
+        else_value = static_cast<ast::ReturnStmt &>(*else_stmt).value.get();
+
+        if (!if_value || !else_value)
+            return false;
+    } else {
+        ast::BinaryOpExpr *if_assignment = getAssignment(if_stmt);
+        if (!if_assignment)
+            return false;
+
+        target = symbol_table[if_assignment->lhs.get()];
+        if_value = if_assignment->rhs.get();
+
+        if (else_stmt) {
+            ast::BinaryOpExpr *else_assignment = getAssignment(else_stmt);
+            if (!else_assignment ||
+                symbol_table[else_assignment->lhs.get()] != target)
+                return false;
+
+            else_value = else_assignment->rhs.get();
+        }
+
+        if (isFloat(*if_assignment->lhs))
+            return false;
+    }
+
+    // Both values are computed, so they must be cheap and safe to compute
+    // when they are not needed.
+    int if_cost = getSpeculationCost(*if_value);
+    int else_cost = else_value ? getSpeculationCost(*else_value) : 0;
+
+    if (if_cost < 0 || else_cost < 0 ||
+        static_cast<unsigned int>(if_cost + else_cost) > IfConversionMaxCost)
+        return false;
+
+    // Constant conditions are left to emitJumpIfFalse, and float equality
+    // needs two conditions, see handleFloatOperation.
+    ast::BinaryOpExpr *comparison = nullptr;
+    if (condition.kind == ast::Base::Kind::BinaryOpExpr &&
+        isComparison(static_cast<ast::BinaryOpExpr &>(condition).op.type))
+        comparison = static_cast<ast::BinaryOpExpr *>(&condition);
 
-    return fmt::format("{}(%rbp)", it->second);
+    bool is_float_comparison = comparison && isFloat(*comparison->lhs);
+
+    if (condition.kind == ast::Base::Kind::IntLiteral ||
+        (comparison ? is_float_comparison &&
+                          comparison->op.type == TokenType::EQUALS_EQUALS
+                    : isFloat(condition)))
+        return false;
+
+    // The condition is evaluated first, as it may have side effects, and
+    // compared last, as the values may clobber the flags.
+    Operand lhs;
+    Operand rhs;
+
+    if (comparison) {
+        lhs = visit(*comparison->lhs);
+        rhs = visitOperand(*comparison->rhs);
+    } else {
+        lhs = materialise(visit(condition));
+    }
+
+    // cmov cannot move an immediate.
+    Operand if_operand = materialise(visit(*if_value));
+    Operand result = newVirtualRegister();
+
+    module << Instruction{
+        Opcode::MOVQ,
+        {else_value ? visit(*else_value) : variable(target), result},
+        "Load value if false [IfStmt]"};
+
+    Opcode opcode = Opcode::CMOVNE;
+
+    if (!comparison) {
+        module << Instruction{
+            Opcode::CMPQ, {Operand::immediate(0), lhs}, "Test condition"};
+    } else if (is_float_comparison) {
+        // See emitFloatCompareAndJump. The moves are not done if the
+        // operands are unordered.
+        static const std::map<TokenType, Opcode> move_opcodes{
+            {TokenType::BANG_EQUALS, Opcode::CMOVNE},
+            {TokenType::LESS_THAN, Opcode::CMOVA},
+            {TokenType::LESS_THAN_EQUALS, Opcode::CMOVAE},
+            {TokenType::GREATER_THAN, Opcode::CMOVA},
+            {TokenType::GREATER_THAN_EQUALS, Opcode::CMOVAE}};
+        bool swap = comparison->op.type == TokenType::LESS_THAN ||
+                    comparison->op.type == TokenType::LESS_THAN_EQUALS;
+
+        module << Instruction{
+            Opcode::UCOMISS,
+            {swap ? lhs : rhs, materialise(swap ? rhs : lhs, true)},
+            "Compare lhs with rhs"};
+        opcode = move_opcodes.at(comparison->op.type);
+    } else {
+        // Conditional moves done if the comparison is true, and if it is
+        // true with its operands swapped. See emitCompareAndJump.
+        static const std::map<TokenType, std::pair<Opcode, Opcode>>
+            move_opcodes{
+                {TokenType::EQUALS_EQUALS, {Opcode::CMOVE, Opcode::CMOVE}},
+                {TokenType::BANG_EQUALS, {Opcode::CMOVNE, Opcode::CMOVNE}},
+                {TokenType::LESS_THAN, {Opcode::CMOVL, Opcode::CMOVG}},
+                {TokenType::LESS_THAN_EQUALS,
+                 {Opcode::CMOVLE, Opcode::CMOVGE}},
+                {TokenType::GREATER_THAN, {Opcode::CMOVG, Opcode::CMOVL}},
+                {TokenType::GREATER_THAN_EQUALS,
+                 {Opcode::CMOVGE, Opcode::CMOVLE}}};
+        const auto &opcodes = move_opcodes.at(comparison->op.type);
+        bool swap = lhs.isImmediate() && !rhs.isImmediate();
+
+        if (swap)
+            module << Instruction{
+                Opcode::CMPQ, {lhs, materialise(rhs)}, "Compare rhs with lhs"};
+        else
+            module << Instruction{
+                Opcode::CMPQ, {rhs, materialise(lhs)}, "Compare lhs with rhs"};
+
+        opcode = swap ? opcodes.second : opcodes.first;
+    }
+
+    module << Instruction{
+        opcode, {if_operand, result}, "Select value if true [IfStmt]"};
+
+    if (target) {
+        module << Instruction{Opcode::MOVQ,
+                              {result, variable(target)},
+                              "Assign variable [IfStmt]"};
+    } else {
+        module << Instruction{Opcode::MOVQ,
+                              {result, Operand::physical(abi_return_reg)},
+                              "Move return value into return register "
+                              "[IfStmt]"};
+        module << Instruction{Opcode::JMP,
+                              {Operand::label(function_exit)},
+                              "Jump to function exit [IfStmt]"};
+    }
+
+    ++NumIfConversions;
+
+    return true;
 }
 
-std::string codegen_x64::CodeGeneratorX64::parameter(std::size_t arg) {
-    // ASSIGNMENT: Return the location where the caller places the value for
-    // argument 'arg' (0-indexed).
-    
-    // 6 first arguments are passed through registers
-    if (arg < 6)
-        return abi_param_regs[arg];
+int codegen_x64::CodeGeneratorX64::getSpeculationCost(ast::Expr &node) {
+    if (isFloat(node))
+        return -1;
+
+    switch (node.kind) {
+    case ast::Base::Kind::IntLiteral:
+    case ast::Base::Kind::VarRefExpr:
+        return 0;
+    case ast::Base::Kind::UnaryOpExpr: {
+        auto &unary = static_cast<ast::UnaryOpExpr &>(node);
+        int cost = getSpeculationCost(*unary.operand);
 
-    // following arguments are passed on the stack
-    // remember to add return addr + callee saved registers + base pointer (1 + 6 + 1)
-    return fmt::format("{}(%rbp)", 8*(arg - 6 + 1 + abi_callee_saved_regs.size() + 1));
+        if (cost < 0)
+            return -1;
+
+        return unary.op.type == TokenType::MINUS ? cost + 1 : cost;
+    }
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binary = static_cast<ast::BinaryOpExpr &>(node);
+        int lhs = getSpeculationCost(*binary.lhs);
+        int rhs = getSpeculationCost(*binary.rhs);
+
+        if (lhs < 0 || rhs < 0)
+            return -1;
+
+        switch (binary.op.type) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+            return lhs + rhs + 1;
+        case TokenType::STAR:
+            return lhs + rhs + 3;
+        default:
+            return -1;
+        }
+    }
+    default:
+        return -1;
+    }
 }
 
-void codegen_x64::CodeGeneratorX64::handleAssignment(ast::BinaryOpExpr &node) {
+bool codegen_x64::CodeGeneratorX64::emitVectorLoop(ast::WhileStmt &node) {
+    // The condition must be 'i < n', for an integer variable 'i' and a
+    // bound 'n' that is a literal or a variable.
+    if (node.condition->kind != ast::Base::Kind::BinaryOpExpr)
+        return false;
+
+    auto &condition = static_cast<ast::BinaryOpExpr &>(*node.condition);
+    ast::Expr &bound = *condition.rhs;
+
+    if (condition.op.type != TokenType::LESS_THAN ||
+        condition.lhs->kind != ast::Base::Kind::VarRefExpr ||
+        isFloat(*condition.lhs) || isFloat(bound) ||
+        (bound.kind != ast::Base::Kind::IntLiteral &&
+         bound.kind != ast::Base::Kind::VarRefExpr))
+        return false;
+
+    VectorLoop loop;
+    loop.induction = symbol_table[condition.lhs.get()];
+
+    auto isInduction = [&](ast::Expr &expr) {
+        return expr.kind == ast::Base::Kind::VarRefExpr &&
+               symbol_table[&expr] == loop.induction;
+    };
+
+    // The body must only assign, and end with 'i = i + 1' or 'i = 1 + i'.
+    if (!getAssignments(*node.body, loop.statements) ||
+        loop.statements.size() < 2)
+        return false;
+
+    ast::BinaryOpExpr &increment = *loop.statements.back();
+    loop.statements.pop_back();
+
+    if (!isInduction(*increment.lhs) ||
+        increment.rhs->kind != ast::Base::Kind::BinaryOpExpr)
+        return false;
+
+    auto &next = static_cast<ast::BinaryOpExpr &>(*increment.rhs);
+    auto isOne = [](ast::Expr &expr) {
+        return expr.kind == ast::Base::Kind::IntLiteral &&
+               static_cast<ast::IntLiteral &>(expr).value == 1;
+    };
+
+    if (next.op.type != TokenType::PLUS ||
+        !((isInduction(*next.lhs) && isOne(*next.rhs)) ||
+          (isOne(*next.lhs) && isInduction(*next.rhs))))
+        return false;
+
+    // Returns the value 'e' that a reduction 's = s + e', 's = e + s' or
+    // 's = s - e' adds to its variable, or nullptr for other assignments.
+    auto getSummand = [&](ast::BinaryOpExpr &assignment) -> ast::Expr * {
+        if (assignment.lhs->kind != ast::Base::Kind::VarRefExpr ||
+            assignment.rhs->kind != ast::Base::Kind::BinaryOpExpr)
+            return nullptr;
+
+        ast::Base *var = symbol_table[assignment.lhs.get()];
+        auto &sum = static_cast<ast::BinaryOpExpr &>(*assignment.rhs);
+        auto isVariable = [&](ast::Expr &expr) {
+            return expr.kind == ast::Base::Kind::VarRefExpr &&
+                   symbol_table[&expr] == var;
+        };
+
+        if (sum.op.type != TokenType::PLUS && sum.op.type != TokenType::MINUS)
+            return nullptr;
+        if (isVariable(*sum.lhs))
+            return sum.rhs.get();
+        if (sum.op.type == TokenType::PLUS && isVariable(*sum.rhs))
+            return sum.lhs.get();
+
+        return nullptr;
+    };
+
+    // The elements and the variables that are summed up must all be
+    // integers or all floats, and each variable may only be summed up once.
+    loop.is_float = isFloat(*loop.statements.front()->lhs);
+
+    for (ast::BinaryOpExpr *assignment : loop.statements) {
+        if (isFloat(*assignment->lhs) != loop.is_float)
+            return false;
+
+        if (assignment->lhs->kind == ast::Base::Kind::ArrayRefExpr) {
+            if (!isVectorElement(
+                    static_cast<ast::ArrayRefExpr &>(*assignment->lhs), loop))
+                return false;
+
+            continue;
+        }
+
+        ast::Base *var = symbol_table[assignment->lhs.get()];
+
+        if (loop.is_float || var == loop.induction ||
+            loop.reductions.count(var) || !getSummand(*assignment))
+            return false;
+
+        loop.reductions.emplace(var, loop.reductions.size());
+    }
+
+    if (bound.kind == ast::Base::Kind::VarRefExpr &&
+        (isInduction(bound) || loop.reductions.count(symbol_table[&bound])))
+        return false;
+
+    // Every value must be computable for a vector of iterations, with the
+    // SSE registers that the register allocator does not use as scratch
+    // registers. Summing up the two halves of an accumulator takes a
+    // temporary.
+    int temporaries = loop.reductions.empty() ? 0 : 1;
+
+    for (ast::BinaryOpExpr *assignment : loop.statements) {
+        ast::Expr *value =
+            loop.reductions.count(symbol_table[assignment->lhs.get()])
+                ? getSummand(*assignment)
+                : assignment->rhs.get();
+        int registers = getVectorRegisters(*value, loop);
+
+        if (registers < 0)
+            return false;
+
+        temporaries = std::max(temporaries, registers);
+    }
+
+    if (loop.invariants.size() + loop.reductions.size() + temporaries >
+        XMM14 - XMM0)
+        return false;
+
+    ++NumLoopsVectorised;
+
+    const std::int64_t width = loop.is_float ? 4 : 2;
+    const Opcode move = loop.is_float ? Opcode::MOVUPS : Opcode::MOVDQU;
+    auto xmm = [](unsigned int number) {
+        return Operand::physical(static_cast<PhysicalRegister>(XMM0 + number));
+    };
+
+    // Broadcast the invariants to every element of their register, and
+    // clear the accumulators.
+    for (ast::Expr *invariant : loop.invariants) {
+        Operand reg = xmm(loop.num_registers++);
+        Operand value = visit(*invariant);
+
+        if (loop.is_float) {
+            module << Instruction{Opcode::MOVSS,
+                                  {value, reg},
+                                  "Load invariant [WhileStmt]"};
+            module << Instruction{Opcode::SHUFPS,
+                                  {Operand::immediate(0), reg, reg},
+                                  "Broadcast invariant [WhileStmt]"};
+        } else {
+            module << Instruction{Opcode::MOVQ_XMM,
+                                  {materialise(value), reg},
+                                  "Load invariant [WhileStmt]"};
+            module << Instruction{Opcode::PSHUFD,
+                                  {Operand::immediate(0x44), reg, reg},
+                                  "Broadcast invariant [WhileStmt]"};
+        }
+    }
+
+    const unsigned int first_accumulator = loop.num_registers;
+
+    for (std::size_t k = 0; k < loop.reductions.size(); ++k) {
+        Operand reg = xmm(loop.num_registers++);
+        module << Instruction{
+            Opcode::PXOR, {reg, reg}, "Clear accumulator [WhileStmt]"};
+    }
+
+    auto vector_label = label("vector");
+    auto end_label = label("endvector");
+    Operand induction = variable(loop.induction);
+
+    // Run the vector loop while the last element of the vector is in range.
+    // Comparing 'i + width - 1' rather than 'n - width + 1' cannot overflow
+    // unless the loop accesses elements out of bounds.
+    module << BasicBlock{vector_label, "Vector loop condition [WhileStmt]"};
+    Operand last = newVirtualRegister();
+    module << Instruction{Opcode::LEAQ,
+                          {Operand::memory(induction.reg, width - 1), last},
+                          "Last iteration of the vector [WhileStmt]"};
+    module << Instruction{
+        Opcode::CMPQ, {visit(bound), last}, "Compare to bound [WhileStmt]"};
+    module << Instruction{Opcode::JGE,
+                          {Operand::label(end_label)},
+                          "Exit vector loop [WhileStmt]"};
+
+    for (ast::BinaryOpExpr *assignment : loop.statements) {
+        const unsigned int top = loop.num_registers;
+        auto it = loop.reductions.find(symbol_table[assignment->lhs.get()]);
+
+        if (it == std::end(loop.reductions)) {
+            auto &element = static_cast<ast::ArrayRefExpr &>(*assignment->lhs);
+            Operand value = emitVectorExpression(*assignment->rhs, loop);
+
+            module << Instruction{move,
+                                  {value, arrayElement(element)},
+                                  "Store vector of elements [WhileStmt]"};
+        } else {
+            auto &sum = static_cast<ast::BinaryOpExpr &>(*assignment->rhs);
+            Operand value =
+                emitVectorExpression(*getSummand(*assignment), loop);
+
+            module << Instruction{sum.op.type == TokenType::MINUS
+                                      ? Opcode::PSUBQ
+                                      : Opcode::PADDQ,
+                                  {value, xmm(first_accumulator + it->second)},
+                                  "Accumulate vector [WhileStmt]"};
+        }
+
+        loop.num_registers = top;
+    }
+
+    module << Instruction{Opcode::ADDQ,
+                          {Operand::immediate(width), induction},
+                          "Next vector of iterations [WhileStmt]"};
+    module << Instruction{Opcode::JMP,
+                          {Operand::label(vector_label)},
+                          "Back to vector loop condition [WhileStmt]"};
+
+    module << BasicBlock{end_label, "End of vector loop [WhileStmt]"};
+
+    // Add the two halves of each accumulator to its variable.
+    std::vector<ast::Base *> sums(loop.reductions.size());
+    for (auto [var, index] : loop.reductions)
+        sums[index] = var;
+
+    for (std::size_t k = 0; k < sums.size(); ++k) {
+        Operand accumulator = xmm(first_accumulator + k);
+        Operand high = xmm(loop.num_registers);
+        Operand sum = newVirtualRegister();
+
+        module << Instruction{Opcode::PSHUFD,
+                              {Operand::immediate(0xee), accumulator, high},
+                              "High half of accumulator [WhileStmt]"};
+        module << Instruction{
+            Opcode::PADDQ, {high, accumulator}, "Add halves [WhileStmt]"};
+        module << Instruction{
+            Opcode::MOVQ_XMM, {accumulator, sum}, "Move sum [WhileStmt]"};
+        module << Instruction{
+            Opcode::ADDQ, {sum, variable(sums[k])}, "Add sum [WhileStmt]"};
+    }
+
+    return true;
+}
+
+bool codegen_x64::CodeGeneratorX64::isVectorElement(ast::ArrayRefExpr &node,
+                                                    const VectorLoop &loop) {
+    return array_declarations.count(symbol_table[&node]) &&
+           node.index->kind == ast::Base::Kind::VarRefExpr &&
+           symbol_table[node.index.get()] == loop.induction;
+}
+
+std::pair<ast::Base *, std::int64_t>
+codegen_x64::CodeGeneratorX64::getInvariantKey(ast::Expr &node) {
+    if (node.kind == ast::Base::Kind::IntLiteral)
+        return {nullptr, static_cast<ast::IntLiteral &>(node).value};
+
+    if (node.kind == ast::Base::Kind::FloatLiteral) {
+        std::uint32_t bits;
+        float value = static_cast<ast::FloatLiteral &>(node).value;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        return {nullptr, bits};
+    }
+
+    return {symbol_table[&node], 0};
+}
+
+int codegen_x64::CodeGeneratorX64::getVectorRegisters(ast::Expr &node,
+                                                      VectorLoop &loop) {
+    if (isFloat(node) != loop.is_float)
+        return -1;
+
+    switch (node.kind) {
+    case ast::Base::Kind::ArrayRefExpr:
+        return isVectorElement(static_cast<ast::ArrayRefExpr &>(node), loop)
+                   ? 1
+                   : -1;
+    case ast::Base::Kind::VarRefExpr:
+        // Only the induction variable and the sums change in the loop.
+        if (symbol_table[&node] == loop.induction ||
+            loop.reductions.count(symbol_table[&node]))
+            return -1;
+        [[fallthrough]];
+    case ast::Base::Kind::IntLiteral:
+    case ast::Base::Kind::FloatLiteral:
+        if (loop.invariant_registers
+                .emplace(getInvariantKey(node), loop.invariants.size())
+                .second)
+            loop.invariants.push_back(&node);
+
+        return 0;
+    case ast::Base::Kind::UnaryOpExpr: {
+        auto &unary = static_cast<ast::UnaryOpExpr &>(node);
+
+        if (unary.op.type != TokenType::PLUS)
+            return -1;
+
+        return getVectorRegisters(*unary.operand, loop);
+    }
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binary = static_cast<ast::BinaryOpExpr &>(node);
+
+        // SSE2 has no packed 64-bit multiplication or division.
+        switch (binary.op.type) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+            break;
+        case TokenType::STAR:
+        case TokenType::SLASH:
+            if (!loop.is_float)
+                return -1;
+            break;
+        default:
+            return -1;
+        }
+
+        int lhs = getVectorRegisters(*binary.lhs, loop);
+        int rhs = getVectorRegisters(*binary.rhs, loop);
+
+        if (lhs < 0 || rhs < 0)
+            return -1;
+
+        // The left operand is computed in a temporary, which holds the
+        // result while the right operand is computed.
+        return std::max({lhs, 1, rhs + 1});
+    }
+    default:
+        return -1;
+    }
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::emitVectorExpression(ast::Expr &node,
+                                                    VectorLoop &loop) {
+    auto temporary = [&] {
+        return Operand::physical(
+            static_cast<PhysicalRegister>(XMM0 + loop.num_registers++));
+    };
+
+    switch (node.kind) {
+    case ast::Base::Kind::ArrayRefExpr: {
+        Operand reg = temporary();
+        module << Instruction{
+            loop.is_float ? Opcode::MOVUPS : Opcode::MOVDQU,
+            {arrayElement(static_cast<ast::ArrayRefExpr &>(node)), reg},
+            "Load vector of elements [WhileStmt]"};
+
+        return reg;
+    }
+    case ast::Base::Kind::UnaryOpExpr:
+        return emitVectorExpression(
+            *static_cast<ast::UnaryOpExpr &>(node).operand, loop);
+    case ast::Base::Kind::BinaryOpExpr: {
+        auto &binary = static_cast<ast::BinaryOpExpr &>(node);
+        const unsigned int top = loop.num_registers;
+        Operand lhs = emitVectorExpression(*binary.lhs, loop);
+
+        // The registers of invariants are kept for the next iterations.
+        if (lhs.reg.number < XMM0 + top) {
+            Operand copy = temporary();
+            module << Instruction{
+                Opcode::MOVAPS, {lhs, copy}, "Copy invariant [WhileStmt]"};
+            lhs = copy;
+        }
+
+        Operand rhs = emitVectorExpression(*binary.rhs, loop);
+        Opcode opcode;
+
+        switch (binary.op.type) {
+        case TokenType::PLUS:
+            opcode = loop.is_float ? Opcode::ADDPS : Opcode::PADDQ;
+            break;
+        case TokenType::MINUS:
+            opcode = loop.is_float ? Opcode::SUBPS : Opcode::PSUBQ;
+            break;
+        case TokenType::STAR:
+            opcode = Opcode::MULPS;
+            break;
+        default:
+            opcode = Opcode::DIVPS;
+            break;
+        }
+
+        module << Instruction{
+            opcode, {rhs, lhs}, "Vector operation [BinaryOpExpr]"};
+        loop.num_registers = top + 1;
+
+        return lhs;
+    }
+    default:
+        return Operand::physical(static_cast<PhysicalRegister>(
+            XMM0 + loop.invariant_registers.at(getInvariantKey(node))));
+    }
+}
+
+codegen_x64::Operand
+codegen_x64::CodeGeneratorX64::handleAssignment(ast::BinaryOpExpr &node) {
+    // Array elements are stored directly, without computing their address.
+    if (node.lhs->kind == ast::Base::Kind::ArrayRefExpr) {
+        Operand element =
+            arrayElement(static_cast<ast::ArrayRefExpr &>(*node.lhs));
+        Operand rhs = visit(*node.rhs);
+
+        if (isFloat(*node.lhs)) {
+            rhs = materialise(rhs, true);
+            module << Instruction{Opcode::MOVSS,
+                                  {rhs, element},
+                                  "Assign array element [BinaryOpExpr]"};
+        } else {
+            module << Instruction{Opcode::MOVQ,
+                                  {rhs, element},
+                                  "Assign array element [BinaryOpExpr]"};
+        }
+
+        return rhs;
+    }
+
     // Ensure the LHS is a variable reference
     if (node.lhs->kind != ast::Base::Kind::VarRefExpr) {
         throw CodegenException(
@@ -356,17 +1863,110 @@ void codegen_x64::CodeGeneratorX64::handleAssignment(ast::BinaryOpExpr &node) {
 
     // Find the declaration of this variable reference
     ast::VarRefExpr &lhs = static_cast<ast::VarRefExpr &>(*node.lhs);
-    ast::Base *decl = symbol_table[&lhs];
+    Operand vreg = variable(symbol_table[&lhs]);
+
+    // Emit the right hand side, and move it into the variable. The value of an
+    // assignment is its right-hand side, which is now in the variable.
+    Operand rhs = visit(*node.rhs);
+
+    module << Instruction{isFloat(lhs) ? Opcode::MOVSS : Opcode::MOVQ,
+                          {rhs, vreg},
+                          "Assign variable [BinaryOpExpr]"};
+
+    return vreg;
+}
+
+void codegen_x64::CodeGeneratorX64::emitJumpIfFalse(ast::Expr &condition,
+                                                    Symbol target) {
+    // Constant conditions need no test.
+    if (condition.kind == ast::Base::Kind::IntLiteral) {
+        if (static_cast<ast::IntLiteral &>(condition).value == 0)
+            module << Instruction{Opcode::JMP,
+                                  {Operand::label(target)},
+                                  "Condition is always false"};
+        return;
+    }
+
+    if (condition.kind == ast::Base::Kind::BinaryOpExpr) {
+        auto &node = static_cast<ast::BinaryOpExpr &>(condition);
+
+        if (isComparison(node.op.type)) {
+            if (isFloat(*node.lhs))
+                emitFloatCompareAndJump(node, target);
+            else
+                emitCompareAndJump(node, target);
+            return;
+        }
+    }
 
-    // Emit the right hand side
-    visit(*node.rhs);
+    Operand value = materialise(visit(condition));
 
-    // Move the right hand side into the variable
     module << Instruction{
-        "movq", {"(%rsp)", "%rax"}, "Load RHS of assignment [BinaryOpExpr]"};
+        Opcode::CMPQ, {Operand::immediate(0), value}, "Test condition"};
+    module << Instruction{Opcode::JE,
+                          {Operand::label(target)},
+                          "Jump if condition is false"};
+}
+
+void codegen_x64::CodeGeneratorX64::emitCompareAndJump(ast::BinaryOpExpr &node,
+                                                       Symbol target) {
+    // Conditional jumps taken if the comparison is false, and if it is false
+    // with its operands swapped.
+    static const std::map<TokenType, std::pair<Opcode, Opcode>> jump_opcodes{
+        {TokenType::EQUALS_EQUALS, {Opcode::JNE, Opcode::JNE}},
+        {TokenType::BANG_EQUALS, {Opcode::JE, Opcode::JE}},
+        {TokenType::LESS_THAN, {Opcode::JGE, Opcode::JLE}},
+        {TokenType::LESS_THAN_EQUALS, {Opcode::JG, Opcode::JL}},
+        {TokenType::GREATER_THAN, {Opcode::JLE, Opcode::JGE}},
+        {TokenType::GREATER_THAN_EQUALS, {Opcode::JL, Opcode::JG}}};
+
+    Operand lhs = visit(*node.lhs);
+    Operand rhs = visitOperand(*node.rhs);
+    const auto &opcodes = jump_opcodes.at(node.op.type);
+
+    // The second operand of cmp cannot be an immediate. A constant lhs is
+    // compared the other way around instead.
+    bool swap = lhs.isImmediate() && !rhs.isImmediate();
+
+    if (swap)
+        module << Instruction{
+            Opcode::CMPQ, {lhs, materialise(rhs)}, "Compare rhs with lhs"};
+    else
+        module << Instruction{
+            Opcode::CMPQ, {rhs, materialise(lhs)}, "Compare lhs with rhs"};
+
+    module << Instruction{swap ? opcodes.second : opcodes.first,
+                          {Operand::label(target)},
+                          fmt::format("Jump if not '{}'", node.op.lexeme)};
+}
+
+void codegen_x64::CodeGeneratorX64::emitFloatCompareAndJump(
+    ast::BinaryOpExpr &node, Symbol target) {
+    // The comparisons are ordered, so the jumps are also taken if the
+    // operands are unordered, i.e. if ucomiss sets ZF, PF and CF. See
+    // handleFloatOperation.
+    static const std::map<TokenType, Opcode> jump_opcodes{
+        {TokenType::EQUALS_EQUALS, Opcode::JNE},
+        {TokenType::BANG_EQUALS, Opcode::JE},
+        {TokenType::LESS_THAN, Opcode::JBE},
+        {TokenType::LESS_THAN_EQUALS, Opcode::JB},
+        {TokenType::GREATER_THAN, Opcode::JBE},
+        {TokenType::GREATER_THAN_EQUALS, Opcode::JB}};
+
+    Operand lhs = visit(*node.lhs);
+    Operand rhs = visitOperand(*node.rhs);
+    bool swap = node.op.type == TokenType::LESS_THAN ||
+                node.op.type == TokenType::LESS_THAN_EQUALS;
+
     module << Instruction{
-        "movq", {"%rax", variable(decl)}, "Assign variable [BinaryOpExpr]"};
+        Opcode::UCOMISS,
+        {swap ? lhs : rhs, materialise(swap ? rhs : lhs, true)},
+        "Compare lhs with rhs"};
+    module << Instruction{jump_opcodes.at(node.op.type),
+                          {Operand::label(target)},
+                          fmt::format("Jump if not '{}'", node.op.lexeme)};
 
-    // Note that we do not pop the RHS from the stack, because the value of an
-    // assignment is its right-hand side.
+    if (node.op.type == TokenType::EQUALS_EQUALS)
+        module << Instruction{
+            Opcode::JP, {Operand::label(target)}, "Jump if unordered"};
 }
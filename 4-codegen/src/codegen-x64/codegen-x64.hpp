@@ -5,34 +5,76 @@
 #include "ast/visitor.hpp"
 #include "codegen-x64/module.hpp"
 #include "sema/scoperesolutionpass.hpp"
+#include "sema/typecheckingpass.hpp"
 
-#include <array>
+#include <cstdint>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace codegen_x64 {
-class CodeGeneratorX64 : public ast::Visitor<CodeGeneratorX64> {
+// Generates x64 assembly for a program. Expressions are evaluated into
+// virtual registers, and every variable lives in a virtual register of its
+// own. Integers live in general-purpose virtual registers, and floats in SSE
+// virtual registers. The virtual registers of each function are mapped to
+// physical registers by the RegisterAllocatorX64 once the function is
+// complete.
+// Arrays live in the stack frame, and their elements are accessed with
+// scaled-index addressing relative to %rbp.
+//
+// Visiting an expression returns the operand holding its value: a virtual
+// register, an immediate for integer literals, or a constant in the constant
+// pool for float literals. Statements and calls to void functions return an
+// empty operand.
+//
+// Instructions are selected by maximal munch over the AST: where a larger
+// subtree maps to a single instruction, it is matched before its children.
+// Comparisons in conditions become a cmp and a conditional jump, additions
+// of registers, constants and scaled indices become a single lea, and array
+// elements that are only read once are used as memory operands.
+//
+// Calls in 'return f(...)' are tail calls: a function that calls itself
+// jumps back to its body instead, and other calls become a jmp after the
+// epilogue, so that the callee returns directly to the caller.
+//
+// If statements that only choose between two cheap values for a variable or
+// a return value are if-converted: both values are computed, and a cmov
+// selects one, so that no branch can be mispredicted.
+//
+// Counted loops over arrays that only compute elements from the elements of
+// the same iteration, or sum them up, are vectorised: a loop of packed SSE2
+// instructions runs two (for integers) or four (for floats) iterations at
+// a time, and the loop itself runs the remaining ones.
+class CodeGeneratorX64 : public ast::Visitor<CodeGeneratorX64, Operand> {
   public:
-    CodeGeneratorX64(const sema::ScopeResolutionPass::SymbolTable &symbol_table)
-        : symbol_table(symbol_table) {}
+    CodeGeneratorX64(const sema::ScopeResolutionPass::SymbolTable &symbol_table,
+                     const sema::TypeCheckingPass::TypeTable &type_table)
+        : symbol_table(symbol_table), type_table(type_table) {}
 
     Module getModule() const { return module; }
 
-    void visitFuncDecl(ast::FuncDecl &node);
-    void visitIfStmt(ast::IfStmt &node);
-    void visitWhileStmt(ast::WhileStmt &node);
-    void visitReturnStmt(ast::ReturnStmt &node);
-    void visitExprStmt(ast::ExprStmt &node);
-    void visitVarDecl(ast::VarDecl &node);
-    void visitArrayDecl(ast::ArrayDecl &node);
-    void visitBinaryOpExpr(ast::BinaryOpExpr &node);
-    void visitUnaryOpExpr(ast::UnaryOpExpr &node);
-    void visitIntLiteral(ast::IntLiteral &node);
-    void visitFloatLiteral(ast::FloatLiteral &node);
-    void visitStringLiteral(ast::StringLiteral &node);
-    void visitVarRefExpr(ast::VarRefExpr &node);
-    void visitArrayRefExpr(ast::ArrayRefExpr &node);
-    void visitFuncCallExpr(ast::FuncCallExpr &node);
+    // Visits a node, with the module's location set to the node's location
+    // in the source while the node's instructions are emitted, so that the
+    // line table can map them back to the source.
+    Operand visit(ast::Base &node);
+
+    Operand visitFuncDecl(ast::FuncDecl &node);
+    Operand visitIfStmt(ast::IfStmt &node);
+    Operand visitWhileStmt(ast::WhileStmt &node);
+    Operand visitReturnStmt(ast::ReturnStmt &node);
+    Operand visitExprStmt(ast::ExprStmt &node);
+    Operand visitCompoundStmt(ast::CompoundStmt &node);
+    Operand visitVarDecl(ast::VarDecl &node);
+    Operand visitArrayDecl(ast::ArrayDecl &node);
+    Operand visitBinaryOpExpr(ast::BinaryOpExpr &node);
+    Operand visitUnaryOpExpr(ast::UnaryOpExpr &node);
+    Operand visitIntLiteral(ast::IntLiteral &node);
+    Operand visitFloatLiteral(ast::FloatLiteral &node);
+    Operand visitStringLiteral(ast::StringLiteral &node);
+    Operand visitVarRefExpr(ast::VarRefExpr &node);
+    Operand visitArrayRefExpr(ast::ArrayRefExpr &node);
+    Operand visitFuncCallExpr(ast::FuncCallExpr &node);
 
   private:
     // Module containing the emitted assembly instructions.
@@ -41,45 +83,204 @@ class CodeGeneratorX64 : public ast::Visitor<CodeGeneratorX64> {
     // Symbol table.
     sema::ScopeResolutionPass::SymbolTable symbol_table;
 
+    // Type table.
+    sema::TypeCheckingPass::TypeTable type_table;
+
     // The label of the basic block corresponding to the current function's
     // exit.
-    std::string function_exit;
+    Symbol function_exit;
 
-    // System-V ABI definitions
+    // The current function.
+    ast::FuncDecl *function = nullptr;
 
-    // Return register.
-    const std::string abi_return_reg{"%rax"};
+    // The label of the body of the current function, after its parameters
+    // are loaded, and the index of its first instruction in the entry block.
+    // The body only becomes a basic block of its own if a self-recursive
+    // tail call jumps back to it.
+    Symbol function_body;
+    std::size_t function_body_start = 0;
+    bool has_tail_recursion = false;
 
-    // Registers used for parameters.
-    const std::array<std::string, 6> abi_param_regs{"%rdi", "%rsi", "%rdx",
-                                                    "%rcx", "%r8",  "%r9"};
+    // System-V ABI definitions
 
-    // Callee-saved registers.
-    const std::array<std::string, 6> abi_callee_saved_regs{
-        "%rbx", "%rbp", "%r12", "%r13", "%r14", "%r15"};
+    // Return registers for integers and floats.
+    const PhysicalRegister abi_return_reg = RAX;
+    const PhysicalRegister abi_float_return_reg = XMM0;
 
     // Label counter
     unsigned int label_counter = 0;
 
     // Generate a new, unique label.
-    std::string label(const std::string &suffix = "");
+    Symbol label(const std::string &suffix = "");
+
+    // Number of virtual registers used so far in the current function.
+    unsigned int num_vregs = 0;
+
+    // True if the current function calls other functions.
+    bool has_calls = false;
+
+    // Returns a new integer virtual register.
+    Operand newVirtualRegister();
+
+    // Returns a new float virtual register.
+    Operand newFloatRegister();
+
+    // Returns a virtual register holding the given operand. Immediates and
+    // memory operands are moved into a new virtual register, of the float
+    // class if 'is_float' is true.
+    Operand materialise(const Operand &operand, bool is_float = false);
+
+    // Visits an expression that is used as the source operand of a single
+    // instruction. Array elements are returned as memory operands instead of
+    // being loaded into a register.
+    Operand visitOperand(ast::Expr &node);
+
+    // Returns an address operand that computes the addition or subtraction
+    // for lea, e.g. '8(%v1)' or '(%v1,%v2,4)', after emitting its operands.
+    // Returns an empty operand, without emitting anything, if the expression
+    // does not match an addressing mode.
+    Operand selectAddress(ast::BinaryOpExpr &node);
+
+    // Returns true if the expression or declaration has type float.
+    bool isFloat(ast::Base &node);
+
+    // Maps the bit patterns of float literals to their constant pool entry.
+    std::map<std::uint32_t, Symbol> float_constants;
+
+    // Returns the memory operand of a float in the constant pool.
+    Operand floatConstant(float value);
+
+    // Maps variables to their virtual register.
+    std::map<ast::Base *, Operand> variable_declarations;
+
+    // Returns the virtual register of a previously defined variable.
+    Operand variable(ast::Base *var);
+
+    // Maps arrays to the offset of their first element from %rbp.
+    std::map<ast::Base *, int> array_declarations;
+
+    // Number of bytes taken by the arrays of the current function.
+    int arrays_size = 0;
 
-    // Maps variables to their offset relative to the base pointer.
-    std::map<ast::Base *, int> variable_declarations;
+    // Returns the memory operand of an array element, e.g. '-64(%rbp,%v3,8)'.
+    Operand arrayElement(ast::ArrayRefExpr &node);
 
-    // Returns the location of a previously defined variable.
-    std::string variable(ast::Base *var);
+    // Returns the size of the elements of an array, in bytes.
+    static int elementSize(ast::ArrayDecl &node) {
+        return node.type.lexeme == "float" ? 4 : 8;
+    }
 
-    // Returns the location where the caller places the value for parameter i.
-    std::string parameter(std::size_t arg);
+    // Emits a call to a float function of the C library, with the operands as
+    // arguments, and returns the virtual register holding the result.
+    Operand callLibraryFunction(const std::string &name,
+                                const std::vector<Operand> &operands);
+
+    // Emits 'return f(...)' as a tail call, and returns false without
+    // emitting anything if that is not possible. Calls of the function itself
+    // assign the arguments to the parameters and jump back to the body, which
+    // turns tail recursion into a loop. Calls of other functions that take
+    // all their arguments in registers and return the same type become a jmp
+    // to the function, after the epilogue.
+    bool emitTailCall(ast::FuncCallExpr &node);
+
+    // Emits 'if (c) x = a; else x = b;' as 'x = c ? a : b' with a cmov, and
+    // returns false without emitting anything if that is not possible or not
+    // worth it. The else clause may be missing, and both clauses may return
+    // a value instead of assigning it. The values must be integer
+    // expressions without side effects, of a total cost of at most
+    // -x64-if-conversion-max-cost.
+    bool emitConditionalMove(ast::Expr &condition, ast::Stmt &if_clause,
+                             ast::Stmt *else_clause);
+
+    // Returns the cost of computing an integer expression on a path where
+    // it may not be needed, or -1 if it cannot be computed there, e.g.
+    // because it calls a function or may divide by zero.
+    int getSpeculationCost(ast::Expr &node);
+
+    // A loop 'while (i < n) { ...; i = i + 1; }' that is vectorised, see
+    // emitVectorLoop.
+    struct VectorLoop {
+        // The declaration of the induction variable 'i'.
+        ast::Base *induction = nullptr;
+
+        // True if the elements are floats, four of which fit in an SSE
+        // register, instead of integers, of which two fit.
+        bool is_float = false;
+
+        // The assignments of the body, without the increment of 'i'.
+        std::vector<ast::BinaryOpExpr *> statements;
+
+        // The variables that are summed up, which are assigned an
+        // accumulator register each, in order.
+        std::map<ast::Base *, unsigned int> reductions;
+
+        // The variables and literals that are read, in order of their first
+        // use, and their index in that order. Each is broadcast to an SSE
+        // register of its own before the loop. Variables are keyed by their
+        // declaration, and literals by their value or bit pattern.
+        std::vector<ast::Expr *> invariants;
+        std::map<std::pair<ast::Base *, std::int64_t>, unsigned int>
+            invariant_registers;
+
+        // The number of SSE registers in use, from %xmm0: the invariants,
+        // the accumulators, then the temporaries of the statement being
+        // emitted.
+        unsigned int num_registers = 0;
+    };
+
+    // Emits a vector loop for a counted loop over arrays, which then runs
+    // the remaining iterations, and returns false without emitting anything
+    // if the loop cannot be vectorised. The body may only assign elements
+    // 'a[i] = e' and sum up integers 's = s + e' or 's = s - e', where 'e'
+    // reads elements 'b[i]', invariant variables and literals. Every
+    // element is then only accessed by its own iteration, and arrays live
+    // in the frame, so they cannot alias: the iterations are independent,
+    // except for the sums, which are reassociated. Floats are not summed up
+    // as their sum would round differently.
+    bool emitVectorLoop(ast::WhileStmt &node);
+
+    // Returns true if an array element is accessed at the induction variable
+    // of the loop, e.g. 'a[i]'.
+    bool isVectorElement(ast::ArrayRefExpr &node, const VectorLoop &loop);
+
+    // Returns the key of a variable or literal in the invariants of a loop.
+    std::pair<ast::Base *, std::int64_t> getInvariantKey(ast::Expr &node);
+
+    // Returns the number of temporary SSE registers needed to evaluate an
+    // expression for a vector of iterations, or -1 if it cannot be evaluated
+    // that way. The invariants that it reads are added to the loop.
+    int getVectorRegisters(ast::Expr &node, VectorLoop &loop);
+
+    // Emits an expression for a vector of iterations, and returns the SSE
+    // register holding it: a temporary, or the register of an invariant.
+    Operand emitVectorExpression(ast::Expr &node, VectorLoop &loop);
 
     // Handle assignment AST nodes.
-    void handleAssignment(ast::BinaryOpExpr &node);
+    Operand handleAssignment(ast::BinaryOpExpr &node);
+
+    // Multiplies by a constant, with shifts, lea and additions where they
+    // are cheaper than imulq, and returns the virtual register holding the
+    // product.
+    Operand multiplyByConstant(const Operand &lhs, std::int64_t value);
+
+    // Divides by a non-zero constant without idivq: with shifts for powers
+    // of two, and a multiplication by a magic number otherwise. Returns the
+    // virtual register holding the quotient, or the remainder if
+    // 'remainder' is set, both rounded towards zero like idivq.
+    Operand divideByConstant(const Operand &lhs, std::int64_t value,
+                             bool remainder);
+
+    // Handle binary operators on floats, given their evaluated operands.
+    Operand handleFloatOperation(ast::BinaryOpExpr &node, const Operand &lhs,
+                                 const Operand &rhs);
+
+    // Emits a conditional jump to 'target' if the condition is zero.
+    void emitJumpIfFalse(ast::Expr &condition, Symbol target);
 
-    // ASSIGNMENT: Add any helper functions you use here (if any).
-    
-    // stack is aligned at the moment, if not padding will be added at the end
-    bool aligned;
+    // Emits a comparison of integers or floats, and a jump to 'target' if it
+    // is false.
+    void emitCompareAndJump(ast::BinaryOpExpr &node, Symbol target);
+    void emitFloatCompareAndJump(ast::BinaryOpExpr &node, Symbol target);
 };
 } // namespace codegen_x64
 
@@ -0,0 +1,463 @@
+#include "codegen-x64/costreport-x64.hpp"
+#include "codegen-x64/cfg-x64.hpp"
+#include "codegen-x64/instrinfo-x64.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace codegen_x64;
+
+// The groups of execution ports that micro-ops are issued to.
+enum Port : std::uint8_t {
+    NoPort,   // nop, which only takes an issue slot
+    ALU,      // integer arithmetic and moves
+    Shift,    // shifts, setcc and cmov
+    Multiply, // imulq and three-component leaq
+    Divide,   // idivq and the SSE divisions, which are not pipelined
+    Branch,
+    Float,   // SSE arithmetic, comparisons and conversions
+    Vector,  // SSE moves, logic and integer arithmetic
+    Shuffle, // pshufd and shufps
+    Load,
+    Store,
+    NumPorts,
+};
+
+// The number of ports in each group, e.g. 4 integer ALUs on ports 0, 1, 5
+// and 6.
+constexpr std::array<unsigned int, NumPorts> num_ports{1, 4, 2, 1, 1,
+                                                       2, 2, 3, 1, 2, 1};
+
+// The number of micro-ops issued per cycle.
+constexpr double issue_width = 4;
+
+// The latency of a load that hits the L1 cache, or that is forwarded from a
+// store to the same address.
+constexpr unsigned int load_latency = 5;
+
+// Blocks are weighted by this factor per level of loop nesting.
+constexpr double loop_weight = 10;
+
+// The cost of an instruction, without the loads and stores of its memory
+// operands.
+struct Cost {
+    // Cycles from the inputs to the result.
+    unsigned int latency;
+    unsigned int uops;
+    Port port;
+
+    // Cycles that the port is busy.
+    unsigned int occupancy = 1;
+
+    // A second micro-op, e.g. the store of the return address of a call.
+    Port second_port = NoPort;
+};
+
+bool isMove(Opcode opcode) {
+    return opcode == Opcode::MOVQ || opcode == Opcode::MOVSS ||
+           opcode == Opcode::MOVQ_XMM || opcode == Opcode::MOVDQU ||
+           opcode == Opcode::MOVUPS || opcode == Opcode::MOVAPS;
+}
+
+Cost getCost(const Instruction &ins) {
+    const auto &ops = ins.operands;
+
+    switch (ins.opcode) {
+    case Opcode::MOVQ:
+    case Opcode::MOVZBQ:
+    case Opcode::ADDQ:
+    case Opcode::SUBQ:
+    case Opcode::ANDQ:
+    case Opcode::NEGQ:
+    case Opcode::CQTO:
+    case Opcode::CMPQ:
+        return {1, 1, ALU};
+    case Opcode::LEAQ:
+        // Addresses with a base, an index and a displacement take the slow
+        // path.
+        if (ops[0].reg && ops[0].index && ops[0].value != 0)
+            return {3, 1, Multiply};
+        return {1, 1, ALU};
+    case Opcode::IMULQ:
+        return {3, 1, Multiply};
+    case Opcode::IMULQ_WIDE:
+        return {3, 2, Multiply};
+    case Opcode::IDIVQ:
+        return {15, 4, Divide, 10};
+    case Opcode::SALQ:
+    case Opcode::SARQ:
+    case Opcode::SHRQ:
+        // Shifts by %cl also merge the flags.
+        if (ops.size() == 2 && ops[0].isRegister())
+            return {2, 3, Shift};
+        return {1, 1, Shift};
+    case Opcode::PUSHQ:
+        return {1, 1, Store};
+    case Opcode::POPQ:
+        return {load_latency, 1, Load};
+    case Opcode::CALL:
+        return {1, 2, Branch, 1, Store};
+    case Opcode::RETQ:
+        return {1, 2, Branch, 1, Load};
+    case Opcode::TAILJMP:
+    case Opcode::JMP:
+    case Opcode::JE:
+    case Opcode::JNE:
+    case Opcode::JL:
+    case Opcode::JLE:
+    case Opcode::JG:
+    case Opcode::JGE:
+    case Opcode::JB:
+    case Opcode::JBE:
+    case Opcode::JA:
+    case Opcode::JAE:
+    case Opcode::JP:
+    case Opcode::JNP:
+        return {1, 1, Branch};
+    case Opcode::SETE:
+    case Opcode::SETNE:
+    case Opcode::SETL:
+    case Opcode::SETLE:
+    case Opcode::SETG:
+    case Opcode::SETGE:
+    case Opcode::SETA:
+    case Opcode::SETAE:
+    case Opcode::SETNP:
+    case Opcode::CMOVE:
+    case Opcode::CMOVNE:
+    case Opcode::CMOVL:
+    case Opcode::CMOVLE:
+    case Opcode::CMOVG:
+    case Opcode::CMOVGE:
+    case Opcode::CMOVA:
+    case Opcode::CMOVAE:
+        return {1, 1, Shift};
+    case Opcode::MOVSS:
+    case Opcode::MOVDQU:
+    case Opcode::MOVUPS:
+    case Opcode::MOVAPS:
+    case Opcode::PXOR:
+    case Opcode::PADDQ:
+    case Opcode::PSUBQ:
+        return {1, 1, Vector};
+    case Opcode::MOVQ_XMM:
+        return {2, 1, Vector};
+    case Opcode::PSHUFD:
+    case Opcode::SHUFPS:
+        return {1, 1, Shuffle};
+    case Opcode::ADDSS:
+    case Opcode::SUBSS:
+    case Opcode::MULSS:
+    case Opcode::ADDPS:
+    case Opcode::SUBPS:
+    case Opcode::MULPS:
+        return {4, 1, Float};
+    case Opcode::DIVSS:
+    case Opcode::DIVPS:
+        return {11, 1, Divide, 3};
+    case Opcode::UCOMISS:
+        return {3, 1, Float};
+    case Opcode::CVTSI2SSQ:
+    case Opcode::CVTTSS2SIQ:
+        return {6, 2, Float};
+    case Opcode::NOP:
+        return {0, 1, NoPort};
+    }
+
+    return {1, 1, ALU};
+}
+
+bool writesFlags(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::ADDQ:
+    case Opcode::SUBQ:
+    case Opcode::ANDQ:
+    case Opcode::NEGQ:
+    case Opcode::CMPQ:
+    case Opcode::IMULQ:
+    case Opcode::IMULQ_WIDE:
+    case Opcode::IDIVQ:
+    case Opcode::SALQ:
+    case Opcode::SARQ:
+    case Opcode::SHRQ:
+    case Opcode::UCOMISS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool readsFlags(Opcode opcode) {
+    return (isJump(opcode) && opcode != Opcode::JMP) ||
+           isSetCondition(opcode) || isConditionalMove(opcode);
+}
+
+// The cost of a basic block.
+struct BlockCost {
+    unsigned int instructions = 0;
+    unsigned int uops = 0;
+    unsigned int loads = 0;
+    unsigned int stores = 0;
+
+    // Push/pop traffic: pushq, popq, and the return addresses of call and
+    // retq.
+    unsigned int stack = 0;
+
+    // The critical path, in cycles.
+    unsigned int latency = 0;
+
+    // Cycles per execution, if the block is repeated.
+    double throughput = 0;
+
+    // The nesting depth of the loops that the block is in.
+    unsigned int depth = 0;
+};
+
+BlockCost getBlockCost(const BasicBlock &block) {
+    BlockCost cost;
+    std::array<double, NumPorts> usage{};
+
+    // The cycles at which the registers, the flags and the memory operands
+    // that were written in the block are ready.
+    std::unordered_map<std::uint64_t, unsigned int> ready;
+    std::vector<std::pair<Operand, unsigned int>> stored;
+    const std::uint64_t flags = UINT64_MAX;
+
+    auto key = [](const Register &reg) {
+        return std::uint64_t{static_cast<std::uint8_t>(reg.kind)} << 32 |
+               reg.number;
+    };
+    auto readyAt = [&](std::uint64_t location) {
+        auto it = ready.find(location);
+        return it == std::end(ready) ? 0 : it->second;
+    };
+
+    for (const Instruction &ins : block.instructions) {
+        Cost ins_cost = getCost(ins);
+        unsigned int uops = ins_cost.uops;
+        unsigned int inputs = 0;
+        bool accesses_memory = false;
+
+        ++cost.instructions;
+
+        if (ins.opcode == Opcode::PUSHQ || ins.opcode == Opcode::POPQ ||
+            ins.opcode == Opcode::CALL || ins.opcode == Opcode::RETQ)
+            ++cost.stack;
+
+        if (readsFlags(ins.opcode))
+            inputs = readyAt(flags);
+
+        for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+            const Operand &operand = ins.operands[k];
+            Access access = getAccess(ins, k);
+
+            if (!operand.isMemory()) {
+                if (operand.isRegister() &&
+                    (access == Access::Read || access == Access::ReadWrite))
+                    inputs = std::max(inputs, readyAt(key(operand.reg)));
+
+                continue;
+            }
+
+            unsigned int address = std::max(readyAt(key(operand.reg)),
+                                            readyAt(key(operand.index)));
+
+            if (ins.opcode == Opcode::LEAQ || access == Access::None) {
+                inputs = std::max(inputs, address);
+                continue;
+            }
+
+            accesses_memory = true;
+
+            if (access == Access::Read || access == Access::ReadWrite) {
+                // A load of a value stored in the block waits for the store.
+                for (const auto &[location, data] : stored) {
+                    if (location == operand)
+                        address = std::max(address, data);
+                }
+
+                inputs = std::max(inputs, address + load_latency);
+                ++cost.loads;
+                ++uops;
+                usage[Load] += 1;
+            }
+
+            if (access == Access::Write || access == Access::ReadWrite) {
+                ++cost.stores;
+                ++uops;
+                usage[Store] += 1;
+            }
+        }
+
+        // The stack pointer is updated by the stack engine, without a
+        // dependency between pushes and pops.
+        for (PhysicalRegister reg : getImplicitUses(ins.opcode)) {
+            if (reg != RSP)
+                inputs = std::max(inputs,
+                                  readyAt(key(Register::physical(reg))));
+        }
+
+        // A move to or from memory is only a load or a store.
+        if (isMove(ins.opcode) && accesses_memory) {
+            ins_cost.latency = 0;
+            --uops;
+        } else {
+            usage[ins_cost.port] += ins_cost.occupancy;
+            if (ins_cost.second_port != NoPort)
+                usage[ins_cost.second_port] += 1;
+        }
+
+        unsigned int result = inputs + ins_cost.latency;
+        cost.latency = std::max(cost.latency, result);
+        cost.uops += uops;
+
+        for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+            const Operand &operand = ins.operands[k];
+            Access access = getAccess(ins, k);
+
+            if (access != Access::Write && access != Access::ReadWrite)
+                continue;
+
+            if (operand.isRegister())
+                ready[key(operand.reg)] = result;
+            else if (operand.isMemory() && ins.opcode != Opcode::LEAQ)
+                stored.emplace_back(operand, result);
+        }
+
+        for (PhysicalRegister reg : getImplicitDefs(ins.opcode)) {
+            if (reg != RSP)
+                ready[key(Register::physical(reg))] = result;
+        }
+
+        if (writesFlags(ins.opcode))
+            ready[flags] = result;
+    }
+
+    cost.throughput = cost.uops / issue_width;
+    for (std::size_t port = ALU; port < NumPorts; ++port)
+        cost.throughput =
+            std::max(cost.throughput, usage[port] / num_ports[port]);
+
+    return cost;
+}
+
+// A loop: the blocks from the target of a backward jump to the jump.
+struct LoopRange {
+    unsigned int header;
+    unsigned int last;
+};
+} // namespace
+
+void codegen_x64::CostReportX64::print(llvm::raw_ostream &os,
+                                       const Module &module) {
+    double module_cycles = 0;
+
+    for (FunctionRange function : getFunctions(module)) {
+        std::unordered_map<Symbol, unsigned int> labels;
+        for (unsigned int b = function.begin; b < function.end; ++b)
+            labels.emplace(module.blocks[b].label, b);
+
+        // Find the loops, with the last backward jump to each header.
+        std::vector<LoopRange> loops;
+        for (unsigned int b = function.begin; b < function.end; ++b) {
+            for (const Instruction &ins : module.blocks[b].instructions) {
+                if (!isJump(ins.opcode) || !ins.operands[0].isLabel())
+                    continue;
+
+                auto it = labels.find(ins.operands[0].symbol);
+                if (it == std::end(labels) || it->second > b)
+                    continue;
+
+                auto loop = std::find_if(
+                    std::begin(loops), std::end(loops),
+                    [&](const LoopRange &l) { return l.header == it->second; });
+
+                if (loop == std::end(loops))
+                    loops.push_back({it->second, b});
+                else
+                    loop->last = std::max(loop->last, b);
+            }
+        }
+
+        std::vector<BlockCost> costs;
+        for (unsigned int b = function.begin; b < function.end; ++b)
+            costs.push_back(getBlockCost(module.blocks[b]));
+
+        for (const LoopRange &loop : loops) {
+            for (unsigned int b = loop.header; b <= loop.last; ++b)
+                ++costs[b - function.begin].depth;
+        }
+
+        os << fmt::format("Function '{}':\n",
+                          module.getSymbolName(module.blocks[function.begin]
+                                                   .label));
+        os << fmt::format("  {:<24} {:>5} {:>6} {:>6} {:>6} {:>6} {:>6} "
+                          "{:>8} {:>10}\n",
+                          "block", "depth", "insts", "uops", "loads",
+                          "stores", "stack", "latency", "throughput");
+
+        BlockCost total;
+        double weighted = 0;
+
+        for (unsigned int b = function.begin; b < function.end; ++b) {
+            const BlockCost &cost = costs[b - function.begin];
+
+            // Loop bodies are highlighted.
+            if (cost.depth > 0 && os.has_colors())
+                os.changeColor(llvm::raw_ostream::YELLOW);
+
+            os << fmt::format("  {:<24} {:>5} {:>6} {:>6} {:>6} {:>6} {:>6} "
+                              "{:>8} {:>10.2f}\n",
+                              module.getSymbolName(module.blocks[b].label),
+                              cost.depth, cost.instructions, cost.uops,
+                              cost.loads, cost.stores, cost.stack,
+                              cost.latency, cost.throughput);
+
+            if (cost.depth > 0 && os.has_colors())
+                os.resetColor();
+
+            total.instructions += cost.instructions;
+            total.uops += cost.uops;
+            total.loads += cost.loads;
+            total.stores += cost.stores;
+            total.stack += cost.stack;
+            weighted += cost.throughput * std::pow(loop_weight, cost.depth);
+        }
+
+        // Each iteration of a loop runs its inner loops, which are weighted
+        // as in the function.
+        for (const LoopRange &loop : loops) {
+            const BlockCost &header = costs[loop.header - function.begin];
+            double cycles = 0;
+
+            for (unsigned int b = loop.header; b <= loop.last; ++b) {
+                const BlockCost &cost = costs[b - function.begin];
+                cycles += cost.throughput *
+                          std::pow(loop_weight, cost.depth - header.depth);
+            }
+
+            os << fmt::format(
+                "  loop {} to {} (depth {}): {:.2f} cycles per iteration\n",
+                module.getSymbolName(module.blocks[loop.header].label),
+                module.getSymbolName(module.blocks[loop.last].label),
+                header.depth, cycles);
+        }
+
+        os << fmt::format("  total: {} instructions, {} uops, {} loads, {} "
+                          "stores, {} push/pop, {:.2f} weighted cycles\n\n",
+                          total.instructions, total.uops, total.loads,
+                          total.stores, total.stack, weighted);
+
+        module_cycles += weighted;
+    }
+
+    os << fmt::format("Module: {:.2f} weighted cycles\n", module_cycles);
+}
@@ -0,0 +1,38 @@
+#ifndef COSTREPORT_X64_HPP
+#define COSTREPORT_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace codegen_x64 {
+// Estimates the cost of the code of a module without running it, from a
+// table of the latency, micro-ops and execution ports of every opcode on a
+// recent out-of-order x64 core (roughly Skylake to Golden Cove, after Agner
+// Fog's instruction tables and uops.info).
+//
+// Every basic block is reported with:
+//
+//   - its number of instructions and micro-ops, and of the loads, stores
+//     and push/pop traffic (pushq, popq, call and retq) that it performs;
+//   - its latency: the critical path through the registers, flags and frame
+//     slots that its instructions read and write, assuming that its inputs
+//     are ready when it starts;
+//   - its throughput: the cycles per execution when it is repeated, limited
+//     by the busiest execution port or by the issue width.
+//
+// Loops are the ranges of blocks from the target of a backward jump to the
+// jump, as laid out by BlockLayoutX64, so the report is meant to be printed
+// after the layout. Loop bodies are highlighted, and each loop is summed up
+// per iteration. A function is summed up by weighting its blocks by 10 per
+// level of loop nesting, which gives a single number to compare between
+// compilations, e.g. with and without an optimisation. Trip counts are not
+// known, so the scalar remainder of a vectorised loop is weighted like the
+// vector loop itself.
+class CostReportX64 {
+  public:
+    void print(llvm::raw_ostream &os, const Module &module);
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: COSTREPORT_X64_HPP */
@@ -0,0 +1,359 @@
+#include "codegen-x64/dataflow-x64.hpp"
+#include "codegen-x64/instrinfo-x64.hpp"
+
+#include <array>
+#include <iterator>
+
+namespace {
+using namespace codegen_x64;
+
+// The registers that a function must preserve for its caller.
+const std::array<PhysicalRegister, 7> callee_saved_registers{
+    RBX, RSP, RBP, R12, R13, R14, R15};
+
+// Frame slots are at most 8 bytes wide.
+constexpr std::int64_t max_slot_size = 8;
+
+bool isFrameBase(const Register &reg) {
+    return reg.isPhysical() && (reg.number == RSP || reg.number == RBP);
+}
+
+// Calls 'fn' with every memory operand of the instruction that is accessed,
+// which excludes the address computed by leaq.
+template <typename Fn> void forEachMemoryAccess(const Instruction &ins, Fn fn) {
+    if (ins.opcode == Opcode::LEAQ)
+        return;
+
+    for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+        if (ins.operands[k].isMemory() && getAccess(ins, k) != Access::None)
+            fn(ins.operands[k], getAccess(ins, k));
+    }
+}
+
+void addRegisterUse(const Register &reg, const Locations &locations,
+                    Effects &effects) {
+    unsigned int location = locations.getRegister(reg);
+
+    if (location != Locations::none)
+        effects.uses.push_back(location);
+}
+} // namespace
+
+codegen_x64::Locations::Locations(const ControlFlowGraph &cfg) {
+    for (unsigned int node = 0; node < cfg.size(); ++node) {
+        for (const Instruction &ins : cfg.getInstructions(node)) {
+            forEachMemoryAccess(ins, [&](const Operand &operand, Access) {
+                if (operand.index || operand.symbol != Operand::no_symbol ||
+                    !isFrameBase(operand.reg))
+                    return;
+
+                slots.emplace(std::make_pair(operand.reg.number, operand.value),
+                              num_registers + slots.size());
+            });
+        }
+    }
+
+    overlapping.resize(slots.size());
+    all_slots.resize(size());
+    stack_slots.resize(size());
+    frame_slots.resize(size());
+    no_slots.resize(size());
+
+    for (const auto &[key, slot] : slots) {
+        auto &[base, offset] = key;
+        auto begin = slots.lower_bound({base, offset - max_slot_size + 1});
+        auto end = slots.lower_bound({base, offset + max_slot_size});
+
+        for (auto it = begin; it != end; ++it)
+            overlapping[slot - num_registers].push_back(it->second);
+
+        all_slots.set(slot);
+        (base == RSP ? stack_slots : frame_slots).set(slot);
+    }
+}
+
+unsigned int
+codegen_x64::Locations::getRegister(const Register &reg) const {
+    return reg.isPhysical() && reg.number < num_registers ? reg.number : none;
+}
+
+unsigned int codegen_x64::Locations::getSlot(const Operand &operand) const {
+    if (!operand.isMemory() || operand.index ||
+        operand.symbol != Operand::no_symbol || !isFrameBase(operand.reg))
+        return none;
+
+    auto it = slots.find({operand.reg.number, operand.value});
+    return it != std::end(slots) ? it->second : none;
+}
+
+const llvm::BitVector &
+codegen_x64::Locations::getSlotsBasedOn(unsigned int reg) const {
+    if (reg == RSP)
+        return stack_slots;
+    if (reg == RBP)
+        return frame_slots;
+
+    return no_slots;
+}
+
+codegen_x64::Effects codegen_x64::getEffects(const Instruction &ins,
+                                             const Locations &locations) {
+    Effects effects;
+
+    for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+        const Operand &operand = ins.operands[k];
+
+        if (operand.isMemory()) {
+            // The address is always read.
+            addRegisterUse(operand.reg, locations, effects);
+            addRegisterUse(operand.index, locations, effects);
+            continue;
+        }
+
+        if (!operand.isRegister())
+            continue;
+
+        unsigned int location = locations.getRegister(operand.reg);
+        Access access = getAccess(ins, k);
+
+        if (location == Locations::none || access == Access::None)
+            continue;
+
+        if (access != Access::Write)
+            effects.uses.push_back(location);
+
+        if (access != Access::Read) {
+            effects.defs.push_back(location);
+
+            // Writing %al keeps the other bits of %rax.
+            if (access == Access::Write && operand.reg.size == 8)
+                effects.kills.push_back(location);
+        }
+    }
+
+    forEachMemoryAccess(ins, [&](const Operand &operand, Access access) {
+        unsigned int slot = locations.getSlot(operand);
+
+        // Constants in the read-only data section are never written.
+        if (operand.reg.isPhysical() && operand.reg.number == RIP)
+            return;
+
+        if (access != Access::Write) {
+            if (slot == Locations::none)
+                effects.reads_memory = true;
+            else
+                for (unsigned int overlap : locations.getOverlappingSlots(slot))
+                    effects.uses.push_back(overlap);
+        }
+
+        if (access != Access::Read) {
+            if (slot == Locations::none) {
+                effects.writes_memory = true;
+            } else {
+                for (unsigned int overlap : locations.getOverlappingSlots(slot))
+                    effects.defs.push_back(overlap);
+
+                // Only 8-byte stores overwrite the whole slot.
+                if (access == Access::Write && ins.opcode == Opcode::MOVQ)
+                    effects.kills.push_back(slot);
+            }
+        }
+    });
+
+    for (PhysicalRegister reg : getImplicitUses(ins.opcode))
+        effects.uses.push_back(reg);
+
+    for (PhysicalRegister reg : getImplicitDefs(ins.opcode)) {
+        effects.defs.push_back(reg);
+        effects.kills.push_back(reg);
+    }
+
+    // The callee may access the frame through pointers to local arrays.
+    if (ins.opcode == Opcode::CALL) {
+        effects.reads_memory = true;
+        effects.writes_memory = true;
+    }
+
+    return effects;
+}
+
+codegen_x64::Liveness::Liveness(const ControlFlowGraph &cfg,
+                                const Locations &locations)
+    : locations(locations),
+      live_out(cfg.size(), llvm::BitVector(locations.size())) {
+    std::vector<llvm::BitVector> live_in(cfg.size(),
+                                         llvm::BitVector(locations.size()));
+
+    // Everything may be live if control leaves the function other than by
+    // a return or a tail call, e.g. by a jump to an unknown label.
+    for (unsigned int node = 0; node < cfg.size(); ++node) {
+        auto instructions = cfg.getInstructions(node);
+
+        if (cfg[node].successors.empty() &&
+            (instructions.empty() || !isReturn(instructions.back().opcode)))
+            live_out[node].set(0, Locations::num_registers);
+    }
+
+    // Visit the nodes in post-order, so that most successors are visited
+    // before their predecessors.
+    std::vector<unsigned int> order;
+    std::vector<bool> reachable(cfg.size(), false);
+
+    for (auto it = std::rbegin(cfg.getReversePostOrder());
+         it != std::rend(cfg.getReversePostOrder()); ++it) {
+        order.push_back(*it);
+        reachable[*it] = true;
+    }
+
+    for (unsigned int node = 0; node < cfg.size(); ++node) {
+        if (!reachable[node])
+            order.push_back(node);
+    }
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (unsigned int node : order) {
+            llvm::BitVector &out = live_out[node];
+
+            for (unsigned int succ : cfg[node].successors)
+                out |= live_in[succ];
+
+            llvm::BitVector live = out;
+            auto instructions = cfg.getInstructions(node);
+
+            for (auto it = std::rbegin(instructions);
+                 it != std::rend(instructions); ++it)
+                transfer(*it, live);
+
+            if (live != live_in[node]) {
+                live_in[node] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+}
+
+void codegen_x64::Liveness::transfer(const Instruction &ins,
+                                     llvm::BitVector &live) const {
+    Effects effects = getEffects(ins, locations);
+
+    for (unsigned int location : effects.kills)
+        live.reset(location);
+
+    for (unsigned int location : effects.uses)
+        live.set(location);
+
+    // Moving the stack or frame pointer changes which slots the offsets
+    // refer to, so all of those slots are kept.
+    for (unsigned int location : effects.defs)
+        live |= locations.getSlotsBasedOn(location);
+
+    if (effects.reads_memory)
+        live |= locations.getAllSlots();
+
+    if (isReturn(ins.opcode)) {
+        for (PhysicalRegister reg : callee_saved_registers)
+            live.set(reg);
+    }
+}
+
+codegen_x64::ReachingDefinitions::ReachingDefinitions(
+    const ControlFlowGraph &cfg, const Locations &locations) {
+    constexpr unsigned int num_registers = Locations::num_registers;
+    std::vector<unsigned int> registers;
+
+    // Collect the registers that each instruction defines.
+    offsets.push_back(0);
+
+    for (unsigned int node = 0; node < cfg.size(); ++node) {
+        for (const Instruction &ins : cfg.getInstructions(node)) {
+            for (unsigned int location : getEffects(ins, locations).defs) {
+                if (location < num_registers)
+                    registers.push_back(location);
+            }
+
+            offsets.push_back(registers.size());
+        }
+    }
+
+    // Number the definitions per register, starting with the value on entry.
+    std::vector<unsigned int> counts(num_registers, 1);
+    for (unsigned int reg : registers)
+        ++counts[reg];
+
+    first_definitions.resize(num_registers + 1);
+    for (unsigned int reg = 0; reg < num_registers; ++reg)
+        first_definitions[reg + 1] = first_definitions[reg] + counts[reg];
+
+    unsigned int num_definitions = first_definitions[num_registers];
+    definition_instructions.assign(num_definitions, Locations::none);
+    definition_registers.resize(num_definitions);
+    definitions.resize(registers.size());
+
+    std::vector<unsigned int> next(std::begin(first_definitions),
+                                   std::end(first_definitions) - 1);
+
+    for (unsigned int reg = 0; reg < num_registers; ++reg)
+        definition_registers[next[reg]++] = reg;
+
+    for (unsigned int number = 0; number + 1 < offsets.size(); ++number) {
+        for (unsigned int i = offsets[number]; i < offsets[number + 1]; ++i) {
+            unsigned int definition = next[registers[i]]++;
+
+            definition_instructions[definition] = number;
+            definition_registers[definition] = registers[i];
+            definitions[i] = definition;
+        }
+    }
+
+    // Forward analysis: a definition reaches a node if it reaches the end of
+    // any predecessor.
+    reaching_in.assign(cfg.size(), llvm::BitVector(num_definitions));
+    std::vector<llvm::BitVector> reaching_out(
+        cfg.size(), llvm::BitVector(num_definitions));
+
+    if (cfg.size() != 0) {
+        for (unsigned int reg = 0; reg < num_registers; ++reg)
+            reaching_in[0].set(first_definitions[reg]);
+    }
+
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (unsigned int node : cfg.getReversePostOrder()) {
+            llvm::BitVector &in = reaching_in[node];
+
+            for (unsigned int pred : cfg[node].predecessors)
+                in |= reaching_out[pred];
+
+            llvm::BitVector reaching = in;
+            unsigned int number = cfg.getInstructionNumber(node);
+
+            for (unsigned int i = 0; i < cfg[node].last - cfg[node].first;
+                 ++i)
+                transfer(number + i, reaching);
+
+            if (reaching != reaching_out[node]) {
+                reaching_out[node] = std::move(reaching);
+                changed = true;
+            }
+        }
+    }
+}
+
+void codegen_x64::ReachingDefinitions::transfer(
+    unsigned int number, llvm::BitVector &reaching) const {
+    for (unsigned int i = offsets[number]; i < offsets[number + 1]; ++i) {
+        unsigned int reg = definition_registers[definitions[i]];
+
+        reaching.reset(first_definitions[reg], first_definitions[reg + 1]);
+    }
+
+    for (unsigned int i = offsets[number]; i < offsets[number + 1]; ++i)
+        reaching.set(definitions[i]);
+}
@@ -0,0 +1,179 @@
+#ifndef DATAFLOW_X64_HPP
+#define DATAFLOW_X64_HPP
+
+#include "codegen-x64/cfg-x64.hpp"
+#include "codegen-x64/module.hpp"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace codegen_x64 {
+// The storage locations tracked by the data-flow analyses of a function: the
+// physical registers, followed by the frame slots. Frame slots are memory
+// operands relative to %rbp or %rsp without an index register, such as spill
+// slots and stack arguments. Slots at different offsets may overlap, since
+// they are accessed with different sizes.
+class Locations {
+  public:
+    static constexpr unsigned int none = UINT_MAX;
+    static constexpr unsigned int num_registers = XMM15 + 1;
+
+    explicit Locations(const ControlFlowGraph &cfg);
+
+    unsigned int size() const { return num_registers + slots.size(); }
+
+    // Returns the location of a physical register, or none.
+    unsigned int getRegister(const Register &reg) const;
+
+    // Returns the location of a memory operand, or none if it is not a frame
+    // slot.
+    unsigned int getSlot(const Operand &operand) const;
+
+    bool isSlot(unsigned int location) const {
+        return location >= num_registers;
+    }
+
+    // Returns the slots that overlap with a slot, including the slot itself.
+    llvm::ArrayRef<unsigned int> getOverlappingSlots(unsigned int slot) const {
+        return overlapping[slot - num_registers];
+    }
+
+    // Returns all frame slots, or the slots relative to the base register
+    // 'reg', which change meaning when the register is written.
+    const llvm::BitVector &getAllSlots() const { return all_slots; }
+    const llvm::BitVector &getSlotsBasedOn(unsigned int reg) const;
+
+  private:
+    std::map<std::pair<unsigned int, std::int64_t>, unsigned int> slots;
+    std::vector<llvm::SmallVector<unsigned int, 2>> overlapping;
+    llvm::BitVector all_slots;
+    llvm::BitVector stack_slots;
+    llvm::BitVector frame_slots;
+    llvm::BitVector no_slots;
+};
+
+// The locations that an instruction reads and writes. 'defs' are the
+// locations that may be written, and 'kills' the locations that are
+// completely overwritten. Accesses to memory other than the frame slots set
+// 'reads_memory' or 'writes_memory', e.g. through pointers to arrays, and
+// calls do both.
+struct Effects {
+    llvm::SmallVector<unsigned int, 4> uses;
+    llvm::SmallVector<unsigned int, 4> defs;
+    llvm::SmallVector<unsigned int, 4> kills;
+    bool reads_memory = false;
+    bool writes_memory = false;
+};
+
+Effects getEffects(const Instruction &ins, const Locations &locations);
+
+// Liveness analysis of the registers and frame slots, from which dead stores
+// are found. At a return, the return value, the stack pointer and the
+// callee-saved registers are live.
+class Liveness {
+  public:
+    Liveness(const ControlFlowGraph &cfg, const Locations &locations);
+
+    const llvm::BitVector &getLiveOut(unsigned int node) const {
+        return live_out[node];
+    }
+
+    // Updates 'live' from the locations that are live after the instruction
+    // to those that are live before it.
+    void transfer(const Instruction &ins, llvm::BitVector &live) const;
+
+  private:
+    const Locations &locations;
+    std::vector<llvm::BitVector> live_out;
+};
+
+// Reaching definitions of the registers. Definitions are numbered per
+// register: the definitions of register r are [getFirstDefinition(r),
+// getFirstDefinition(r + 1)), where the first one is the value on entry to
+// the function.
+class ReachingDefinitions {
+  public:
+    ReachingDefinitions(const ControlFlowGraph &cfg,
+                        const Locations &locations);
+
+    unsigned int size() const { return definition_instructions.size(); }
+
+    unsigned int getFirstDefinition(unsigned int reg) const {
+        return first_definitions[reg];
+    }
+
+    // Returns the number of the instruction of a definition, or
+    // Locations::none for the value on entry to the function.
+    unsigned int getInstruction(unsigned int definition) const {
+        return definition_instructions[definition];
+    }
+
+    const llvm::BitVector &getReachingIn(unsigned int node) const {
+        return reaching_in[node];
+    }
+
+    // Updates 'reaching' from the definitions that reach the instruction
+    // with the given number to those that reach the next one.
+    void transfer(unsigned int number, llvm::BitVector &reaching) const;
+
+  private:
+    std::vector<unsigned int> first_definitions;
+    std::vector<unsigned int> definition_instructions;
+    std::vector<unsigned int> definition_registers;
+
+    // The definitions of instruction i are definitions[offsets[i]] up to
+    // definitions[offsets[i + 1]].
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> definitions;
+
+    std::vector<llvm::BitVector> reaching_in;
+};
+
+// Solves a forward data-flow problem in which a fact holds at the start of a
+// node if it holds at the end of all of its predecessors, such as available
+// expressions. 'transfer(node, facts)' updates the facts from the start to
+// the end of the node. Returns the facts at the start of every node; no facts
+// hold at the entry point and in unreachable nodes.
+template <typename Transfer>
+std::vector<llvm::BitVector>
+solveAvailability(const ControlFlowGraph &cfg, unsigned int num_facts,
+                  Transfer transfer) {
+    std::vector<llvm::BitVector> in(cfg.size(), llvm::BitVector(num_facts));
+    std::vector<llvm::BitVector> out(cfg.size(),
+                                     llvm::BitVector(num_facts, true));
+    const auto &order = cfg.getReversePostOrder();
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (unsigned int node : order) {
+            llvm::BitVector facts(num_facts, node != 0);
+
+            if (node != 0) {
+                for (unsigned int pred : cfg[node].predecessors)
+                    facts &= out[pred];
+            }
+
+            in[node] = facts;
+            transfer(node, facts);
+
+            if (facts != out[node]) {
+                out[node] = std::move(facts);
+                changed = true;
+            }
+        }
+    }
+
+    return in;
+}
+} // namespace codegen_x64
+
+#endif /* end of include guard: DATAFLOW_X64_HPP */
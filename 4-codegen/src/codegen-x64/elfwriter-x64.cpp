@@ -0,0 +1,241 @@
+#include "codegen-x64/elfwriter-x64.hpp"
+
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Support/EndianStream.h"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+
+namespace {
+using namespace codegen_x64;
+using namespace llvm::ELF;
+
+// The sections of the object, in order.
+enum Section : unsigned int {
+    NullSection,
+    TextSection,
+    RodataSection,
+    RelaTextSection,
+    SymtabSection,
+    StrtabSection,
+    ShstrtabSection,
+    NoteStackSection,
+    NumSections,
+};
+
+// The symbols start with the null symbol and the section symbols of .text
+// and .rodata. All other symbols are global.
+constexpr std::uint32_t rodata_symbol = 2;
+constexpr std::uint32_t first_global_symbol = 3;
+
+// An ELF string table.
+class StringTable {
+  public:
+    StringTable() : data(1, '\0') {}
+
+    std::uint32_t add(const std::string &name) {
+        std::uint32_t offset = data.size();
+
+        data += name;
+        data += '\0';
+
+        return offset;
+    }
+
+    const std::string &getData() const { return data; }
+
+  private:
+    std::string data;
+};
+
+struct SectionHeader {
+    std::uint32_t name = 0;
+    std::uint32_t type = SHT_NULL;
+    std::uint64_t flags = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint32_t link = 0;
+    std::uint32_t info = 0;
+    std::uint64_t alignment = 0;
+    std::uint64_t entry_size = 0;
+};
+
+std::uint64_t alignTo(std::uint64_t offset, std::uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+void codegen_x64::ELFWriterX64::write(llvm::raw_ostream &os,
+                                      const Module &module,
+                                      const ObjectCode &object) {
+    llvm::support::endian::Writer out(os, llvm::support::little);
+
+    // Symbols: the section symbols, the functions, and the undefined
+    // functions.
+    StringTable strings;
+    std::string symbols;
+    llvm::raw_string_ostream symbol_stream(symbols);
+    llvm::support::endian::Writer symbol_out(symbol_stream,
+                                             llvm::support::little);
+    std::unordered_map<Symbol, std::uint32_t> symbol_indices;
+
+    auto writeSymbol = [&](std::uint32_t name, std::uint8_t binding,
+                           std::uint8_t type, std::uint16_t section,
+                           std::uint64_t value, std::uint64_t size) {
+        symbol_out.write<std::uint32_t>(name);
+        symbol_out.write<std::uint8_t>(binding << 4 | type);
+        symbol_out.write<std::uint8_t>(STV_DEFAULT);
+        symbol_out.write<std::uint16_t>(section);
+        symbol_out.write<std::uint64_t>(value);
+        symbol_out.write<std::uint64_t>(size);
+    };
+
+    writeSymbol(0, STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0, 0);
+    writeSymbol(0, STB_LOCAL, STT_SECTION, TextSection, 0, 0);
+    writeSymbol(0, STB_LOCAL, STT_SECTION, RodataSection, 0, 0);
+
+    std::uint32_t num_symbols = first_global_symbol;
+
+    for (const auto &function : object.functions) {
+        writeSymbol(strings.add(module.getSymbolName(function.name)),
+                    STB_GLOBAL, STT_FUNC, TextSection, function.offset,
+                    function.size);
+        symbol_indices[function.name] = num_symbols++;
+    }
+
+    for (Symbol symbol : object.undefined) {
+        writeSymbol(strings.add(module.getSymbolName(symbol)), STB_GLOBAL,
+                    STT_NOTYPE, SHN_UNDEF, 0, 0);
+        symbol_indices[symbol] = num_symbols++;
+    }
+
+    symbol_stream.flush();
+
+    // Relocations refer to constants through the .rodata section symbol.
+    std::string relocations;
+    llvm::raw_string_ostream relocation_stream(relocations);
+    llvm::support::endian::Writer relocation_out(relocation_stream,
+                                                 llvm::support::little);
+
+    for (const auto &relocation : object.relocations) {
+        std::uint64_t symbol;
+        std::int64_t addend = relocation.addend;
+        auto constant = object.constants.find(relocation.symbol);
+
+        if (constant != std::end(object.constants)) {
+            symbol = rodata_symbol;
+            addend += constant->second;
+        } else {
+            symbol = symbol_indices.at(relocation.symbol);
+        }
+
+        relocation_out.write<std::uint64_t>(relocation.offset);
+        relocation_out.write<std::uint64_t>(symbol << 32 | relocation.type);
+        relocation_out.write<std::int64_t>(addend);
+    }
+
+    relocation_stream.flush();
+
+    // Lay out the sections after the ELF header.
+    StringTable section_names;
+    std::array<SectionHeader, NumSections> sections;
+    std::uint64_t offset = sizeof(Elf64_Ehdr);
+
+    auto addSection = [&](Section section, const char *name,
+                          std::uint32_t type, std::uint64_t flags,
+                          std::uint64_t size, std::uint64_t alignment) {
+        offset = alignTo(offset, alignment);
+
+        SectionHeader &header = sections[section];
+        header.name = section_names.add(name);
+        header.type = type;
+        header.flags = flags;
+        header.offset = offset;
+        header.size = size;
+        header.alignment = alignment;
+
+        offset += size;
+    };
+
+    addSection(TextSection, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+               object.text.size(), 16);
+    addSection(RodataSection, ".rodata", SHT_PROGBITS, SHF_ALLOC,
+               object.rodata.size(), 4);
+    addSection(RelaTextSection, ".rela.text", SHT_RELA, SHF_INFO_LINK,
+               relocations.size(), 8);
+    addSection(SymtabSection, ".symtab", SHT_SYMTAB, 0, symbols.size(), 8);
+    addSection(StrtabSection, ".strtab", SHT_STRTAB, 0,
+               strings.getData().size(), 1);
+
+    // Marks the stack as not executable.
+    addSection(NoteStackSection, ".note.GNU-stack", SHT_PROGBITS, 0, 0, 1);
+
+    // The names of the sections come last, as they include their own.
+    addSection(ShstrtabSection, ".shstrtab", SHT_STRTAB, 0, 0, 1);
+    sections[ShstrtabSection].size = section_names.getData().size();
+    offset += sections[ShstrtabSection].size;
+
+    sections[RelaTextSection].link = SymtabSection;
+    sections[RelaTextSection].info = TextSection;
+    sections[RelaTextSection].entry_size = sizeof(Elf64_Rela);
+    sections[SymtabSection].link = StrtabSection;
+    sections[SymtabSection].info = first_global_symbol;
+    sections[SymtabSection].entry_size = sizeof(Elf64_Sym);
+
+    std::uint64_t section_headers = alignTo(offset, 8);
+
+    // The ELF header.
+    std::array<std::uint8_t, EI_NIDENT> ident{
+        0x7f, 'E', 'L', 'F', ELFCLASS64, ELFDATA2LSB, EV_CURRENT,
+        ELFOSABI_NONE};
+    os.write(reinterpret_cast<const char *>(ident.data()), ident.size());
+    out.write<std::uint16_t>(ET_REL);
+    out.write<std::uint16_t>(EM_X86_64);
+    out.write<std::uint32_t>(EV_CURRENT);
+    out.write<std::uint64_t>(0); // entry point
+    out.write<std::uint64_t>(0); // program headers
+    out.write<std::uint64_t>(section_headers);
+    out.write<std::uint32_t>(0); // flags
+    out.write<std::uint16_t>(sizeof(Elf64_Ehdr));
+    out.write<std::uint16_t>(0);
+    out.write<std::uint16_t>(0);
+    out.write<std::uint16_t>(sizeof(Elf64_Shdr));
+    out.write<std::uint16_t>(NumSections);
+    out.write<std::uint16_t>(ShstrtabSection);
+
+    // The contents of the sections, in the order of their offsets.
+    std::uint64_t written = sizeof(Elf64_Ehdr);
+
+    auto writeContents = [&](Section section, const char *data) {
+        const SectionHeader &header = sections[section];
+
+        os.write_zeros(header.offset - written);
+        os.write(data, header.size);
+        written = header.offset + header.size;
+    };
+
+    writeContents(TextSection,
+                  reinterpret_cast<const char *>(object.text.data()));
+    writeContents(RodataSection,
+                  reinterpret_cast<const char *>(object.rodata.data()));
+    writeContents(RelaTextSection, relocations.data());
+    writeContents(SymtabSection, symbols.data());
+    writeContents(StrtabSection, strings.getData().data());
+    writeContents(ShstrtabSection, section_names.getData().data());
+
+    os.write_zeros(section_headers - written);
+
+    for (const SectionHeader &header : sections) {
+        out.write<std::uint32_t>(header.name);
+        out.write<std::uint32_t>(header.type);
+        out.write<std::uint64_t>(header.flags);
+        out.write<std::uint64_t>(0); // address
+        out.write<std::uint64_t>(header.offset);
+        out.write<std::uint64_t>(header.size);
+        out.write<std::uint32_t>(header.link);
+        out.write<std::uint32_t>(header.info);
+        out.write<std::uint64_t>(header.alignment);
+        out.write<std::uint64_t>(header.entry_size);
+    }
+}
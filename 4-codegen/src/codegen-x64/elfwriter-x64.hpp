@@ -0,0 +1,22 @@
+#ifndef ELFWRITER_X64_HPP
+#define ELFWRITER_X64_HPP
+
+#include "codegen-x64/encoder-x64.hpp"
+#include "codegen-x64/module.hpp"
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace codegen_x64 {
+// Writes the code of a module as an ELF64 relocatable object for x86-64,
+// which can be linked like the output of an assembler. The object has the
+// sections .text, .rodata and .rela.text, and a symbol for every function.
+// Constants are referenced through the section symbol of .rodata, like the
+// GNU assembler does for local labels.
+class ELFWriterX64 {
+  public:
+    void write(llvm::raw_ostream &os, const Module &module,
+               const ObjectCode &object);
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: ELFWRITER_X64_HPP */
@@ -0,0 +1,860 @@
+#include "codegen-x64/encoder-x64.hpp"
+#include "codegen-x64/codegenexception.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <unordered_set>
+#include <utility>
+
+#define DEBUG_TYPE "encoder-x64"
+
+STATISTIC(NumInstructionsEncoded, "The number of instructions encoded");
+STATISTIC(NumShortJumps,
+          "The number of jumps encoded with an 8-bit displacement");
+
+namespace {
+using namespace codegen_x64;
+
+bool fitsInt8(std::int64_t value) { return value >= -128 && value <= 127; }
+
+bool fitsInt32(std::int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Returns the condition code of a conditional jump, setcc or cmovcc, which is
+// added to the opcode.
+std::uint8_t getConditionCode(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::JB:
+        return 0x2;
+    case Opcode::JAE:
+    case Opcode::SETAE:
+    case Opcode::CMOVAE:
+        return 0x3;
+    case Opcode::JE:
+    case Opcode::SETE:
+    case Opcode::CMOVE:
+        return 0x4;
+    case Opcode::JNE:
+    case Opcode::SETNE:
+    case Opcode::CMOVNE:
+        return 0x5;
+    case Opcode::JBE:
+        return 0x6;
+    case Opcode::JA:
+    case Opcode::SETA:
+    case Opcode::CMOVA:
+        return 0x7;
+    case Opcode::JP:
+        return 0xa;
+    case Opcode::JNP:
+    case Opcode::SETNP:
+        return 0xb;
+    case Opcode::JL:
+    case Opcode::SETL:
+    case Opcode::CMOVL:
+        return 0xc;
+    case Opcode::JGE:
+    case Opcode::SETGE:
+    case Opcode::CMOVGE:
+        return 0xd;
+    case Opcode::JLE:
+    case Opcode::SETLE:
+    case Opcode::CMOVLE:
+        return 0xe;
+    case Opcode::JG:
+    case Opcode::SETG:
+    case Opcode::CMOVG:
+        return 0xf;
+    default:
+        throw CodegenException(fmt::format("'{}' has no condition code",
+                                           getMnemonic(opcode)));
+    }
+}
+
+// Encodings of the integer arithmetic with a register or memory
+// destination: the opcode with a register source ('op r/m, reg'), with a
+// memory source ('op reg, r/m'), the opcode extension of the forms with an
+// immediate, and the short form with an immediate and %rax.
+struct ArithmeticEncoding {
+    std::uint8_t register_source;
+    std::uint8_t memory_source;
+    std::uint8_t extension;
+    std::uint8_t accumulator;
+};
+
+ArithmeticEncoding getArithmeticEncoding(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::ADDQ:
+        return {0x01, 0x03, 0, 0x05};
+    case Opcode::ANDQ:
+        return {0x21, 0x23, 4, 0x25};
+    case Opcode::SUBQ:
+        return {0x29, 0x2b, 5, 0x2d};
+    default:
+        return {0x39, 0x3b, 7, 0x3d};
+    }
+}
+
+// Returns the number of bytes from an address to the next multiple of the
+// alignment.
+unsigned int getPadding(std::uint64_t address, unsigned int alignment) {
+    return (alignment - address % alignment) % alignment;
+}
+
+// Appends 'size' bytes of NOPs, with the multi-byte NOPs of the GNU
+// assembler: a single NOP of up to 11 bytes, and the longest one followed by
+// the rest otherwise.
+void emitPadding(std::vector<std::uint8_t> &text, unsigned int size) {
+    static const std::vector<std::vector<std::uint8_t>> nops{
+        {},
+        {0x90},
+        {0x66, 0x90},
+        {0x0f, 0x1f, 0x00},
+        {0x0f, 0x1f, 0x40, 0x00},
+        {0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x2e, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x66, 0x2e, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    };
+
+    while (size != 0) {
+        unsigned int nop = std::min<unsigned int>(size, nops.size() - 1);
+
+        text.insert(std::end(text), std::begin(nops[nop]), std::end(nops[nop]));
+        size -= nop;
+    }
+}
+
+// A position in the code before the jumps are relaxed: the number of bytes
+// emitted, and the number of fragments before it, whose sizes are not yet
+// known.
+struct Position {
+    std::size_t offset;
+    std::size_t fragments;
+};
+
+// A part of the code whose size depends on its address: a jump, or the
+// padding before an aligned block.
+struct Fragment {
+    Position position;
+    Opcode opcode;
+    Symbol target;
+    bool is_short;
+
+    // The alignment of the padding in bytes, or 0 for jumps.
+    unsigned int alignment;
+};
+
+// A call to a function in the module, with the position of its 32-bit
+// displacement.
+struct Call {
+    Position position;
+    Symbol target;
+};
+
+struct PendingRelocation {
+    Position position;
+    std::uint32_t type;
+    Symbol symbol;
+    std::int64_t addend;
+};
+
+// Encodes the instructions into a buffer without the fragments, which are
+// inserted once their sizes are known.
+class Assembler {
+  public:
+    explicit Assembler(const Module &module) : module(module) {}
+
+    ObjectCode assemble();
+
+  private:
+    Position here() const { return {code.size(), fragments.size()}; }
+
+    void emitByte(std::uint8_t byte) { code.push_back(byte); }
+
+    void emitValue(std::uint64_t value, unsigned int size) {
+        for (unsigned int i = 0; i < size; ++i)
+            code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+
+    unsigned int getEncoding(const Register &reg) const;
+    unsigned int getEncoding(const Operand &operand) const;
+    std::int32_t getImmediate32(const Operand &operand) const;
+
+    // Emits an instruction with a ModRM byte: the mandatory prefix, if any,
+    // the REX prefix, the opcode, 'reg' in the reg field of ModRM and 'rm' as
+    // register or memory operand, followed by an immediate of 'imm_size'
+    // bytes. 'byte_rm' is set if 'rm' is an 8-bit register.
+    void emitInstruction(std::uint8_t prefix, bool rex_w,
+                         std::initializer_list<std::uint8_t> opcode,
+                         unsigned int reg, const Operand &rm,
+                         unsigned int imm_size = 0, std::int64_t imm = 0,
+                         bool byte_rm = false);
+    void emitAddress(unsigned int reg, const Operand &memory,
+                     unsigned int imm_size);
+
+    void encode(const Instruction &ins);
+    void encodeArithmetic(const Instruction &ins);
+    void encodeCall(const Instruction &ins);
+
+    void relax();
+    std::uint64_t getAddress(Position position) const {
+        return position.offset + fragment_bytes[position.fragments];
+    }
+
+    const Module &module;
+    std::unordered_set<Symbol> defined;
+
+    std::vector<std::uint8_t> code;
+    std::vector<Fragment> fragments;
+    std::vector<Call> calls;
+    std::vector<PendingRelocation> relocations;
+    std::unordered_map<Symbol, Position> labels;
+    std::vector<std::pair<Symbol, Position>> functions;
+    std::vector<Symbol> undefined;
+
+    // The total size of the fragments before each fragment, after
+    // relaxation.
+    std::vector<std::uint64_t> fragment_bytes;
+};
+
+unsigned int Assembler::getEncoding(const Register &reg) const {
+    if (!reg.isPhysical() || reg.number == RIP) {
+        std::string name;
+        llvm::raw_string_ostream os(name);
+        printOperand(os, Operand::makeRegister(reg));
+
+        throw CodegenException(
+            fmt::format("Register '{}' cannot be encoded", os.str()));
+    }
+
+    return reg.number >= XMM0 ? reg.number - XMM0 : reg.number;
+}
+
+unsigned int Assembler::getEncoding(const Operand &operand) const {
+    if (!operand.isRegister())
+        throw CodegenException("Expected a register operand");
+
+    return getEncoding(operand.reg);
+}
+
+std::int32_t Assembler::getImmediate32(const Operand &operand) const {
+    if (!operand.isImmediate() || !fitsInt32(operand.value))
+        throw CodegenException("Expected a 32-bit immediate operand");
+
+    return static_cast<std::int32_t>(operand.value);
+}
+
+void Assembler::emitInstruction(std::uint8_t prefix, bool rex_w,
+                                std::initializer_list<std::uint8_t> opcode,
+                                unsigned int reg, const Operand &rm,
+                                unsigned int imm_size, std::int64_t imm,
+                                bool byte_rm) {
+    std::uint8_t rex = rex_w ? 0x08 : 0;
+    bool needs_rex = rex_w;
+
+    if (reg & 8) {
+        rex |= 0x04;
+        needs_rex = true;
+    }
+
+    if (rm.isRegister()) {
+        unsigned int encoding = getEncoding(rm);
+
+        if (encoding & 8) {
+            rex |= 0x01;
+            needs_rex = true;
+        }
+
+        // %spl, %bpl, %sil and %dil are only accessible with a REX prefix.
+        if (byte_rm && encoding >= 4)
+            needs_rex = true;
+    } else if (rm.isMemory()) {
+        if (rm.reg && rm.reg.number != RIP && (getEncoding(rm.reg) & 8)) {
+            rex |= 0x01;
+            needs_rex = true;
+        }
+        if (rm.index && (getEncoding(rm.index) & 8)) {
+            rex |= 0x02;
+            needs_rex = true;
+        }
+    } else {
+        throw CodegenException("Expected a register or memory operand");
+    }
+
+    if (prefix)
+        emitByte(prefix);
+    if (needs_rex)
+        emitByte(0x40 | rex);
+    for (std::uint8_t byte : opcode)
+        emitByte(byte);
+
+    if (rm.isRegister())
+        emitByte(0xc0 | (reg & 7) << 3 | (getEncoding(rm) & 7));
+    else
+        emitAddress(reg, rm, imm_size);
+
+    emitValue(static_cast<std::uint64_t>(imm), imm_size);
+}
+
+void Assembler::emitAddress(unsigned int reg, const Operand &memory,
+                            unsigned int imm_size) {
+    if (!fitsInt32(memory.value))
+        throw CodegenException("Displacement does not fit in 32 bits");
+
+    // Constants are addressed relative to the end of the instruction, which
+    // is 'imm_size' bytes after the displacement.
+    if (memory.reg && memory.reg.number == RIP) {
+        emitByte(0x05 | (reg & 7) << 3);
+
+        if (memory.symbol != Operand::no_symbol) {
+            relocations.push_back(
+                {here(), llvm::ELF::R_X86_64_PC32, memory.symbol,
+                 memory.value - 4 - static_cast<std::int64_t>(imm_size)});
+            emitValue(0, 4);
+        } else {
+            emitValue(static_cast<std::uint64_t>(memory.value), 4);
+        }
+
+        return;
+    }
+
+    if (!memory.reg || memory.symbol != Operand::no_symbol)
+        throw CodegenException("Memory operands need a base register");
+
+    unsigned int base = getEncoding(memory.reg) & 7;
+    std::int64_t disp = memory.value;
+
+    // %rbp and %r13 as base always need a displacement.
+    unsigned int mod = disp == 0 && base != 5 ? 0 : fitsInt8(disp) ? 1 : 2;
+
+    // %rsp and %r12 as base need a SIB byte.
+    if (memory.index || base == 4) {
+        unsigned int index = 4;
+        unsigned int scale = 0;
+
+        if (memory.index) {
+            index = getEncoding(memory.index);
+            scale = memory.scale == 8   ? 3
+                    : memory.scale == 4 ? 2
+                    : memory.scale == 2 ? 1
+                                        : 0;
+
+            if (index == 4)
+                throw CodegenException("%rsp cannot be an index register");
+        }
+
+        emitByte(mod << 6 | (reg & 7) << 3 | 4);
+        emitByte(scale << 6 | (index & 7) << 3 | base);
+    } else {
+        emitByte(mod << 6 | (reg & 7) << 3 | base);
+    }
+
+    if (mod == 1)
+        emitValue(static_cast<std::uint64_t>(disp), 1);
+    else if (mod == 2)
+        emitValue(static_cast<std::uint64_t>(disp), 4);
+}
+
+void Assembler::encodeArithmetic(const Instruction &ins) {
+    const Operand &source = ins.operands[0];
+    const Operand &dest = ins.operands[1];
+    ArithmeticEncoding encoding = getArithmeticEncoding(ins.opcode);
+
+    if (source.isImmediate()) {
+        std::int32_t imm = getImmediate32(source);
+
+        if (fitsInt8(imm)) {
+            emitInstruction(0, true, {0x83}, encoding.extension, dest, 1, imm);
+        } else if (dest.isRegister() && getEncoding(dest) == RAX) {
+            emitByte(0x48);
+            emitByte(encoding.accumulator);
+            emitValue(static_cast<std::uint32_t>(imm), 4);
+        } else {
+            emitInstruction(0, true, {0x81}, encoding.extension, dest, 4, imm);
+        }
+    } else if (source.isRegister()) {
+        emitInstruction(0, true, {encoding.register_source},
+                        getEncoding(source), dest);
+    } else {
+        emitInstruction(0, true, {encoding.memory_source}, getEncoding(dest),
+                        source);
+    }
+}
+
+void Assembler::encodeCall(const Instruction &ins) {
+    Symbol target = ins.operands[0].symbol;
+
+    // Tail calls to other objects are a jmp with a 32-bit displacement.
+    emitByte(ins.opcode == Opcode::TAILJMP ? 0xe9 : 0xe8);
+
+    if (defined.count(target)) {
+        calls.push_back({here(), target});
+    } else {
+        // The linker resolves the call, through the PLT if the function is
+        // in a shared library.
+        relocations.push_back({here(), llvm::ELF::R_X86_64_PLT32, target, -4});
+
+        if (std::find(std::begin(undefined), std::end(undefined), target) ==
+            std::end(undefined))
+            undefined.push_back(target);
+    }
+
+    emitValue(0, 4);
+}
+
+void Assembler::encode(const Instruction &ins) {
+    const auto &ops = ins.operands;
+
+    switch (ins.opcode) {
+    case Opcode::MOVQ:
+        if (ops[0].isImmediate() && ops[1].isRegister() &&
+            !fitsInt32(ops[0].value)) {
+            // movabsq
+            unsigned int dest = getEncoding(ops[1]);
+
+            emitByte(0x48 | dest >> 3);
+            emitByte(0xb8 + (dest & 7));
+            emitValue(static_cast<std::uint64_t>(ops[0].value), 8);
+        } else if (ops[0].isImmediate()) {
+            emitInstruction(0, true, {0xc7}, 0, ops[1], 4,
+                            getImmediate32(ops[0]));
+        } else if (ops[0].isRegister()) {
+            emitInstruction(0, true, {0x89}, getEncoding(ops[0]), ops[1]);
+        } else {
+            emitInstruction(0, true, {0x8b}, getEncoding(ops[1]), ops[0]);
+        }
+        break;
+    case Opcode::MOVZBQ:
+        emitInstruction(0, true, {0x0f, 0xb6}, getEncoding(ops[1]), ops[0], 0,
+                        0, true);
+        break;
+    case Opcode::LEAQ:
+        emitInstruction(0, true, {0x8d}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::ADDQ:
+    case Opcode::SUBQ:
+    case Opcode::ANDQ:
+    case Opcode::CMPQ:
+        encodeArithmetic(ins);
+        break;
+    case Opcode::IMULQ:
+        if (ops[0].isImmediate()) {
+            std::int32_t imm = getImmediate32(ops[0]);
+            bool is_short = fitsInt8(imm);
+
+            emitInstruction(0, true, {is_short ? std::uint8_t{0x6b}
+                                               : std::uint8_t{0x69}},
+                            getEncoding(ops[1]), ops[1], is_short ? 1 : 4,
+                            imm);
+        } else {
+            emitInstruction(0, true, {0x0f, 0xaf}, getEncoding(ops[1]),
+                            ops[0]);
+        }
+        break;
+    case Opcode::SALQ:
+    case Opcode::SARQ:
+    case Opcode::SHRQ: {
+        unsigned int extension = ins.opcode == Opcode::SALQ   ? 4
+                                 : ins.opcode == Opcode::SARQ ? 7
+                                                              : 5;
+
+        if (ops[0].isRegister()) {
+            if (getEncoding(ops[0]) != RCX)
+                throw CodegenException("Shift counts must be in %cl");
+
+            emitInstruction(0, true, {0xd3}, extension, ops[1]);
+        } else if (getImmediate32(ops[0]) == 1) {
+            emitInstruction(0, true, {0xd1}, extension, ops[1]);
+        } else {
+            emitInstruction(0, true, {0xc1}, extension, ops[1], 1,
+                            ops[0].value);
+        }
+        break;
+    }
+    case Opcode::NEGQ:
+        emitInstruction(0, true, {0xf7}, 3, ops[0]);
+        break;
+    case Opcode::CQTO:
+        emitByte(0x48);
+        emitByte(0x99);
+        break;
+    case Opcode::IDIVQ:
+        emitInstruction(0, true, {0xf7}, 7, ops[0]);
+        break;
+    case Opcode::IMULQ_WIDE:
+        emitInstruction(0, true, {0xf7}, 5, ops[0]);
+        break;
+    case Opcode::PUSHQ:
+        if (ops[0].isRegister()) {
+            unsigned int reg = getEncoding(ops[0]);
+
+            if (reg & 8)
+                emitByte(0x41);
+            emitByte(0x50 + (reg & 7));
+        } else if (ops[0].isImmediate()) {
+            std::int32_t imm = getImmediate32(ops[0]);
+
+            emitByte(fitsInt8(imm) ? 0x6a : 0x68);
+            emitValue(static_cast<std::uint32_t>(imm), fitsInt8(imm) ? 1 : 4);
+        } else {
+            emitInstruction(0, false, {0xff}, 6, ops[0]);
+        }
+        break;
+    case Opcode::POPQ:
+        if (ops[0].isRegister()) {
+            unsigned int reg = getEncoding(ops[0]);
+
+            if (reg & 8)
+                emitByte(0x41);
+            emitByte(0x58 + (reg & 7));
+        } else {
+            emitInstruction(0, false, {0x8f}, 0, ops[0]);
+        }
+        break;
+    case Opcode::CALL:
+        encodeCall(ins);
+        break;
+    case Opcode::TAILJMP:
+        // Tail calls to functions in the module are relaxed like jumps.
+        if (defined.count(ops[0].symbol))
+            fragments.push_back({here(), Opcode::JMP, ops[0].symbol, true, 0});
+        else
+            encodeCall(ins);
+        break;
+    case Opcode::RETQ:
+        emitByte(0xc3);
+        break;
+    case Opcode::JMP:
+    case Opcode::JE:
+    case Opcode::JNE:
+    case Opcode::JL:
+    case Opcode::JLE:
+    case Opcode::JG:
+    case Opcode::JGE:
+    case Opcode::JB:
+    case Opcode::JBE:
+    case Opcode::JA:
+    case Opcode::JAE:
+    case Opcode::JP:
+    case Opcode::JNP:
+        fragments.push_back({here(), ins.opcode, ops[0].symbol, true, 0});
+        break;
+    case Opcode::SETE:
+    case Opcode::SETNE:
+    case Opcode::SETL:
+    case Opcode::SETLE:
+    case Opcode::SETG:
+    case Opcode::SETGE:
+    case Opcode::SETA:
+    case Opcode::SETAE:
+    case Opcode::SETNP:
+        emitInstruction(
+            0, false,
+            {0x0f, static_cast<std::uint8_t>(0x90 | getConditionCode(
+                                                        ins.opcode))},
+            0, ops[0], 0, 0, true);
+        break;
+    case Opcode::CMOVE:
+    case Opcode::CMOVNE:
+    case Opcode::CMOVL:
+    case Opcode::CMOVLE:
+    case Opcode::CMOVG:
+    case Opcode::CMOVGE:
+    case Opcode::CMOVA:
+    case Opcode::CMOVAE:
+        emitInstruction(
+            0, true,
+            {0x0f, static_cast<std::uint8_t>(0x40 | getConditionCode(
+                                                        ins.opcode))},
+            getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::MOVSS:
+        if (ops[1].isMemory())
+            emitInstruction(0xf3, false, {0x0f, 0x11}, getEncoding(ops[0]),
+                            ops[1]);
+        else
+            emitInstruction(0xf3, false, {0x0f, 0x10}, getEncoding(ops[1]),
+                            ops[0]);
+        break;
+    case Opcode::ADDSS:
+        emitInstruction(0xf3, false, {0x0f, 0x58}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::SUBSS:
+        emitInstruction(0xf3, false, {0x0f, 0x5c}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::MULSS:
+        emitInstruction(0xf3, false, {0x0f, 0x59}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::DIVSS:
+        emitInstruction(0xf3, false, {0x0f, 0x5e}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::UCOMISS:
+        emitInstruction(0, false, {0x0f, 0x2e}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::CVTSI2SSQ:
+        emitInstruction(0xf3, true, {0x0f, 0x2a}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::CVTTSS2SIQ:
+        emitInstruction(0xf3, true, {0x0f, 0x2c}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::MOVQ_XMM:
+        if (!ops[1].reg.isFloat())
+            emitInstruction(0x66, true, {0x0f, 0x7e}, getEncoding(ops[0]),
+                            ops[1]);
+        else if (ops[0].isMemory())
+            emitInstruction(0xf3, false, {0x0f, 0x7e}, getEncoding(ops[1]),
+                            ops[0]);
+        else
+            emitInstruction(0x66, true, {0x0f, 0x6e}, getEncoding(ops[1]),
+                            ops[0]);
+        break;
+    case Opcode::MOVDQU:
+        if (ops[1].isMemory())
+            emitInstruction(0xf3, false, {0x0f, 0x7f}, getEncoding(ops[0]),
+                            ops[1]);
+        else
+            emitInstruction(0xf3, false, {0x0f, 0x6f}, getEncoding(ops[1]),
+                            ops[0]);
+        break;
+    case Opcode::MOVUPS:
+        if (ops[1].isMemory())
+            emitInstruction(0, false, {0x0f, 0x11}, getEncoding(ops[0]),
+                            ops[1]);
+        else
+            emitInstruction(0, false, {0x0f, 0x10}, getEncoding(ops[1]),
+                            ops[0]);
+        break;
+    case Opcode::MOVAPS:
+        emitInstruction(0, false, {0x0f, 0x28}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::PXOR:
+        emitInstruction(0x66, false, {0x0f, 0xef}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::PADDQ:
+        emitInstruction(0x66, false, {0x0f, 0xd4}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::PSUBQ:
+        emitInstruction(0x66, false, {0x0f, 0xfb}, getEncoding(ops[1]),
+                        ops[0]);
+        break;
+    case Opcode::PSHUFD:
+        emitInstruction(0x66, false, {0x0f, 0x70}, getEncoding(ops[2]),
+                        ops[1], 1, ops[0].value);
+        break;
+    case Opcode::ADDPS:
+        emitInstruction(0, false, {0x0f, 0x58}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::SUBPS:
+        emitInstruction(0, false, {0x0f, 0x5c}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::MULPS:
+        emitInstruction(0, false, {0x0f, 0x59}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::DIVPS:
+        emitInstruction(0, false, {0x0f, 0x5e}, getEncoding(ops[1]), ops[0]);
+        break;
+    case Opcode::SHUFPS:
+        emitInstruction(0, false, {0x0f, 0xc6}, getEncoding(ops[2]), ops[1],
+                        1, ops[0].value);
+        break;
+    case Opcode::NOP:
+        emitByte(0x90);
+        break;
+    }
+
+    ++NumInstructionsEncoded;
+}
+
+void Assembler::relax() {
+    // Start with short jumps, and widen those whose target is out of range,
+    // in passes over the code until nothing changes. Jumps only grow, so
+    // this terminates. As in the GNU assembler, a pass places each fragment
+    // after the ones before it: a jump backwards is checked against the new
+    // address of its target, and a jump forwards against the old one, moved
+    // by how much the code before the jump has grown in this pass, unless
+    // there is padding in between to take up that growth. Padding may shrink
+    // as jumps grow, so the order matters to get the same code.
+    std::vector<std::size_t> paddings(fragments.size() + 1, 0);
+
+    for (std::size_t f = 0; f < fragments.size(); ++f)
+        paddings[f + 1] = paddings[f] + (fragments[f].alignment != 0);
+
+    auto place = [this](std::size_t f) {
+        const Fragment &fragment = fragments[f];
+        unsigned int size =
+            fragment.alignment != 0
+                ? getPadding(getAddress(fragment.position), fragment.alignment)
+            : fragment.is_short             ? 2
+            : fragment.opcode == Opcode::JMP ? 5
+                                             : 6;
+
+        fragment_bytes[f + 1] = fragment_bytes[f] + size;
+    };
+
+    fragment_bytes.assign(fragments.size() + 1, 0);
+
+    for (std::size_t f = 0; f < fragments.size(); ++f)
+        place(f);
+
+    std::vector<std::uint64_t> old_bytes;
+
+    while (old_bytes != fragment_bytes) {
+        old_bytes = fragment_bytes;
+
+        for (std::size_t f = 0; f < fragments.size(); ++f) {
+            Fragment &jump = fragments[f];
+
+            if (jump.alignment == 0 && jump.is_short) {
+                Position label = labels.at(jump.target);
+                std::int64_t stretch = fragment_bytes[f] - old_bytes[f];
+                std::int64_t end = getAddress(jump.position) + 2;
+                std::int64_t target =
+                    label.offset + old_bytes[label.fragments];
+
+                if (label.fragments <= f)
+                    target = getAddress(label);
+                else if (stretch < 0 ||
+                         paddings[label.fragments] == paddings[f])
+                    target += stretch;
+                else
+                    target = std::max(target, end);
+
+                jump.is_short = fitsInt8(target - end);
+            }
+
+            place(f);
+        }
+    }
+}
+
+ObjectCode Assembler::assemble() {
+    ObjectCode object;
+
+    for (const auto &constant : module.constants) {
+        object.constants.emplace(constant.label, object.rodata.size());
+
+        for (unsigned int i = 0; i < 4; ++i)
+            object.rodata.push_back(
+                static_cast<std::uint8_t>(constant.value >> (8 * i)));
+    }
+
+    for (const auto &bbl : module.blocks)
+        defined.insert(bbl.label);
+
+    for (const auto &bbl : module.blocks) {
+        if (bbl.p2align != 0)
+            fragments.push_back({here(), Opcode::NOP, Operand::no_symbol,
+                                 false, 1u << bbl.p2align});
+
+        labels.emplace(bbl.label, here());
+
+        if (bbl.is_global)
+            functions.emplace_back(bbl.label, here());
+
+        for (const auto &ins : bbl.instructions)
+            encode(ins);
+    }
+
+    for (const Fragment &jump : fragments) {
+        if (jump.alignment == 0 && !defined.count(jump.target))
+            throw CodegenException(
+                fmt::format("Jump to undefined label '{}'",
+                            module.getSymbolName(jump.target)));
+    }
+
+    relax();
+
+    // Insert the jumps and the padding into the code.
+    auto &text = object.text;
+    text.reserve(code.size() + fragment_bytes.back());
+    std::size_t offset = 0;
+
+    for (const Fragment &jump : fragments) {
+        text.insert(std::end(text), std::begin(code) + offset,
+                    std::begin(code) + jump.position.offset);
+        offset = jump.position.offset;
+
+        if (jump.alignment != 0) {
+            emitPadding(text, getPadding(text.size(), jump.alignment));
+            continue;
+        }
+
+        std::int64_t target = getAddress(labels.at(jump.target));
+        bool is_jmp = jump.opcode == Opcode::JMP;
+        std::uint8_t cc = is_jmp ? 0 : getConditionCode(jump.opcode);
+
+        if (jump.is_short) {
+            text.push_back(is_jmp ? 0xeb : 0x70 | cc);
+            text.push_back(static_cast<std::uint8_t>(
+                target - static_cast<std::int64_t>(text.size() + 1)));
+            ++NumShortJumps;
+            continue;
+        }
+
+        if (is_jmp) {
+            text.push_back(0xe9);
+        } else {
+            text.push_back(0x0f);
+            text.push_back(0x80 | cc);
+        }
+
+        std::int64_t disp = target - static_cast<std::int64_t>(text.size() + 4);
+        for (unsigned int i = 0; i < 4; ++i)
+            text.push_back(static_cast<std::uint8_t>(disp >> (8 * i)));
+    }
+
+    text.insert(std::end(text), std::begin(code) + offset, std::end(code));
+
+    // Resolve the calls to functions in the module.
+    for (const Call &call : calls) {
+        std::uint64_t address = getAddress(call.position);
+        std::int64_t disp =
+            static_cast<std::int64_t>(getAddress(labels.at(call.target))) -
+            static_cast<std::int64_t>(address + 4);
+
+        for (unsigned int i = 0; i < 4; ++i)
+            text[address + i] = static_cast<std::uint8_t>(disp >> (8 * i));
+    }
+
+    for (const auto &relocation : relocations)
+        object.relocations.push_back({getAddress(relocation.position),
+                                      relocation.type, relocation.symbol,
+                                      relocation.addend});
+
+    for (std::size_t f = 0; f < functions.size(); ++f) {
+        std::uint64_t begin = getAddress(functions[f].second);
+        std::uint64_t end = f + 1 < functions.size()
+                                ? getAddress(functions[f + 1].second)
+                                : text.size();
+
+        object.functions.push_back({functions[f].first, begin, end - begin});
+    }
+
+    object.undefined = std::move(undefined);
+
+    return object;
+}
+} // namespace
+
+codegen_x64::ObjectCode codegen_x64::EncoderX64::encode(const Module &module) {
+    return Assembler{module}.assemble();
+}
@@ -0,0 +1,59 @@
+#ifndef ENCODER_X64_HPP
+#define ENCODER_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace codegen_x64 {
+// A reference from the code to a symbol that the linker resolves: a function
+// that is not defined in the module, or a constant in .rodata. 'type' is an
+// ELF relocation type, e.g. R_X86_64_PC32.
+struct Relocation {
+    std::uint64_t offset;
+    std::uint32_t type;
+    Symbol symbol;
+    std::int64_t addend;
+};
+
+// A function in the code: a global basic block, up to the next one.
+struct FunctionSymbol {
+    Symbol name;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// The machine code and the data of a module, with the symbols that it
+// defines and the references to resolve when it is linked.
+struct ObjectCode {
+    std::vector<std::uint8_t> text;
+    std::vector<std::uint8_t> rodata;
+
+    std::vector<FunctionSymbol> functions;
+
+    // Functions that are called, but not defined in the module.
+    std::vector<Symbol> undefined;
+
+    // Offsets of the constants in .rodata.
+    std::unordered_map<Symbol, std::uint64_t> constants;
+
+    std::vector<Relocation> relocations;
+};
+
+// Encodes a module to x64 machine code, without an external assembler. Only
+// the instructions and operand forms that the code generator emits are
+// supported; other forms throw a CodegenException. The encodings are those
+// that the GNU assembler picks for the same assembly, e.g. an 8-bit
+// immediate when it fits. Jumps are relaxed: they start with an 8-bit
+// displacement, and are widened until all targets are in range. Aligned
+// blocks are padded with the NOPs that the GNU assembler uses. Calls to
+// functions in the module are resolved, other calls get a relocation.
+class EncoderX64 {
+  public:
+    ObjectCode encode(const Module &module);
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: ENCODER_X64_HPP */
@@ -0,0 +1,233 @@
+#include "codegen-x64/framelayout-x64.hpp"
+#include "codegen-x64/codegenexception.hpp"
+#include "codegen-x64/regalloc-x64.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+
+#define DEBUG_TYPE "framelayout-x64"
+
+STATISTIC(NumFramelessFunctions,
+          "The number of functions without a frame pointer");
+STATISTIC(NumSavedRegisters, "The number of callee-saved registers saved");
+
+codegen_x64::FrameLayoutX64::FrameLayoutX64(bool is_leaf,
+                                            bool has_stack_parameters,
+                                            int arrays_size)
+    : is_leaf(is_leaf),
+      frame_pointer(!is_leaf || has_stack_parameters || arrays_size != 0),
+      arrays_size(arrays_size) {}
+
+bool codegen_x64::FrameLayoutX64::setNumSpillSlots(unsigned int num_slots) {
+    // Spill slots must remain addressable with a 32-bit displacement.
+    if (static_cast<std::int64_t>(arrays_size) + 8 * std::int64_t{num_slots} >
+        max_frame_size)
+        throw CodegenException("Stack frame is too large");
+
+    this->num_slots = num_slots;
+
+    if (!frame_pointer && 8 * static_cast<int>(num_slots) > red_zone_size) {
+        frame_pointer = true;
+        return false;
+    }
+
+    return true;
+}
+
+int codegen_x64::FrameLayoutX64::getAllocationSize() const {
+    // Leaf functions keep their spill slots in the red zone.
+    if (!frame_pointer)
+        return 0;
+
+    // At the entry of the function, the return address makes %rsp 8 bytes
+    // off, and pushing %rbp aligns it again. Leaf functions make no calls,
+    // so they need no padding.
+    int size = arrays_size + 8 * (num_slots + saved_registers.size());
+    int padding = is_leaf ? 0 : size % 16;
+
+    return arrays_size + 8 * num_slots + padding;
+}
+
+std::vector<codegen_x64::Instruction>
+codegen_x64::FrameLayoutX64::getPrologue() const {
+    std::vector<Instruction> prologue;
+    int allocation_size = getAllocationSize();
+
+    if (frame_pointer) {
+        prologue.push_back(Instruction{Opcode::PUSHQ,
+                                       {Operand::physical(RBP)},
+                                       "Save base pointer [FuncDecl]"});
+        prologue.push_back(
+            Instruction{Opcode::MOVQ,
+                        {Operand::physical(RSP), Operand::physical(RBP)},
+                        "Set base pointer [FuncDecl]"});
+    } else {
+        ++NumFramelessFunctions;
+    }
+
+    if (allocation_size != 0)
+        prologue.push_back(Instruction{
+            Opcode::SUBQ,
+            {Operand::immediate(allocation_size), Operand::physical(RSP)},
+            arrays_size != 0
+                ? fmt::format("Allocate {} bytes of arrays and {} spill "
+                              "slot(s) [FuncDecl]",
+                              arrays_size, num_slots)
+                : fmt::format("Allocate {} spill slot(s) [FuncDecl]",
+                              num_slots)});
+
+    for (const auto &reg : saved_registers)
+        prologue.push_back(
+            Instruction{Opcode::PUSHQ,
+                        {Operand::physical(reg)},
+                        "Save callee-saved register [FuncDecl]"});
+
+    NumSavedRegisters += saved_registers.size();
+
+    return prologue;
+}
+
+std::vector<codegen_x64::Instruction>
+codegen_x64::FrameLayoutX64::getEpilogue() const {
+    std::vector<Instruction> epilogue;
+
+    for (auto it = std::rbegin(saved_registers);
+         it != std::rend(saved_registers); ++it)
+        epilogue.push_back(
+            Instruction{Opcode::POPQ,
+                        {Operand::physical(*it)},
+                        "Restore callee-saved register [FuncDecl]"});
+
+    if (frame_pointer) {
+        if (getAllocationSize() != 0)
+            epilogue.push_back(
+                Instruction{Opcode::MOVQ,
+                            {Operand::physical(RBP), Operand::physical(RSP)},
+                            "Free stack frame [FuncDecl]"});
+
+        epilogue.push_back(Instruction{Opcode::POPQ,
+                                       {Operand::physical(RBP)},
+                                       "Restore base pointer [FuncDecl]"});
+    }
+
+    epilogue.push_back(
+        Instruction{Opcode::RETQ, {}, "Return to the caller [FuncDecl]"});
+
+    return epilogue;
+}
+
+namespace {
+using namespace codegen_x64;
+
+// Registers used for integer and float parameters.
+const std::array<PhysicalRegister, 6> abi_param_regs{RDI, RSI, RDX,
+                                                     RCX, R8,  R9};
+const std::array<PhysicalRegister, 8> abi_float_param_regs{
+    XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7};
+
+// Callee-saved registers, except for the base pointer, in the order in which
+// they are saved.
+const std::array<PhysicalRegister, 5> abi_callee_saved_regs{RBX, R12, R13,
+                                                            R14, R15};
+} // namespace
+
+std::vector<codegen_x64::Operand>
+codegen_x64::getArgumentRegisters(const std::vector<bool> &is_float) {
+    // Integer and float arguments are assigned the registers of their class
+    // in order, independently of each other.
+    std::vector<Operand> registers;
+    std::size_t num_ints = 0;
+    std::size_t num_floats = 0;
+
+    for (bool f : is_float) {
+        if (f)
+            registers.push_back(
+                num_floats < abi_float_param_regs.size()
+                    ? Operand::physical(abi_float_param_regs[num_floats++])
+                    : Operand{});
+        else
+            registers.push_back(
+                num_ints < abi_param_regs.size()
+                    ? Operand::physical(abi_param_regs[num_ints++])
+                    : Operand{});
+    }
+
+    return registers;
+}
+
+codegen_x64::Operand codegen_x64::getStackParameter(std::size_t index) {
+    // Stack parameters are above the return address and the saved base
+    // pointer.
+    return Operand::memory(Register::physical(RBP), 8 * (index + 2));
+}
+
+void codegen_x64::finishFunction(Module &module, std::size_t entry,
+                                 bool is_leaf, bool has_stack_parameters,
+                                 int arrays_size) {
+    // Allocate registers, and lay out the stack frame. Leaf functions keep
+    // their spill slots in the red zone if they fit, and are allocated again
+    // with a frame pointer otherwise.
+    auto function_begin = std::begin(module.blocks) + entry;
+    FrameLayoutX64 frame{is_leaf, has_stack_parameters, arrays_size};
+    std::vector<BasicBlock> blocks;
+
+    if (!frame.hasFramePointer())
+        blocks.assign(function_begin, std::end(module.blocks));
+
+    RegisterAllocatorX64 allocator{frame.getSpillBase(),
+                                   frame.getSpillOffset()};
+    unsigned int num_slots =
+        allocator.allocate(function_begin, std::end(module.blocks));
+
+    if (!frame.setNumSpillSlots(num_slots)) {
+        std::copy(std::begin(blocks), std::end(blocks), function_begin);
+
+        allocator = RegisterAllocatorX64{frame.getSpillBase(),
+                                         frame.getSpillOffset()};
+        frame.setNumSpillSlots(
+            allocator.allocate(function_begin, std::end(module.blocks)));
+    }
+
+    // Only save the callee-saved registers that the function uses.
+    std::vector<PhysicalRegister> saved_registers;
+    const auto &used_registers = allocator.getUsedRegisters();
+
+    for (const auto &reg : abi_callee_saved_regs) {
+        if (std::find(std::begin(used_registers), std::end(used_registers),
+                      reg) != std::end(used_registers))
+            saved_registers.push_back(reg);
+    }
+
+    frame.setSavedRegisters(saved_registers);
+
+    // Function prologue and epilogue
+    std::vector<Instruction> prologue = frame.getPrologue();
+    auto &entry_instructions = module.blocks[entry].instructions;
+    entry_instructions.insert(std::begin(entry_instructions),
+                              std::begin(prologue), std::end(prologue));
+
+    std::vector<Instruction> epilogue = frame.getEpilogue();
+
+    for (const auto &ins : epilogue)
+        module << ins;
+
+    // Tail calls leave through the epilogue as well, without its retq.
+    epilogue.pop_back();
+
+    for (auto block = std::begin(module.blocks) + entry;
+         block != std::end(module.blocks); ++block) {
+        auto &instructions = block->instructions;
+
+        for (auto it = std::begin(instructions); it != std::end(instructions);
+             ++it) {
+            if (it->opcode == Opcode::TAILJMP)
+                it = instructions.insert(it, std::begin(epilogue),
+                                         std::end(epilogue)) +
+                     epilogue.size();
+        }
+    }
+}
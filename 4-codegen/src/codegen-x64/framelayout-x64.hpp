@@ -0,0 +1,103 @@
+#ifndef FRAMELAYOUT_X64_HPP
+#define FRAMELAYOUT_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace codegen_x64 {
+// Layout of the stack frame of a function. The layout is completed after
+// register allocation, when the number of spill slots and the registers used
+// by the function are known. A function with a frame pointer has the frame:
+//
+//     stack parameters          16(%rbp), 24(%rbp), ...
+//     return address
+//     saved %rbp                <- %rbp
+//     arrays
+//     spill slots
+//     padding
+//     saved registers           <- %rsp
+//
+// The arrays, the spill slots and the padding are allocated with a single
+// subq, and only the callee-saved registers that the function uses are saved.
+// The padding keeps %rsp 16-byte aligned at calls. All locations in the frame
+// are addressed with a 32-bit displacement from %rbp, which limits the size
+// of the frame to 2 GiB.
+//
+// Leaf functions do not call other functions, so the stack need not be
+// aligned, and they may use the red zone: the 128 bytes below %rsp that the
+// System V ABI guarantees are not clobbered by signal handlers. Leaf
+// functions without stack parameters or arrays thus have no frame pointer,
+// and keep their spill slots in the red zone, relative to %rsp after the
+// callee-saved registers are saved. If they use no callee-saved registers, no
+// frame is set up at all.
+class FrameLayoutX64 {
+  public:
+    // Maximum size of the arrays and spill slots, in bytes. Leaves room for
+    // the saved registers and the padding below the 2 GiB limit.
+    static constexpr std::int64_t max_frame_size =
+        (std::int64_t{1} << 31) - 4096;
+
+    // 'arrays_size' is the number of bytes taken by the arrays of the
+    // function, which are placed directly below the saved %rbp.
+    FrameLayoutX64(bool is_leaf, bool has_stack_parameters, int arrays_size);
+
+    // Returns true if the function uses %rbp as a frame pointer.
+    bool hasFramePointer() const { return frame_pointer; }
+
+    // Returns the register relative to which the spill slots are addressed.
+    Register getSpillBase() const {
+        return Register::physical(frame_pointer ? RBP : RSP);
+    }
+
+    // Returns the offset of the first spill slot from the spill base. The
+    // spill slots are placed below the arrays.
+    int getSpillOffset() const { return -arrays_size; }
+
+    // Sets the number of spill slots. Returns false if the spill slots do not
+    // fit in the red zone. The layout then uses a frame pointer instead, and
+    // the registers must be allocated again with the new spill base.
+    bool setNumSpillSlots(unsigned int num_slots);
+
+    // Sets the callee-saved registers that must be saved by the function.
+    void setSavedRegisters(const std::vector<PhysicalRegister> &registers) {
+        saved_registers = registers;
+    }
+
+    std::vector<Instruction> getPrologue() const;
+    std::vector<Instruction> getEpilogue() const;
+
+  private:
+    // Size of the red zone, in bytes.
+    static constexpr int red_zone_size = 128;
+
+    bool is_leaf;
+    bool frame_pointer;
+    int arrays_size;
+    unsigned int num_slots = 0;
+    std::vector<PhysicalRegister> saved_registers;
+
+    // Returns the number of bytes allocated with subq: the arrays, the spill
+    // slots and the padding.
+    int getAllocationSize() const;
+};
+
+// Returns the registers in which the arguments of a call are passed, given
+// which arguments are floats. Arguments that are passed on the stack have an
+// empty operand.
+std::vector<Operand> getArgumentRegisters(const std::vector<bool> &is_float);
+
+// Returns the location of the i-th parameter that is passed on the stack.
+Operand getStackParameter(std::size_t index);
+
+// Completes a function whose code is in the blocks of the module from
+// 'entry' to the end, the last of which is its exit: allocates its
+// registers, lays out its frame, inserts the prologue at the start of the
+// entry, and appends the epilogue to the exit. Tail calls leave through the
+// epilogue as well, without its retq.
+void finishFunction(Module &module, std::size_t entry, bool is_leaf,
+                    bool has_stack_parameters, int arrays_size);
+} // namespace codegen_x64
+
+#endif /* end of include guard: FRAMELAYOUT_X64_HPP */
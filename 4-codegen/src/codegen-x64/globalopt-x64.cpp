@@ -0,0 +1,415 @@
+#include "codegen-x64/globalopt-x64.hpp"
+#include "codegen-x64/dataflow-x64.hpp"
+#include "codegen-x64/instrinfo-x64.hpp"
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/Statistic.h"
+
+#include <cstdint>
+#include <vector>
+
+#define DEBUG_TYPE "globalopt-x64"
+
+STATISTIC(NumDeadStoresEliminated,
+          "The number of moves and stores to dead locations eliminated");
+STATISTIC(NumCopiesPropagated,
+          "The number of register reads replaced by the copied register");
+STATISTIC(NumConstantsPropagated,
+          "The number of register reads replaced by a constant");
+STATISTIC(NumLoadsEliminated,
+          "The number of loads from frame slots replaced by register moves");
+STATISTIC(NumStoresEliminated,
+          "The number of stores of a value already in the frame slot removed");
+
+namespace {
+using namespace codegen_x64;
+
+constexpr unsigned int num_registers = Locations::num_registers;
+
+bool isFramePointer(unsigned int reg) { return reg == RSP || reg == RBP; }
+
+// Returns the location of a full 64-bit register that the optimisations may
+// rewrite, or Locations::none.
+unsigned int getRewritableRegister(const Register &reg,
+                                   const Locations &locations) {
+    unsigned int location = locations.getRegister(reg);
+
+    if (location == Locations::none || reg.size != 8 ||
+        isFramePointer(location))
+        return Locations::none;
+
+    return location;
+}
+
+// Returns true if 'reg' belongs to the register class that 'opcode' moves.
+bool isMovedBy(Opcode opcode, unsigned int reg) {
+    return opcode == Opcode::MOVQ ? reg < XMM0 : reg >= XMM0;
+}
+
+// Returns true if operand 0 of the instruction may be an immediate instead
+// of a register.
+bool acceptsImmediate(const Instruction &ins) {
+    switch (ins.opcode) {
+    case Opcode::PUSHQ:
+    case Opcode::MOVQ:
+    case Opcode::ADDQ:
+    case Opcode::SUBQ:
+    case Opcode::ANDQ:
+        return true;
+    case Opcode::CMPQ:
+        return !ins.operands[1].isImmediate();
+    default:
+        return false;
+    }
+}
+
+// A register-to-register move 'mov %source, %dest'.
+struct Copy {
+    unsigned int source = Locations::none;
+    unsigned int dest = Locations::none;
+};
+
+Copy getCopy(const Instruction &ins, const Locations &locations) {
+    if ((ins.opcode != Opcode::MOVQ && ins.opcode != Opcode::MOVSS) ||
+        !ins.operands[0].isRegister() || !ins.operands[1].isRegister())
+        return {};
+
+    unsigned int source = getRewritableRegister(ins.operands[0].reg, locations);
+    unsigned int dest = getRewritableRegister(ins.operands[1].reg, locations);
+
+    if (source == Locations::none || dest == Locations::none ||
+        source == dest || !isMovedBy(ins.opcode, source) ||
+        !isMovedBy(ins.opcode, dest))
+        return {};
+
+    return {source, dest};
+}
+
+// A move between a register and a frame slot: a load 'mov slot, %reg' or a
+// store 'mov %reg, slot'.
+struct SlotMove {
+    bool is_load = false;
+    unsigned int slot = Locations::none;
+    unsigned int reg = Locations::none;
+};
+
+SlotMove getSlotMove(const Instruction &ins, const Locations &locations) {
+    if (ins.opcode != Opcode::MOVQ && ins.opcode != Opcode::MOVSS)
+        return {};
+
+    bool is_load = ins.operands[1].isRegister();
+    const Operand &memory = ins.operands[is_load ? 0 : 1];
+    const Operand &reg = ins.operands[is_load ? 1 : 0];
+
+    if (!reg.isRegister())
+        return {};
+
+    unsigned int slot = locations.getSlot(memory);
+    unsigned int location = getRewritableRegister(reg.reg, locations);
+
+    if (slot == Locations::none || location == Locations::none ||
+        !isMovedBy(ins.opcode, location))
+        return {};
+
+    return {is_load, slot, location};
+}
+
+// Facts of the available copies: 'dest' holds the same value as 'source'.
+unsigned int copyFact(unsigned int source, unsigned int dest) {
+    return source * num_registers + dest;
+}
+
+// Facts of the available values in frame slots: the slot holds the same
+// value as the register, for the size that the register class is moved
+// with.
+unsigned int slotFact(unsigned int slot, unsigned int reg) {
+    return (slot - num_registers) * num_registers + reg;
+}
+} // namespace
+
+bool codegen_x64::eliminateDeadStores(ControlFlowGraph &cfg) {
+    Locations locations{cfg};
+    Liveness liveness{cfg, locations};
+    std::vector<bool> erased(cfg.getNumInstructions(), false);
+    bool changed = false;
+
+    for (unsigned int node = 0; node < cfg.size(); ++node) {
+        llvm::BitVector live = liveness.getLiveOut(node);
+        auto instructions = cfg.getInstructions(node);
+        unsigned int number = cfg.getInstructionNumber(node);
+
+        for (unsigned int i = instructions.size(); i-- > 0;) {
+            const Instruction &ins = instructions[i];
+            unsigned int dest = Locations::none;
+
+            if (isRemovableIfUnused(ins.opcode)) {
+                const Operand &operand = ins.operands[1];
+
+                if (operand.isRegister())
+                    dest = getRewritableRegister(operand.reg, locations);
+                else if (ins.opcode == Opcode::MOVQ ||
+                         ins.opcode == Opcode::MOVSS)
+                    dest = locations.getSlot(operand);
+            }
+
+            // Removing the instruction also removes its uses, so chains of
+            // dead moves are removed at once.
+            if (dest != Locations::none && !live.test(dest)) {
+                erased[number + i] = true;
+                changed = true;
+                ++NumDeadStoresEliminated;
+                continue;
+            }
+
+            liveness.transfer(ins, live);
+        }
+    }
+
+    if (changed)
+        cfg.eraseInstructions(erased);
+
+    return changed;
+}
+
+bool codegen_x64::propagateCopies(ControlFlowGraph &cfg) {
+    Locations locations{cfg};
+    ReachingDefinitions reaching{cfg, locations};
+
+    // The instructions by number, to look up reaching definitions.
+    std::vector<const Instruction *> instructions;
+    for (unsigned int node = 0; node < cfg.size(); ++node) {
+        for (const Instruction &ins : cfg.getInstructions(node))
+            instructions.push_back(&ins);
+    }
+
+    // The copy facts that involve each register.
+    std::vector<llvm::BitVector> involving(
+        num_registers, llvm::BitVector(num_registers * num_registers));
+    for (unsigned int a = 0; a < num_registers; ++a) {
+        for (unsigned int b = 0; b < num_registers; ++b) {
+            involving[a].set(copyFact(a, b));
+            involving[b].set(copyFact(a, b));
+        }
+    }
+
+    auto transfer = [&](const Instruction &ins, llvm::BitVector &copies) {
+        for (unsigned int location : getEffects(ins, locations).defs) {
+            if (location < num_registers)
+                copies.reset(involving[location]);
+        }
+
+        Copy copy = getCopy(ins, locations);
+        if (copy.source != Locations::none)
+            copies.set(copyFact(copy.source, copy.dest));
+    };
+
+    std::vector<llvm::BitVector> available = solveAvailability(
+        cfg, num_registers * num_registers,
+        [&](unsigned int node, llvm::BitVector &copies) {
+            for (const Instruction &ins : cfg.getInstructions(node))
+                transfer(ins, copies);
+        });
+
+    // Returns the register that 'reg' is a copy of, or none.
+    auto findOriginal = [&](const llvm::BitVector &copies,
+                            unsigned int reg) -> unsigned int {
+        for (unsigned int source = 0; source < num_registers; ++source) {
+            if (copies.test(copyFact(source, reg)))
+                return source;
+        }
+
+        return Locations::none;
+    };
+
+    // Returns the constant that 'reg' holds if its only reaching definition
+    // moves a 32-bit immediate into it.
+    auto findConstant = [&](const llvm::BitVector &defs, unsigned int reg,
+                            std::int64_t &value) {
+        unsigned int begin = reaching.getFirstDefinition(reg);
+        unsigned int end = reaching.getFirstDefinition(reg + 1);
+        int def = defs.find_first_in(begin, end);
+
+        if (def < 0 || defs.find_first_in(def + 1, end) >= 0)
+            return false;
+
+        unsigned int number = reaching.getInstruction(def);
+        if (number == Locations::none)
+            return false;
+
+        const Instruction &ins = *instructions[number];
+        if (ins.opcode != Opcode::MOVQ || !ins.operands[0].isImmediate() ||
+            !ins.operands[1].isRegister())
+            return false;
+
+        value = ins.operands[0].value;
+        return value >= INT32_MIN && value <= INT32_MAX;
+    };
+
+    bool changed = false;
+
+    for (unsigned int node : cfg.getReversePostOrder()) {
+        llvm::BitVector copies = available[node];
+        llvm::BitVector defs = reaching.getReachingIn(node);
+        unsigned int number = cfg.getInstructionNumber(node);
+
+        for (Instruction &ins : cfg.getInstructions(node)) {
+            for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+                Operand &operand = ins.operands[k];
+
+                auto replace = [&](Register &reg) {
+                    unsigned int location =
+                        getRewritableRegister(reg, locations);
+                    if (location == Locations::none)
+                        return;
+
+                    unsigned int source = findOriginal(copies, location);
+                    if (source == Locations::none)
+                        return;
+
+                    reg = Register::physical(
+                        static_cast<PhysicalRegister>(source));
+                    changed = true;
+                    ++NumCopiesPropagated;
+                };
+
+                if (operand.isMemory()) {
+                    replace(operand.reg);
+                    replace(operand.index);
+                    continue;
+                }
+
+                if (!operand.isRegister() || getAccess(ins, k) != Access::Read)
+                    continue;
+
+                std::int64_t value;
+                unsigned int location =
+                    getRewritableRegister(operand.reg, locations);
+
+                if (k == 0 && location != Locations::none &&
+                    acceptsImmediate(ins) &&
+                    findConstant(defs, location, value)) {
+                    operand = Operand::immediate(value);
+                    changed = true;
+                    ++NumConstantsPropagated;
+                    continue;
+                }
+
+                replace(operand.reg);
+            }
+
+            transfer(ins, copies);
+            reaching.transfer(number++, defs);
+        }
+    }
+
+    return changed;
+}
+
+bool codegen_x64::eliminateRedundantLoads(ControlFlowGraph &cfg) {
+    Locations locations{cfg};
+    unsigned int num_slots = locations.size() - num_registers;
+    unsigned int num_facts = num_slots * num_registers;
+
+    if (num_slots == 0)
+        return false;
+
+    // The slot facts that involve each register.
+    std::vector<llvm::BitVector> involving(num_registers,
+                                           llvm::BitVector(num_facts));
+    for (unsigned int slot = num_registers; slot < locations.size(); ++slot) {
+        for (unsigned int reg = 0; reg < num_registers; ++reg)
+            involving[reg].set(slotFact(slot, reg));
+    }
+
+    auto killSlot = [&](llvm::BitVector &values, unsigned int slot) {
+        values.reset(slotFact(slot, 0), slotFact(slot, num_registers));
+    };
+
+    auto transfer = [&](const Instruction &ins, llvm::BitVector &values) {
+        Effects effects = getEffects(ins, locations);
+
+        if (effects.writes_memory)
+            values.reset();
+
+        for (unsigned int location : effects.defs) {
+            if (locations.isSlot(location)) {
+                killSlot(values, location);
+                continue;
+            }
+
+            values.reset(involving[location]);
+
+            const auto &based_on = locations.getSlotsBasedOn(location);
+            for (unsigned int slot : based_on.set_bits())
+                killSlot(values, slot);
+        }
+
+        SlotMove move = getSlotMove(ins, locations);
+        if (move.slot != Locations::none)
+            values.set(slotFact(move.slot, move.reg));
+    };
+
+    std::vector<llvm::BitVector> available = solveAvailability(
+        cfg, num_facts, [&](unsigned int node, llvm::BitVector &values) {
+            for (const Instruction &ins : cfg.getInstructions(node))
+                transfer(ins, values);
+        });
+
+    std::vector<bool> erased(cfg.getNumInstructions(), false);
+    bool changed = false;
+
+    for (unsigned int node : cfg.getReversePostOrder()) {
+        llvm::BitVector values = available[node];
+        unsigned int number = cfg.getInstructionNumber(node);
+
+        for (Instruction &ins : cfg.getInstructions(node)) {
+            SlotMove move = getSlotMove(ins, locations);
+            unsigned int current = number++;
+
+            if (move.slot == Locations::none) {
+                transfer(ins, values);
+                continue;
+            }
+
+            // The register that holds the value of the slot, preferring the
+            // register of the move.
+            unsigned int holder = Locations::none;
+
+            if (values.test(slotFact(move.slot, move.reg))) {
+                holder = move.reg;
+            } else if (move.is_load) {
+                for (unsigned int reg = 0; reg < num_registers; ++reg) {
+                    if (isMovedBy(ins.opcode, reg) &&
+                        !isFramePointer(reg) &&
+                        values.test(slotFact(move.slot, reg))) {
+                        holder = reg;
+                        break;
+                    }
+                }
+            }
+
+            // The state after the instruction is the same when it is
+            // rewritten, so the transfer is applied to the original.
+            transfer(ins, values);
+
+            if (holder == Locations::none)
+                continue;
+
+            changed = true;
+
+            if (holder == move.reg) {
+                erased[current] = true;
+                ++(move.is_load ? NumLoadsEliminated : NumStoresEliminated);
+            } else {
+                ins.operands[0] = Operand::physical(
+                    static_cast<PhysicalRegister>(holder));
+                ++NumLoadsEliminated;
+            }
+        }
+    }
+
+    if (changed)
+        cfg.eraseInstructions(erased);
+
+    return changed;
+}
@@ -0,0 +1,30 @@
+#ifndef GLOBALOPT_X64_HPP
+#define GLOBALOPT_X64_HPP
+
+#include "codegen-x64/cfg-x64.hpp"
+
+namespace codegen_x64 {
+// Optimisations over the control-flow graph of a function, built on the
+// data-flow analyses in dataflow-x64.hpp. They run after register
+// allocation, on physical registers and frame slots. Each returns true if it
+// changed the function. Instructions are removed from the module, so the
+// graph must be rebuilt afterwards.
+
+// Removes moves and stores to registers and frame slots that are not live,
+// e.g. the copy of a return value that is only moved again.
+bool eliminateDeadStores(ControlFlowGraph &cfg);
+
+// Replaces reads of a register that holds a copy of another register on all
+// paths by reads of the original register, found by an analysis of the
+// available copies. Reads of a register whose only reaching definition moves
+// a constant into it are replaced by the constant, where the instruction
+// accepts an immediate.
+bool propagateCopies(ControlFlowGraph &cfg);
+
+// Replaces loads from frame slots whose value is already in a register on
+// all paths by register moves, and removes stores of a value that is already
+// in the slot. This mostly removes reloads of spilled registers.
+bool eliminateRedundantLoads(ControlFlowGraph &cfg);
+} // namespace codegen_x64
+
+#endif /* end of include guard: GLOBALOPT_X64_HPP */
@@ -0,0 +1,123 @@
+#include "codegen-x64/instrinfo-x64.hpp"
+
+#include <array>
+
+namespace {
+using namespace codegen_x64;
+
+// Registers used to pass arguments, and registers clobbered by a call.
+const std::array<PhysicalRegister, 14> argument_registers{
+    RDI,  RSI,  RDX,  RCX,  R8,   R9,   XMM0,
+    XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7};
+const std::array<PhysicalRegister, 25> caller_saved_registers{
+    RAX,  RCX,  RDX,   RSI,   RDI,   R8,    R9,    R10,  R11,
+    XMM0, XMM1, XMM2,  XMM3,  XMM4,  XMM5,  XMM6,  XMM7, XMM8,
+    XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15};
+
+// Registers holding the return value, which are read by retq.
+const std::array<PhysicalRegister, 3> return_registers{RAX, XMM0, RSP};
+
+// Registers read by a tail call: the arguments, and the stack pointer, which
+// points at the return address.
+const std::array<PhysicalRegister, 15> tail_call_registers{
+    RDI,  RSI,  RDX,  RCX,  R8,   R9,   XMM0, XMM1,
+    XMM2, XMM3, XMM4, XMM5, XMM6, XMM7, RSP};
+
+const std::array<PhysicalRegister, 1> stack_pointer{RSP};
+const std::array<PhysicalRegister, 1> cqto_uses{RAX};
+const std::array<PhysicalRegister, 1> cqto_defs{RDX};
+const std::array<PhysicalRegister, 2> idivq_registers{RAX, RDX};
+const std::array<PhysicalRegister, 1> imulq_wide_uses{RAX};
+const std::array<PhysicalRegister, 2> imulq_wide_defs{RAX, RDX};
+} // namespace
+
+codegen_x64::Access codegen_x64::getAccess(const Instruction &ins,
+                                           std::size_t index) {
+    const Opcode opcode = ins.opcode;
+    std::size_t num_operands = ins.operands.size();
+
+    if (opcode == Opcode::CALL || opcode == Opcode::TAILJMP || isJump(opcode))
+        return Access::None;
+
+    if (num_operands == 1) {
+        if (opcode == Opcode::POPQ || isSetCondition(opcode))
+            return Access::Write;
+
+        if (opcode == Opcode::NEGQ)
+            return Access::ReadWrite;
+
+        return Access::Read;
+    }
+
+    // All operands except the last one are sources.
+    if (index + 1 < num_operands)
+        return Access::Read;
+
+    switch (opcode) {
+    case Opcode::MOVQ:
+    case Opcode::LEAQ:
+    case Opcode::MOVZBQ:
+    case Opcode::MOVSS:
+    case Opcode::CVTSI2SSQ:
+    case Opcode::CVTTSS2SIQ:
+    case Opcode::MOVQ_XMM:
+    case Opcode::MOVDQU:
+    case Opcode::MOVUPS:
+    case Opcode::MOVAPS:
+    case Opcode::PSHUFD:
+        return Access::Write;
+    case Opcode::CMPQ:
+    case Opcode::UCOMISS:
+        return Access::Read;
+    default:
+        return Access::ReadWrite;
+    }
+}
+
+llvm::ArrayRef<codegen_x64::PhysicalRegister>
+codegen_x64::getImplicitUses(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::CALL:
+        return argument_registers;
+    case Opcode::RETQ:
+        return return_registers;
+    case Opcode::TAILJMP:
+        return tail_call_registers;
+    case Opcode::CQTO:
+        return cqto_uses;
+    case Opcode::IDIVQ:
+        return idivq_registers;
+    case Opcode::IMULQ_WIDE:
+        return imulq_wide_uses;
+    case Opcode::PUSHQ:
+    case Opcode::POPQ:
+        return stack_pointer;
+    default:
+        return {};
+    }
+}
+
+llvm::ArrayRef<codegen_x64::PhysicalRegister>
+codegen_x64::getImplicitDefs(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::CALL:
+        return caller_saved_registers;
+    case Opcode::CQTO:
+        return cqto_defs;
+    case Opcode::IDIVQ:
+        return idivq_registers;
+    case Opcode::IMULQ_WIDE:
+        return imulq_wide_defs;
+    case Opcode::PUSHQ:
+    case Opcode::POPQ:
+        return stack_pointer;
+    default:
+        return {};
+    }
+}
+
+bool codegen_x64::isRemovableIfUnused(Opcode opcode) {
+    // Arithmetic also sets the flags, which are not tracked.
+    return opcode == Opcode::MOVQ || opcode == Opcode::MOVSS ||
+           opcode == Opcode::LEAQ || opcode == Opcode::MOVZBQ;
+}
@@ -0,0 +1,32 @@
+#ifndef INSTRINFO_X64_HPP
+#define INSTRINFO_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <cstddef>
+
+namespace codegen_x64 {
+// Information about the registers that instructions access, shared by the
+// register allocator and the optimiser.
+
+// How an instruction accesses one of its operands.
+enum class Access { None, Read, Write, ReadWrite };
+
+// Returns how the instruction accesses operand 'index'. For memory operands,
+// this is the access to the memory; the registers in the address are read.
+Access getAccess(const Instruction &ins, std::size_t index);
+
+// Returns the physical registers that the instruction reads or writes without
+// naming them as operands, e.g. the argument registers of a call, or %rdx for
+// cqto.
+llvm::ArrayRef<PhysicalRegister> getImplicitUses(Opcode opcode);
+llvm::ArrayRef<PhysicalRegister> getImplicitDefs(Opcode opcode);
+
+// Returns true if the instruction only writes its destination operand, and
+// has no other effects, so that it can be removed if the value is not used.
+bool isRemovableIfUnused(Opcode opcode);
+} // namespace codegen_x64
+
+#endif /* end of include guard: INSTRINFO_X64_HPP */
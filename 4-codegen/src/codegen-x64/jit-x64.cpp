@@ -0,0 +1,222 @@
+#include "codegen-x64/jit-x64.hpp"
+#include "codegen-x64/codegenexception.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ios>
+#include <iostream>
+#include <sys/mman.h>
+
+#define DEBUG_TYPE "jit-x64"
+
+STATISTIC(NumRuntimeStubs, "The number of stubs to runtime functions");
+
+namespace {
+using namespace codegen_x64;
+
+// The micro-C standard library, for programs run in-process. These mirror
+// src/runtime/runtime.cpp, but are not exported under their C names, as e.g.
+// 'read' would clash with the C library of the compiler.
+void print(std::int64_t i) { std::cout << i << "\n"; }
+
+std::int64_t read() {
+    std::int64_t i;
+    std::cout << "> ";
+    std::cin >> i;
+
+    return i;
+}
+
+void print8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
+            std::int64_t arg3, std::int64_t arg4, std::int64_t arg5,
+            std::int64_t arg6, std::int64_t arg7) {
+    std::cout << arg0 << " " << arg1 << " " << arg2 << " " << arg3 << " "
+              << arg4 << " " << arg5 << " " << arg6 << " " << arg7 << "\n";
+}
+
+std::int64_t sum8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
+                  std::int64_t arg3, std::int64_t arg4, std::int64_t arg5,
+                  std::int64_t arg6, std::int64_t arg7) {
+    return arg0 + arg1 + arg2 + arg3 + arg4 + arg5 + arg6 + arg7;
+}
+
+void print_f(float f) { std::cout << std::showpoint << f << "\n"; }
+
+float read_f() {
+    float f;
+    std::cout << "> ";
+    std::cin >> f;
+
+    return f;
+}
+
+// A stub is 'jmpq *0(%rip)', followed by the address of the function.
+constexpr std::size_t stub_size = 16;
+constexpr std::uint8_t stub_code[] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+
+// Returns the address of a function of the runtime or the C library.
+void *getRuntimeFunction(const std::string &name) {
+    static const std::unordered_map<std::string, void *> runtime{
+        {"print", reinterpret_cast<void *>(&print)},
+        {"read", reinterpret_cast<void *>(&read)},
+        {"print8", reinterpret_cast<void *>(&print8)},
+        {"sum8", reinterpret_cast<void *>(&sum8)},
+        {"print_f", reinterpret_cast<void *>(&print_f)},
+        {"read_f", reinterpret_cast<void *>(&read_f)},
+    };
+
+    auto it = runtime.find(name);
+
+    if (it != std::end(runtime))
+        return it->second;
+
+    // Other functions, e.g. 'fmodf' for '%' on floats, come from the
+    // libraries of the compiler.
+    static bool loaded =
+        !llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    void *address =
+        loaded ? llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(name)
+               : nullptr;
+
+    if (!address)
+        throw CodegenException(
+            fmt::format("Call to unknown function '{}'", name));
+
+    return address;
+}
+
+std::size_t alignTo(std::size_t offset, std::size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+codegen_x64::JITX64::~JITX64() { unload(); }
+
+void codegen_x64::JITX64::unload() {
+    if (memory)
+        munmap(memory, size);
+
+    memory = nullptr;
+    size = 0;
+    functions.clear();
+}
+
+void codegen_x64::JITX64::load(const Module &module) {
+    llvm::NamedRegionTimer timer("jit-x64", "Loading for -run", "codegen-x64",
+                                 "x64 code generator",
+                                 llvm::TimePassesIsEnabled);
+
+    unload();
+
+    EncoderX64 encoder;
+    ObjectCode object = encoder.encode(module);
+
+    // The layout of the memory: the code, the stubs, and the constants.
+    std::size_t stubs = alignTo(object.text.size(), stub_size);
+    std::size_t rodata =
+        alignTo(stubs + object.undefined.size() * stub_size, 16);
+    std::size_t page_size = llvm::sys::Process::getPageSizeEstimate();
+    std::size_t mapped_size =
+        alignTo(std::max<std::size_t>(rodata + object.rodata.size(), 1),
+                page_size);
+
+    void *mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapped == MAP_FAILED)
+        throw CodegenException(
+            fmt::format("Cannot map memory: {}", std::strerror(errno)));
+
+    memory = static_cast<std::uint8_t *>(mapped);
+    size = mapped_size;
+
+    std::memcpy(memory, object.text.data(), object.text.size());
+    std::memcpy(memory + rodata, object.rodata.data(), object.rodata.size());
+
+    std::unordered_map<Symbol, std::uint8_t *> addresses;
+
+    for (const auto &function : object.functions)
+        addresses[function.name] = memory + function.offset;
+
+    for (const auto &constant : object.constants)
+        addresses[constant.first] = memory + rodata + constant.second;
+
+    for (std::size_t i = 0; i < object.undefined.size(); ++i) {
+        Symbol symbol = object.undefined[i];
+        std::uint8_t *stub = memory + stubs + i * stub_size;
+        void *target = getRuntimeFunction(module.getSymbolName(symbol));
+
+        std::memcpy(stub, stub_code, sizeof(stub_code));
+        std::memcpy(stub + sizeof(stub_code), &target, sizeof(target));
+        addresses[symbol] = stub;
+
+        ++NumRuntimeStubs;
+    }
+
+    // All references are 32-bit and relative to the program counter, which
+    // is enough as everything is in the same mapping.
+    for (const auto &relocation : object.relocations) {
+        if (relocation.type != llvm::ELF::R_X86_64_PC32 &&
+            relocation.type != llvm::ELF::R_X86_64_PLT32)
+            throw CodegenException("Unsupported relocation");
+
+        std::uint8_t *location = memory + relocation.offset;
+        std::int32_t value = static_cast<std::int32_t>(
+            addresses.at(relocation.symbol) + relocation.addend - location);
+
+        std::memcpy(location, &value, sizeof(value));
+    }
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+        throw CodegenException(fmt::format(
+            "Cannot make memory executable: {}", std::strerror(errno)));
+
+    for (const auto &function : object.functions)
+        functions[module.getSymbolName(function.name)] =
+            memory + function.offset;
+
+    if (write_perf_map)
+        writePerfMap(module, object);
+}
+
+std::int64_t codegen_x64::JITX64::run(const std::string &function) {
+    auto it = functions.find(function);
+
+    if (it == std::end(functions))
+        throw CodegenException(
+            fmt::format("Function '{}' is not defined", function));
+
+    auto *entry = reinterpret_cast<std::int64_t (*)()>(it->second);
+
+    return entry();
+}
+
+void codegen_x64::JITX64::writePerfMap(const Module &module,
+                                       const ObjectCode &object) {
+    std::string filename =
+        fmt::format("/tmp/perf-{}.map", llvm::sys::Process::getProcessId());
+    std::error_code ec;
+    llvm::raw_fd_ostream os(filename, ec, llvm::sys::fs::OF_Append);
+
+    if (ec)
+        throw CodegenException(
+            fmt::format("Cannot open '{}': {}", filename, ec.message()));
+
+    for (const auto &function : object.functions)
+        os << fmt::format("{:x} {:x} {}\n",
+                          reinterpret_cast<std::uintptr_t>(memory) +
+                              function.offset,
+                          function.size, module.getSymbolName(function.name));
+}
@@ -0,0 +1,51 @@
+#ifndef JIT_X64_HPP
+#define JIT_X64_HPP
+
+#include "codegen-x64/encoder-x64.hpp"
+#include "codegen-x64/module.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace codegen_x64 {
+// Runs the code of a module in the process of the compiler. The module is
+// encoded with EncoderX64 and loaded into memory that is mapped executable
+// after the relocations are applied. Calls to the Micro-C runtime go to a
+// copy of it in the compiler, through a stub per function, as the compiler
+// may be too far away for a 32-bit displacement.
+//
+// If 'write_perf_map' is set, the functions are listed in
+// /tmp/perf-<pid>.map, so that perf can name them in its profiles.
+class JITX64 {
+  public:
+    explicit JITX64(bool write_perf_map = false)
+        : write_perf_map(write_perf_map) {}
+    ~JITX64();
+
+    JITX64(const JITX64 &) = delete;
+    JITX64 &operator=(const JITX64 &) = delete;
+
+    // Loads a module, and unloads the previous one. Throws a
+    // CodegenException if the module calls an unknown function.
+    void load(const Module &module);
+
+    // Calls a function without parameters of the loaded module, and returns
+    // its result.
+    std::int64_t run(const std::string &function);
+
+  private:
+    void unload();
+    void writePerfMap(const Module &module, const ObjectCode &object);
+
+    bool write_perf_map;
+
+    std::uint8_t *memory = nullptr;
+    std::size_t size = 0;
+
+    std::unordered_map<std::string, std::uint8_t *> functions;
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: JIT_X64_HPP */
@@ -0,0 +1,438 @@
+#include "codegen-x64/layout-x64.hpp"
+#include "codegen-x64/cfg-x64.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Timer.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define DEBUG_TYPE "layout-x64"
+
+STATISTIC(NumLoopsRotated, "The number of loops rotated");
+STATISTIC(NumConditionsDuplicated,
+          "The number of loop conditions duplicated in front of their loop");
+STATISTIC(NumJumpsInverted,
+          "The number of conditional jumps inverted to fall through");
+STATISTIC(NumJumpsRemoved, "The number of jumps to the next node removed");
+STATISTIC(NumLoopsAligned, "The number of loop headers aligned");
+
+llvm::cl::opt<bool> BlockLayout(
+    "x64-block-layout",
+    llvm::cl::desc("Rotate loops, and lay out the code so that the common "
+                   "path falls through (default: true)"),
+    llvm::cl::init(true));
+
+llvm::cl::opt<bool>
+    AlignLoops("x64-align-loops",
+               llvm::cl::desc("Align loop headers to 16 bytes with "
+                              "-x64-block-layout (default: true)"),
+               llvm::cl::init(true));
+
+namespace {
+using namespace codegen_x64;
+
+constexpr unsigned int no_node = UINT_MAX;
+
+// Loop conditions of at most this many instructions, without calls, are
+// duplicated in front of their loop.
+constexpr std::size_t max_duplicated_condition = 6;
+
+// Loop headers are aligned to 2^loop_alignment bytes.
+constexpr std::uint8_t loop_alignment = 4;
+
+// How control leaves a node: into the next node, with a jmp, with a
+// conditional jump or into the next node, or out of the function.
+enum class Exit { FallThrough, Jump, Branch, Return };
+
+// A node of the control-flow graph, without the jump that leaves it. That
+// jump is added again once the nodes are placed.
+struct LayoutNode {
+    // The label, comment and location of the basic block that starts with
+    // the node, if any.
+    Symbol label = Operand::no_symbol;
+    std::string comment;
+    bool is_global = false;
+    Location location;
+
+    std::vector<Instruction> instructions;
+
+    Exit exit = Exit::FallThrough;
+
+    // The jump that leaves the node, and its comment and location.
+    Opcode opcode = Opcode::JMP;
+    std::string jump_comment;
+    Location jump_location;
+
+    // The node that is jumped to, and the node that is fallen through to.
+    unsigned int target = no_node;
+    unsigned int next = no_node;
+};
+
+// A jump added after a node when it is placed.
+struct LayoutJump {
+    Opcode opcode;
+    unsigned int target;
+    std::string comment;
+    Location location;
+};
+
+class FunctionLayout {
+  public:
+    FunctionLayout(Module &module, FunctionRange function)
+        : module(module), function(function) {}
+
+    // Splits the function into nodes. Returns false if the function jumps to
+    // a label outside of it, or falls through past its end.
+    bool build();
+
+    // Removes empty and unreachable nodes, and rotates the loops.
+    void optimise();
+
+    // Returns the basic blocks of the function, in the new order.
+    std::vector<BasicBlock> emit();
+
+  private:
+    // Returns the first node reached from a node that is not empty.
+    unsigned int skipEmpty(unsigned int node) const;
+
+    // Rotates the loop with its header at the given position in the order,
+    // if there is one. Returns false if nothing changed.
+    bool rotateLoop(std::size_t position);
+
+    Module &module;
+    FunctionRange function;
+
+    std::vector<LayoutNode> nodes;
+    std::vector<unsigned int> order;
+};
+
+bool FunctionLayout::build() {
+    ControlFlowGraph cfg{module, function};
+    std::unordered_map<Symbol, unsigned int> block_nodes;
+
+    for (unsigned int n = 0; n < cfg.size(); ++n) {
+        if (cfg[n].first == 0)
+            block_nodes.emplace(module.blocks[cfg[n].block].label, n);
+    }
+
+    for (unsigned int n = 0; n < cfg.size(); ++n) {
+        const BasicBlock &block = module.blocks[cfg[n].block];
+        auto instructions = cfg.getInstructions(n);
+        LayoutNode node;
+
+        if (cfg[n].first == 0) {
+            node.label = block.label;
+            node.comment = block.comment;
+            node.is_global = block.is_global;
+            node.location = block.location;
+        }
+
+        node.instructions.assign(std::begin(instructions),
+                                 std::end(instructions));
+        node.next = n + 1 < cfg.size() ? n + 1 : no_node;
+
+        if (!instructions.empty()) {
+            const Instruction &last = instructions.back();
+
+            if (isReturn(last.opcode)) {
+                node.exit = Exit::Return;
+            } else if (isJump(last.opcode)) {
+                auto it = block_nodes.find(last.operands[0].symbol);
+                if (it == std::end(block_nodes))
+                    return false;
+
+                node.exit =
+                    last.opcode == Opcode::JMP ? Exit::Jump : Exit::Branch;
+                node.opcode = last.opcode;
+                node.jump_comment = last.comment;
+                node.jump_location = last.location;
+                node.target = it->second;
+                node.instructions.pop_back();
+            }
+        }
+
+        if ((node.exit == Exit::FallThrough || node.exit == Exit::Branch) &&
+            node.next == no_node)
+            return false;
+
+        nodes.push_back(std::move(node));
+    }
+
+    return !nodes.empty();
+}
+
+unsigned int FunctionLayout::skipEmpty(unsigned int node) const {
+    // Empty loops are followed at most once around.
+    for (std::size_t steps = 0; steps < nodes.size(); ++steps) {
+        const LayoutNode &n = nodes[node];
+
+        if (!n.instructions.empty() || n.is_global)
+            break;
+
+        if (n.exit == Exit::FallThrough)
+            node = n.next;
+        else if (n.exit == Exit::Jump)
+            node = n.target;
+        else
+            break;
+    }
+
+    return node;
+}
+
+void FunctionLayout::optimise() {
+    // Jumps and fallthroughs into empty nodes go to where those lead.
+    for (auto &node : nodes) {
+        if (node.exit == Exit::Jump || node.exit == Exit::Branch)
+            node.target = skipEmpty(node.target);
+        if (node.exit == Exit::FallThrough || node.exit == Exit::Branch)
+            node.next = skipEmpty(node.next);
+    }
+
+    // Keep the reachable nodes in their original order.
+    std::vector<bool> reachable(nodes.size(), false);
+    std::vector<unsigned int> worklist{0};
+    reachable[0] = true;
+
+    while (!worklist.empty()) {
+        const LayoutNode &node = nodes[worklist.back()];
+        worklist.pop_back();
+
+        for (unsigned int succ : {node.target, node.next}) {
+            bool follows = succ == node.target
+                               ? node.exit == Exit::Jump ||
+                                     node.exit == Exit::Branch
+                               : node.exit == Exit::FallThrough ||
+                                     node.exit == Exit::Branch;
+
+            if (follows && !reachable[succ]) {
+                reachable[succ] = true;
+                worklist.push_back(succ);
+            }
+        }
+    }
+
+    for (unsigned int n = 0; n < nodes.size(); ++n) {
+        if (reachable[n])
+            order.push_back(n);
+    }
+
+    // The entry node stays first.
+    for (std::size_t position = 1; position < order.size();) {
+        if (!rotateLoop(position))
+            ++position;
+    }
+}
+
+bool FunctionLayout::rotateLoop(std::size_t position) {
+    unsigned int header = order[position];
+    const LayoutNode &node = nodes[header];
+
+    // The header must test the loop condition, and fall through into the
+    // body if it holds.
+    if (node.exit != Exit::Branch || position + 1 >= order.size() ||
+        node.next != order[position + 1] ||
+        invertJump(node.opcode) == node.opcode)
+        return false;
+
+    // The latch is the last node that jumps back to the header.
+    std::size_t latch = position;
+
+    for (std::size_t p = order.size(); p-- > position + 1;) {
+        const LayoutNode &n = nodes[order[p]];
+
+        if (n.exit == Exit::Jump && n.target == header) {
+            latch = p;
+            break;
+        }
+    }
+
+    if (latch == position)
+        return false;
+
+    std::vector<bool> in_loop(nodes.size() + 1, false);
+    for (std::size_t p = position; p <= latch; ++p)
+        in_loop[order[p]] = true;
+
+    // The header must leave the loop if the condition does not hold.
+    if (in_loop[node.target])
+        return false;
+
+    // Move the header below the latch, which then falls through into it.
+    order.erase(std::begin(order) + position);
+    order.insert(std::begin(order) + latch, header);
+    ++NumLoopsRotated;
+
+    bool has_call = std::any_of(
+        std::begin(node.instructions), std::end(node.instructions),
+        [](const Instruction &ins) { return ins.opcode == Opcode::CALL; });
+
+    if (node.instructions.size() > max_duplicated_condition || has_call)
+        return true;
+
+    // Test the condition once in front of the loop as well, and enter the
+    // loop there from outside of it, instead of jumping to the header.
+    LayoutNode guard = node;
+    guard.label = Operand::no_symbol;
+    guard.comment.clear();
+
+    unsigned int guard_node = nodes.size();
+    nodes.push_back(std::move(guard));
+    order.insert(std::begin(order) + position, guard_node);
+    ++NumConditionsDuplicated;
+
+    for (unsigned int n = 0; n < guard_node; ++n) {
+        if (in_loop[n])
+            continue;
+
+        LayoutNode &pred = nodes[n];
+
+        if (pred.target == header &&
+            (pred.exit == Exit::Jump || pred.exit == Exit::Branch))
+            pred.target = guard_node;
+        if (pred.next == header &&
+            (pred.exit == Exit::FallThrough || pred.exit == Exit::Branch))
+            pred.next = guard_node;
+    }
+
+    return true;
+}
+
+std::vector<BasicBlock> FunctionLayout::emit() {
+    std::vector<std::vector<LayoutJump>> jumps(order.size());
+    std::vector<bool> has_label(nodes.size(), false);
+    std::vector<bool> is_loop_header(nodes.size(), false);
+    std::vector<std::size_t> positions(nodes.size(), order.size());
+
+    for (std::size_t p = 0; p < order.size(); ++p)
+        positions[order[p]] = p;
+
+    has_label[order[0]] = true;
+
+    for (std::size_t p = 0; p < order.size(); ++p) {
+        const LayoutNode &node = nodes[order[p]];
+        unsigned int following = p + 1 < order.size() ? order[p + 1] : no_node;
+        auto &added = jumps[p];
+
+        switch (node.exit) {
+        case Exit::FallThrough:
+            if (node.next != following)
+                added.push_back({Opcode::JMP, node.next,
+                                 "Jump to fallthrough successor", {}});
+            break;
+        case Exit::Jump:
+            if (node.target != following)
+                added.push_back({Opcode::JMP, node.target, node.jump_comment,
+                                 node.jump_location});
+            else
+                ++NumJumpsRemoved;
+            break;
+        case Exit::Branch:
+            if (node.next == following) {
+                added.push_back({node.opcode, node.target, node.jump_comment,
+                                 node.jump_location});
+            } else if (node.target == following) {
+                added.push_back(
+                    {invertJump(node.opcode), node.next,
+                     fmt::format("Inverted: {}", node.jump_comment),
+                     node.jump_location});
+                ++NumJumpsInverted;
+            } else {
+                added.push_back({node.opcode, node.target, node.jump_comment,
+                                 node.jump_location});
+                added.push_back({Opcode::JMP, node.next,
+                                 "Jump to fallthrough successor", {}});
+            }
+            break;
+        case Exit::Return:
+            break;
+        }
+
+        for (const auto &jump : added) {
+            has_label[jump.target] = true;
+
+            if (positions[jump.target] <= p)
+                is_loop_header[jump.target] = true;
+        }
+    }
+
+    // Nodes keep the label of their basic block, and nodes from the middle
+    // of a block get a new one if they are jumped to.
+    std::string name = module.getSymbolName(nodes[order[0]].label);
+    unsigned int num_labels = 0;
+
+    for (unsigned int n : order) {
+        if (has_label[n] && nodes[n].label == Operand::no_symbol)
+            nodes[n].label =
+                module.getSymbol(fmt::format(".{}.{}", name, num_labels++));
+    }
+
+    std::vector<BasicBlock> blocks;
+
+    for (std::size_t p = 0; p < order.size(); ++p) {
+        LayoutNode &node = nodes[order[p]];
+
+        if (node.label != Operand::no_symbol) {
+            blocks.emplace_back(node.label, node.comment, node.is_global);
+            blocks.back().location = node.location;
+
+            if (AlignLoops && is_loop_header[order[p]]) {
+                blocks.back().p2align = loop_alignment;
+                ++NumLoopsAligned;
+            }
+        }
+
+        auto &instructions = blocks.back().instructions;
+        std::move(std::begin(node.instructions), std::end(node.instructions),
+                  std::back_inserter(instructions));
+
+        for (const auto &jump : jumps[p]) {
+            instructions.push_back(
+                Instruction{jump.opcode,
+                            {Operand::label(nodes[jump.target].label)},
+                            jump.comment});
+            instructions.back().location = jump.location;
+        }
+    }
+
+    return blocks;
+}
+} // namespace
+
+void codegen_x64::BlockLayoutX64::layout(Module &module) {
+    if (!BlockLayout)
+        return;
+
+    llvm::NamedRegionTimer timer("layout-x64", "Block layout", "codegen-x64",
+                                 "x64 code generator",
+                                 llvm::TimePassesIsEnabled);
+
+    // Later functions first, so that the ranges of the earlier ones stay
+    // valid.
+    std::vector<FunctionRange> functions = getFunctions(module);
+
+    for (auto it = std::rbegin(functions); it != std::rend(functions); ++it) {
+        FunctionLayout function{module, *it};
+
+        if (!function.build())
+            continue;
+
+        function.optimise();
+        std::vector<BasicBlock> blocks = function.emit();
+
+        auto begin = std::begin(module.blocks) + it->begin;
+        module.blocks.erase(begin, std::begin(module.blocks) + it->end);
+        module.blocks.insert(std::begin(module.blocks) + it->begin,
+                             std::make_move_iterator(std::begin(blocks)),
+                             std::make_move_iterator(std::end(blocks)));
+    }
+}
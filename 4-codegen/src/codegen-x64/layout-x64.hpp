@@ -0,0 +1,30 @@
+#ifndef LAYOUT_X64_HPP
+#define LAYOUT_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+namespace codegen_x64 {
+// Orders the code of each function after register allocation and
+// optimisation, so that the common path falls through. The function is split
+// into the nodes of its control-flow graph, which are laid out again in their
+// original order, except that:
+//
+//   - Loops are rotated: the loop condition, which the code generator emits
+//     at the top with a jump out of the loop, is moved below the body, with a
+//     single backward conditional jump. Small conditions are duplicated in
+//     front of the loop, which then needs no jump to enter it.
+//   - Conditional jumps to the next node are inverted, so that they jump
+//     where the fallthrough went instead.
+//   - Jumps to the next node, empty nodes, and unreachable code are removed.
+//
+// Jumps are then added where a node does not fall through into its
+// successor, and labels where they are jumped to. Loop headers, i.e. the
+// targets of backward jumps, are aligned to 16 bytes. Functions with jumps to
+// labels outside of the function are left alone.
+class BlockLayoutX64 {
+  public:
+    void layout(Module &module);
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: LAYOUT_X64_HPP */
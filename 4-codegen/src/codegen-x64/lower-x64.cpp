@@ -0,0 +1,806 @@
+#include "codegen-x64/lower-x64.hpp"
+#include "codegen-x64/codegenexception.hpp"
+#include "codegen-x64/framelayout-x64.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Timer.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#define DEBUG_TYPE "lower-x64"
+
+STATISTIC(NumPhiCopies, "The number of copies inserted for phis");
+STATISTIC(NumFusedComparisons,
+          "The number of comparisons emitted as a conditional jump");
+STATISTIC(NumSiblingCalls, "The number of calls in SSA form emitted as jmp");
+
+extern llvm::cl::opt<bool> TailCalls;
+
+namespace {
+using codegen_x64::Opcode;
+
+bool fitsInt32(std::int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Returns the comment of an instruction lowered from an SSA instruction.
+std::string comment(const std::string &text, ssa::Opcode opcode) {
+    return fmt::format("{} [{}]", text, ssa::getOpcodeName(opcode));
+}
+} // namespace
+
+codegen_x64::Module codegen_x64::LoweringX64::lower(
+    const ssa::Module &ssa_module) {
+    llvm::NamedRegionTimer timer("lower-x64", "Lowering of SSA form",
+                                 "codegen-x64", "x64 code generator",
+                                 llvm::TimePassesIsEnabled);
+
+    module = Module{};
+    float_constants.clear();
+
+    for (const auto &ssa_function : ssa_module.functions)
+        lowerFunction(*ssa_function);
+
+    return std::move(module);
+}
+
+void codegen_x64::LoweringX64::lowerFunction(
+    const ssa::Function &ssa_function) {
+    function = &ssa_function;
+    vregs.clear();
+    phi_copies.clear();
+    labels.clear();
+    num_uses.clear();
+    array_offsets.clear();
+    arrays_size = 0;
+    num_vregs = 0;
+    has_calls = false;
+
+    const std::string &name = ssa_function.name;
+
+    // Arrays are laid out as in CodeGeneratorX64::visitArrayDecl.
+    for (const auto &array : ssa_function.arrays) {
+        std::int64_t size = arrays_size + (array.type == ssa::Type::Float
+                                               ? 4 * std::int64_t{array.size}
+                                               : 8 * std::int64_t{array.size});
+        size = (size + 7) & ~std::int64_t{7};
+
+        if (size > FrameLayoutX64::max_frame_size)
+            throw CodegenException(fmt::format(
+                "Array '{}' does not fit in the stack frame", array.name));
+
+        arrays_size = static_cast<int>(size);
+        array_offsets.push_back(-arrays_size);
+    }
+
+    for (const auto &block : ssa_function.blocks) {
+        labels[block.get()] =
+            block.get() == ssa_function.getEntry()
+                ? module.getSymbol(name)
+                : module.getSymbol(fmt::format(".{}.{}", name, block->name));
+
+        for (const auto &ins : block->instructions) {
+            for (const ssa::Instruction *operand : ins->operands)
+                ++num_uses[operand];
+        }
+    }
+
+    function_exit = module.getSymbol(fmt::format(".{}.exit", name));
+
+    std::vector<bool> is_float;
+    for (ssa::Type type : ssa_function.parameters)
+        is_float.push_back(type == ssa::Type::Float);
+
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+    std::vector<Operand> parameters;
+    std::size_t stack_parameters = 0;
+
+    for (const auto &reg : registers)
+        parameters.push_back(reg ? reg
+                                 : getStackParameter(stack_parameters++));
+
+    std::size_t entry = module.blocks.size();
+
+    for (const auto &block : ssa_function.blocks) {
+        bool is_entry = block.get() == ssa_function.getEntry();
+
+        module << BasicBlock{
+            labels[block.get()],
+            is_entry ? fmt::format("Entry point of function '{}'", name)
+                     : fmt::format("Block '{}'", block->name),
+            is_entry};
+
+        // Parameters are read before anything can clobber their registers.
+        for (const auto &ins : block->instructions) {
+            if (ins->opcode == ssa::Opcode::Param)
+                emitMove(parameters[ins->value], vreg(ins.get()),
+                         is_float[ins->value],
+                         fmt::format("Load parameter {} [param]", ins->value));
+        }
+
+        for (const auto &ins : block->instructions) {
+            if (ins->opcode == ssa::Opcode::Phi) {
+                auto [copy, inserted] = phi_copies.try_emplace(ins.get());
+                if (inserted)
+                    copy->second = ins->type == ssa::Type::Float
+                                       ? newFloatRegister()
+                                       : newVirtualRegister();
+
+                emitMove(copy->second, vreg(ins.get()),
+                         ins->type == ssa::Type::Float,
+                         comment("Copy into phi", ssa::Opcode::Phi));
+            } else if (ins->opcode != ssa::Opcode::Const &&
+                       ins->opcode != ssa::Opcode::Param &&
+                       !ssa::isTerminator(ins->opcode)) {
+                lowerInstruction(*ins);
+            }
+        }
+
+        // Pass the values of the phis of the successors, once for each
+        // successor that is branched to twice.
+        std::vector<ssa::BasicBlock *> successors = block->getSuccessors();
+        successors.erase(std::unique(std::begin(successors),
+                                     std::end(successors)),
+                         std::end(successors));
+
+        for (const ssa::BasicBlock *succ : successors) {
+            for (const auto &phi : succ->instructions) {
+                if (phi->opcode != ssa::Opcode::Phi)
+                    break;
+
+                auto it = std::find(std::begin(phi->blocks),
+                                    std::end(phi->blocks), block.get());
+                const ssa::Instruction *value =
+                    phi->operands[it - std::begin(phi->blocks)];
+                bool phi_float = phi->type == ssa::Type::Float;
+
+                auto [copy, inserted] = phi_copies.try_emplace(phi.get());
+                if (inserted)
+                    copy->second = phi_float ? newFloatRegister()
+                                             : newVirtualRegister();
+
+                emitMove(operand(value), copy->second, phi_float,
+                         comment(fmt::format("Pass value to phi in '{}'",
+                                             succ->name),
+                                 ssa::Opcode::Phi));
+                ++NumPhiCopies;
+            }
+        }
+
+        lowerTerminator(*block);
+    }
+
+    module << BasicBlock{function_exit,
+                         fmt::format("Exit point of function '{}'", name)};
+
+    finishFunction(module, entry, !has_calls, stack_parameters != 0,
+                   arrays_size);
+}
+
+void codegen_x64::LoweringX64::lowerInstruction(const ssa::Instruction &ins) {
+    bool is_float = ins.type == ssa::Type::Float;
+
+    switch (ins.opcode) {
+    case ssa::Opcode::Copy:
+        emitMove(operand(ins.operands[0]), vreg(&ins), is_float,
+                 comment("Copy", ins.opcode));
+        return;
+    case ssa::Opcode::Load:
+        emitMove(arrayElement(ins.value, ins.operands[0]), vreg(&ins),
+                 is_float, comment("Load array element", ins.opcode));
+        return;
+    case ssa::Opcode::Store: {
+        Operand element = arrayElement(ins.value, ins.operands[0]);
+        Operand value = operand(ins.operands[1]);
+        bool float_value = ins.operands[1]->type == ssa::Type::Float;
+
+        if (float_value)
+            value = materialise(value, true);
+
+        emitMove(value, element, float_value,
+                 comment("Store array element", ins.opcode));
+        return;
+    }
+    case ssa::Opcode::Call:
+        lowerCall(ins);
+        return;
+    default:
+        break;
+    }
+
+    // Comparisons that are only used by a branch are emitted there.
+    if (isFusedComparison(ins))
+        return;
+
+    if (ins.operands[0]->type == ssa::Type::Float)
+        lowerFloatOperation(ins);
+    else
+        lowerIntOperation(ins);
+}
+
+void codegen_x64::LoweringX64::lowerIntOperation(const ssa::Instruction &ins) {
+    Operand lhs = operand(ins.operands[0]);
+    Operand rhs =
+        ins.operands.size() > 1 ? operand(ins.operands[1]) : Operand{};
+    Operand result = vreg(&ins);
+    std::string text = comment(
+        fmt::format("Compute '{}'", ssa::getOpcodeName(ins.opcode)),
+        ins.opcode);
+
+    switch (ins.opcode) {
+    case ssa::Opcode::Add:
+    case ssa::Opcode::Sub:
+    case ssa::Opcode::Mul: {
+        Opcode opcode = ins.opcode == ssa::Opcode::Add   ? Opcode::ADDQ
+                        : ins.opcode == ssa::Opcode::Sub ? Opcode::SUBQ
+                                                         : Opcode::IMULQ;
+
+        module << Instruction{
+            Opcode::MOVQ, {lhs, result}, comment("Load lhs", ins.opcode)};
+        module << Instruction{opcode, {rhs, result}, text};
+        return;
+    }
+    case ssa::Opcode::Div:
+    case ssa::Opcode::Rem: {
+        // See CodeGeneratorX64::visitBinaryOpExpr.
+        Operand divisor = rhs.isImmediate() ? materialise(rhs) : rhs;
+
+        module << Instruction{Opcode::MOVQ,
+                              {lhs, Operand::physical(RAX)},
+                              comment("Load dividend", ins.opcode)};
+        module << Instruction{
+            Opcode::CQTO, {},
+            comment("Sign-extend dividend into %rdx", ins.opcode)};
+        module << Instruction{
+            Opcode::IDIVQ, {divisor}, comment("Divide", ins.opcode)};
+        module << Instruction{
+            Opcode::MOVQ,
+            {Operand::physical(ins.opcode == ssa::Opcode::Div ? RAX : RDX),
+             result},
+            comment(ins.opcode == ssa::Opcode::Div ? "Store quotient"
+                                                   : "Store remainder",
+                    ins.opcode)};
+        return;
+    }
+    case ssa::Opcode::Pow: {
+        // Integer powers are computed in single precision, as in the LLVM
+        // backend.
+        Operand base = newFloatRegister();
+        Operand exponent = newFloatRegister();
+
+        module << Instruction{Opcode::CVTSI2SSQ,
+                              {materialise(lhs), base},
+                              comment("Convert base to float", ins.opcode)};
+        module << Instruction{
+            Opcode::CVTSI2SSQ,
+            {materialise(rhs), exponent},
+            comment("Convert exponent to float", ins.opcode)};
+
+        Operand power = callLibraryFunction("powf", {base, exponent},
+                                            comment("", ins.opcode));
+
+        module << Instruction{
+            Opcode::CVTTSS2SIQ,
+            {power, result},
+            comment("Truncate power to integer", ins.opcode)};
+        return;
+    }
+    case ssa::Opcode::Neg:
+        module << Instruction{
+            Opcode::MOVQ, {lhs, result}, comment("Load operand", ins.opcode)};
+        module << Instruction{Opcode::NEGQ, {result}, text};
+        return;
+    case ssa::Opcode::Eq:
+    case ssa::Opcode::Ne:
+    case ssa::Opcode::Lt:
+    case ssa::Opcode::Le:
+    case ssa::Opcode::Gt:
+    case ssa::Opcode::Ge: {
+        static const std::map<ssa::Opcode, Opcode> set_opcodes{
+            {ssa::Opcode::Eq, Opcode::SETE},  {ssa::Opcode::Ne, Opcode::SETNE},
+            {ssa::Opcode::Lt, Opcode::SETL},  {ssa::Opcode::Le, Opcode::SETLE},
+            {ssa::Opcode::Gt, Opcode::SETG},  {ssa::Opcode::Ge, Opcode::SETGE}};
+
+        // The second operand of cmp cannot be an immediate.
+        module << Instruction{Opcode::CMPQ,
+                              {rhs, materialise(lhs)},
+                              comment("Compare lhs with rhs", ins.opcode)};
+        module << Instruction{set_opcodes.at(ins.opcode),
+                              {Operand::physical(RAX, 1)},
+                              text};
+        module << Instruction{
+            Opcode::MOVZBQ,
+            {Operand::physical(RAX, 1), result},
+            comment("Zero-extend comparison", ins.opcode)};
+        return;
+    }
+    default:
+        throw CodegenException(
+            fmt::format("Cannot lower '{}' on integers",
+                        ssa::getOpcodeName(ins.opcode)));
+    }
+}
+
+void codegen_x64::LoweringX64::lowerFloatOperation(
+    const ssa::Instruction &ins) {
+    Operand lhs = operand(ins.operands[0]);
+    Operand rhs =
+        ins.operands.size() > 1 ? operand(ins.operands[1]) : Operand{};
+    std::string text = comment(
+        fmt::format("Compute '{}'", ssa::getOpcodeName(ins.opcode)),
+        ins.opcode);
+
+    switch (ins.opcode) {
+    case ssa::Opcode::Add:
+    case ssa::Opcode::Sub:
+    case ssa::Opcode::Mul:
+    case ssa::Opcode::Div: {
+        static const std::map<ssa::Opcode, Opcode> opcodes{
+            {ssa::Opcode::Add, Opcode::ADDSS},
+            {ssa::Opcode::Sub, Opcode::SUBSS},
+            {ssa::Opcode::Mul, Opcode::MULSS},
+            {ssa::Opcode::Div, Opcode::DIVSS}};
+        Operand result = vreg(&ins);
+
+        module << Instruction{
+            Opcode::MOVSS, {lhs, result}, comment("Load lhs", ins.opcode)};
+        module << Instruction{opcodes.at(ins.opcode), {rhs, result}, text};
+        return;
+    }
+    case ssa::Opcode::Rem:
+    case ssa::Opcode::Pow: {
+        Operand value = callLibraryFunction(
+            ins.opcode == ssa::Opcode::Rem ? "fmodf" : "powf", {lhs, rhs},
+            comment("", ins.opcode));
+        emitMove(value, vreg(&ins), true,
+                 comment("Store result", ins.opcode));
+        return;
+    }
+    case ssa::Opcode::Neg: {
+        // As in the LLVM backend, '-x' is computed as '0 - x'.
+        Operand result = vreg(&ins);
+
+        module << Instruction{Opcode::MOVSS,
+                              {floatConstant(0.0f), result},
+                              comment("Load zero", ins.opcode)};
+        module << Instruction{Opcode::SUBSS, {lhs, result}, text};
+        return;
+    }
+    case ssa::Opcode::Eq:
+    case ssa::Opcode::Ne:
+    case ssa::Opcode::Lt:
+    case ssa::Opcode::Le:
+    case ssa::Opcode::Gt:
+    case ssa::Opcode::Ge: {
+        // See CodeGeneratorX64::handleFloatOperation.
+        bool swap =
+            ins.opcode == ssa::Opcode::Lt || ins.opcode == ssa::Opcode::Le;
+        static const std::map<ssa::Opcode, Opcode> set_opcodes{
+            {ssa::Opcode::Eq, Opcode::SETE},  {ssa::Opcode::Ne, Opcode::SETNE},
+            {ssa::Opcode::Lt, Opcode::SETA},  {ssa::Opcode::Le, Opcode::SETAE},
+            {ssa::Opcode::Gt, Opcode::SETA},  {ssa::Opcode::Ge, Opcode::SETAE}};
+        Operand result = vreg(&ins);
+
+        module << Instruction{
+            Opcode::UCOMISS,
+            {swap ? lhs : rhs, materialise(swap ? rhs : lhs, true)},
+            comment("Compare lhs with rhs", ins.opcode)};
+        module << Instruction{set_opcodes.at(ins.opcode),
+                              {Operand::physical(RAX, 1)},
+                              text};
+        module << Instruction{
+            Opcode::MOVZBQ,
+            {Operand::physical(RAX, 1), result},
+            comment("Zero-extend comparison", ins.opcode)};
+
+        if (ins.opcode == ssa::Opcode::Eq) {
+            Operand ordered = newVirtualRegister();
+
+            module << Instruction{Opcode::SETNP,
+                                  {Operand::physical(RAX, 1)},
+                                  comment("Test if ordered", ins.opcode)};
+            module << Instruction{
+                Opcode::MOVZBQ,
+                {Operand::physical(RAX, 1), ordered},
+                comment("Zero-extend comparison", ins.opcode)};
+            module << Instruction{Opcode::ANDQ,
+                                  {ordered, result},
+                                  comment("Compute ordered 'eq'", ins.opcode)};
+        }
+        return;
+    }
+    default:
+        throw CodegenException(
+            fmt::format("Cannot lower '{}' on floats",
+                        ssa::getOpcodeName(ins.opcode)));
+    }
+}
+
+void codegen_x64::LoweringX64::lowerCall(const ssa::Instruction &ins) {
+    // Calls whose value is returned right away are emitted at the return.
+    if (isTailCall(ins))
+        return;
+
+    std::vector<Operand> arguments;
+    std::vector<bool> is_float;
+    for (const ssa::Instruction *argument : ins.operands) {
+        arguments.push_back(operand(argument));
+        is_float.push_back(argument->type == ssa::Type::Float);
+    }
+
+    // See CodeGeneratorX64::visitFuncCallExpr.
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+    std::vector<std::size_t> stack_arguments;
+
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (!registers[i])
+            stack_arguments.push_back(i);
+    }
+
+    std::size_t stack_size =
+        8 * (stack_arguments.size() + stack_arguments.size() % 2);
+
+    if (stack_arguments.size() % 2 != 0)
+        module << Instruction{Opcode::SUBQ,
+                              {Operand::immediate(8), Operand::physical(RSP)},
+                              comment("Align stack arguments", ins.opcode)};
+
+    for (auto it = std::rbegin(stack_arguments);
+         it != std::rend(stack_arguments); ++it) {
+        std::size_t i = *it;
+        std::string text =
+            comment(fmt::format("Pass argument {} on the stack", i),
+                    ins.opcode);
+
+        if (is_float[i]) {
+            Operand value = materialise(arguments[i], true);
+
+            module << Instruction{
+                Opcode::SUBQ,
+                {Operand::immediate(8), Operand::physical(RSP)},
+                text};
+            module << Instruction{
+                Opcode::MOVSS,
+                {value, Operand::memory(Register::physical(RSP))},
+                text};
+        } else {
+            module << Instruction{Opcode::PUSHQ, {arguments[i]}, text};
+        }
+    }
+
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (registers[i])
+            emitMove(arguments[i], registers[i], is_float[i],
+                     comment(fmt::format("Pass argument {} in a register", i),
+                             ins.opcode));
+    }
+
+    module << Instruction{Opcode::CALL,
+                          {Operand::label(module.getSymbol(ins.name))},
+                          comment("Call function", ins.opcode)};
+    has_calls = true;
+
+    if (stack_size != 0)
+        module << Instruction{Opcode::ADDQ,
+                              {Operand::immediate(stack_size),
+                               Operand::physical(RSP)},
+                              comment("Pop stack arguments", ins.opcode)};
+
+    if (ins.type != ssa::Type::Void)
+        emitMove(Operand::physical(ins.type == ssa::Type::Float ? XMM0 : RAX),
+                 vreg(&ins), ins.type == ssa::Type::Float,
+                 comment("Store return value", ins.opcode));
+}
+
+bool codegen_x64::LoweringX64::isTailCall(
+    const ssa::Instruction &call) const {
+    // The call must be followed by the return of its value, and the callee
+    // must take all its arguments in registers, and return the same type.
+    const auto &instructions = call.parent->instructions;
+    const ssa::Instruction *ret = instructions.back().get();
+    auto uses = num_uses.find(&call);
+
+    if (!TailCalls || call.opcode != ssa::Opcode::Call ||
+        ret->opcode != ssa::Opcode::Ret || ret->operands.empty() ||
+        ret->operands[0] != &call ||
+        instructions[instructions.size() - 2].get() != &call ||
+        uses == std::end(num_uses) || uses->second != 1 ||
+        call.type != function->return_type)
+        return false;
+
+    std::vector<bool> is_float;
+    for (const ssa::Instruction *argument : call.operands)
+        is_float.push_back(argument->type == ssa::Type::Float);
+
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+
+    return std::find(std::begin(registers), std::end(registers), Operand{}) ==
+           std::end(registers);
+}
+
+void codegen_x64::LoweringX64::lowerTailCall(const ssa::Instruction &call) {
+    std::vector<bool> is_float;
+    for (const ssa::Instruction *argument : call.operands)
+        is_float.push_back(argument->type == ssa::Type::Float);
+
+    std::vector<Operand> registers = getArgumentRegisters(is_float);
+
+    for (std::size_t i = 0; i < registers.size(); ++i)
+        emitMove(operand(call.operands[i]), registers[i], is_float[i],
+                 comment(fmt::format("Pass argument {} in a register", i),
+                         call.opcode));
+
+    module << Instruction{Opcode::TAILJMP,
+                          {Operand::label(module.getSymbol(call.name))},
+                          comment("Tail call", call.opcode)};
+    ++NumSiblingCalls;
+}
+
+void codegen_x64::LoweringX64::lowerTerminator(const ssa::BasicBlock &block) {
+    const ssa::Instruction &ins = *block.getTerminator();
+
+    switch (ins.opcode) {
+    case ssa::Opcode::Br:
+        module << Instruction{Opcode::JMP,
+                              {Operand::label(labels.at(ins.blocks[0]))},
+                              comment("Branch", ins.opcode)};
+        return;
+    case ssa::Opcode::CondBr: {
+        const ssa::Instruction &condition = *ins.operands[0];
+        Symbol if_false = labels.at(ins.blocks[1]);
+
+        if (isFusedComparison(condition)) {
+            emitCompareAndJump(condition, if_false);
+            ++NumFusedComparisons;
+        } else {
+            module << Instruction{Opcode::CMPQ,
+                                  {Operand::immediate(0),
+                                   materialise(operand(&condition))},
+                                  comment("Test condition", ins.opcode)};
+            module << Instruction{
+                Opcode::JE,
+                {Operand::label(if_false)},
+                comment("Jump if condition is false", ins.opcode)};
+        }
+
+        module << Instruction{Opcode::JMP,
+                              {Operand::label(labels.at(ins.blocks[0]))},
+                              comment("Jump if condition is true", ins.opcode)};
+        return;
+    }
+    case ssa::Opcode::Ret:
+        if (!ins.operands.empty() && isTailCall(*ins.operands[0])) {
+            lowerTailCall(*ins.operands[0]);
+            return;
+        }
+
+        if (!ins.operands.empty()) {
+            bool is_float = ins.operands[0]->type == ssa::Type::Float;
+
+            emitMove(operand(ins.operands[0]),
+                     Operand::physical(is_float ? XMM0 : RAX), is_float,
+                     comment("Move return value into return register",
+                             ins.opcode));
+        }
+
+        module << Instruction{Opcode::JMP,
+                              {Operand::label(function_exit)},
+                              comment("Jump to function exit", ins.opcode)};
+        return;
+    default:
+        throw CodegenException(fmt::format("Block '{}' has no terminator",
+                                           block.name));
+    }
+}
+
+void codegen_x64::LoweringX64::emitCompareAndJump(
+    const ssa::Instruction &comparison, Symbol target) {
+    Operand lhs = operand(comparison.operands[0]);
+    Operand rhs = operand(comparison.operands[1]);
+    std::string text =
+        fmt::format("Jump if not '{}'", ssa::getOpcodeName(comparison.opcode));
+
+    if (comparison.operands[0]->type == ssa::Type::Float) {
+        // See CodeGeneratorX64::emitFloatCompareAndJump.
+        static const std::map<ssa::Opcode, Opcode> jump_opcodes{
+            {ssa::Opcode::Eq, Opcode::JNE}, {ssa::Opcode::Ne, Opcode::JE},
+            {ssa::Opcode::Lt, Opcode::JBE}, {ssa::Opcode::Le, Opcode::JB},
+            {ssa::Opcode::Gt, Opcode::JBE}, {ssa::Opcode::Ge, Opcode::JB}};
+        bool swap = comparison.opcode == ssa::Opcode::Lt ||
+                    comparison.opcode == ssa::Opcode::Le;
+
+        module << Instruction{
+            Opcode::UCOMISS,
+            {swap ? lhs : rhs, materialise(swap ? rhs : lhs, true)},
+            "Compare lhs with rhs"};
+        module << Instruction{
+            jump_opcodes.at(comparison.opcode), {Operand::label(target)}, text};
+
+        if (comparison.opcode == ssa::Opcode::Eq)
+            module << Instruction{
+                Opcode::JP, {Operand::label(target)}, "Jump if unordered"};
+        return;
+    }
+
+    // See CodeGeneratorX64::emitCompareAndJump.
+    static const std::map<ssa::Opcode, std::pair<Opcode, Opcode>>
+        jump_opcodes{{ssa::Opcode::Eq, {Opcode::JNE, Opcode::JNE}},
+                     {ssa::Opcode::Ne, {Opcode::JE, Opcode::JE}},
+                     {ssa::Opcode::Lt, {Opcode::JGE, Opcode::JLE}},
+                     {ssa::Opcode::Le, {Opcode::JG, Opcode::JL}},
+                     {ssa::Opcode::Gt, {Opcode::JLE, Opcode::JGE}},
+                     {ssa::Opcode::Ge, {Opcode::JL, Opcode::JG}}};
+    const auto &opcodes = jump_opcodes.at(comparison.opcode);
+    bool swap = lhs.isImmediate() && !rhs.isImmediate();
+
+    if (swap)
+        module << Instruction{
+            Opcode::CMPQ, {lhs, materialise(rhs)}, "Compare rhs with lhs"};
+    else
+        module << Instruction{
+            Opcode::CMPQ, {rhs, materialise(lhs)}, "Compare lhs with rhs"};
+
+    module << Instruction{swap ? opcodes.second : opcodes.first,
+                          {Operand::label(target)},
+                          text};
+}
+
+bool codegen_x64::LoweringX64::isFusedComparison(
+    const ssa::Instruction &ins) const {
+    if (!ssa::isComparison(ins.opcode))
+        return false;
+
+    const ssa::Instruction *terminator = ins.parent->getTerminator();
+    auto uses = num_uses.find(&ins);
+
+    return terminator->opcode == ssa::Opcode::CondBr &&
+           terminator->operands[0] == &ins && uses != std::end(num_uses) &&
+           uses->second == 1;
+}
+
+codegen_x64::Operand
+codegen_x64::LoweringX64::operand(const ssa::Instruction *value) {
+    if (value->opcode != ssa::Opcode::Const)
+        return vreg(value);
+
+    if (value->type == ssa::Type::Float)
+        return floatConstant(value->getFloat());
+
+    if (fitsInt32(value->value))
+        return Operand::immediate(value->value);
+
+    // Larger constants are built from 32-bit immediates, as a movq of a
+    // 64-bit immediate cannot store to a spilled register: the high half,
+    // shifted, plus the sign-extended low half.
+    std::uint64_t bits = static_cast<std::uint64_t>(value->value);
+    std::int64_t low = static_cast<std::int32_t>(bits & 0xffffffff);
+    std::int64_t high = static_cast<std::int64_t>(
+                            bits - static_cast<std::uint64_t>(low)) >>
+                        32;
+    Operand result = newVirtualRegister();
+    std::string text = fmt::format("Load constant {}", value->value);
+
+    module << Instruction{Opcode::MOVQ, {Operand::immediate(high), result},
+                          text};
+    module << Instruction{Opcode::SALQ, {Operand::immediate(32), result},
+                          text};
+    if (low != 0)
+        module << Instruction{Opcode::ADDQ, {Operand::immediate(low), result},
+                              text};
+
+    return result;
+}
+
+codegen_x64::Operand
+codegen_x64::LoweringX64::vreg(const ssa::Instruction *value) {
+    auto [it, inserted] = vregs.try_emplace(value);
+
+    if (inserted)
+        it->second = value->type == ssa::Type::Float ? newFloatRegister()
+                                                     : newVirtualRegister();
+
+    return it->second;
+}
+
+codegen_x64::Operand codegen_x64::LoweringX64::materialise(
+    const Operand &operand, bool is_float) {
+    if (operand.isImmediate()) {
+        Operand vreg = newVirtualRegister();
+        module << Instruction{
+            Opcode::MOVQ, {operand, vreg}, "Materialise immediate"};
+
+        return vreg;
+    }
+
+    if (operand.isMemory()) {
+        Operand vreg = is_float ? newFloatRegister() : newVirtualRegister();
+        module << Instruction{is_float ? Opcode::MOVSS : Opcode::MOVQ,
+                              {operand, vreg},
+                              "Materialise memory operand"};
+
+        return vreg;
+    }
+
+    return operand;
+}
+
+codegen_x64::Operand codegen_x64::LoweringX64::newVirtualRegister() {
+    return Operand::makeRegister(Register::virtualRegister(num_vregs++));
+}
+
+codegen_x64::Operand codegen_x64::LoweringX64::newFloatRegister() {
+    return Operand::makeRegister(Register::floatRegister(num_vregs++));
+}
+
+codegen_x64::Operand codegen_x64::LoweringX64::floatConstant(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    auto it = float_constants.find(bits);
+
+    if (it == std::end(float_constants)) {
+        Symbol name =
+            module.getSymbol(fmt::format(".LC{}", float_constants.size()));
+
+        module.constants.push_back(
+            Constant{name, bits, fmt::format("float {}", value)});
+        it = float_constants.emplace(bits, name).first;
+    }
+
+    return Operand::constant(it->second);
+}
+
+codegen_x64::Operand
+codegen_x64::LoweringX64::arrayElement(std::int64_t array,
+                                       const ssa::Instruction *index) {
+    int offset = array_offsets[array];
+    int scale = function->arrays[array].type == ssa::Type::Float ? 4 : 8;
+    Register rbp = Register::physical(RBP);
+
+    // Constant indices are folded into the displacement, if it fits.
+    if (index->opcode == ssa::Opcode::Const && fitsInt32(index->value) &&
+        fitsInt32(offset + scale * index->value))
+        return Operand::memory(rbp, offset + scale * index->value);
+
+    return Operand::memory(rbp, offset, materialise(operand(index)).reg,
+                           scale);
+}
+
+codegen_x64::Operand codegen_x64::LoweringX64::callLibraryFunction(
+    const char *name, const std::vector<Operand> &operands,
+    const std::string &comment) {
+    std::vector<Operand> registers =
+        getArgumentRegisters(std::vector<bool>(operands.size(), true));
+
+    for (std::size_t i = 0; i < operands.size(); ++i)
+        module << Instruction{
+            Opcode::MOVSS,
+            {operands[i], registers[i]},
+            fmt::format("Pass argument {} in a register{}", i, comment)};
+
+    module << Instruction{Opcode::CALL,
+                          {Operand::label(module.getSymbol(name))},
+                          fmt::format("Call '{}'{}", name, comment)};
+    has_calls = true;
+
+    Operand result = newFloatRegister();
+    module << Instruction{Opcode::MOVSS,
+                          {Operand::physical(XMM0), result},
+                          fmt::format("Store return value{}", comment)};
+
+    return result;
+}
+
+void codegen_x64::LoweringX64::emitMove(const Operand &source,
+                                        const Operand &dest, bool is_float,
+                                        const std::string &comment) {
+    module << Instruction{is_float ? Opcode::MOVSS : Opcode::MOVQ,
+                          {source, dest},
+                          comment};
+}
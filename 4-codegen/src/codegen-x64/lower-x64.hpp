@@ -0,0 +1,112 @@
+#ifndef LOWER_X64_HPP
+#define LOWER_X64_HPP
+
+#include "codegen-x64/module.hpp"
+#include "ssa/ir.hpp"
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace codegen_x64 {
+// Lowers a module in SSA form (see ssa/ir.hpp) to x64 code, as an
+// alternative to the CodeGeneratorX64. Every SSA value lives in a virtual
+// register of its own, except for integer constants, which become
+// immediates, and float constants, which go in the constant pool. Registers
+// are then allocated and the frames laid out as for the CodeGeneratorX64,
+// and the result is optimised and emitted the same way.
+//
+// Phis are replaced by copies (Sreedhar et al., method I): each predecessor
+// writes the value for the phi into a virtual register of the phi's own at
+// its end, which the phi's block copies into the phi's register at its
+// start. Since no other phi reads these registers, the copies need not be
+// ordered, and no critical edge needs to be split.
+//
+// A comparison whose only use is the branch at the end of its block is
+// emitted at the branch, as a cmp and a conditional jump. A call whose value
+// is returned right away becomes a jmp after the epilogue, as in
+// CodeGeneratorX64::emitTailCall.
+class LoweringX64 {
+  public:
+    Module lower(const ssa::Module &ssa_module);
+
+  private:
+    Module module;
+
+    // Maps the bit patterns of float constants to their constant pool entry.
+    std::map<std::uint32_t, Symbol> float_constants;
+
+    // The function being lowered.
+    const ssa::Function *function = nullptr;
+
+    // The virtual registers of the values, and of the copies into phis.
+    std::unordered_map<const ssa::Instruction *, Operand> vregs;
+    std::unordered_map<const ssa::Instruction *, Operand> phi_copies;
+
+    // The labels of the blocks, and of the function's exit.
+    std::unordered_map<const ssa::BasicBlock *, Symbol> labels;
+    Symbol function_exit;
+
+    // The number of uses of each value.
+    std::unordered_map<const ssa::Instruction *, unsigned int> num_uses;
+
+    // The offsets of the arrays from %rbp, and their total size in bytes.
+    std::vector<int> array_offsets;
+    int arrays_size = 0;
+
+    unsigned int num_vregs = 0;
+    bool has_calls = false;
+
+    void lowerFunction(const ssa::Function &ssa_function);
+    void lowerInstruction(const ssa::Instruction &ins);
+    void lowerIntOperation(const ssa::Instruction &ins);
+    void lowerFloatOperation(const ssa::Instruction &ins);
+    void lowerCall(const ssa::Instruction &ins);
+    void lowerTerminator(const ssa::BasicBlock &block);
+
+    // Returns true if a call is returned right away, and can be emitted as
+    // a tail call at the return.
+    bool isTailCall(const ssa::Instruction &call) const;
+    void lowerTailCall(const ssa::Instruction &call);
+
+    // Emits a comparison and a jump to 'target' if it is false.
+    void emitCompareAndJump(const ssa::Instruction &comparison, Symbol target);
+
+    // Returns true if a comparison is only used by the branch of its block.
+    bool isFusedComparison(const ssa::Instruction &ins) const;
+
+    // Returns the operand holding a value: its virtual register, an
+    // immediate, or a constant in the constant pool.
+    Operand operand(const ssa::Instruction *value);
+
+    // Returns the virtual register of a value.
+    Operand vreg(const ssa::Instruction *value);
+
+    // Returns a virtual register holding the operand. Immediates and memory
+    // operands are moved into a new virtual register, of the float class if
+    // 'is_float' is true.
+    Operand materialise(const Operand &operand, bool is_float = false);
+
+    Operand newVirtualRegister();
+    Operand newFloatRegister();
+
+    // Returns the memory operand of a float in the constant pool.
+    Operand floatConstant(float value);
+
+    // Returns the memory operand of element 'index' of an array.
+    Operand arrayElement(std::int64_t array, const ssa::Instruction *index);
+
+    // Emits a call to a float function of the C library, and returns the
+    // virtual register holding the result.
+    Operand callLibraryFunction(const char *name,
+                                const std::vector<Operand> &operands,
+                                const std::string &comment);
+
+    // Emits a move of an integer or a float.
+    void emitMove(const Operand &source, const Operand &dest, bool is_float,
+                  const std::string &comment);
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: LOWER_X64_HPP */
@@ -1,19 +1,358 @@
 #include "codegen-x64/module.hpp"
 
-codegen_x64::Instruction::Instruction(const std::string &opcode,
-                                      const std::vector<std::string> &operands,
+#include <fmt/core.h>
+
+#include <array>
+#include <optional>
+#include <unordered_set>
+
+namespace {
+using codegen_x64::BasicBlock;
+using codegen_x64::Instruction;
+using codegen_x64::NumPhysicalRegisters;
+using codegen_x64::Opcode;
+using codegen_x64::Operand;
+using codegen_x64::PhysicalRegister;
+
+const std::array<const char *, static_cast<std::size_t>(Opcode::NOP) + 1>
+    mnemonics{"movq",      "movzbq",     "leaq",  "addq",    "subq",
+              "imulq",     "andq",       "salq",  "sarq",    "shrq",
+              "negq",      "cqto",       "idivq", "imulq",   "cmpq",
+              "pushq",     "popq",       "call",  "retq",    "jmp",
+              "jmp",       "je",         "jne",   "jl",      "jle",
+              "jg",        "jge",        "jb",    "jbe",     "ja",
+              "jae",       "jp",         "jnp",   "sete",    "setne",
+              "setl",      "setle",      "setg",  "setge",   "seta",
+              "setae",     "setnp",      "cmove", "cmovne",  "cmovl",
+              "cmovle",    "cmovg",      "cmovge", "cmova",  "cmovae",
+              "movss",     "addss",      "subss", "mulss",   "divss",
+              "ucomiss",   "cvtsi2ssq",  "cvttss2siq", "movq", "movdqu",
+              "movups",    "movaps",     "pxor",  "paddq",   "psubq",
+              "pshufd",    "addps",      "subps", "mulps",   "divps",
+              "shufps",    "nop"};
+
+const std::array<const char *, NumPhysicalRegisters> register_names{
+    "%rax",   "%rcx",   "%rdx",   "%rbx",   "%rsp",   "%rbp",   "%rsi",
+    "%rdi",   "%r8",    "%r9",    "%r10",   "%r11",   "%r12",   "%r13",
+    "%r14",   "%r15",   "%xmm0",  "%xmm1",  "%xmm2",  "%xmm3",  "%xmm4",
+    "%xmm5",  "%xmm6",  "%xmm7",  "%xmm8",  "%xmm9",  "%xmm10", "%xmm11",
+    "%xmm12", "%xmm13", "%xmm14", "%xmm15", "%rip"};
+
+// The low bytes of the general-purpose registers.
+const std::array<const char *, 16> byte_register_names{
+    "%al",  "%cl",  "%dl",   "%bl",   "%spl",  "%bpl",  "%sil",  "%dil",
+    "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"};
+
+void printRegister(llvm::raw_ostream &os, const codegen_x64::Register &reg) {
+    switch (reg.kind) {
+    case codegen_x64::Register::Kind::Physical:
+        os << (reg.size == 1 ? byte_register_names[reg.number]
+                             : register_names[reg.number]);
+        break;
+    case codegen_x64::Register::Kind::Virtual:
+        os << "%v" << reg.number;
+        break;
+    case codegen_x64::Register::Kind::FloatVirtual:
+        os << "%f" << reg.number;
+        break;
+    case codegen_x64::Register::Kind::None:
+        break;
+    }
+}
+
+void printSymbol(llvm::raw_ostream &os, codegen_x64::Symbol symbol,
+                 const codegen_x64::Module *module) {
+    if (module)
+        os << module->getSymbolName(symbol);
+    else
+        os << ".S" << symbol;
+}
+
+bool isPhysicalRegister(const Operand &op, PhysicalRegister reg) {
+    return op.isRegister() && op.reg == codegen_x64::Register::physical(reg);
+}
+
+// Returns true for the instructions of an epilogue (see FrameLayoutX64),
+// which restore the stack pointer and the saved registers before a return.
+bool isEpilogue(const Instruction &ins) {
+    switch (ins.opcode) {
+    case Opcode::POPQ:
+        return true;
+    case Opcode::MOVQ:
+        return isPhysicalRegister(ins.operands[0], codegen_x64::RBP) &&
+               isPhysicalRegister(ins.operands[1], codegen_x64::RSP);
+    case Opcode::ADDQ:
+        return ins.operands[0].isImmediate() &&
+               isPhysicalRegister(ins.operands[1], codegen_x64::RSP);
+    default:
+        return false;
+    }
+}
+
+// The call frame of a function, from which its call frame information is
+// printed. The canonical frame address (CFA), the value of %rsp before the
+// call, is tracked through the prologue and the epilogues, and is relative
+// to %rsp until the frame pointer is set up, and to %rbp after.
+//
+// The body of a function leaves the CFA where its prologue put it, so the
+// state of the frame is remembered before every epilogue that other code
+// follows, and restored after its return.
+class CallFrame {
+  public:
+    // Finds the epilogues of the function in the blocks [begin, end).
+    CallFrame(const std::vector<BasicBlock> &blocks, std::size_t begin,
+              std::size_t end);
+
+    // Prints the directives to be placed before and after an instruction.
+    void printBefore(llvm::raw_ostream &os, const Instruction &ins);
+    void printAfter(llvm::raw_ostream &os, const Instruction &ins);
+
+  private:
+    struct State {
+        PhysicalRegister cfa_register = codegen_x64::RSP;
+
+        // The distances from %rsp and from %rbp to the CFA.
+        std::int64_t rsp_offset = 8;
+        std::int64_t rbp_offset = 0;
+    };
+
+    State state;
+    std::vector<State> remembered;
+
+    // True until the first instruction after the prologue.
+    bool in_prologue = true;
+
+    // The first instructions of the epilogues that other code follows, and
+    // the returns that end them.
+    std::unordered_set<const Instruction *> epilogues;
+    std::unordered_set<const Instruction *> returns;
+
+    void printCFAOffset(llvm::raw_ostream &os);
+};
+
+CallFrame::CallFrame(const std::vector<BasicBlock> &blocks, std::size_t begin,
+                     std::size_t end) {
+    for (std::size_t b = begin; b < end; ++b) {
+        const auto &instructions = blocks[b].instructions;
+
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            bool is_last = b + 1 == end && i + 1 == instructions.size();
+            if (!codegen_x64::isReturn(instructions[i].opcode) || is_last)
+                continue;
+
+            std::size_t start = i;
+            while (start > 0 && isEpilogue(instructions[start - 1]))
+                --start;
+
+            if (start != i) {
+                epilogues.insert(&instructions[start]);
+                returns.insert(&instructions[i]);
+            }
+        }
+    }
+}
+
+void CallFrame::printBefore(llvm::raw_ostream &os, const Instruction &ins) {
+    if (!epilogues.count(&ins))
+        return;
+
+    os << "    .cfi_remember_state\n";
+    remembered.push_back(state);
+}
+
+void CallFrame::printAfter(llvm::raw_ostream &os, const Instruction &ins) {
+    bool is_prologue = false;
+
+    switch (ins.opcode) {
+    case Opcode::PUSHQ:
+        state.rsp_offset += 8;
+        printCFAOffset(os);
+
+        // The callee-saved registers are pushed by the prologue.
+        if (in_prologue && ins.operands[0].isRegister()) {
+            os << "    .cfi_offset ";
+            printRegister(os, ins.operands[0].reg);
+            os << ", " << -state.rsp_offset << "\n";
+            is_prologue = true;
+        }
+        break;
+    case Opcode::POPQ:
+        state.rsp_offset -= 8;
+
+        if (state.cfa_register == codegen_x64::RBP &&
+            isPhysicalRegister(ins.operands[0], codegen_x64::RBP)) {
+            state.cfa_register = codegen_x64::RSP;
+            os << "    .cfi_def_cfa %rsp, " << state.rsp_offset << "\n";
+        } else {
+            printCFAOffset(os);
+        }
+        break;
+    case Opcode::MOVQ:
+        if (isPhysicalRegister(ins.operands[0], codegen_x64::RSP) &&
+            isPhysicalRegister(ins.operands[1], codegen_x64::RBP)) {
+            state.cfa_register = codegen_x64::RBP;
+            state.rbp_offset = state.rsp_offset;
+            os << "    .cfi_def_cfa_register %rbp\n";
+            is_prologue = true;
+        } else if (isPhysicalRegister(ins.operands[0], codegen_x64::RBP) &&
+                   isPhysicalRegister(ins.operands[1], codegen_x64::RSP)) {
+            state.rsp_offset = state.rbp_offset;
+        }
+        break;
+    case Opcode::SUBQ:
+    case Opcode::ADDQ:
+        if (ins.operands[0].isImmediate() &&
+            isPhysicalRegister(ins.operands[1], codegen_x64::RSP)) {
+            std::int64_t size = ins.operands[0].value;
+            state.rsp_offset += ins.opcode == Opcode::SUBQ ? size : -size;
+            printCFAOffset(os);
+            is_prologue = ins.opcode == Opcode::SUBQ;
+        }
+        break;
+    default:
+        break;
+    }
+
+    in_prologue = in_prologue && is_prologue;
+
+    if (returns.count(&ins)) {
+        os << "    .cfi_restore_state\n";
+        state = remembered.back();
+        remembered.pop_back();
+    }
+}
+
+void CallFrame::printCFAOffset(llvm::raw_ostream &os) {
+    if (state.cfa_register == codegen_x64::RSP)
+        os << "    .cfi_def_cfa_offset " << state.rsp_offset << "\n";
+}
+
+// Prints a '.loc' directive for an instruction at 'location', unless the
+// previous instruction was at the same location.
+void printLocation(llvm::raw_ostream &os, const Location &location,
+                   Location &previous) {
+    if (location.line == 0 || (location.line == previous.line &&
+                               location.col == previous.col))
+        return;
+
+    os << "    .loc 1 " << location.line << " " << location.col << "\n";
+    previous = location;
+}
+} // namespace
+
+const char *codegen_x64::getMnemonic(Opcode opcode) {
+    return mnemonics[static_cast<std::size_t>(opcode)];
+}
+
+bool codegen_x64::isJump(Opcode opcode) {
+    return opcode >= Opcode::JMP && opcode <= Opcode::JNP;
+}
+
+bool codegen_x64::isReturn(Opcode opcode) {
+    return opcode == Opcode::RETQ || opcode == Opcode::TAILJMP;
+}
+
+codegen_x64::Opcode codegen_x64::invertJump(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::JE:
+        return Opcode::JNE;
+    case Opcode::JNE:
+        return Opcode::JE;
+    case Opcode::JL:
+        return Opcode::JGE;
+    case Opcode::JGE:
+        return Opcode::JL;
+    case Opcode::JLE:
+        return Opcode::JG;
+    case Opcode::JG:
+        return Opcode::JLE;
+    case Opcode::JB:
+        return Opcode::JAE;
+    case Opcode::JAE:
+        return Opcode::JB;
+    case Opcode::JBE:
+        return Opcode::JA;
+    case Opcode::JA:
+        return Opcode::JBE;
+    case Opcode::JP:
+        return Opcode::JNP;
+    case Opcode::JNP:
+        return Opcode::JP;
+    default:
+        return opcode;
+    }
+}
+
+bool codegen_x64::isSetCondition(Opcode opcode) {
+    return opcode >= Opcode::SETE && opcode <= Opcode::SETNP;
+}
+
+bool codegen_x64::isConditionalMove(Opcode opcode) {
+    return opcode >= Opcode::CMOVE && opcode <= Opcode::CMOVAE;
+}
+
+codegen_x64::Instruction::Instruction(Opcode opcode,
+                                      std::initializer_list<Operand> operands,
                                       const std::string &comment)
     : opcode(opcode), operands(operands), comment(comment) {}
 
-codegen_x64::BasicBlock::BasicBlock(const std::string &name,
-                                    const std::string &comment, bool is_global)
-    : name(name), comment(comment), is_global(is_global) {}
+codegen_x64::BasicBlock::BasicBlock(Symbol label, const std::string &comment,
+                                    bool is_global)
+    : label(label), comment(comment), is_global(is_global) {}
 
-llvm::formatted_raw_ostream &
-codegen_x64::operator<<(llvm::formatted_raw_ostream &os,
-                        const codegen_x64::Instruction &ins) {
+codegen_x64::Symbol codegen_x64::Module::getSymbol(const std::string &name) {
+    auto [it, inserted] = symbols.emplace(name, symbol_names.size());
+
+    if (inserted)
+        symbol_names.push_back(name);
+
+    return it->second;
+}
+
+void codegen_x64::printOperand(llvm::raw_ostream &os, const Operand &op,
+                               const Module *module) {
+    switch (op.kind) {
+    case Operand::Kind::Register:
+        printRegister(os, op.reg);
+        break;
+    case Operand::Kind::Immediate:
+        os << "$" << op.value;
+        break;
+    case Operand::Kind::Label:
+        printSymbol(os, op.symbol, module);
+        break;
+    case Operand::Kind::Memory:
+        if (op.symbol != Operand::no_symbol)
+            printSymbol(os, op.symbol, module);
+        if (op.symbol != Operand::no_symbol && op.value > 0)
+            os << "+";
+        if (op.value != 0 ||
+            (!op.reg && !op.index && op.symbol == Operand::no_symbol))
+            os << op.value;
+
+        if (!op.reg && !op.index)
+            break;
+
+        os << "(";
+        printRegister(os, op.reg);
+        if (op.index) {
+            os << ",";
+            printRegister(os, op.index);
+            if (op.scale != 1)
+                os << "," << static_cast<int>(op.scale);
+        }
+        os << ")";
+        break;
+    case Operand::Kind::None:
+        break;
+    }
+}
+
+void codegen_x64::printInstruction(llvm::formatted_raw_ostream &os,
+                                   const Instruction &ins,
+                                   const Module *module) {
     os.PadToColumn(4);
-    os << ins.opcode;
+    os << getMnemonic(ins.opcode);
     os.PadToColumn(16);
 
     bool first = true;
@@ -24,7 +363,7 @@ codegen_x64::operator<<(llvm::formatted_raw_ostream &os,
         }
         first = false;
 
-        os << operand;
+        printOperand(os, operand, module);
     }
 
     if (!ins.comment.empty()) {
@@ -33,38 +372,99 @@ codegen_x64::operator<<(llvm::formatted_raw_ostream &os,
     }
 
     os << "\n";
-
-    return os;
 }
 
 llvm::formatted_raw_ostream &
 codegen_x64::operator<<(llvm::formatted_raw_ostream &os,
-                        const codegen_x64::BasicBlock &bbl) {
-    os << "\n";
-    if (bbl.is_global)
-        os << ".global " << bbl.name << "\n";
-
-    os << bbl.name << ":";
+                        const codegen_x64::Module &mod) {
+    const bool debug_info = !mod.source_file.empty();
 
-    if (!bbl.comment.empty()) {
-        os.PadToColumn(40);
-        os << "# " << bbl.comment;
+    if (debug_info) {
+        os << ".file 1 \"";
+        os.write_escaped(mod.source_file);
+        os << "\"\n";
     }
 
-    os << "\n";
+    // The call frame of the function being printed, if any.
+    std::optional<CallFrame> frame;
+    Location previous_location;
+
+    for (std::size_t b = 0; b < mod.blocks.size(); ++b) {
+        const auto &bbl = mod.blocks[b];
+        const std::string &name = mod.getSymbolName(bbl.label);
+
+        if (debug_info && bbl.is_global) {
+            if (frame)
+                os << "    .cfi_endproc\n";
+
+            std::size_t end = b + 1;
+            while (end < mod.blocks.size() && !mod.blocks[end].is_global)
+                ++end;
+
+            frame.emplace(mod.blocks, b, end);
+        }
+
+        os << "\n";
+        if (bbl.is_global)
+            os << ".global " << name << "\n";
+
+        if (bbl.p2align != 0)
+            os << ".p2align " << static_cast<int>(bbl.p2align) << "\n";
+
+        os << name << ":";
+
+        if (!bbl.comment.empty()) {
+            os.PadToColumn(40);
+            os << "# " << bbl.comment;
+        }
+
+        os << "\n";
+
+        if (debug_info && bbl.is_global)
+            os << "    .cfi_startproc\n";
 
-    for (const auto &ins : bbl.instructions) {
-        os << ins;
+        // The instructions at the start of the block without a location of
+        // their own are at the location of the block.
+        Location location = bbl.location;
+
+        for (const auto &ins : bbl.instructions) {
+            if (!debug_info) {
+                printInstruction(os, ins, &mod);
+                continue;
+            }
+
+            if (ins.location.line != 0)
+                location = ins.location;
+
+            printLocation(os, location, previous_location);
+            if (frame)
+                frame->printBefore(os, ins);
+            printInstruction(os, ins, &mod);
+            if (frame)
+                frame->printAfter(os, ins);
+        }
     }
 
-    return os;
-}
+    if (frame)
+        os << "    .cfi_endproc\n";
 
-llvm::formatted_raw_ostream &
-codegen_x64::operator<<(llvm::formatted_raw_ostream &os,
-                        const codegen_x64::Module &mod) {
-    for (const auto &bbl : mod.blocks) {
-        os << bbl;
+    if (!mod.constants.empty()) {
+        os << "\n.section .rodata\n.p2align 2\n";
+
+        for (const auto &constant : mod.constants) {
+            os << mod.getSymbolName(constant.label) << ":\n";
+            os.PadToColumn(4);
+            os << ".long";
+            os.PadToColumn(16);
+            os << fmt::format("0x{:08x}", constant.value);
+
+            if (!constant.comment.empty()) {
+                os.PadToColumn(40);
+                os << "# " << constant.comment;
+            }
+
+            os << "\n";
+        }
     }
 
     return os;
@@ -74,12 +474,17 @@ codegen_x64::Module &
 codegen_x64::operator<<(codegen_x64::Module &mod,
                         const codegen_x64::BasicBlock &bbl) {
     mod.blocks.emplace_back(bbl);
+    if (mod.blocks.back().location.line == 0)
+        mod.blocks.back().location = mod.location;
     return mod;
 }
 
 codegen_x64::Module &
 codegen_x64::operator<<(codegen_x64::Module &mod,
                         const codegen_x64::Instruction &ins) {
-    mod.blocks.back().instructions.emplace_back(ins);
+    auto &instructions = mod.blocks.back().instructions;
+    instructions.emplace_back(ins);
+    if (instructions.back().location.line == 0)
+        instructions.back().location = mod.location;
     return mod;
 }
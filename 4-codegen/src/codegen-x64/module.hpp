@@ -1,43 +1,363 @@
 #ifndef PROGRAM_HPP
 #define PROGRAM_HPP
 
+#include "lexer/token.hpp"
+
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/FormattedStream.h"
 
-#include <ostream>
+#include <cstdint>
+#include <initializer_list>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace codegen_x64 {
+// Machine instructions of the x64 backend (MIR). Instructions have a typed
+// opcode and typed operands, and are only printed as AT&T assembly when the
+// module is emitted.
+
+// The instructions used by the code generator.
+enum class Opcode : std::uint8_t {
+    // Integer moves and arithmetic
+    MOVQ,
+    MOVZBQ,
+    LEAQ,
+    ADDQ,
+    SUBQ,
+    IMULQ,
+    ANDQ,
+    SALQ,
+    SARQ,
+    SHRQ,
+    NEGQ,
+    CQTO,
+    IDIVQ,
+    IMULQ_WIDE, // imulq with one operand: %rdx:%rax = %rax * operand
+    CMPQ,
+
+    // Stack and control flow
+    PUSHQ,
+    POPQ,
+    CALL,
+    RETQ,
+    TAILJMP, // jmp to another function, which returns to the caller
+    JMP,
+    JE,
+    JNE,
+    JL,
+    JLE,
+    JG,
+    JGE,
+    JB,
+    JBE,
+    JA,
+    JAE,
+    JP,
+    JNP,
+
+    // Conditions
+    SETE,
+    SETNE,
+    SETL,
+    SETLE,
+    SETG,
+    SETGE,
+    SETA,
+    SETAE,
+    SETNP,
+
+    // Conditional moves
+    CMOVE,
+    CMOVNE,
+    CMOVL,
+    CMOVLE,
+    CMOVG,
+    CMOVGE,
+    CMOVA,
+    CMOVAE,
+
+    // SSE
+    MOVSS,
+    ADDSS,
+    SUBSS,
+    MULSS,
+    DIVSS,
+    UCOMISS,
+    CVTSI2SSQ,
+    CVTTSS2SIQ,
+
+    // Packed SSE2, for vector loops
+    MOVQ_XMM, // movq between a general-purpose and an SSE register
+    MOVDQU,
+    MOVUPS,
+    MOVAPS,
+    PXOR,
+    PADDQ,
+    PSUBQ,
+    PSHUFD,
+    ADDPS,
+    SUBPS,
+    MULPS,
+    DIVPS,
+    SHUFPS,
+
+    NOP,
+};
+
+// Returns the AT&T mnemonic of an opcode.
+const char *getMnemonic(Opcode opcode);
+
+// Returns true for jmp and the conditional jumps, but not for tail calls.
+bool isJump(Opcode opcode);
+
+// Returns true for retq and tail calls, which leave the function.
+bool isReturn(Opcode opcode);
+
+// Returns the conditional jump that is taken if and only if the given one is
+// not taken.
+Opcode invertJump(Opcode opcode);
+
+// Returns true for the setcc instructions.
+bool isSetCondition(Opcode opcode);
+
+// Returns true for the cmovcc instructions.
+bool isConditionalMove(Opcode opcode);
+
+// The physical registers: the 64-bit general-purpose registers in encoding
+// order, followed by the SSE registers, and %rip for addressing constants.
+enum PhysicalRegister : std::uint8_t {
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+    XMM0,
+    XMM1,
+    XMM2,
+    XMM3,
+    XMM4,
+    XMM5,
+    XMM6,
+    XMM7,
+    XMM8,
+    XMM9,
+    XMM10,
+    XMM11,
+    XMM12,
+    XMM13,
+    XMM14,
+    XMM15,
+    RIP,
+    NumPhysicalRegisters,
+};
+
+// A physical register, or a virtual register of the integer or float class.
+// Integer and float virtual registers share their numbers.
+struct Register {
+    enum class Kind : std::uint8_t { None, Physical, Virtual, FloatVirtual };
+
+    Kind kind = Kind::None;
+
+    // Size in bytes of a general-purpose register, e.g. 1 for %al.
+    std::uint8_t size = 8;
+
+    // The PhysicalRegister, or the number of the virtual register.
+    std::uint32_t number = 0;
+
+    static Register physical(PhysicalRegister reg, std::uint8_t size = 8) {
+        return Register{Kind::Physical, size, reg};
+    }
+    static Register virtualRegister(std::uint32_t number) {
+        return Register{Kind::Virtual, 8, number};
+    }
+    static Register floatRegister(std::uint32_t number) {
+        return Register{Kind::FloatVirtual, 8, number};
+    }
+
+    bool isPhysical() const { return kind == Kind::Physical; }
+    bool isVirtual() const {
+        return kind == Kind::Virtual || kind == Kind::FloatVirtual;
+    }
+    bool isFloat() const {
+        return kind == Kind::FloatVirtual ||
+               (kind == Kind::Physical && number >= XMM0 && number <= XMM15);
+    }
+
+    explicit operator bool() const { return kind != Kind::None; }
+
+    bool operator==(const Register &other) const {
+        return kind == other.kind && size == other.size &&
+               number == other.number;
+    }
+    bool operator!=(const Register &other) const { return !(*this == other); }
+};
+
+// Index of a name in the symbol table of a module.
+using Symbol = std::uint32_t;
+
+// An operand: a register, an immediate, a memory location of the form
+// 'symbol+disp(base,index,scale)', or a label.
+struct Operand {
+    enum class Kind : std::uint8_t { None, Register, Immediate, Memory, Label };
+
+    static constexpr Symbol no_symbol = UINT32_MAX;
+
+    Kind kind = Kind::None;
+    std::uint8_t scale = 1;
+
+    // The label, or the symbol that a memory operand is relative to.
+    Symbol symbol = no_symbol;
+
+    // The register, or the base register of a memory operand.
+    codegen_x64::Register reg;
+
+    // The index register of a memory operand.
+    codegen_x64::Register index;
+
+    // The immediate, or the displacement of a memory operand.
+    std::int64_t value = 0;
+
+    static Operand makeRegister(codegen_x64::Register reg) {
+        Operand op;
+        op.kind = Kind::Register;
+        op.reg = reg;
+        return op;
+    }
+    static Operand physical(PhysicalRegister reg, std::uint8_t size = 8) {
+        return makeRegister(codegen_x64::Register::physical(reg, size));
+    }
+    static Operand immediate(std::int64_t value) {
+        Operand op;
+        op.kind = Kind::Immediate;
+        op.value = value;
+        return op;
+    }
+    static Operand memory(codegen_x64::Register base, std::int64_t disp = 0,
+                          codegen_x64::Register index = {},
+                          std::uint8_t scale = 1) {
+        Operand op;
+        op.kind = Kind::Memory;
+        op.reg = base;
+        op.value = disp;
+        op.index = index;
+        op.scale = scale;
+        return op;
+    }
+    // A constant in the data section, addressed relative to %rip.
+    static Operand constant(Symbol symbol) {
+        Operand op = memory(codegen_x64::Register::physical(RIP));
+        op.symbol = symbol;
+        return op;
+    }
+    static Operand label(Symbol symbol) {
+        Operand op;
+        op.kind = Kind::Label;
+        op.symbol = symbol;
+        return op;
+    }
+
+    bool isRegister() const { return kind == Kind::Register; }
+    bool isImmediate() const { return kind == Kind::Immediate; }
+    bool isMemory() const { return kind == Kind::Memory; }
+    bool isLabel() const { return kind == Kind::Label; }
+
+    explicit operator bool() const { return kind != Kind::None; }
+
+    bool operator==(const Operand &other) const {
+        return kind == other.kind && scale == other.scale &&
+               reg == other.reg && index == other.index &&
+               symbol == other.symbol && value == other.value;
+    }
+    bool operator!=(const Operand &other) const { return !(*this == other); }
+};
+
 struct Instruction {
-    Instruction(const std::string &opcode,
-                const std::vector<std::string> &operands,
+    Instruction(Opcode opcode, std::initializer_list<Operand> operands,
                 const std::string &comment = "");
 
-    std::string opcode;
-    std::vector<std::string> operands;
+    Opcode opcode;
+    llvm::SmallVector<Operand, 2> operands;
     std::string comment;
+
+    // The source location that the instruction was generated for, or line 0
+    // if it is not known.
+    Location location;
 };
 
 struct BasicBlock {
-    explicit BasicBlock(const std::string &name,
-                        const std::string &comment = "",
+    explicit BasicBlock(Symbol label, const std::string &comment = "",
                         bool is_global = false);
 
-    std::string name;
+    Symbol label;
     std::string comment;
     bool is_global;
 
+    // If non-zero, the block is aligned to 2^p2align bytes, e.g. to place a
+    // loop header at the start of a fetch block.
+    std::uint8_t p2align = 0;
+
+    // The source location of the instructions at the start of the block that
+    // have none of their own, e.g. the prologue of a function.
+    Location location;
+
     std::vector<Instruction> instructions;
 };
 
+// A 32-bit constant in the read-only data section, e.g. a float literal.
+struct Constant {
+    Symbol label;
+    std::uint32_t value;
+    std::string comment;
+};
+
 struct Module {
     std::vector<BasicBlock> blocks;
+
+    // Constant pool, emitted in .rodata after the code.
+    std::vector<Constant> constants;
+
+    // The name of the source file. If it is set, the module is emitted with
+    // a line table (.file and .loc) and call frame information (.cfi_*), so
+    // that debuggers and profilers map the code back to the source.
+    std::string source_file;
+
+    // The location given to the blocks and instructions appended to the
+    // module without one.
+    Location location;
+
+    // Returns the symbol with the given name, adding it if needed.
+    Symbol getSymbol(const std::string &name);
+
+    // Returns the name of a symbol.
+    const std::string &getSymbolName(Symbol symbol) const {
+        return symbol_names[symbol];
+    }
+
+  private:
+    // Names of the labels, functions and constants.
+    std::vector<std::string> symbol_names;
+    std::unordered_map<std::string, Symbol> symbols;
 };
 
-llvm::formatted_raw_ostream &operator<<(llvm::formatted_raw_ostream &os,
-                                        const Instruction &ins);
-llvm::formatted_raw_ostream &operator<<(llvm::formatted_raw_ostream &os,
-                                        const BasicBlock &bbl);
+// Prints an operand or an instruction in AT&T syntax. Labels are printed with
+// the symbol table of the module, if given.
+void printOperand(llvm::raw_ostream &os, const Operand &op,
+                  const Module *module = nullptr);
+void printInstruction(llvm::formatted_raw_ostream &os, const Instruction &ins,
+                      const Module *module = nullptr);
+
 llvm::formatted_raw_ostream &operator<<(llvm::formatted_raw_ostream &os,
                                         const Module &mod);
 
@@ -1,187 +1,387 @@
+#include "codegen-x64/cfg-x64.hpp"
+#include "codegen-x64/globalopt-x64.hpp"
 #include "codegen-x64/module.hpp"
 #include "codegen-x64/optimise-x64.hpp"
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Pass.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdint>
 #include <iterator>
-#include <map>
 
 #define DEBUG_TYPE "optimiser-x64"
 
 // Command-line options to select which optimisation to apply.
 llvm::cl::bits<codegen_x64::Optimisations> OptimisationsBits(
-    llvm::cl::desc("Available peephole optimisations:"),
+    llvm::cl::desc("Available optimisations:"),
     llvm::cl::values(clEnumValN(codegen_x64::Optimisations::NopElimination,
                                 "optimisation-nop-elimination",
                                 "Eliminate NOP instructions"),
                      clEnumValN(codegen_x64::Optimisations::Assignment1,
-                                "optimisation-1", "Your optimisation 1"),
+                                "optimisation-1",
+                                "Fold push/pop pairs into moves"),
                      clEnumValN(codegen_x64::Optimisations::Assignment2,
-                                "optimisation-2", "Your optimisation 2"),
+                                "optimisation-2",
+                                "Fold constants into add/sub"),
                      clEnumValN(codegen_x64::Optimisations::Assignment3,
-                                "optimisation-3", "Your optimisation 3")));
+                                "optimisation-3",
+                                "Remove moves of a register to itself"),
+                     clEnumValN(
+                         codegen_x64::Optimisations::DeadStoreElimination,
+                         "optimisation-dse",
+                         "Remove moves and stores to dead locations"),
+                     clEnumValN(codegen_x64::Optimisations::CopyPropagation,
+                                "optimisation-copy-propagation",
+                                "Propagate copies and constants across "
+                                "blocks"),
+                     clEnumValN(
+                         codegen_x64::Optimisations::RedundantLoadElimination,
+                         "optimisation-redundant-loads",
+                         "Reuse values of frame slots in registers")));
 
 // Statistic to see how many NOPs were removed.
 STATISTIC(NumNopsEliminated,
           "The number of NOP instructions that were eliminated");
+STATISTIC(NumPushPopsFolded, "The number of push/pop pairs folded into a move");
+STATISTIC(NumConstantsFolded,
+          "The number of constants folded into an add or sub");
+STATISTIC(NumSelfMovesRemoved,
+          "The number of moves of a register to itself removed");
+STATISTIC(NumInstructionsVisited,
+          "The number of instructions visited by the peephole optimiser");
 
-void codegen_x64::OptimiserX64::optimise(Module &module) {
-    bool changed = true;
+namespace {
+using namespace codegen_x64;
 
-    while (changed) {
-        changed = false;
+// The instructions of a basic block as a doubly-linked list, so that
+// instructions are deleted in constant time while the block is optimised.
+// Instructions are identified by their index in the block.
+class PeepholeBlock {
+  public:
+    static constexpr unsigned int none = UINT_MAX;
 
-        if (OptimisationsBits.isSet(Optimisations::NopElimination))
-            changed |= optimiseNopElimination(module);
+    explicit PeepholeBlock(std::vector<Instruction> &instructions)
+        : instructions(instructions), next_index(instructions.size()),
+          prev_index(instructions.size()),
+          erased(instructions.size(), false) {
+        for (unsigned int i = 0; i < instructions.size(); ++i) {
+            next_index[i] = i + 1 < instructions.size() ? i + 1 : none;
+            prev_index[i] = i > 0 ? i - 1 : none;
+        }
+    }
 
-        if (OptimisationsBits.isSet(Optimisations::Assignment1))
-            changed |= optimise1(module);
+    unsigned int size() const { return instructions.size(); }
 
-        if (OptimisationsBits.isSet(Optimisations::Assignment2))
-            changed |= optimise2(module);
+    Instruction &operator[](unsigned int i) { return instructions[i]; }
 
-        if (OptimisationsBits.isSet(Optimisations::Assignment3))
-            changed |= optimise3(module);
-    }
-}
+    // Returns the next or previous instruction that is not erased, or none.
+    unsigned int next(unsigned int i) const { return next_index[i]; }
+    unsigned int prev(unsigned int i) const { return prev_index[i]; }
 
-bool codegen_x64::OptimiserX64::optimiseNopElimination(Module &mod) {
-    bool changed = false;
+    bool isErased(unsigned int i) const { return erased[i]; }
 
-    // Remove all "nop" instructions from all basic blocks.
-    for (auto &bbl : mod.blocks) {
-        auto &insns = bbl.instructions;
+    void erase(unsigned int i) {
+        erased[i] = true;
+
+        if (next_index[i] != none)
+            prev_index[next_index[i]] = prev_index[i];
+        if (prev_index[i] != none)
+            next_index[prev_index[i]] = next_index[i];
+    }
+
+    // Removes the erased instructions from the basic block.
+    void compact() {
+        unsigned int i = 0;
         auto it = std::remove_if(
-            std::begin(insns), std::end(insns),
-            [](const Instruction &ins) { return ins.opcode == "nop"; });
-            
+            std::begin(instructions), std::end(instructions),
+            [&](const Instruction &) { return erased[i++]; });
+
+        instructions.erase(it, std::end(instructions));
+    }
+
+  private:
+    std::vector<Instruction> &instructions;
+    std::vector<unsigned int> next_index;
+    std::vector<unsigned int> prev_index;
+    std::vector<bool> erased;
+};
+
+// A peephole pattern. 'apply' is called for the instructions with the anchor
+// opcode, and returns true if it matched and rewrote the instructions around
+// the anchor.
+struct Pattern {
+    const char *name;
+    Optimisations optimisation;
+    Opcode anchor;
+    bool (*apply)(PeepholeBlock &block, unsigned int index);
+    llvm::Statistic *count;
+};
+
+// Maximum number of times the global optimisations are run on a function.
+// Each run can expose more opportunities to the others, e.g. a propagated
+// copy makes the original move dead.
+constexpr unsigned int max_global_rounds = 4;
+
+// Maximum number of instructions that constant folding looks back for the
+// definition of a register, which keeps the optimiser linear.
+constexpr unsigned int max_lookback = 16;
 
-        // Update statistic
-        NumNopsEliminated += std::distance(it, std::end(insns));
+bool isSameRegister(const Register &a, const Register &b) {
+    // Sub-registers such as %al are part of their 64-bit register.
+    return a.kind == b.kind && a.number == b.number;
+}
+
+bool usesRegister(const Operand &op, PhysicalRegister reg) {
+    Register full = Register::physical(reg);
+
+    return (op.isRegister() || op.isMemory()) &&
+           (isSameRegister(op.reg, full) || isSameRegister(op.index, full));
+}
 
-        // Check if anything was removed
-        if (it != std::end(insns))
-            changed = true;
+// Returns true if the instruction may write the register.
+bool mayWrite(const Instruction &ins, const Register &reg) {
+    auto is = [&](PhysicalRegister phys) {
+        return isSameRegister(reg, Register::physical(phys));
+    };
 
-        insns.erase(it, std::end(insns));
+    switch (ins.opcode) {
+    case Opcode::CALL:
+    case Opcode::TAILJMP:
+        return true;
+    case Opcode::CQTO:
+        return is(RDX);
+    case Opcode::IDIVQ:
+    case Opcode::IMULQ_WIDE:
+        return is(RAX) || is(RDX);
+    case Opcode::PUSHQ:
+        return is(RSP);
+    case Opcode::POPQ:
+        if (is(RSP))
+            return true;
+        break;
+    default:
+        break;
     }
 
-    return changed;
+    // The last operand is the destination.
+    return !ins.operands.empty() && ins.operands.back().isRegister() &&
+           isSameRegister(ins.operands.back().reg, reg);
 }
 
-bool codegen_x64::OptimiserX64::optimise1(Module &mod) {
-    // ASSIGNMENT: Implement your first peephole optimisation here.
-    // Return true only if you have changed the assembly.
-    // First optimization: push and pop changes to move
-    bool changed = false;
-    for (auto &bbl : mod.blocks) {
-       for (auto it = std::begin(bbl.instructions);
-            it != std::end(bbl.instructions) &&
-            std::next(it) != std::end(bbl.instructions) &&
-            std::next(std::next(it)) != std::end(bbl.instructions);
-            ++it) {
-            auto &cur_ins = *it;
-            auto &next_ins = *std::next(it);
-            
-            if (cur_ins.opcode == "pushq" && next_ins.opcode == "popq"){
-                
-                auto next_next_ins = std::next(std::next(it));
-                changed = true;
-                next_ins.opcode = "movq" ;
-                next_ins.operands = {cur_ins.operands[0], next_ins.operands[0]};
-                next_ins.comment = "opt1";
-                makeNop(cur_ins);
-                if (it != std::begin(bbl.instructions)){
-                    auto prev_ins = std::prev(it);
-                    while (prev_ins->opcode == "pushq" && next_next_ins->opcode == "popq" && prev_ins != std::begin(bbl.instructions) &&  next_next_ins != std::end(bbl.instructions)){
-                        next_next_ins->opcode = "movq" ;
-                        next_next_ins->operands = {prev_ins->operands[0], next_next_ins->operands[0]};
-                        next_next_ins->comment = "opt1";
-                        makeNop(*prev_ins);
-                        prev_ins = std::prev(prev_ins);
-                        next_next_ins = std::next(next_next_ins);
-                    }
-                }
-
-            }
-            
+// 'nop' -> (deleted)
+bool applyNopElimination(PeepholeBlock &block, unsigned int index) {
+    block.erase(index);
+    return true;
+}
+
+// 'pushq X; popq Y' -> 'movq X, Y'
+bool applyPushPop(PeepholeBlock &block, unsigned int index) {
+    unsigned int pop = block.next(index);
+
+    if (pop == PeepholeBlock::none || block[pop].opcode != Opcode::POPQ)
+        return false;
+
+    Operand source = block[index].operands[0];
+    Operand dest = block[pop].operands[0];
+
+    // A move has at most one memory operand, and addresses relative to %rsp
+    // would change meaning.
+    if ((source.isMemory() && dest.isMemory()) || usesRegister(source, RSP) ||
+        usesRegister(dest, RSP))
+        return false;
+
+    Instruction move{Opcode::MOVQ, {source, dest}, block[pop].comment};
+    move.location = block[pop].location;
+    block[pop] = move;
+    block.erase(index);
+
+    return true;
+}
+
+// 'movq $c, %r; ...; addq %r, X' -> 'movq $c, %r; ...; addq $c, X', if %r
+// is not written in between. The same holds for subq.
+bool applyConstantOperand(PeepholeBlock &block, unsigned int index) {
+    Operand &source = block[index].operands[0];
+
+    if (!source.isRegister())
+        return false;
+
+    unsigned int distance = 0;
+
+    for (unsigned int i = block.prev(index);
+         i != PeepholeBlock::none && distance < max_lookback;
+         i = block.prev(i), ++distance) {
+        const Instruction &def = block[i];
+
+        if (def.opcode == Opcode::MOVQ && def.operands[1].isRegister() &&
+            isSameRegister(def.operands[1].reg, source.reg)) {
+            // add and sub take a sign-extended 32-bit immediate.
+            const Operand &value = def.operands[0];
+
+            if (!value.isImmediate() || value.value < INT32_MIN ||
+                value.value > INT32_MAX)
+                return false;
+
+            source = value;
+            return true;
         }
+
+        if (mayWrite(def, source.reg))
+            return false;
     }
-    return changed;
+
+    return false;
 }
 
-bool codegen_x64::OptimiserX64::optimise2(Module &mod) {
-    // ASSIGNMENT: Implement your second peephole optimisation here.
-    // Return true only if you have changed the assembly.
-    bool changed = false;
-
-    
-    for (auto &bbl : mod.blocks) {
-        std::map<std::string, int> dict; //registers saved with their values
-        int i = 0;
-        for (auto it = std::begin(bbl.instructions);
-            it != std::end(bbl.instructions) ;
-            ++it) {
-            auto &cur_ins = *it;
-            if (cur_ins.opcode == "movq"){
-                std::string firstop = cur_ins.operands[0];
-                std::string secondop = cur_ins.operands[1];
-                if (firstop.at(0) == '$' && secondop.at(0) == '%'){
-                    dict[secondop] = i;
-                }
-            }
-            else if(cur_ins.opcode == "addq" || cur_ins.opcode == "subq"){ //check if in the map
-                if (dict.find(cur_ins.operands[0])!=dict.end()){
-                    int nr = dict.find(cur_ins.operands[0])->second;
-                    auto oldinstr = bbl.instructions[nr];
-                    cur_ins.operands[0]= oldinstr.operands[0];
-                    makeNop(oldinstr);
-                    changed = true;
-                }//invalidate second operand
-                dict.erase(cur_ins.operands[1]);
-            }
-            else{
-                int oplen = cur_ins.operands.size();
-                if (oplen>0){//invalidate last operand
-                    dict.erase(cur_ins.operands[oplen-1]);
-                }
-            }
-            i++;
-
-            
-            
+// 'movq %r, %r' -> (deleted)
+bool applySelfMove(PeepholeBlock &block, unsigned int index) {
+    const Instruction &ins = block[index];
+
+    if (!ins.operands[0].isRegister() || ins.operands[0] != ins.operands[1])
+        return false;
+
+    block.erase(index);
+    return true;
+}
+
+// The peephole patterns, and the option that enables each of them.
+constexpr std::array<Pattern, 5> patterns{{
+    {"nop-elimination", Optimisations::NopElimination, Opcode::NOP,
+     applyNopElimination, &NumNopsEliminated},
+    {"push-pop", Optimisations::Assignment1, Opcode::PUSHQ, applyPushPop,
+     &NumPushPopsFolded},
+    {"constant-add", Optimisations::Assignment2, Opcode::ADDQ,
+     applyConstantOperand, &NumConstantsFolded},
+    {"constant-sub", Optimisations::Assignment2, Opcode::SUBQ,
+     applyConstantOperand, &NumConstantsFolded},
+    {"self-move", Optimisations::Assignment3, Opcode::MOVQ, applySelfMove,
+     &NumSelfMovesRemoved},
+}};
+
+constexpr std::size_t num_opcodes = static_cast<std::size_t>(Opcode::NOP) + 1;
+
+// The enabled patterns, by anchor opcode.
+using Dispatch =
+    std::array<llvm::SmallVector<const Pattern *, 2>, num_opcodes>;
+
+void optimiseBlock(const Module &module, BasicBlock &bbl,
+                   const Dispatch &dispatch) {
+    PeepholeBlock block{bbl.instructions};
+
+    // The worklist is a stack, filled such that the instructions are first
+    // visited in order.
+    std::vector<unsigned int> worklist;
+    std::vector<bool> queued(block.size(), true);
+
+    for (unsigned int i = block.size(); i-- > 0;)
+        worklist.push_back(i);
+
+    auto enqueue = [&](unsigned int i) {
+        if (i == PeepholeBlock::none || block.isErased(i) || queued[i])
+            return;
+
+        queued[i] = true;
+        worklist.push_back(i);
+    };
+
+    while (!worklist.empty()) {
+        unsigned int index = worklist.back();
+        worklist.pop_back();
+        queued[index] = false;
+
+        if (block.isErased(index))
+            continue;
+
+        ++NumInstructionsVisited;
+
+        const auto &candidates =
+            dispatch[static_cast<std::size_t>(block[index].opcode)];
+
+        for (const Pattern *pattern : candidates) {
+            unsigned int prev = block.prev(index);
+            unsigned int next = block.next(index);
+
+            if (!pattern->apply(block, index))
+                continue;
+
+            ++*pattern->count;
+            LLVM_DEBUG(llvm::dbgs() << "Applied " << pattern->name << " in "
+                                    << module.getSymbolName(bbl.label)
+                                    << "\n");
+
+            // Only the instructions around the rewrite can match a new
+            // pattern. The previous one is visited first.
+            enqueue(next);
+            enqueue(index);
+            enqueue(prev);
+            break;
         }
     }
-    return changed;
+
+    block.compact();
 }
 
-bool codegen_x64::OptimiserX64::optimise3(Module &mod) {
-    // ASSIGNMENT: Implement your third peephole optimisation here.
-    // Return true only if you have changed the assembly.
-    bool changed = false;
-    for (auto &bbl : mod.blocks) {
-       for (auto it = std::begin(bbl.instructions);
-            it != std::end(bbl.instructions) &&
-            std::next(it) != std::end(bbl.instructions);
-            ++it) {
-            auto &cur_ins = *it;
-            auto &next_ins = *std::next(it);
-            if (cur_ins.operands.size()>=2){
-                if (cur_ins.opcode == "movq" && cur_ins.operands[0]==cur_ins.operands[1]){
-                    makeNop(cur_ins);
-                    changed = true;
-                }
-            }
+void optimiseFunction(Module &module, FunctionRange function) {
+    bool copies = OptimisationsBits.isSet(Optimisations::CopyPropagation);
+    bool loads =
+        OptimisationsBits.isSet(Optimisations::RedundantLoadElimination);
+    bool stores = OptimisationsBits.isSet(Optimisations::DeadStoreElimination);
+
+    for (unsigned int round = 0; round < max_global_rounds; ++round) {
+        bool changed = false;
+
+        // The graph is rebuilt after every optimisation that removes
+        // instructions.
+        if (copies) {
+            ControlFlowGraph cfg{module, function};
+            changed |= propagateCopies(cfg);
+        }
+
+        if (loads) {
+            ControlFlowGraph cfg{module, function};
+            changed |= eliminateRedundantLoads(cfg);
         }
+
+        if (stores) {
+            ControlFlowGraph cfg{module, function};
+            changed |= eliminateDeadStores(cfg);
+        }
+
+        if (!changed)
+            break;
     }
-    return changed;
 }
+} // namespace
 
-void codegen_x64::OptimiserX64::makeNop(Instruction &ins) {
-    ins.opcode = "nop";
-    ins.operands.clear();
-}
+void codegen_x64::OptimiserX64::optimise(Module &module) {
+    {
+        llvm::NamedRegionTimer timer("global-x64", "Global optimisation",
+                                     "codegen-x64", "x64 code generator",
+                                     llvm::TimePassesIsEnabled);
+
+        for (FunctionRange function : getFunctions(module))
+            optimiseFunction(module, function);
+    }
+
+    llvm::NamedRegionTimer timer("peephole-x64", "Peephole optimisation",
+                                 "codegen-x64", "x64 code generator",
+                                 llvm::TimePassesIsEnabled);
 
+    Dispatch dispatch;
+
+    for (const auto &pattern : patterns) {
+        if (OptimisationsBits.isSet(pattern.optimisation))
+            dispatch[static_cast<std::size_t>(pattern.anchor)].push_back(
+                &pattern);
+    }
+
+    for (auto &bbl : module.blocks)
+        optimiseBlock(module, bbl, dispatch);
+}
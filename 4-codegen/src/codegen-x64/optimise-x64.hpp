@@ -8,26 +8,27 @@
 namespace codegen_x64 {
 
 enum class Optimisations {
-    NopElimination, // Eliminate NOP instructions
-    Assignment1,    // Your optimisation 1
-    Assignment2,    // Your optimisation 2
-    Assignment3,    // Your optimisation 3
+    NopElimination,           // Eliminate NOP instructions
+    Assignment1,              // Fold push/pop pairs into moves
+    Assignment2,              // Fold constants into add/sub
+    Assignment3,              // Remove moves of a register to itself
+    DeadStoreElimination,     // Remove moves and stores to dead locations
+    CopyPropagation,          // Propagate copies and constants across blocks
+    RedundantLoadElimination, // Reuse values of frame slots in registers
 };
 
+// Optimiser of the x64 code after register allocation. The global
+// optimisations in globalopt-x64.hpp run first on the control-flow graph of
+// each function, until nothing changes. The peephole patterns are declared in
+// a table in optimise-x64.cpp, and are applied by a worklist algorithm: every
+// instruction is visited once, and after a pattern rewrites an instruction,
+// only the instructions around it are visited again. Deleted instructions are
+// unlinked immediately, so no NOPs are left behind, and each basic block is
+// compacted once at the end. The number of rewrites is reported per pattern
+// with -stats, and the time taken with -time-passes.
 class OptimiserX64 {
   public:
     void optimise(Module &module);
-
-  private:
-    bool optimiseNopElimination(Module &mod);
-    bool optimise1(Module &mod);
-    bool optimise2(Module &mod);
-    bool optimise3(Module &mod);
-
-    // Make an instruction a NOP.
-    void makeNop(Instruction &ins);
-
-    // ASSIGNMENT: Add any helper methods or fields you need here.
 };
 } // namespace codegen_x64
 
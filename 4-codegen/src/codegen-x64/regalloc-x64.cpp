@@ -0,0 +1,693 @@
+#include "codegen-x64/regalloc-x64.hpp"
+#include "codegen-x64/codegenexception.hpp"
+#include "codegen-x64/instrinfo-x64.hpp"
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <map>
+#include <unordered_map>
+
+#define DEBUG_TYPE "regalloc-x64"
+
+STATISTIC(NumVirtualRegisters, "The number of virtual registers");
+STATISTIC(NumSpilled, "The number of virtual registers spilled to the stack");
+STATISTIC(NumSpillSlots, "The number of spill slots");
+STATISTIC(NumLeasLowered,
+          "The number of lea instructions lowered to an add of spill slots");
+STATISTIC(NumCopiesRemoved,
+          "The number of copies removed after register allocation");
+
+namespace {
+using namespace codegen_x64;
+
+// Number of registers that the allocator keeps track of: the general-purpose
+// and the SSE registers.
+constexpr int NumRegisters = XMM15 + 1;
+
+// The register classes: general-purpose registers for integers, and SSE
+// registers for floats.
+enum RegisterClass : int { GPR, SSE, NumRegisterClasses };
+
+// Registers available to the allocator, in order of preference. Caller-saved
+// registers come first: values that are live across a call conflict with
+// them, and end up in the callee-saved registers. All SSE registers are
+// caller-saved, so floats that are live across a call are spilled.
+const std::array<PhysicalRegister, 12> gpr_allocation_order{
+    RCX, RSI, RDI, R8, R9, RDX, RAX, RBX, R12, R13, R14, R15};
+const std::array<PhysicalRegister, 14> sse_allocation_order{
+    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM7,
+    XMM6, XMM5, XMM4,  XMM3,  XMM2,  XMM1,  XMM0};
+
+// Registers used to reload and store spilled virtual registers, per class.
+const std::array<std::array<PhysicalRegister, 2>, NumRegisterClasses>
+    scratch_registers{{{R11, R10}, {XMM15, XMM14}}};
+
+// Instruction that moves a value of each class between a register and
+// memory.
+const std::array<Opcode, NumRegisterClasses> move_opcodes{Opcode::MOVQ,
+                                                         Opcode::MOVSS};
+
+// The registers that an instruction reads and writes.
+struct Accesses {
+    std::vector<unsigned int> uses;
+    std::vector<unsigned int> defs;
+    std::vector<int> reads;
+    std::vector<int> writes;
+};
+
+// Calls 'fn' with every register in the operand, including the base and
+// index registers of memory operands. 'OperandT' is Operand or const Operand.
+template <typename OperandT, typename Fn>
+void forEachRegister(OperandT &operand, Fn fn) {
+    if (operand.isRegister()) {
+        fn(operand.reg);
+    } else if (operand.isMemory()) {
+        if (operand.reg)
+            fn(operand.reg);
+        if (operand.index)
+            fn(operand.index);
+    }
+}
+
+// Returns the virtual register in the operand, or an empty register if it is
+// not a virtual register.
+Register virtualRegisterOf(const Operand &operand) {
+    return operand.isRegister() && operand.reg.isVirtual() ? operand.reg
+                                                           : Register{};
+}
+
+// Returns true if operand 'index' of the instruction must be a register.
+bool requiresRegister(const Instruction &ins, std::size_t index) {
+    if (ins.operands.size() < 2 || index + 1 != ins.operands.size())
+        return false;
+
+    // The destination of SSE arithmetic, comparisons, conversions, moves
+    // between register classes and conditional moves is always a register.
+    if (isConditionalMove(ins.opcode))
+        return true;
+
+    switch (ins.opcode) {
+    case Opcode::IMULQ:
+    case Opcode::LEAQ:
+    case Opcode::MOVZBQ:
+    case Opcode::ADDSS:
+    case Opcode::SUBSS:
+    case Opcode::MULSS:
+    case Opcode::DIVSS:
+    case Opcode::UCOMISS:
+    case Opcode::CVTSI2SSQ:
+    case Opcode::CVTTSS2SIQ:
+    case Opcode::MOVQ_XMM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Accesses getAccesses(const Instruction &ins) {
+    Accesses result;
+
+    for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+        const Operand &operand = ins.operands[k];
+
+        // Registers in memory operands are only used to compute the address.
+        Access access =
+            operand.isMemory() ? Access::Read : getAccess(ins, k);
+
+        if (access == Access::None)
+            continue;
+
+        bool read = access == Access::Read || access == Access::ReadWrite;
+        bool write = access == Access::Write || access == Access::ReadWrite;
+
+        forEachRegister(operand, [&](const Register &reg) {
+            if (reg.isVirtual()) {
+                if (read)
+                    result.uses.push_back(reg.number);
+                if (write)
+                    result.defs.push_back(reg.number);
+            } else if (reg.number < NumRegisters) {
+                if (read)
+                    result.reads.push_back(reg.number);
+                if (write)
+                    result.writes.push_back(reg.number);
+            }
+        });
+    }
+
+    // Implicit operands.
+    for (PhysicalRegister reg : getImplicitUses(ins.opcode))
+        result.reads.push_back(reg);
+    for (PhysicalRegister reg : getImplicitDefs(ins.opcode))
+        result.writes.push_back(reg);
+
+    return result;
+}
+
+// Returns the name of a register or operand, for debug output.
+std::string toString(const Operand &operand) {
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    printOperand(os, operand);
+
+    return os.str();
+}
+} // namespace
+
+codegen_x64::Operand
+codegen_x64::RegisterAllocatorX64::spillSlot(unsigned int slot) const {
+    return Operand::memory(spill_base,
+                           spill_offset - 8 * static_cast<int>(slot + 1));
+}
+
+std::vector<codegen_x64::Instruction>
+codegen_x64::RegisterAllocatorX64::lowerSpilledLea(
+    const Instruction &ins, const std::vector<int> &assignment,
+    const std::vector<int> &slots) const {
+    if (ins.opcode != Opcode::LEAQ)
+        return {};
+
+    // Only 'leaq (%vA,%vB), %vD' is lowered.
+    const Operand &address = ins.operands[0];
+
+    if (address.value != 0 || address.scale != 1 ||
+        address.symbol != Operand::no_symbol || !address.reg.isVirtual() ||
+        !address.index.isVirtual())
+        return {};
+
+    Register dest_vreg = virtualRegisterOf(ins.operands[1]);
+    if (!dest_vreg)
+        return {};
+
+    unsigned int a = address.reg.number;
+    unsigned int b = address.index.number;
+    unsigned int d = dest_vreg.number;
+
+    if (assignment[d] < 0 || (assignment[a] >= 0 && assignment[b] >= 0))
+        return {};
+
+    auto location = [&](unsigned int vreg) {
+        return assignment[vreg] >= 0
+                   ? Operand::physical(
+                         static_cast<PhysicalRegister>(assignment[vreg]))
+                   : spillSlot(slots[vreg]);
+    };
+
+    // Addition is commutative, so if the result is in the register of one
+    // operand, only the other one needs to be added.
+    Operand dest = location(d);
+    std::vector<Instruction> lowered;
+
+    if (assignment[b] == assignment[d])
+        std::swap(a, b);
+
+    if (assignment[a] != assignment[d])
+        lowered.push_back(
+            Instruction{Opcode::MOVQ, {location(a), dest}, ins.comment});
+
+    lowered.push_back(
+        Instruction{Opcode::ADDQ, {location(b), dest}, ins.comment});
+    ++NumLeasLowered;
+
+    for (auto &lowered_ins : lowered)
+        lowered_ins.location = ins.location;
+
+    return lowered;
+}
+
+unsigned int codegen_x64::RegisterAllocatorX64::allocate(
+    std::vector<BasicBlock>::iterator begin,
+    std::vector<BasicBlock>::iterator end) {
+    const std::size_t num_blocks = std::distance(begin, end);
+
+    // Number the instructions, and collect the registers they access.
+    std::vector<unsigned int> first(num_blocks);
+    std::unordered_map<Symbol, std::size_t> block_index;
+    std::vector<Accesses> accesses;
+    unsigned int num_vregs = 0;
+
+    // Register class of each virtual register.
+    std::vector<RegisterClass> classes;
+
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        const BasicBlock &bbl = *(begin + b);
+
+        first[b] = accesses.size();
+        block_index[bbl.label] = b;
+
+        for (const auto &ins : bbl.instructions) {
+            accesses.push_back(getAccesses(ins));
+
+            for (const auto &operand : ins.operands) {
+                forEachRegister(operand, [&](const Register &reg) {
+                    if (!reg.isVirtual())
+                        return;
+
+                    if (reg.number >= num_vregs) {
+                        num_vregs = reg.number + 1;
+                        classes.resize(num_vregs, GPR);
+                    }
+
+                    classes[reg.number] = reg.isFloat() ? SSE : GPR;
+                });
+            }
+        }
+    }
+
+    auto name = [&](unsigned int vreg) {
+        return toString(Operand::makeRegister(
+            classes[vreg] == SSE ? Register::floatRegister(vreg)
+                                 : Register::virtualRegister(vreg)));
+    };
+
+    const unsigned int num_positions = 2 * accesses.size();
+
+    // Successors of each block. Every jump in a block adds its target, which
+    // also covers jumps in the middle of a block.
+    std::vector<std::vector<std::size_t>> successors(num_blocks);
+
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        const auto &insns = (begin + b)->instructions;
+        bool falls_through = true;
+
+        for (const auto &ins : insns) {
+            if (!isJump(ins.opcode))
+                continue;
+
+            auto it = block_index.find(ins.operands[0].symbol);
+            if (it != std::end(block_index))
+                successors[b].push_back(it->second);
+        }
+
+        if (!insns.empty() &&
+            (insns.back().opcode == Opcode::JMP ||
+             isReturn(insns.back().opcode)))
+            falls_through = false;
+
+        if (falls_through && b + 1 < num_blocks)
+            successors[b].push_back(b + 1);
+    }
+
+    // Liveness analysis of the virtual registers.
+    std::vector<llvm::BitVector> use(num_blocks, llvm::BitVector(num_vregs));
+    std::vector<llvm::BitVector> def(num_blocks, llvm::BitVector(num_vregs));
+    std::vector<llvm::BitVector> live_in(num_blocks,
+                                         llvm::BitVector(num_vregs));
+    std::vector<llvm::BitVector> live_out(num_blocks,
+                                          llvm::BitVector(num_vregs));
+
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        std::size_t size = (begin + b)->instructions.size();
+
+        for (std::size_t i = first[b]; i < first[b] + size; ++i) {
+            for (unsigned int vreg : accesses[i].uses) {
+                if (!def[b].test(vreg))
+                    use[b].set(vreg);
+            }
+            for (unsigned int vreg : accesses[i].defs)
+                def[b].set(vreg);
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (std::size_t b = num_blocks; b-- > 0;) {
+            llvm::BitVector out(num_vregs);
+            for (std::size_t succ : successors[b])
+                out |= live_in[succ];
+
+            llvm::BitVector in = out;
+            in.reset(def[b]);
+            in |= use[b];
+
+            if (in != live_in[b] || out != live_out[b]) {
+                live_in[b] = std::move(in);
+                live_out[b] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    // Build one live interval per virtual register, which spans all positions
+    // where it is live.
+    std::vector<LiveInterval> all_intervals(num_vregs);
+
+    for (unsigned int vreg = 0; vreg < num_vregs; ++vreg)
+        all_intervals[vreg] = LiveInterval{vreg, UINT_MAX, 0};
+
+    auto extend = [&](unsigned int vreg, unsigned int pos) {
+        all_intervals[vreg].start = std::min(all_intervals[vreg].start, pos);
+        all_intervals[vreg].end = std::max(all_intervals[vreg].end, pos);
+    };
+
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        std::size_t size = (begin + b)->instructions.size();
+
+        if (size == 0)
+            continue;
+
+        for (unsigned int vreg : live_in[b].set_bits())
+            extend(vreg, 2 * first[b]);
+        for (unsigned int vreg : live_out[b].set_bits())
+            extend(vreg, 2 * (first[b] + size - 1) + 1);
+
+        for (std::size_t i = first[b]; i < first[b] + size; ++i) {
+            for (unsigned int vreg : accesses[i].uses)
+                extend(vreg, 2 * i);
+            for (unsigned int vreg : accesses[i].defs)
+                extend(vreg, 2 * i + 1);
+        }
+    }
+
+    std::vector<LiveInterval> intervals;
+    for (const auto &interval : all_intervals) {
+        if (interval.start != UINT_MAX)
+            intervals.push_back(interval);
+    }
+
+    NumVirtualRegisters += intervals.size();
+
+    // Positions at which each physical register is in use. A register read
+    // is live from the preceding write in the same block, or from the start
+    // of the function for the parameter registers in the entry block.
+    std::vector<std::vector<int>> occupied(
+        NumRegisters, std::vector<int>(num_positions + 1, 0));
+
+    auto occupy = [&](int reg, unsigned int from, unsigned int to) {
+        ++occupied[reg][from];
+        --occupied[reg][to + 1];
+    };
+
+    for (std::size_t b = 0; b < num_blocks; ++b) {
+        std::size_t size = (begin + b)->instructions.size();
+        std::array<int, NumRegisters> last_write;
+        last_write.fill(-1);
+
+        for (std::size_t i = first[b]; i < first[b] + size; ++i) {
+            unsigned int read = 2 * i;
+            unsigned int write = 2 * i + 1;
+
+            for (int reg : accesses[i].reads) {
+                if (last_write[reg] >= 0)
+                    occupy(reg, last_write[reg], read);
+                else
+                    occupy(reg, b == 0 ? 0 : read, read);
+            }
+
+            for (int reg : accesses[i].writes) {
+                occupy(reg, write, write);
+                last_write[reg] = write;
+            }
+        }
+    }
+
+    // Turn the counts into prefix sums of the occupied positions, so that
+    // conflicts can be checked in constant time.
+    for (auto &positions : occupied) {
+        int count = 0;
+        int occupied_so_far = 0;
+
+        for (auto &pos : positions) {
+            count += pos;
+            pos = occupied_so_far;
+            occupied_so_far += count > 0;
+        }
+
+        positions.push_back(occupied_so_far);
+    }
+
+    auto conflicts = [&](const LiveInterval &interval, int reg) {
+        const auto &positions = occupied[reg];
+        return positions[interval.end + 1] != positions[interval.start];
+    };
+
+    // Linear scan, over the intervals in order of increasing start position.
+    // The active intervals are kept in order of increasing end position.
+    std::sort(std::begin(intervals), std::end(intervals),
+              [](const LiveInterval &a, const LiveInterval &b) {
+                  return a.start < b.start ||
+                         (a.start == b.start && a.vreg < b.vreg);
+              });
+
+    std::vector<LiveInterval *> active;
+    std::array<bool, NumRegisters> in_use{};
+
+    auto spill = [&](LiveInterval &interval) {
+        interval.reg = -1;
+        ++NumSpilled;
+    };
+
+    for (auto &current : intervals) {
+        // Expire the intervals that end before the current one starts.
+        auto expired = std::begin(active);
+        while (expired != std::end(active) &&
+               (*expired)->end < current.start) {
+            in_use[(*expired)->reg] = false;
+            ++expired;
+        }
+        active.erase(std::begin(active), expired);
+
+        const RegisterClass cls = classes[current.vreg];
+        auto try_allocate = [&](const auto &allocation_order) {
+            for (PhysicalRegister reg : allocation_order) {
+                if (!in_use[reg] && !conflicts(current, reg)) {
+                    current.reg = reg;
+                    break;
+                }
+            }
+        };
+
+        if (cls == SSE)
+            try_allocate(sse_allocation_order);
+        else
+            try_allocate(gpr_allocation_order);
+
+        if (current.reg < 0) {
+            // Spill the active interval of the same class that ends last, if
+            // it ends after the current interval and its register can hold
+            // the current interval. Otherwise, spill the current interval.
+            auto victim = std::end(active);
+
+            for (auto it = std::begin(active); it != std::end(active); ++it) {
+                if (classes[(*it)->vreg] == cls && (*it)->end > current.end &&
+                    !conflicts(current, (*it)->reg))
+                    victim = it;
+            }
+
+            if (victim == std::end(active)) {
+                spill(current);
+                continue;
+            }
+
+            current.reg = (*victim)->reg;
+            spill(**victim);
+            active.erase(victim);
+        }
+
+        in_use[current.reg] = true;
+        active.insert(std::upper_bound(std::begin(active), std::end(active),
+                                       &current,
+                                       [](const LiveInterval *a,
+                                          const LiveInterval *b) {
+                                           return a->end < b->end;
+                                       }),
+                      &current);
+    }
+
+    // Assign stack slots to the spilled intervals. Intervals that do not
+    // overlap share a slot, so that e.g. the spilled variables of disjoint
+    // scopes use the same stack memory.
+    std::vector<int> slots(num_vregs, -1);
+    std::vector<unsigned int> slot_end;
+
+    for (const auto &interval : intervals) {
+        if (interval.reg >= 0)
+            continue;
+
+        auto slot = std::find_if(
+            std::begin(slot_end), std::end(slot_end),
+            [&](unsigned int end) { return end < interval.start; });
+
+        if (slot == std::end(slot_end)) {
+            slot_end.push_back(interval.end);
+            slot = std::prev(std::end(slot_end));
+        } else {
+            *slot = interval.end;
+        }
+
+        slots[interval.vreg] = std::distance(std::begin(slot_end), slot);
+    }
+
+    NumSpillSlots += slot_end.size();
+
+    std::vector<int> assignment(num_vregs, -1);
+    used_registers.clear();
+
+    for (const auto &interval : intervals) {
+        assignment[interval.vreg] = interval.reg;
+
+        if (interval.reg >= 0 &&
+            std::find(std::begin(used_registers), std::end(used_registers),
+                      interval.reg) == std::end(used_registers))
+            used_registers.push_back(
+                static_cast<PhysicalRegister>(interval.reg));
+
+        LLVM_DEBUG(llvm::dbgs()
+                   << name(interval.vreg) << " [" << interval.start
+                   << ", " << interval.end << "] -> "
+                   << toString(interval.reg >= 0
+                                   ? Operand::physical(static_cast<
+                                         PhysicalRegister>(interval.reg))
+                                   : spillSlot(slots[interval.vreg]))
+                   << "\n");
+    }
+
+    // Rewrite the instructions. Spilled virtual registers are accessed in
+    // their stack slot directly where possible, and through a scratch
+    // register otherwise.
+    for (auto bbl = begin; bbl != end; ++bbl) {
+        std::vector<Instruction> rewritten;
+
+        for (const auto &original : bbl->instructions) {
+            // A lea that adds two spilled registers would need both reloaded
+            // into scratch registers. If its result is in a register, it is
+            // computed with a move and an add from the stack slots instead.
+            if (auto lowered = lowerSpilledLea(original, assignment, slots);
+                !lowered.empty()) {
+                rewritten.insert(std::end(rewritten), std::begin(lowered),
+                                 std::end(lowered));
+                continue;
+            }
+
+            Instruction ins = original;
+            std::vector<Instruction> before;
+            std::vector<Instruction> after;
+            std::map<unsigned int, Register> scratch;
+            std::array<std::size_t, NumRegisterClasses> next_scratch{};
+
+            auto getScratch = [&](unsigned int vreg, bool reload) {
+                auto it = scratch.find(vreg);
+                if (it != std::end(scratch))
+                    return it->second;
+
+                const RegisterClass cls = classes[vreg];
+                if (next_scratch[cls] == scratch_registers[cls].size())
+                    throw CodegenException(
+                        "Out of scratch registers for spill code");
+
+                Register reg = Register::physical(
+                    scratch_registers[cls][next_scratch[cls]++]);
+
+                if (reload)
+                    before.push_back(Instruction{
+                        move_opcodes[cls],
+                        {spillSlot(slots[vreg]), Operand::makeRegister(reg)},
+                        fmt::format("Reload {}", name(vreg))});
+
+                scratch[vreg] = reg;
+                return reg;
+            };
+
+            unsigned int memory_operands = 0;
+            for (const auto &operand : ins.operands) {
+                Register vreg = virtualRegisterOf(operand);
+
+                if (operand.isMemory() ||
+                    (vreg && assignment[vreg.number] < 0))
+                    ++memory_operands;
+            }
+
+            // Virtual registers in memory operands must be registers.
+            for (auto &operand : ins.operands) {
+                if (!operand.isMemory())
+                    continue;
+
+                forEachRegister(operand, [&](Register &reg) {
+                    if (!reg.isVirtual())
+                        return;
+
+                    int assigned = assignment[reg.number];
+
+                    reg = assigned >= 0 ? Register::physical(
+                                              static_cast<PhysicalRegister>(
+                                                  assigned))
+                                        : getScratch(reg.number, true);
+                });
+            }
+
+            for (std::size_t k = 0; k < ins.operands.size(); ++k) {
+                Register vreg_register = virtualRegisterOf(ins.operands[k]);
+
+                if (!vreg_register)
+                    continue;
+
+                unsigned int vreg = vreg_register.number;
+
+                if (assignment[vreg] >= 0) {
+                    ins.operands[k] = Operand::physical(
+                        static_cast<PhysicalRegister>(assignment[vreg]));
+                    continue;
+                }
+
+                if (!requiresRegister(ins, k) && memory_operands <= 1) {
+                    ins.operands[k] = spillSlot(slots[vreg]);
+                    continue;
+                }
+
+                // A register that is only written may reuse a scratch
+                // register, as all operands are read before it is written.
+                Access access = getAccess(ins, k);
+                const RegisterClass cls = classes[vreg];
+                Register reg;
+
+                if (access == Access::Write && !scratch.count(vreg) &&
+                    next_scratch[cls] == scratch_registers[cls].size())
+                    reg = Register::physical(scratch_registers[cls][0]);
+                else
+                    reg = getScratch(vreg, access != Access::Write);
+
+                if (access != Access::Read)
+                    after.push_back(Instruction{
+                        move_opcodes[cls],
+                        {Operand::makeRegister(reg), spillSlot(slots[vreg])},
+                        fmt::format("Spill {}", name(vreg))});
+
+                ins.operands[k] = Operand::makeRegister(reg);
+                --memory_operands;
+            }
+
+            // Copies between the same register are no longer needed.
+            if ((ins.opcode == Opcode::MOVQ || ins.opcode == Opcode::MOVSS) &&
+                ins.operands[0] == ins.operands[1] && before.empty() &&
+                after.empty()) {
+                ++NumCopiesRemoved;
+                continue;
+            }
+
+            // Spill code belongs to the source of the instruction.
+            for (auto &spill : before)
+                spill.location = ins.location;
+            for (auto &spill : after)
+                spill.location = ins.location;
+
+            rewritten.insert(std::end(rewritten), std::begin(before),
+                             std::end(before));
+            rewritten.push_back(ins);
+            rewritten.insert(std::end(rewritten), std::begin(after),
+                             std::end(after));
+        }
+
+        bbl->instructions = std::move(rewritten);
+    }
+
+    return slot_end.size();
+}
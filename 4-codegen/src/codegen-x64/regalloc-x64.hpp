@@ -0,0 +1,73 @@
+#ifndef REGALLOC_X64_HPP
+#define REGALLOC_X64_HPP
+
+#include "codegen-x64/module.hpp"
+
+#include <vector>
+
+namespace codegen_x64 {
+// Linear scan register allocator (Poletto and Sarkar, 1999).
+//
+// The code generator emits instructions on an unlimited number of virtual
+// registers, of the integer or float class, which are register operands or
+// the base and index of memory operands such as '(%v1,%v2,8)'. The
+// allocator maps these to general-purpose and SSE registers respectively,
+// one function at a time, and spills the remaining ones to stack slots in the
+// frame of the function.
+//
+// Physical registers that are used explicitly by the code generator (e.g. for
+// parameters, return values or division) and registers that are clobbered by
+// calls are taken into account: a virtual register is never assigned a
+// physical register that is written or read while the virtual register is
+// live. The registers %r10, %r11, %xmm14 and %xmm15 are never allocated, and
+// are used to load and store spilled virtual registers where an instruction
+// needs a register operand.
+class RegisterAllocatorX64 {
+  public:
+    // Spill slot i is placed at 'spill_offset - 8 * (i + 1)' relative to
+    // 'spill_base'.
+    explicit RegisterAllocatorX64(Register spill_base, int spill_offset = 0)
+        : spill_base(spill_base), spill_offset(spill_offset) {}
+
+    // Allocates registers for the function consisting of the basic blocks in
+    // [begin, end), of which the first block is the entry point. The
+    // instructions are rewritten in place. Returns the number of spill slots.
+    unsigned int allocate(std::vector<BasicBlock>::iterator begin,
+                          std::vector<BasicBlock>::iterator end);
+
+    // Returns the physical registers assigned by the last allocation.
+    const std::vector<PhysicalRegister> &getUsedRegisters() const {
+        return used_registers;
+    }
+
+  private:
+    // The range of positions in which a virtual register is live. Each
+    // instruction i has two positions: its operands are read at 2i and
+    // written at 2i + 1.
+    struct LiveInterval {
+        unsigned int vreg;
+        unsigned int start;
+        unsigned int end;
+
+        // Index of the assigned physical register, or -1 if spilled.
+        int reg = -1;
+    };
+
+    Register spill_base;
+    int spill_offset;
+
+    std::vector<PhysicalRegister> used_registers;
+
+    // Returns the stack slot of the given spill slot number.
+    Operand spillSlot(unsigned int slot) const;
+
+    // Returns the instructions that replace 'leaq (%vA,%vB), %vD' if %vA or
+    // %vB is spilled, given the assigned registers and spill slots of the
+    // virtual registers, or no instructions if the lea is kept.
+    std::vector<Instruction>
+    lowerSpilledLea(const Instruction &ins, const std::vector<int> &assignment,
+                    const std::vector<int> &slots) const;
+};
+} // namespace codegen_x64
+
+#endif /* end of include guard: REGALLOC_X64_HPP */
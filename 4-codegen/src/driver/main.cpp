@@ -1,7 +1,14 @@
+#include "ast-opt/astoptimiser.hpp"
 #include "ast/ast.hpp"
 #include "ast/prettyprinter.hpp"
 #include "codegen-x64/codegen-x64.hpp"
 #include "codegen-x64/codegenexception.hpp"
+#include "codegen-x64/costreport-x64.hpp"
+#include "codegen-x64/elfwriter-x64.hpp"
+#include "codegen-x64/encoder-x64.hpp"
+#include "codegen-x64/jit-x64.hpp"
+#include "codegen-x64/layout-x64.hpp"
+#include "codegen-x64/lower-x64.hpp"
 #include "codegen-x64/module.hpp"
 #include "codegen-x64/optimise-x64.hpp"
 #include "lexer/lexer.hpp"
@@ -12,11 +19,17 @@
 #include "sema/semanticexception.hpp"
 #include "sema/typecheckingpass.hpp"
 #include "sema/util.hpp"
+#include "ssa/irbuilder.hpp"
+#include "ssa/passmanager.hpp"
+#include "ssa/ssaexception.hpp"
 
+#include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/WithColor.h"
 
 #include <cstdlib>
 #include <fmt/core.h>
@@ -68,6 +81,31 @@ llvm::cl::opt<bool>
                   llvm::cl::desc("Dump the type table after semantic analysis"),
                   llvm::cl::init(false));
 
+llvm::cl::opt<bool>
+    AstOpt("ast-opt",
+           llvm::cl::desc("Run the AST-level optimisation pipeline (constant "
+                          "folding, dead code elimination, common "
+                          "subexpression elimination) before code generation"),
+           llvm::cl::init(false));
+
+llvm::cl::opt<bool>
+    SSA("ssa",
+        llvm::cl::desc("Generate code through the SSA form, which is optimised "
+                       "with the passes of -ssa-passes before it is lowered"),
+        llvm::cl::init(false));
+
+llvm::cl::opt<std::string> SSAPasses(
+    "ssa-passes",
+    llvm::cl::desc("Comma-separated list of the passes to run on the SSA form "
+                   "(copy-propagation, constant-folding, dce, gvn, licm)"),
+    llvm::cl::value_desc("passes"),
+    llvm::cl::init(ssa::PassManager::getDefaultPipeline()));
+
+llvm::cl::opt<bool>
+    DumpSSA("dump-ssa",
+            llvm::cl::desc("Dump the SSA form after it has been optimised"),
+            llvm::cl::init(false));
+
 llvm::cl::opt<bool> DumpAssembly(
     "dump-assembly",
     llvm::cl::desc("Dump the generated assembly after code generation"),
@@ -77,6 +115,48 @@ llvm::cl::alias DumpAssemblyAlias("S",
                                   llvm::cl::desc("Alias for -dump-assembly"),
                                   llvm::cl::aliasopt(DumpAssembly));
 
+llvm::cl::opt<bool> CostReport(
+    "x64-cost-report",
+    llvm::cl::desc("Estimate the latency and throughput of every basic block "
+                   "of the generated code instead of dumping the assembly"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> DebugInfo(
+    "g",
+    llvm::cl::desc("Emit a line table and call frame information with the "
+                   "assembly, for debuggers and profilers"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<std::string> OutputFilename(
+    "o",
+    llvm::cl::desc("Write an ELF object file instead of dumping the assembly"),
+    llvm::cl::value_desc("filename"));
+
+llvm::cl::opt<bool>
+    Run("run",
+        llvm::cl::desc("Run the program in-process instead of dumping the "
+                       "assembly, and exit with the result of 'main'"),
+        llvm::cl::init(false));
+
+llvm::cl::opt<bool> PerfMap(
+    "perf-map",
+    llvm::cl::desc("Describe the code run with -run in /tmp/perf-<pid>.map"),
+    llvm::cl::init(false));
+
+// Adds the float functions of the runtime (see runtime/runtime.cpp) to a
+// function table. CollectFuncDeclsPass only declares the integer ones.
+static void
+addRuntimeFunctions(llvm::LLVMContext &ctx,
+                    sema::CollectFuncDeclsPass::FunctionTable &function_table) {
+    llvm::Type *floatTy = llvm::Type::getFloatTy(ctx);
+    llvm::Type *voidTy = llvm::Type::getVoidTy(ctx);
+
+    function_table.emplace("print_f",
+                           llvm::FunctionType::get(voidTy, {floatTy}, false));
+    function_table.emplace("read_f",
+                           llvm::FunctionType::get(floatTy, {}, false));
+}
+
 int main(int argc, char *argv[]) {
     // Create an LLVM context
     llvm::LLVMContext ctx;
@@ -130,14 +210,17 @@ int main(int argc, char *argv[]) {
     sema::CollectFuncDeclsPass collectFuncDeclsPass{ctx};
     sema::ScopeResolutionPass scopeResolutionPass;
     sema::TypeCheckingPass typeCheckingPass{ctx};
+    sema::CollectFuncDeclsPass::FunctionTable functionTable;
 
     try {
         // Run all semantic passes in the correct order.
         collectFuncDeclsPass.visit(*root);
         scopeResolutionPass.visit(*root);
 
-        typeCheckingPass.setFunctionTable(
-            collectFuncDeclsPass.getFunctionTable());
+        functionTable = collectFuncDeclsPass.getFunctionTable();
+        addRuntimeFunctions(ctx, functionTable);
+
+        typeCheckingPass.setFunctionTable(functionTable);
         typeCheckingPass.setSymbolTable(scopeResolutionPass.getSymbolTable());
 
         typeCheckingPass.visit(*root);
@@ -155,7 +238,6 @@ int main(int argc, char *argv[]) {
 
     if (DumpFunctionTable) {
         std::cout << "Function table:\n";
-        auto functionTable = collectFuncDeclsPass.getFunctionTable();
 
         for (const auto &func : functionTable) {
             fmt::print("{:20}{}\n", func.first,
@@ -182,29 +264,118 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // Phase 4: code generation
-    codegen_x64::CodeGeneratorX64 codeGenerator{
-        scopeResolutionPass.getSymbolTable()};
+    // Phase 3b: AST-level optimisation
+    ast_opt::ASTOptimiser astOptimiser{scopeResolutionPass.getSymbolTable(),
+                                       typeCheckingPass.getTypeTable()};
+
+    if (AstOpt) {
+        astOptimiser.optimise(*root);
+
+        if (DumpAst) {
+            ast::PrettyPrinter printer(std::cout, AsciiMode, DumpAstIds);
+            printer.visit(*root, "", true);
+        }
+    }
+
+    // Phase 4: code generation, directly from the AST or through SSA form
+    codegen_x64::Module module;
 
     try {
-        codeGenerator.visit(*root);
+        if (SSA) {
+            ssa::Module ssaModule;
+            ssa::IRBuilder builder{astOptimiser.getSymbolTable(),
+                                   astOptimiser.getTypeTable()};
+            builder.build(*root, ssaModule);
+
+            ssa::PassManager passManager;
+            passManager.addPipeline(SSAPasses);
+            passManager.run(ssaModule);
+
+            if (DumpSSA)
+                llvm::outs() << ssaModule;
+
+            codegen_x64::LoweringX64 lowering;
+            module = lowering.lower(ssaModule);
+        } else {
+            codegen_x64::CodeGeneratorX64 codeGenerator{
+                astOptimiser.getSymbolTable(), astOptimiser.getTypeTable()};
+            codeGenerator.visit(*root);
+            module = codeGenerator.getModule();
+        }
+    } catch (ssa::SSAException &e) {
+        llvm::WithColor::error(llvm::errs(), "ssa") << e.what() << "\n";
+        return EXIT_FAILURE;
     } catch (codegen_x64::CodegenException &e) {
         llvm::WithColor::error(llvm::errs(), "codegen") << e.what() << "\n";
         return EXIT_FAILURE;
     }
 
-    codegen_x64::Module module = codeGenerator.getModule();
+    if (DebugInfo)
+        module.source_file = InputFilename;
 
     // Phase 5: code optimisation
     codegen_x64::OptimiserX64 optimiser;
     optimiser.optimise(module);
 
-    if (DumpAssembly) {
+    // Lay out the blocks last, as the optimiser may remove code from them.
+    codegen_x64::BlockLayoutX64 layout;
+    layout.layout(module);
+
+    // With -o, -run or -x64-cost-report, the assembly is only dumped if
+    // asked for.
+    if (DumpAssembly &&
+        ((OutputFilename.empty() && !Run && !CostReport) ||
+         DumpAssembly.getNumOccurrences())) {
         llvm::formatted_raw_ostream(llvm::outs()) << module;
     }
 
+    if (CostReport) {
+        codegen_x64::CostReportX64 report;
+        report.print(llvm::outs(), module);
+    }
+
+    // Phase 6: object file emission
+    if (!OutputFilename.empty()) {
+        std::error_code ec;
+        llvm::raw_fd_ostream output(OutputFilename, ec, llvm::sys::fs::OF_None);
+
+        if (ec) {
+            llvm::WithColor::error(llvm::errs(), "microcc")
+                << fmt::format("cannot open '{}': {}\n",
+                               std::string(OutputFilename), ec.message());
+            return EXIT_FAILURE;
+        }
+
+        try {
+            codegen_x64::EncoderX64 encoder;
+            codegen_x64::ObjectCode object = encoder.encode(module);
+
+            codegen_x64::ELFWriterX64 writer;
+            writer.write(output, module, object);
+        } catch (codegen_x64::CodegenException &e) {
+            llvm::WithColor::error(llvm::errs(), "codegen") << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Phase 7: execution
+    int status = EXIT_SUCCESS;
+
+    if (Run) {
+        llvm::outs().flush();
+
+        try {
+            codegen_x64::JITX64 jit{PerfMap};
+            jit.load(module);
+            status = static_cast<int>(jit.run("main"));
+        } catch (codegen_x64::CodegenException &e) {
+            llvm::WithColor::error(llvm::errs(), "codegen") << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     // We need to call this to print statistics using -stats.
     llvm::llvm_shutdown();
 
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -1,4 +1,5 @@
 #include <cstdint>
+#include <ios>
 #include <iostream>
 
 // Micro-C standard library
@@ -28,4 +29,14 @@ std::int64_t sum8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
     return arg0 + arg1 + arg2 + arg3 + arg4 + arg5 + arg6 + arg7;
 }
 
+void print_f(float f) { std::cout << std::showpoint << f << "\n"; }
+
+float read_f() {
+    float f;
+    std::cout << "> ";
+    std::cin >> f;
+
+    return f;
+}
+
 };
@@ -0,0 +1,271 @@
+#include "ssa/constantfoldingpass.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+#define DEBUG_TYPE "ssa-constant-folding"
+
+STATISTIC(NumFolded, "The number of instructions folded into a constant");
+STATISTIC(NumSimplified,
+          "The number of instructions simplified by an algebraic identity");
+STATISTIC(NumBranchesFolded,
+          "The number of conditional branches on a constant folded");
+
+namespace {
+using namespace ssa;
+
+bool isConstant(const Instruction *ins, std::int64_t value) {
+    return ins->opcode == Opcode::Const && ins->type == Type::Int &&
+           ins->value == value;
+}
+
+bool isFloatConstant(const Instruction *ins, float value) {
+    return ins->opcode == Opcode::Const && ins->type == Type::Float &&
+           ins->getFloat() == value && !std::signbit(ins->getFloat());
+}
+
+// Returns the constant that an integer operation on constants yields, or
+// nullptr if it cannot be folded.
+Instruction *foldInt(Function &function, Opcode opcode, std::int64_t lhs,
+                     std::int64_t rhs) {
+    // Wrap around like the hardware, without signed overflow.
+    auto u = [](std::int64_t value) {
+        return static_cast<std::uint64_t>(value);
+    };
+    std::int64_t result;
+
+    switch (opcode) {
+    case Opcode::Add:
+        result = static_cast<std::int64_t>(u(lhs) + u(rhs));
+        break;
+    case Opcode::Sub:
+        result = static_cast<std::int64_t>(u(lhs) - u(rhs));
+        break;
+    case Opcode::Mul:
+        result = static_cast<std::int64_t>(u(lhs) * u(rhs));
+        break;
+    case Opcode::Div:
+    case Opcode::Rem:
+        if (rhs == 0 || (lhs == INT64_MIN && rhs == -1))
+            return nullptr;
+        result = opcode == Opcode::Div ? lhs / rhs : lhs % rhs;
+        break;
+    case Opcode::Neg:
+        result = static_cast<std::int64_t>(0 - u(lhs));
+        break;
+    case Opcode::Eq:
+        result = lhs == rhs;
+        break;
+    case Opcode::Ne:
+        result = lhs != rhs;
+        break;
+    case Opcode::Lt:
+        result = lhs < rhs;
+        break;
+    case Opcode::Le:
+        result = lhs <= rhs;
+        break;
+    case Opcode::Gt:
+        result = lhs > rhs;
+        break;
+    case Opcode::Ge:
+        result = lhs >= rhs;
+        break;
+    default:
+        return nullptr;
+    }
+
+    return function.getConstant(Type::Int, result);
+}
+
+// Returns the constant that a float operation on constants yields, or nullptr
+// if it cannot be folded.
+Instruction *foldFloat(Function &function, Opcode opcode, float lhs,
+                       float rhs) {
+    // Comparisons are ordered, so only the C++ '!=' needs a test for NaN.
+    bool ordered = !std::isnan(lhs) && !std::isnan(rhs);
+
+    switch (opcode) {
+    case Opcode::Add:
+        return function.getFloatConstant(lhs + rhs);
+    case Opcode::Sub:
+        return function.getFloatConstant(lhs - rhs);
+    case Opcode::Mul:
+        return function.getFloatConstant(lhs * rhs);
+    case Opcode::Div:
+        return function.getFloatConstant(lhs / rhs);
+    case Opcode::Rem:
+        // fmodf is exact, so it yields the same value at run time.
+        return function.getFloatConstant(std::fmod(lhs, rhs));
+    case Opcode::Neg:
+        // '-x' is computed as '0 - x', see CodeGeneratorX64.
+        return function.getFloatConstant(0.0f - lhs);
+    case Opcode::Eq:
+        return function.getConstant(Type::Int, lhs == rhs);
+    case Opcode::Ne:
+        return function.getConstant(Type::Int, ordered && lhs != rhs);
+    case Opcode::Lt:
+        return function.getConstant(Type::Int, lhs < rhs);
+    case Opcode::Le:
+        return function.getConstant(Type::Int, lhs <= rhs);
+    case Opcode::Gt:
+        return function.getConstant(Type::Int, lhs > rhs);
+    case Opcode::Ge:
+        return function.getConstant(Type::Int, lhs >= rhs);
+    default:
+        return nullptr;
+    }
+}
+
+// Returns the value that an instruction with one constant operand is equal
+// to, or nullptr.
+Instruction *simplify(Function &function, const Instruction &ins) {
+    Instruction *lhs = ins.operands[0];
+    Instruction *rhs = ins.operands[1];
+
+    if (ins.type == Type::Float) {
+        // x - 0.0, x * 1.0 and x / 1.0 are exact, even for NaN and -0.0.
+        if ((ins.opcode == Opcode::Sub && isFloatConstant(rhs, 0.0f)) ||
+            ((ins.opcode == Opcode::Mul || ins.opcode == Opcode::Div) &&
+             isFloatConstant(rhs, 1.0f)))
+            return lhs;
+        if (ins.opcode == Opcode::Mul && isFloatConstant(lhs, 1.0f))
+            return rhs;
+
+        return nullptr;
+    }
+
+    switch (ins.opcode) {
+    case Opcode::Add:
+        return isConstant(rhs, 0) ? lhs : isConstant(lhs, 0) ? rhs : nullptr;
+    case Opcode::Sub:
+        return isConstant(rhs, 0) ? lhs : nullptr;
+    case Opcode::Mul:
+        if (isConstant(lhs, 0) || isConstant(rhs, 0))
+            return function.getConstant(Type::Int, 0);
+        return isConstant(rhs, 1) ? lhs : isConstant(lhs, 1) ? rhs : nullptr;
+    case Opcode::Div:
+        return isConstant(rhs, 1) ? lhs : nullptr;
+    case Opcode::Rem:
+        return isConstant(rhs, 1) || isConstant(rhs, -1)
+                   ? function.getConstant(Type::Int, 0)
+                   : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+// Returns the constant or value that replaces an instruction, or nullptr.
+Instruction *fold(Function &function, const Instruction &ins) {
+    switch (ins.opcode) {
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::Div:
+    case Opcode::Rem:
+    case Opcode::Eq:
+    case Opcode::Ne:
+    case Opcode::Lt:
+    case Opcode::Le:
+    case Opcode::Gt:
+    case Opcode::Ge:
+        break;
+    case Opcode::Neg:
+        if (ins.operands[0]->opcode != Opcode::Const)
+            return nullptr;
+
+        ++NumFolded;
+        return ins.type == Type::Float
+                   ? foldFloat(function, ins.opcode,
+                               ins.operands[0]->getFloat(), 0.0f)
+                   : foldInt(function, ins.opcode, ins.operands[0]->value, 0);
+    default:
+        return nullptr;
+    }
+
+    const Instruction &lhs = *ins.operands[0];
+    const Instruction &rhs = *ins.operands[1];
+
+    if (lhs.opcode != Opcode::Const || rhs.opcode != Opcode::Const) {
+        Instruction *value = simplify(function, ins);
+        if (value)
+            ++NumSimplified;
+
+        return value;
+    }
+
+    Instruction *value =
+        lhs.type == Type::Float
+            ? foldFloat(function, ins.opcode, lhs.getFloat(), rhs.getFloat())
+            : foldInt(function, ins.opcode, lhs.value, rhs.value);
+    if (value)
+        ++NumFolded;
+
+    return value;
+}
+} // namespace
+
+bool ssa::ConstantFoldingPass::run(Function &function) {
+    std::unordered_map<Instruction *, Instruction *> replacements;
+    bool changed = false;
+
+    // Operands are replaced as soon as they are folded, so that the users
+    // of a folded instruction can be folded in the same scan. Uses that come
+    // before their definition in the list of blocks, e.g. in phis, need
+    // another scan.
+    for (bool folded = true; folded;) {
+        folded = false;
+
+        for (const auto &block : function.blocks) {
+            for (const auto &ins : block->instructions) {
+                for (auto &operand : ins->operands) {
+                    for (auto it = replacements.find(operand);
+                         it != std::end(replacements);
+                         it = replacements.find(operand))
+                        operand = it->second;
+                }
+
+                if (replacements.count(ins.get()))
+                    continue;
+
+                if (Instruction *value = fold(function, *ins)) {
+                    replacements[ins.get()] = value;
+                    folded = true;
+                }
+            }
+
+            // A constant condition decides the branch.
+            Instruction *terminator = block->getTerminator();
+
+            if (terminator && terminator->opcode == Opcode::CondBr &&
+                terminator->operands[0]->opcode == Opcode::Const) {
+                bool taken = terminator->operands[0]->value != 0;
+                BasicBlock *target = terminator->blocks[taken ? 0 : 1];
+
+                Function::removeEdge(block.get(),
+                                     terminator->blocks[taken ? 1 : 0]);
+                terminator->opcode = Opcode::Br;
+                terminator->operands.clear();
+                terminator->blocks = {target};
+
+                ++NumBranchesFolded;
+                changed = true;
+            }
+        }
+    }
+
+    if (replacements.empty())
+        return changed;
+
+    function.replaceUses(replacements);
+
+    for (const auto &block : function.blocks)
+        block->eraseIf([&](Instruction *ins) {
+            return replacements.count(ins) != 0;
+        });
+
+    return true;
+}
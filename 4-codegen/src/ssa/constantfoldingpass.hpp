@@ -0,0 +1,21 @@
+#ifndef SSA_CONSTANTFOLDINGPASS_HPP
+#define SSA_CONSTANTFOLDINGPASS_HPP
+
+#include "ssa/passmanager.hpp"
+
+namespace ssa {
+// Folds instructions whose operands are constants, with the semantics of the
+// x64 backend: 64-bit integers that wrap around, and single-precision floats.
+// Divisions that trap (by zero, or of the smallest integer by -1) and powers
+// are left alone. Algebraic identities with one constant operand (x + 0,
+// x * 1, x * 0, ...) are applied where they hold for every value, which rules
+// out most of them for floats. Conditional branches on a constant become
+// branches, and the other edge is removed.
+class ConstantFoldingPass : public FunctionPass {
+  public:
+    const char *getName() const override { return "constant-folding"; }
+    bool run(Function &function) override;
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_CONSTANTFOLDINGPASS_HPP */
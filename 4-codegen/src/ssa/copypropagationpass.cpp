@@ -0,0 +1,84 @@
+#include "ssa/copypropagationpass.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#include <unordered_map>
+
+#define DEBUG_TYPE "ssa-copy-propagation"
+
+STATISTIC(NumCopiesRemoved, "The number of copies removed");
+STATISTIC(NumPhisRemoved, "The number of trivial phis removed");
+
+bool ssa::CopyPropagationPass::run(Function &function) {
+    std::unordered_map<Instruction *, Instruction *> replacements;
+
+    auto resolve = [&](Instruction *value) {
+        for (auto it = replacements.find(value); it != std::end(replacements);
+             it = replacements.find(value))
+            value = it->second;
+
+        return value;
+    };
+
+    // Removing a phi may make the phis that use it trivial, so the blocks
+    // are scanned until nothing changes.
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (const auto &block : function.blocks) {
+            for (const auto &ins : block->instructions) {
+                Instruction *value = ins.get();
+
+                if (replacements.count(value))
+                    continue;
+
+                if (ins->opcode == Opcode::Copy) {
+                    replacements[value] = ins->operands[0];
+                    ++NumCopiesRemoved;
+                    changed = true;
+                    continue;
+                }
+
+                if (ins->opcode != Opcode::Phi)
+                    continue;
+
+                Instruction *same = nullptr;
+                bool trivial = true;
+
+                for (Instruction *operand : ins->operands) {
+                    operand = resolve(operand);
+
+                    if (operand == value || operand == same)
+                        continue;
+
+                    if (same) {
+                        trivial = false;
+                        break;
+                    }
+
+                    same = operand;
+                }
+
+                // A phi without other operands is only left in unreachable
+                // blocks.
+                if (trivial && same) {
+                    replacements[value] = same;
+                    ++NumPhisRemoved;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    if (replacements.empty())
+        return false;
+
+    function.replaceUses(replacements);
+
+    for (const auto &block : function.blocks)
+        block->eraseIf([&](Instruction *ins) {
+            return replacements.count(ins) != 0;
+        });
+
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef SSA_COPYPROPAGATIONPASS_HPP
+#define SSA_COPYPROPAGATIONPASS_HPP
+
+#include "ssa/passmanager.hpp"
+
+namespace ssa {
+// Replaces the uses of copies by the copied value, and removes them. Phis
+// whose operands are all the same value, apart from the phi itself, are
+// removed the same way, until no such phi is left. These are the trivial phis
+// that the IRBuilder places, e.g. in the header of a loop that does not
+// assign the variable.
+class CopyPropagationPass : public FunctionPass {
+  public:
+    const char *getName() const override { return "copy-propagation"; }
+    bool run(Function &function) override;
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_COPYPROPAGATIONPASS_HPP */
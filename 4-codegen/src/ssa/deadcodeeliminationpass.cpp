@@ -0,0 +1,171 @@
+#include "ssa/deadcodeeliminationpass.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+#define DEBUG_TYPE "ssa-dce"
+
+STATISTIC(NumBlocksRemoved, "The number of unreachable blocks removed");
+STATISTIC(NumBlocksMerged,
+          "The number of blocks merged into their predecessor");
+STATISTIC(NumInstructionsRemoved, "The number of dead instructions removed");
+
+bool ssa::DeadCodeEliminationPass::run(Function &function) {
+    bool changed = removeUnreachableBlocks(function);
+    changed |= mergeBlocks(function);
+    changed |= removeDeadInstructions(function);
+
+    return changed;
+}
+
+bool ssa::DeadCodeEliminationPass::removeUnreachableBlocks(
+    Function &function) {
+    std::unordered_set<BasicBlock *> reachable{function.getEntry()};
+    std::vector<BasicBlock *> worklist{function.getEntry()};
+
+    while (!worklist.empty()) {
+        BasicBlock *block = worklist.back();
+        worklist.pop_back();
+
+        for (BasicBlock *succ : block->getSuccessors()) {
+            if (reachable.insert(succ).second)
+                worklist.push_back(succ);
+        }
+    }
+
+    if (reachable.size() == function.blocks.size())
+        return false;
+
+    // Only phis can use the values of unreachable blocks in reachable ones,
+    // and those operands go with the edges.
+    for (const auto &block : function.blocks) {
+        if (reachable.count(block.get()))
+            continue;
+
+        for (BasicBlock *succ : block->getSuccessors())
+            Function::removeEdge(block.get(), succ);
+    }
+
+    auto &blocks = function.blocks;
+    auto it = std::remove_if(std::begin(blocks), std::end(blocks),
+                             [&](const std::unique_ptr<BasicBlock> &block) {
+                                 return !reachable.count(block.get());
+                             });
+
+    NumBlocksRemoved += std::distance(it, std::end(blocks));
+    blocks.erase(it, std::end(blocks));
+
+    return true;
+}
+
+bool ssa::DeadCodeEliminationPass::mergeBlocks(Function &function) {
+    std::unordered_map<Instruction *, Instruction *> replacements;
+    std::unordered_set<BasicBlock *> merged;
+
+    for (const auto &block : function.blocks) {
+        if (merged.count(block.get()))
+            continue;
+
+        // Merge the successors for as long as the block ends in a branch to
+        // a block that only it branches to.
+        for (;;) {
+            Instruction *terminator = block->getTerminator();
+            if (terminator->opcode != Opcode::Br)
+                break;
+
+            BasicBlock *succ = terminator->blocks[0];
+            if (succ == block.get() || succ == function.getEntry() ||
+                succ->predecessors.size() != 1)
+                break;
+
+            // The phis of the successor have a single operand.
+            block->instructions.pop_back();
+
+            for (auto &ins : succ->instructions) {
+                if (ins->opcode == Opcode::Phi) {
+                    replacements[ins.get()] = ins->operands[0];
+                    continue;
+                }
+
+                block->append(std::move(ins));
+            }
+
+            for (BasicBlock *next : block->getSuccessors())
+                std::replace(std::begin(next->predecessors),
+                             std::end(next->predecessors), succ, block.get());
+
+            for (BasicBlock *next : block->getSuccessors()) {
+                for (const auto &ins : next->instructions) {
+                    if (ins->opcode != Opcode::Phi)
+                        break;
+
+                    std::replace(std::begin(ins->blocks),
+                                 std::end(ins->blocks), succ, block.get());
+                }
+            }
+
+            succ->instructions.clear();
+            merged.insert(succ);
+            ++NumBlocksMerged;
+        }
+    }
+
+    if (merged.empty())
+        return false;
+
+    auto &blocks = function.blocks;
+    blocks.erase(std::remove_if(std::begin(blocks), std::end(blocks),
+                                [&](const std::unique_ptr<BasicBlock> &block) {
+                                    return merged.count(block.get()) != 0;
+                                }),
+                 std::end(blocks));
+
+    function.replaceUses(replacements);
+
+    return true;
+}
+
+bool ssa::DeadCodeEliminationPass::removeDeadInstructions(Function &function) {
+    std::unordered_set<Instruction *> live;
+    std::vector<Instruction *> worklist;
+
+    for (const auto &block : function.blocks) {
+        for (const auto &ins : block->instructions) {
+            if (hasSideEffects(ins->opcode) && live.insert(ins.get()).second)
+                worklist.push_back(ins.get());
+        }
+    }
+
+    while (!worklist.empty()) {
+        Instruction *ins = worklist.back();
+        worklist.pop_back();
+
+        for (Instruction *operand : ins->operands) {
+            if (live.insert(operand).second)
+                worklist.push_back(operand);
+        }
+    }
+
+    bool changed = false;
+
+    for (const auto &block : function.blocks) {
+        block->eraseIf([&](Instruction *ins) {
+            if (live.count(ins))
+                return false;
+
+            if (ins->opcode == Opcode::Const)
+                function.eraseConstant(ins);
+            else
+                ++NumInstructionsRemoved;
+
+            changed = true;
+            return true;
+        });
+    }
+
+    return changed;
+}
@@ -0,0 +1,24 @@
+#ifndef SSA_DEADCODEELIMINATIONPASS_HPP
+#define SSA_DEADCODEELIMINATIONPASS_HPP
+
+#include "ssa/passmanager.hpp"
+
+namespace ssa {
+// Removes the blocks that cannot be reached from the entry, merges blocks
+// into their predecessor where it is their only one and branches only to
+// them, and removes the instructions whose value is not used by a store, a
+// call or a terminator, directly or indirectly. Unused loads and divisions
+// are removed as well, even if they could trap.
+class DeadCodeEliminationPass : public FunctionPass {
+  public:
+    const char *getName() const override { return "dce"; }
+    bool run(Function &function) override;
+
+  private:
+    bool removeUnreachableBlocks(Function &function);
+    bool mergeBlocks(Function &function);
+    bool removeDeadInstructions(Function &function);
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_DEADCODEELIMINATIONPASS_HPP */
@@ -0,0 +1,159 @@
+#include "ssa/dominators.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <utility>
+
+ssa::DominatorTree::DominatorTree(const Function &function) {
+    // Post-order walk from the entry, without recursion.
+    std::vector<BasicBlock *> post_order;
+    std::unordered_set<const BasicBlock *> visited;
+    std::vector<std::pair<BasicBlock *, std::size_t>> stack;
+
+    visited.insert(function.getEntry());
+    stack.emplace_back(function.getEntry(), 0);
+
+    while (!stack.empty()) {
+        auto &[block, next] = stack.back();
+        std::vector<BasicBlock *> successors = block->getSuccessors();
+
+        if (next < successors.size()) {
+            BasicBlock *succ = successors[next++];
+            if (visited.insert(succ).second)
+                stack.emplace_back(succ, 0);
+        } else {
+            post_order.push_back(block);
+            stack.pop_back();
+        }
+    }
+
+    reverse_post_order.assign(std::rbegin(post_order), std::rend(post_order));
+
+    std::unordered_map<const BasicBlock *, unsigned int> order;
+    for (unsigned int i = 0; i < reverse_post_order.size(); ++i)
+        order[reverse_post_order[i]] = i;
+
+    // The immediate dominators, by index in reverse post-order. The entry is
+    // its own dominator while the algorithm runs.
+    constexpr unsigned int undefined = UINT_MAX;
+    std::vector<unsigned int> idom(reverse_post_order.size(), undefined);
+    idom[0] = 0;
+
+    auto intersect = [&](unsigned int a, unsigned int b) {
+        while (a != b) {
+            while (a > b)
+                a = idom[a];
+            while (b > a)
+                b = idom[b];
+        }
+
+        return a;
+    };
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (unsigned int i = 1; i < reverse_post_order.size(); ++i) {
+            unsigned int new_idom = undefined;
+
+            for (const BasicBlock *pred :
+                 reverse_post_order[i]->predecessors) {
+                auto it = order.find(pred);
+                if (it == std::end(order) || idom[it->second] == undefined)
+                    continue;
+
+                new_idom = new_idom == undefined
+                               ? it->second
+                               : intersect(it->second, new_idom);
+            }
+
+            if (idom[i] != new_idom) {
+                idom[i] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < reverse_post_order.size(); ++i) {
+        Node &node = nodes[reverse_post_order[i]];
+
+        if (i != 0) {
+            node.idom = reverse_post_order[idom[i]];
+            nodes[node.idom].children.push_back(reverse_post_order[i]);
+        }
+    }
+
+    // Number the blocks in a depth-first walk of the tree.
+    unsigned int number = 0;
+    std::vector<std::pair<const BasicBlock *, bool>> walk{
+        {function.getEntry(), false}};
+
+    while (!walk.empty()) {
+        auto [block, done] = walk.back();
+        walk.pop_back();
+        Node &node = nodes[block];
+
+        if (done) {
+            node.post = number++;
+            continue;
+        }
+
+        node.pre = number++;
+        walk.emplace_back(block, true);
+        for (const BasicBlock *child : node.children)
+            walk.emplace_back(child, false);
+    }
+}
+
+bool ssa::DominatorTree::dominates(const BasicBlock *a,
+                                   const BasicBlock *b) const {
+    const Node &node_a = nodes.at(a);
+    const Node &node_b = nodes.at(b);
+
+    return node_a.pre <= node_b.pre && node_b.post <= node_a.post;
+}
+
+std::vector<ssa::Loop> ssa::findLoops(const DominatorTree &dominators) {
+    std::vector<Loop> loops;
+
+    // Headers are visited in reverse post-order, so outer loops come before
+    // the loops they contain.
+    for (BasicBlock *header : dominators.getReversePostOrder()) {
+        Loop loop{header, {header}};
+        std::vector<BasicBlock *> worklist;
+        bool is_loop = false;
+
+        // The sources of the back edges, i.e. the predecessors that the
+        // header dominates.
+        for (BasicBlock *pred : header->predecessors) {
+            if (dominators.isReachable(pred) &&
+                dominators.dominates(header, pred)) {
+                worklist.push_back(pred);
+                is_loop = true;
+            }
+        }
+
+        if (!is_loop)
+            continue;
+
+        while (!worklist.empty()) {
+            BasicBlock *block = worklist.back();
+            worklist.pop_back();
+
+            if (!loop.blocks.insert(block).second)
+                continue;
+
+            for (BasicBlock *pred : block->predecessors) {
+                if (dominators.isReachable(pred))
+                    worklist.push_back(pred);
+            }
+        }
+
+        loops.push_back(std::move(loop));
+    }
+
+    std::reverse(std::begin(loops), std::end(loops));
+
+    return loops;
+}
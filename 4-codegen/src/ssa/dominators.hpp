@@ -0,0 +1,74 @@
+#ifndef SSA_DOMINATORS_HPP
+#define SSA_DOMINATORS_HPP
+
+#include "ssa/ir.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ssa {
+// Dominator tree of the reachable blocks of a function, computed with the
+// iterative algorithm of Cooper, Harvey and Kennedy (A Simple, Fast Dominance
+// Algorithm, 2001) over the reverse post-order. Blocks are numbered in a
+// depth-first walk of the tree, so that dominance is tested in constant time.
+// The tree must be recomputed when the control-flow graph changes.
+class DominatorTree {
+  public:
+    explicit DominatorTree(const Function &function);
+
+    // Returns the reachable blocks in reverse post-order.
+    const std::vector<BasicBlock *> &getReversePostOrder() const {
+        return reverse_post_order;
+    }
+
+    bool isReachable(const BasicBlock *block) const {
+        return nodes.count(block) != 0;
+    }
+
+    // Returns the immediate dominator of a reachable block, or nullptr for
+    // the entry.
+    BasicBlock *getIdom(const BasicBlock *block) const {
+        return nodes.at(block).idom;
+    }
+
+    // Returns the blocks that a reachable block immediately dominates.
+    const std::vector<BasicBlock *> &
+    getChildren(const BasicBlock *block) const {
+        return nodes.at(block).children;
+    }
+
+    // Returns true if every path from the entry to 'b' goes through 'a'. A
+    // block dominates itself.
+    bool dominates(const BasicBlock *a, const BasicBlock *b) const;
+
+  private:
+    struct Node {
+        BasicBlock *idom = nullptr;
+        std::vector<BasicBlock *> children;
+
+        // Numbers of the block in a walk of the tree, before and after its
+        // children.
+        unsigned int pre = 0;
+        unsigned int post = 0;
+    };
+
+    std::vector<BasicBlock *> reverse_post_order;
+    std::unordered_map<const BasicBlock *, Node> nodes;
+};
+
+// A natural loop: the header and the blocks that reach a back edge to the
+// header without going through it. Back edges to the same header form one
+// loop.
+struct Loop {
+    BasicBlock *header;
+    std::unordered_set<BasicBlock *> blocks;
+
+    bool contains(BasicBlock *block) const { return blocks.count(block) != 0; }
+};
+
+// Returns the natural loops of the reachable blocks, inner loops first.
+std::vector<Loop> findLoops(const DominatorTree &dominators);
+} // namespace ssa
+
+#endif /* end of include guard: SSA_DOMINATORS_HPP */
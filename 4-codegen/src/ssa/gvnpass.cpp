@@ -0,0 +1,140 @@
+#include "ssa/gvnpass.hpp"
+#include "ssa/dominators.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define DEBUG_TYPE "ssa-gvn"
+
+STATISTIC(NumRedundant, "The number of redundant instructions removed by GVN");
+
+namespace {
+using namespace ssa;
+
+// The value computed by an instruction: its opcode, type, operands, and the
+// block of a phi.
+using Key = std::tuple<Opcode, Type, BasicBlock *, std::vector<Instruction *>>;
+
+bool isNumbered(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::Phi:
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::Div:
+    case Opcode::Rem:
+    case Opcode::Pow:
+    case Opcode::Neg:
+    case Opcode::Eq:
+    case Opcode::Ne:
+    case Opcode::Lt:
+    case Opcode::Le:
+    case Opcode::Gt:
+    case Opcode::Ge:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Key makeKey(const Instruction &ins) {
+    Opcode opcode = ins.opcode;
+    std::vector<Instruction *> operands = ins.operands;
+
+    if (opcode == Opcode::Phi) {
+        // The operands of a phi are only comparable in the order of the
+        // predecessors.
+        return {opcode, ins.type, ins.parent, operands};
+    }
+
+    if (opcode == Opcode::Gt || opcode == Opcode::Ge) {
+        opcode = opcode == Opcode::Gt ? Opcode::Lt : Opcode::Le;
+        std::swap(operands[0], operands[1]);
+    } else if (isCommutative(opcode) && std::less<Instruction *>{}(
+                                            operands[1], operands[0])) {
+        std::swap(operands[0], operands[1]);
+    }
+
+    return {opcode, ins.type, nullptr, operands};
+}
+} // namespace
+
+bool ssa::GVNPass::run(Function &function) {
+    DominatorTree dominators{function};
+    std::unordered_map<Instruction *, Instruction *> replacements;
+    std::map<Key, Instruction *> table;
+
+    // Walk the dominator tree depth first. The keys that a block adds to the
+    // table are removed again when the walk leaves it.
+    struct Frame {
+        BasicBlock *block;
+        std::size_t next_child = 0;
+        std::vector<Key> added;
+    };
+    std::vector<Frame> stack{{function.getEntry(), 0, {}}};
+    bool enter = true;
+
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+
+        if (enter) {
+            for (const auto &ins : frame.block->instructions) {
+                // Operands that are defined in a dominating block have been
+                // numbered already. Phi operands may come from later blocks,
+                // and are replaced at the end.
+                for (auto &operand : ins->operands) {
+                    auto it = replacements.find(operand);
+                    if (it != std::end(replacements))
+                        operand = it->second;
+                }
+
+                if (!isNumbered(ins->opcode))
+                    continue;
+
+                Key key = makeKey(*ins);
+                auto [it, inserted] = table.emplace(key, ins.get());
+
+                if (inserted) {
+                    frame.added.push_back(std::move(key));
+                } else {
+                    replacements[ins.get()] = it->second;
+                    ++NumRedundant;
+                }
+            }
+        }
+
+        const auto &children = dominators.getChildren(frame.block);
+
+        if (frame.next_child < children.size()) {
+            BasicBlock *child = children[frame.next_child++];
+            stack.push_back(Frame{child, 0, {}});
+            enter = true;
+            continue;
+        }
+
+        for (const Key &key : frame.added)
+            table.erase(key);
+
+        stack.pop_back();
+        enter = false;
+    }
+
+    if (replacements.empty())
+        return false;
+
+    function.replaceUses(replacements);
+
+    for (const auto &block : function.blocks)
+        block->eraseIf([&](Instruction *ins) {
+            return replacements.count(ins) != 0;
+        });
+
+    return true;
+}
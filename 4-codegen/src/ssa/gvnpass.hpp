@@ -0,0 +1,22 @@
+#ifndef SSA_GVNPASS_HPP
+#define SSA_GVNPASS_HPP
+
+#include "ssa/passmanager.hpp"
+
+namespace ssa {
+// Global value numbering by hashing over the dominator tree (Briggs, Cooper
+// and Simpson, Value Numbering, 1997). Pure instructions are looked up by
+// their opcode, type and operands in a table that holds the instructions of
+// the dominating blocks, and are replaced by the one found. Operands of
+// commutative operators are put in a fixed order, and 'a > b' and 'a >= b'
+// are looked up as 'b < a' and 'b <= a'. Phis are only equal to the phis of
+// the same block. Loads and calls are never numbered, as stores and callees
+// may change what they read.
+class GVNPass : public FunctionPass {
+  public:
+    const char *getName() const override { return "gvn"; }
+    bool run(Function &function) override;
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_GVNPASS_HPP */
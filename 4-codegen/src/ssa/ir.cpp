@@ -0,0 +1,394 @@
+#include "ssa/ir.hpp"
+#include "ssa/ssaexception.hpp"
+
+#include <fmt/core.h>
+
+#include <cstring>
+#include <iterator>
+#include <unordered_set>
+
+const char *ssa::getOpcodeName(Opcode opcode) {
+    switch (opcode) {
+    case Opcode::Const:
+        return "const";
+    case Opcode::Param:
+        return "param";
+    case Opcode::Phi:
+        return "phi";
+    case Opcode::Copy:
+        return "copy";
+    case Opcode::Add:
+        return "add";
+    case Opcode::Sub:
+        return "sub";
+    case Opcode::Mul:
+        return "mul";
+    case Opcode::Div:
+        return "div";
+    case Opcode::Rem:
+        return "rem";
+    case Opcode::Pow:
+        return "pow";
+    case Opcode::Neg:
+        return "neg";
+    case Opcode::Eq:
+        return "eq";
+    case Opcode::Ne:
+        return "ne";
+    case Opcode::Lt:
+        return "lt";
+    case Opcode::Le:
+        return "le";
+    case Opcode::Gt:
+        return "gt";
+    case Opcode::Ge:
+        return "ge";
+    case Opcode::Load:
+        return "load";
+    case Opcode::Store:
+        return "store";
+    case Opcode::Call:
+        return "call";
+    case Opcode::Br:
+        return "br";
+    case Opcode::CondBr:
+        return "condbr";
+    case Opcode::Ret:
+        return "ret";
+    }
+
+    return "?";
+}
+
+bool ssa::isTerminator(Opcode opcode) {
+    return opcode == Opcode::Br || opcode == Opcode::CondBr ||
+           opcode == Opcode::Ret;
+}
+
+bool ssa::isComparison(Opcode opcode) {
+    return opcode >= Opcode::Eq && opcode <= Opcode::Ge;
+}
+
+bool ssa::isCommutative(Opcode opcode) {
+    return opcode == Opcode::Add || opcode == Opcode::Mul ||
+           opcode == Opcode::Eq || opcode == Opcode::Ne;
+}
+
+bool ssa::hasSideEffects(Opcode opcode) {
+    return opcode == Opcode::Store || opcode == Opcode::Call ||
+           isTerminator(opcode);
+}
+
+float ssa::Instruction::getFloat() const {
+    std::uint32_t bits = static_cast<std::uint32_t>(value);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+
+    return f;
+}
+
+ssa::Instruction *ssa::BasicBlock::getTerminator() const {
+    if (instructions.empty() || !isTerminator(instructions.back()->opcode))
+        return nullptr;
+
+    return instructions.back().get();
+}
+
+std::vector<ssa::BasicBlock *> ssa::BasicBlock::getSuccessors() const {
+    Instruction *terminator = getTerminator();
+
+    return terminator ? terminator->blocks : std::vector<BasicBlock *>{};
+}
+
+ssa::Instruction *
+ssa::BasicBlock::append(std::unique_ptr<Instruction> instruction) {
+    instruction->parent = this;
+    instructions.push_back(std::move(instruction));
+
+    return instructions.back().get();
+}
+
+ssa::Instruction *ssa::BasicBlock::insertBeforeTerminator(
+    std::unique_ptr<Instruction> instruction) {
+    auto position = std::end(instructions);
+    if (getTerminator())
+        --position;
+
+    instruction->parent = this;
+    return instructions.insert(position, std::move(instruction))->get();
+}
+
+ssa::Instruction *ssa::Function::getConstant(Type type, std::int64_t value) {
+    Instruction *&constant = constants[{type, value}];
+
+    if (!constant) {
+        auto ins = std::make_unique<Instruction>(Opcode::Const, type);
+        ins->value = value;
+        ins->parent = getEntry();
+        constant = ins.get();
+
+        auto &entry = getEntry()->instructions;
+        entry.insert(std::begin(entry), std::move(ins));
+    }
+
+    return constant;
+}
+
+ssa::Instruction *ssa::Function::getFloatConstant(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    return getConstant(Type::Float, bits);
+}
+
+void ssa::Function::eraseConstant(const Instruction *constant) {
+    constants.erase({constant->type, constant->value});
+}
+
+void ssa::Function::replaceUses(
+    const std::unordered_map<Instruction *, Instruction *> &replacements) {
+    if (replacements.empty())
+        return;
+
+    auto resolve = [&](Instruction *value) {
+        // Chains end, as a value is never replaced by itself.
+        for (auto it = replacements.find(value); it != std::end(replacements);
+             it = replacements.find(value))
+            value = it->second;
+
+        return value;
+    };
+
+    for (const auto &block : blocks) {
+        for (const auto &ins : block->instructions) {
+            for (auto &operand : ins->operands)
+                operand = resolve(operand);
+        }
+    }
+}
+
+ssa::BasicBlock *ssa::Function::createBlock(const std::string &name,
+                                            BasicBlock *after) {
+    auto block = std::make_unique<BasicBlock>(
+        blocks.empty() ? name : fmt::format("{}{}", name, num_blocks));
+    auto position = std::end(blocks);
+    ++num_blocks;
+
+    if (after) {
+        position = std::find_if(
+            std::begin(blocks), std::end(blocks),
+            [&](const std::unique_ptr<BasicBlock> &b) {
+                return b.get() == after;
+            });
+        ++position;
+    }
+
+    return blocks.insert(position, std::move(block))->get();
+}
+
+void ssa::Function::removeEdge(BasicBlock *from, BasicBlock *to) {
+    auto &preds = to->predecessors;
+    auto it = std::find(std::begin(preds), std::end(preds), from);
+
+    if (it == std::end(preds))
+        return;
+
+    std::size_t index = std::distance(std::begin(preds), it);
+    preds.erase(it);
+
+    for (const auto &ins : to->instructions) {
+        if (ins->opcode != Opcode::Phi)
+            break;
+
+        ins->operands.erase(std::begin(ins->operands) + index);
+        ins->blocks.erase(std::begin(ins->blocks) + index);
+    }
+}
+
+void ssa::Function::verify() const {
+    std::unordered_set<const Instruction *> defined;
+    std::unordered_set<const BasicBlock *> function_blocks;
+
+    for (const auto &block : blocks) {
+        function_blocks.insert(block.get());
+        for (const auto &ins : block->instructions)
+            defined.insert(ins.get());
+    }
+
+    auto fail = [&](const BasicBlock &block, const std::string &message) {
+        throw SSAException(fmt::format("Invalid SSA in block '{}' of '{}': {}",
+                                       block.name, name, message));
+    };
+
+    for (const auto &block : blocks) {
+        if (!block->getTerminator())
+            fail(*block, "no terminator");
+
+        // Each branch to a block must be one of its predecessors.
+        std::vector<BasicBlock *> successors = block->getSuccessors();
+
+        for (BasicBlock *succ : successors) {
+            if (!function_blocks.count(succ))
+                fail(*block, "branch to a block of another function");
+
+            auto &preds = succ->predecessors;
+            if (std::count(std::begin(preds), std::end(preds), block.get()) !=
+                std::count(std::begin(successors), std::end(successors), succ))
+                fail(*succ, fmt::format("predecessor '{}' is missing",
+                                        block->name));
+        }
+
+        bool phis = true;
+
+        for (const auto &ins : block->instructions) {
+            if (ins->parent != block.get())
+                fail(*block, "instruction with the wrong parent");
+
+            if (ins->opcode == Opcode::Phi) {
+                if (!phis)
+                    fail(*block, "phi after other instructions");
+                if (ins->blocks != block->predecessors)
+                    fail(*block, "phi does not match the predecessors");
+            } else {
+                phis = false;
+            }
+
+            if (isTerminator(ins->opcode) &&
+                ins.get() != block->getTerminator())
+                fail(*block, "terminator in the middle of the block");
+
+            for (const Instruction *operand : ins->operands) {
+                if (!defined.count(operand))
+                    fail(*block,
+                         fmt::format("use of an undefined value in '{}'",
+                                     getOpcodeName(ins->opcode)));
+            }
+        }
+    }
+}
+
+llvm::raw_ostream &ssa::operator<<(llvm::raw_ostream &os, Type type) {
+    switch (type) {
+    case Type::Void:
+        return os << "void";
+    case Type::Int:
+        return os << "int";
+    case Type::Float:
+        return os << "float";
+    }
+
+    return os;
+}
+
+llvm::raw_ostream &ssa::operator<<(llvm::raw_ostream &os,
+                                   const Function &function) {
+    // Values are numbered in order, and constants are printed where they are
+    // used.
+    std::unordered_map<const Instruction *, std::string> names;
+
+    for (const auto &block : function.blocks) {
+        for (const auto &ins : block->instructions) {
+            if (ins->type == Type::Void || ins->opcode == Opcode::Const)
+                continue;
+
+            std::string number = std::to_string(names.size());
+            names[ins.get()] =
+                ins->name.empty() || ins->opcode == Opcode::Call
+                    ? "%" + number
+                    : fmt::format("%{}.{}", ins->name, number);
+        }
+    }
+
+    auto value = [&](const Instruction *ins) -> std::string {
+        if (ins->opcode != Opcode::Const) {
+            auto it = names.find(ins);
+            return it != std::end(names) ? it->second : "%<undefined>";
+        }
+
+        if (ins->type == Type::Int)
+            return std::to_string(ins->value);
+
+        std::string f = fmt::format("{}", ins->getFloat());
+        return f.find_first_of(".ein") == std::string::npos ? f + ".0" : f;
+    };
+
+    os << "define " << function.return_type << " @" << function.name << "(";
+    for (std::size_t i = 0; i < function.parameters.size(); ++i)
+        os << (i == 0 ? "" : ", ") << function.parameters[i];
+    os << ") {\n";
+
+    for (const auto &array : function.arrays)
+        os << "  @" << array.name << " = array " << array.type << " ["
+           << array.size << "]\n";
+
+    for (const auto &block : function.blocks) {
+        std::string label = block->name + ":";
+        os << label;
+
+        if (!block->predecessors.empty()) {
+            os.indent(label.size() < 40 ? 40 - label.size() : 1) << "; preds:";
+            for (const BasicBlock *pred : block->predecessors)
+                os << " " << pred->name;
+        }
+
+        os << "\n";
+
+        for (const auto &ins : block->instructions) {
+            if (ins->opcode == Opcode::Const)
+                continue;
+
+            os << "  ";
+            if (ins->type != Type::Void)
+                os << names[ins.get()] << " = ";
+
+            os << getOpcodeName(ins->opcode);
+            if (ins->type != Type::Void || ins->opcode == Opcode::Store)
+                os << " "
+                   << (ins->opcode == Opcode::Store ? ins->operands[1]->type
+                                                    : ins->type);
+
+            switch (ins->opcode) {
+            case Opcode::Param:
+                os << " " << ins->value;
+                break;
+            case Opcode::Phi:
+                for (std::size_t i = 0; i < ins->operands.size(); ++i)
+                    os << (i == 0 ? " [" : ", [") << value(ins->operands[i])
+                       << ", " << ins->blocks[i]->name << "]";
+                break;
+            case Opcode::Load:
+            case Opcode::Store:
+                os << " @" << function.arrays[ins->value].name << "["
+                   << value(ins->operands[0]) << "]";
+                if (ins->opcode == Opcode::Store)
+                    os << ", " << value(ins->operands[1]);
+                break;
+            case Opcode::Call:
+                os << " @" << ins->name << "(";
+                for (std::size_t i = 0; i < ins->operands.size(); ++i)
+                    os << (i == 0 ? "" : ", ") << value(ins->operands[i]);
+                os << ")";
+                break;
+            default:
+                for (std::size_t i = 0; i < ins->operands.size(); ++i)
+                    os << (i == 0 ? " " : ", ") << value(ins->operands[i]);
+                for (std::size_t i = 0; i < ins->blocks.size(); ++i)
+                    os << (i == 0 && ins->operands.empty() ? " " : ", ")
+                       << ins->blocks[i]->name;
+                break;
+            }
+
+            os << "\n";
+        }
+    }
+
+    return os << "}\n";
+}
+
+llvm::raw_ostream &ssa::operator<<(llvm::raw_ostream &os,
+                                   const Module &module) {
+    for (std::size_t i = 0; i < module.functions.size(); ++i)
+        os << (i == 0 ? "" : "\n") << *module.functions[i];
+
+    return os;
+}
@@ -0,0 +1,184 @@
+#ifndef SSA_IR_HPP
+#define SSA_IR_HPP
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ssa {
+// Mid-level intermediate representation of micro-C: three-address code in
+// static single assignment form. A function is a list of basic blocks, of
+// which the first is the entry. Each block starts with its phi nodes and ends
+// with exactly one terminator (br, condbr or ret). Every instruction that
+// computes a value is that value, and is used by pointing to it.
+//
+// Constants live in the entry block, at most one per type and value, so that
+// they dominate every use and can be compared by pointer. Parameters are
+// instructions in the entry block as well. Arrays are the only memory: they
+// are local to a function, and are accessed with load and store.
+enum class Type { Void, Int, Float };
+
+enum class Opcode {
+    Const,  // The integer in 'value', or the bits of a float
+    Param,  // The parameter with index 'value'
+    Phi,    // The operand from the predecessor at the same index in 'blocks'
+    Copy,   // The operand, e.g. after an assignment to a variable
+    Add,
+    Sub,
+    Mul,
+    Div, // Rounded towards zero for integers
+    Rem, // With the sign of the dividend, fmodf for floats
+    Pow, // powf, also for integers
+    Neg,
+
+    // Comparisons of two integers or two floats, which yield the integer 0
+    // or 1. Comparisons of floats are ordered: they are false if either
+    // operand is NaN.
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+
+    Load,   // Element 'operands[0]' of array 'value'
+    Store,  // Stores 'operands[1]' into element 'operands[0]' of array 'value'
+    Call,   // Calls 'name' with the operands as arguments
+    Br,     // Jumps to 'blocks[0]'
+    CondBr, // Jumps to 'blocks[0]' if the operand is not 0, else 'blocks[1]'
+    Ret,    // Returns the operand, if any
+};
+
+const char *getOpcodeName(Opcode opcode);
+
+bool isTerminator(Opcode opcode);
+bool isComparison(Opcode opcode);
+bool isCommutative(Opcode opcode);
+
+// Returns true if the instruction must be kept even if its value is unused.
+bool hasSideEffects(Opcode opcode);
+
+struct BasicBlock;
+
+struct Instruction {
+    Instruction(Opcode opcode, Type type,
+                std::vector<Instruction *> operands = {})
+        : opcode(opcode), type(type), operands(std::move(operands)) {}
+
+    Opcode opcode;
+    Type type;
+    std::vector<Instruction *> operands;
+
+    // The incoming blocks of a phi, or the targets of a branch.
+    std::vector<BasicBlock *> blocks;
+
+    // The value of a constant, the index of a parameter or the array of a
+    // load or store.
+    std::int64_t value = 0;
+
+    // The callee of a call, or the variable a value was assigned to, which
+    // is only used to print the IR.
+    std::string name;
+
+    BasicBlock *parent = nullptr;
+
+    float getFloat() const;
+};
+
+struct BasicBlock {
+    explicit BasicBlock(const std::string &name) : name(name) {}
+
+    std::string name;
+    std::vector<std::unique_ptr<Instruction>> instructions;
+
+    // Predecessors, once for each branch to the block. Phis have their
+    // incoming blocks in the same order.
+    std::vector<BasicBlock *> predecessors;
+
+    Instruction *getTerminator() const;
+    std::vector<BasicBlock *> getSuccessors() const;
+
+    // Appends an instruction, or inserts it before the terminator, and
+    // returns it.
+    Instruction *append(std::unique_ptr<Instruction> instruction);
+    Instruction *insertBeforeTerminator(
+        std::unique_ptr<Instruction> instruction);
+
+    // Removes the instructions for which the predicate holds.
+    template <typename Predicate> void eraseIf(Predicate predicate);
+};
+
+// An array in the stack frame of a function.
+struct Array {
+    std::string name;
+    Type type;
+    int size;
+};
+
+struct Function {
+    std::string name;
+    Type return_type = Type::Void;
+    std::vector<Type> parameters;
+    std::vector<std::unique_ptr<BasicBlock>> blocks;
+    std::vector<Array> arrays;
+
+    BasicBlock *getEntry() const { return blocks.front().get(); }
+
+    // Returns the constant with the given type and value (the bits of a
+    // float), adding it to the entry block if needed.
+    Instruction *getConstant(Type type, std::int64_t value);
+    Instruction *getFloatConstant(float value);
+
+    // Forgets a constant that is removed from the entry block.
+    void eraseConstant(const Instruction *constant);
+
+    // Replaces every use of a key of the map by its value, following chains
+    // of replacements.
+    void replaceUses(
+        const std::unordered_map<Instruction *, Instruction *> &replacements);
+
+    // Creates a basic block after the given one, or at the end.
+    BasicBlock *createBlock(const std::string &name,
+                            BasicBlock *after = nullptr);
+
+    // Removes one edge between two blocks, with the operands of the phis of
+    // 'to' that come from 'from'. The branch itself is not changed.
+    static void removeEdge(BasicBlock *from, BasicBlock *to);
+
+    // Checks that the function is well-formed SSA: every block has one
+    // terminator at its end, phis match the predecessors, and every operand
+    // is defined in the function. Throws an SSAException otherwise.
+    void verify() const;
+
+  private:
+    std::map<std::pair<Type, std::int64_t>, Instruction *> constants;
+    unsigned int num_blocks = 0;
+};
+
+struct Module {
+    std::vector<std::unique_ptr<Function>> functions;
+};
+
+llvm::raw_ostream &operator<<(llvm::raw_ostream &os, Type type);
+llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const Function &function);
+llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const Module &module);
+
+template <typename Predicate> void BasicBlock::eraseIf(Predicate predicate) {
+    auto it = std::remove_if(
+        std::begin(instructions), std::end(instructions),
+        [&](const std::unique_ptr<Instruction> &ins) {
+            return predicate(ins.get());
+        });
+
+    instructions.erase(it, std::end(instructions));
+}
+} // namespace ssa
+
+#endif /* end of include guard: SSA_IR_HPP */
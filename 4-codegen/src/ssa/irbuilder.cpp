@@ -0,0 +1,438 @@
+#include "ssa/irbuilder.hpp"
+#include "ssa/ssaexception.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <fmt/core.h>
+
+#define DEBUG_TYPE "ssa-builder"
+
+STATISTIC(NumPhis, "The number of phis placed while building SSA form");
+STATISTIC(NumTailRecursions,
+          "The number of self-recursive tail calls turned into loops");
+
+llvm::cl::opt<bool> TailRecursion(
+    "ssa-tail-recursion",
+    llvm::cl::desc("Turn self-recursive tail calls into loops when building "
+                   "SSA form (default: true)"),
+    llvm::cl::init(true));
+
+void ssa::IRBuilder::build(ast::Base &root, Module &module) {
+    this->module = &module;
+    visit(root);
+
+    this->module = nullptr;
+    function = nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitFuncDecl(ast::FuncDecl &node) {
+    current_def.clear();
+    sealed.clear();
+    incomplete_phis.clear();
+    variable_types.clear();
+    array_indices.clear();
+    declaration = &node;
+
+    module->functions.push_back(std::make_unique<Function>());
+    function = module->functions.back().get();
+
+    function->name = node.name.lexeme;
+    function->return_type = getType(node.returnType);
+
+    // The entry block has no predecessors, so it is sealed right away.
+    block = function->createBlock("entry");
+    sealBlock(block);
+
+    for (std::size_t i = 0; i < node.arguments.size(); ++i) {
+        ast::VarDecl &argument = *node.arguments[i];
+        Type type = getType(argument.type);
+
+        Instruction *param = emit(Opcode::Param, type);
+        param->value = i;
+        param->name = argument.name.lexeme;
+
+        function->parameters.push_back(type);
+        variable_types[&argument] = type;
+        writeVariable(&argument, block, param);
+    }
+
+    // The body is only sealed at the end, as tail calls may branch back to
+    // it.
+    body = function->createBlock("body");
+    emitBranch(body);
+    block = body;
+
+    visit(*node.body);
+
+    if (!block->getTerminator()) {
+        if (block->predecessors.empty()) {
+            // Nothing reaches the end of the function, and nothing uses the
+            // values of this block.
+            auto &blocks = function->blocks;
+            blocks.erase(std::find_if(
+                std::begin(blocks), std::end(blocks),
+                [&](const auto &bb) { return bb.get() == block; }));
+        } else if (function->return_type == Type::Void) {
+            emit(Opcode::Ret, Type::Void);
+        } else {
+            emit(Opcode::Ret, Type::Void, {zero(function->return_type)});
+        }
+    }
+
+    sealBlock(body);
+
+    return nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitIfStmt(ast::IfStmt &node) {
+    Instruction *condition = visitCondition(*node.condition);
+
+    BasicBlock *if_block = function->createBlock("if");
+    BasicBlock *else_block =
+        node.else_clause ? function->createBlock("else") : nullptr;
+    BasicBlock *end_block = function->createBlock("endif");
+
+    emitCondBranch(condition, if_block, else_block ? else_block : end_block);
+
+    sealBlock(if_block);
+    block = if_block;
+    visit(*node.if_clause);
+    if (!block->getTerminator())
+        emitBranch(end_block);
+
+    if (else_block) {
+        sealBlock(else_block);
+        block = else_block;
+        visit(*node.else_clause);
+        if (!block->getTerminator())
+            emitBranch(end_block);
+    }
+
+    sealBlock(end_block);
+    block = end_block;
+
+    return nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitWhileStmt(ast::WhileStmt &node) {
+    // The header is sealed after the body, which branches back to it.
+    BasicBlock *header = function->createBlock("while");
+    emitBranch(header);
+    block = header;
+
+    Instruction *condition = visitCondition(*node.condition);
+
+    BasicBlock *body_block = function->createBlock("do");
+    BasicBlock *end_block = function->createBlock("endwhile");
+
+    emitCondBranch(condition, body_block, end_block);
+
+    sealBlock(body_block);
+    block = body_block;
+    visit(*node.body);
+    if (!block->getTerminator())
+        emitBranch(header);
+
+    sealBlock(header);
+    sealBlock(end_block);
+    block = end_block;
+
+    return nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitReturnStmt(ast::ReturnStmt &node) {
+    if (node.value && TailRecursion &&
+        node.value->kind == ast::Base::Kind::FuncCallExpr) {
+        auto &call = static_cast<ast::FuncCallExpr &>(*node.value);
+
+        if (call.name.lexeme == declaration->name.lexeme &&
+            call.arguments.size() == declaration->arguments.size()) {
+            // All arguments are evaluated before the parameters are
+            // assigned, as they may read the parameters.
+            std::vector<Instruction *> arguments;
+            for (const auto &argument : call.arguments)
+                arguments.push_back(visit(*argument));
+
+            for (std::size_t i = 0; i < arguments.size(); ++i)
+                writeVariable(declaration->arguments[i].get(), block,
+                              arguments[i]);
+
+            emitBranch(body);
+            startUnreachableBlock();
+            ++NumTailRecursions;
+
+            return nullptr;
+        }
+    }
+
+    if (node.value)
+        emit(Opcode::Ret, Type::Void, {visit(*node.value)});
+    else
+        emit(Opcode::Ret, Type::Void);
+
+    startUnreachableBlock();
+
+    return nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitVarDecl(ast::VarDecl &node) {
+    Type type = getType(node.type);
+    variable_types[&node] = type;
+
+    if (!node.init) {
+        writeVariable(&node, block, zero(type));
+        return nullptr;
+    }
+
+    Instruction *copy = emit(Opcode::Copy, type, {visit(*node.init)});
+    copy->name = node.name.lexeme;
+    writeVariable(&node, block, copy);
+
+    return nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitArrayDecl(ast::ArrayDecl &node) {
+    if (node.type.lexeme != "int" && node.type.lexeme != "float")
+        throw SSAException(fmt::format(
+            "Arrays of type '{}' are not supported in SSA form",
+            node.type.lexeme));
+
+    if (node.size->value <= 0)
+        throw SSAException(fmt::format("Array '{}' has no elements",
+                                       node.name.lexeme));
+
+    array_indices[&node] = function->arrays.size();
+    function->arrays.push_back(
+        Array{node.name.lexeme, getType(node.type), node.size->value});
+
+    return nullptr;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitBinaryOpExpr(ast::BinaryOpExpr &node) {
+    if (node.op.type == TokenType::EQUALS) {
+        // The value of an assignment is its right-hand side.
+        if (node.lhs->kind == ast::Base::Kind::ArrayRefExpr) {
+            auto &lhs = static_cast<ast::ArrayRefExpr &>(*node.lhs);
+            Instruction *index = visit(*lhs.index);
+            Instruction *rhs = visit(*node.rhs);
+
+            Instruction *store =
+                emit(Opcode::Store, Type::Void, {index, rhs});
+            store->value = array_indices.at(symbol_table[&lhs]);
+
+            return rhs;
+        }
+
+        if (node.lhs->kind != ast::Base::Kind::VarRefExpr)
+            throw SSAException(
+                "Only variable references can be used as lvalues!");
+
+        auto &lhs = static_cast<ast::VarRefExpr &>(*node.lhs);
+        ast::Base *var = symbol_table[&lhs];
+
+        Instruction *copy =
+            emit(Opcode::Copy, variable_types.at(var), {visit(*node.rhs)});
+        copy->name = lhs.name.lexeme;
+        writeVariable(var, block, copy);
+
+        return copy;
+    }
+
+    static const std::map<TokenType, Opcode> opcodes{
+        {TokenType::PLUS, Opcode::Add},
+        {TokenType::MINUS, Opcode::Sub},
+        {TokenType::STAR, Opcode::Mul},
+        {TokenType::SLASH, Opcode::Div},
+        {TokenType::PERCENT, Opcode::Rem},
+        {TokenType::CARET, Opcode::Pow},
+        {TokenType::EQUALS_EQUALS, Opcode::Eq},
+        {TokenType::BANG_EQUALS, Opcode::Ne},
+        {TokenType::LESS_THAN, Opcode::Lt},
+        {TokenType::LESS_THAN_EQUALS, Opcode::Le},
+        {TokenType::GREATER_THAN, Opcode::Gt},
+        {TokenType::GREATER_THAN_EQUALS, Opcode::Ge}};
+
+    auto it = opcodes.find(node.op.type);
+    if (it == std::end(opcodes))
+        throw SSAException(fmt::format(
+            "Binary operator '{}' is not supported in SSA form",
+            node.op.lexeme));
+
+    Instruction *lhs = visit(*node.lhs);
+    Instruction *rhs = visit(*node.rhs);
+    Type type = isComparison(it->second) ? Type::Int : lhs->type;
+
+    return emit(it->second, type, {lhs, rhs});
+}
+
+ssa::Instruction *ssa::IRBuilder::visitUnaryOpExpr(ast::UnaryOpExpr &node) {
+    Instruction *operand = visit(*node.operand);
+
+    if (node.op.type == TokenType::PLUS)
+        return operand;
+
+    return emit(Opcode::Neg, operand->type, {operand});
+}
+
+ssa::Instruction *ssa::IRBuilder::visitIntLiteral(ast::IntLiteral &node) {
+    return function->getConstant(Type::Int, node.value);
+}
+
+ssa::Instruction *ssa::IRBuilder::visitFloatLiteral(ast::FloatLiteral &node) {
+    return function->getFloatConstant(node.value);
+}
+
+ssa::Instruction *ssa::IRBuilder::visitStringLiteral(ast::StringLiteral &) {
+    throw SSAException("String literals are not supported in SSA form");
+}
+
+ssa::Instruction *ssa::IRBuilder::visitVarRefExpr(ast::VarRefExpr &node) {
+    return readVariable(symbol_table[&node], block);
+}
+
+ssa::Instruction *ssa::IRBuilder::visitArrayRefExpr(ast::ArrayRefExpr &node) {
+    ast::Base *array = symbol_table[&node];
+    Instruction *index = visit(*node.index);
+
+    Instruction *load = emit(Opcode::Load, getType(node), {index});
+    load->value = array_indices.at(array);
+
+    return load;
+}
+
+ssa::Instruction *ssa::IRBuilder::visitFuncCallExpr(ast::FuncCallExpr &node) {
+    std::vector<Instruction *> arguments;
+    for (const auto &argument : node.arguments)
+        arguments.push_back(visit(*argument));
+
+    Instruction *call = emit(Opcode::Call, getType(node), arguments);
+    call->name = node.name.lexeme;
+
+    return call;
+}
+
+void ssa::IRBuilder::writeVariable(ast::Base *var, BasicBlock *bb,
+                                   Instruction *value) {
+    current_def[bb][var] = value;
+}
+
+ssa::Instruction *ssa::IRBuilder::readVariable(ast::Base *var,
+                                               BasicBlock *bb) {
+    auto &defs = current_def[bb];
+    auto it = defs.find(var);
+
+    if (it != std::end(defs))
+        return it->second;
+
+    return readVariableRecursive(var, bb);
+}
+
+ssa::Instruction *ssa::IRBuilder::readVariableRecursive(ast::Base *var,
+                                                        BasicBlock *bb) {
+    auto newPhi = [&]() {
+        auto phi = std::make_unique<Instruction>(Opcode::Phi,
+                                                 variable_types.at(var));
+        phi->parent = bb;
+        phi->name = static_cast<ast::VarDecl *>(var)->name.lexeme;
+        ++NumPhis;
+
+        auto &instructions = bb->instructions;
+        return instructions.insert(std::begin(instructions), std::move(phi))
+            ->get();
+    };
+
+    Instruction *value;
+
+    if (!sealed.count(bb)) {
+        // Not all predecessors are known yet.
+        value = newPhi();
+        incomplete_phis[bb].emplace_back(var, value);
+    } else if (bb->predecessors.size() == 1) {
+        value = readVariable(var, bb->predecessors.front());
+    } else if (bb->predecessors.empty()) {
+        // The variable is read before it is assigned, or in unreachable
+        // code.
+        value = zero(variable_types.at(var));
+    } else {
+        // The phi is recorded first, to break cycles through loops.
+        value = newPhi();
+        writeVariable(var, bb, value);
+        addPhiOperands(var, value);
+    }
+
+    writeVariable(var, bb, value);
+
+    return value;
+}
+
+void ssa::IRBuilder::addPhiOperands(ast::Base *var, Instruction *phi) {
+    for (BasicBlock *pred : phi->parent->predecessors) {
+        phi->operands.push_back(readVariable(var, pred));
+        phi->blocks.push_back(pred);
+    }
+}
+
+void ssa::IRBuilder::sealBlock(BasicBlock *bb) {
+    for (const auto &[var, phi] : incomplete_phis[bb])
+        addPhiOperands(var, phi);
+
+    incomplete_phis.erase(bb);
+    sealed.insert(bb);
+}
+
+ssa::Instruction *ssa::IRBuilder::emit(Opcode opcode, Type type,
+                                       std::vector<Instruction *> operands) {
+    return block->append(
+        std::make_unique<Instruction>(opcode, type, std::move(operands)));
+}
+
+void ssa::IRBuilder::emitBranch(BasicBlock *target) {
+    emit(Opcode::Br, Type::Void)->blocks = {target};
+    target->predecessors.push_back(block);
+}
+
+void ssa::IRBuilder::emitCondBranch(Instruction *condition,
+                                    BasicBlock *if_true,
+                                    BasicBlock *if_false) {
+    emit(Opcode::CondBr, Type::Void, {condition})->blocks = {if_true,
+                                                             if_false};
+    if_true->predecessors.push_back(block);
+    if_false->predecessors.push_back(block);
+}
+
+void ssa::IRBuilder::startUnreachableBlock() {
+    block = function->createBlock("unreachable");
+    sealBlock(block);
+}
+
+ssa::Instruction *ssa::IRBuilder::visitCondition(ast::Expr &condition) {
+    Instruction *value = visit(condition);
+
+    if (value->type == Type::Float)
+        return emit(Opcode::Ne, Type::Int, {value, zero(Type::Float)});
+
+    return value;
+}
+
+ssa::Type ssa::IRBuilder::getType(ast::Base &node) const {
+    auto it = type_table.find(&node);
+
+    if (it == std::end(type_table) || it->second == nullptr)
+        return Type::Int;
+
+    return it->second->isFloatTy()  ? Type::Float
+           : it->second->isVoidTy() ? Type::Void
+                                    : Type::Int;
+}
+
+ssa::Type ssa::IRBuilder::getType(const Token &type) {
+    return type.lexeme == "float"  ? Type::Float
+           : type.lexeme == "void" ? Type::Void
+                                   : Type::Int;
+}
+
+ssa::Instruction *ssa::IRBuilder::zero(Type type) {
+    return type == Type::Float ? function->getFloatConstant(0.0f)
+                               : function->getConstant(Type::Int, 0);
+}
@@ -0,0 +1,120 @@
+#ifndef SSA_IRBUILDER_HPP
+#define SSA_IRBUILDER_HPP
+
+#include "ast/ast.hpp"
+#include "ast/visitor.hpp"
+#include "sema/scoperesolutionpass.hpp"
+#include "sema/typecheckingpass.hpp"
+#include "ssa/ir.hpp"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace ssa {
+// Builds the SSA form of a type checked program, directly from the AST, with
+// the algorithm of Braun et al. (Simple and Efficient Construction of Static
+// Single Assignment Form, 2013). The current value of each variable is
+// tracked per basic block. Reading a variable in a block that does not assign
+// it looks the value up in the predecessors, and places a phi where they may
+// disagree. Blocks whose predecessors are not all known yet (loop headers)
+// are not sealed: their phis get their operands once the block is sealed.
+//
+// Trivial phis, whose operands are all the same value, are left to copy
+// propagation. Every assignment to a variable is a copy, which gives the
+// value the name of the variable in the dump.
+//
+// Each function starts with an entry block that holds the parameters, and
+// branches to the body. Calls in 'return f(...)' of the function itself
+// assign the arguments to the parameters and branch back to the body, which
+// turns tail recursion into a loop. Variables that are read before they are
+// assigned, and functions that end without a return, yield 0.
+//
+// Visiting an expression returns the instruction that computes its value.
+class IRBuilder : public ast::Visitor<IRBuilder, Instruction *> {
+  public:
+    IRBuilder(const sema::ScopeResolutionPass::SymbolTable &symbol_table,
+              const sema::TypeCheckingPass::TypeTable &type_table)
+        : symbol_table(symbol_table), type_table(type_table) {}
+
+    // Builds the functions of a program into 'module'.
+    void build(ast::Base &root, Module &module);
+
+    Instruction *visitFuncDecl(ast::FuncDecl &node);
+    Instruction *visitIfStmt(ast::IfStmt &node);
+    Instruction *visitWhileStmt(ast::WhileStmt &node);
+    Instruction *visitReturnStmt(ast::ReturnStmt &node);
+    Instruction *visitVarDecl(ast::VarDecl &node);
+    Instruction *visitArrayDecl(ast::ArrayDecl &node);
+    Instruction *visitBinaryOpExpr(ast::BinaryOpExpr &node);
+    Instruction *visitUnaryOpExpr(ast::UnaryOpExpr &node);
+    Instruction *visitIntLiteral(ast::IntLiteral &node);
+    Instruction *visitFloatLiteral(ast::FloatLiteral &node);
+    Instruction *visitStringLiteral(ast::StringLiteral &node);
+    Instruction *visitVarRefExpr(ast::VarRefExpr &node);
+    Instruction *visitArrayRefExpr(ast::ArrayRefExpr &node);
+    Instruction *visitFuncCallExpr(ast::FuncCallExpr &node);
+
+  private:
+    // Symbol table.
+    sema::ScopeResolutionPass::SymbolTable symbol_table;
+
+    // Type table.
+    sema::TypeCheckingPass::TypeTable type_table;
+
+    // The module being built, the current function and declaration, and the
+    // block that instructions are appended to.
+    Module *module = nullptr;
+    Function *function = nullptr;
+    ast::FuncDecl *declaration = nullptr;
+    BasicBlock *block = nullptr;
+
+    // The block after the entry, which self-recursive tail calls branch to.
+    BasicBlock *body = nullptr;
+
+    // The value of each variable at the end of each block, as far as it is
+    // known.
+    std::map<BasicBlock *, std::map<ast::Base *, Instruction *>> current_def;
+
+    // Blocks whose predecessors are all known, and the phis of the other
+    // blocks that still need their operands.
+    std::set<BasicBlock *> sealed;
+    std::map<BasicBlock *, std::vector<std::pair<ast::Base *, Instruction *>>>
+        incomplete_phis;
+
+    // The type of each variable, and the index of each array in the
+    // function.
+    std::map<ast::Base *, Type> variable_types;
+    std::map<ast::Base *, int> array_indices;
+
+    void writeVariable(ast::Base *var, BasicBlock *bb, Instruction *value);
+    Instruction *readVariable(ast::Base *var, BasicBlock *bb);
+    Instruction *readVariableRecursive(ast::Base *var, BasicBlock *bb);
+    void addPhiOperands(ast::Base *var, Instruction *phi);
+    void sealBlock(BasicBlock *bb);
+
+    // Appends an instruction to the current block, and returns it.
+    Instruction *emit(Opcode opcode, Type type,
+                      std::vector<Instruction *> operands = {});
+
+    // Terminates the current block with a branch, and records the edges.
+    void emitBranch(BasicBlock *target);
+    void emitCondBranch(Instruction *condition, BasicBlock *if_true,
+                        BasicBlock *if_false);
+
+    // Continues in a new block without predecessors, after a return.
+    void startUnreachableBlock();
+
+    // Returns the value of a condition, compared with 0 if it is a float.
+    Instruction *visitCondition(ast::Expr &condition);
+
+    Type getType(ast::Base &node) const;
+    static Type getType(const Token &type);
+
+    // Returns the constant 0 of a type.
+    Instruction *zero(Type type);
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_IRBUILDER_HPP */
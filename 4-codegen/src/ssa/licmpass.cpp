@@ -0,0 +1,193 @@
+#include "ssa/licmpass.hpp"
+
+#include "llvm/ADT/Statistic.h"
+
+#include <algorithm>
+#include <iterator>
+
+#define DEBUG_TYPE "ssa-licm"
+
+STATISTIC(NumPreheaders, "The number of loop preheaders created");
+STATISTIC(NumHoisted, "The number of instructions moved out of loops");
+
+namespace {
+using namespace ssa;
+
+bool isHoistable(const Instruction &ins) {
+    switch (ins.opcode) {
+    case Opcode::Copy:
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::Pow:
+    case Opcode::Neg:
+    case Opcode::Eq:
+    case Opcode::Ne:
+    case Opcode::Lt:
+    case Opcode::Le:
+    case Opcode::Gt:
+    case Opcode::Ge:
+        return true;
+    case Opcode::Div:
+    case Opcode::Rem: {
+        // Integer divisions trap for a divisor of 0, and of -1 if the
+        // dividend is the smallest integer.
+        const Instruction &divisor = *ins.operands[1];
+
+        return ins.type == Type::Float ||
+               (divisor.opcode == Opcode::Const && divisor.value != 0 &&
+                divisor.value != -1);
+    }
+    default:
+        return false;
+    }
+}
+} // namespace
+
+bool ssa::LICMPass::run(Function &function) {
+    DominatorTree dominators{function};
+    std::vector<Loop> loops = findLoops(dominators);
+
+    if (loops.empty())
+        return false;
+
+    // Preheaders change the graph, so the loops are found again after they
+    // are created.
+    std::size_t num_blocks = function.blocks.size();
+
+    for (const Loop &loop : loops)
+        getPreheader(function, loop);
+
+    bool changed = function.blocks.size() != num_blocks;
+
+    if (changed) {
+        dominators = DominatorTree{function};
+        loops = findLoops(dominators);
+    }
+
+    for (const Loop &loop : loops)
+        changed |= hoist(loop, getPreheader(function, loop), dominators);
+
+    return changed;
+}
+
+ssa::BasicBlock *ssa::LICMPass::getPreheader(Function &function,
+                                             const Loop &loop) {
+    BasicBlock *header = loop.header;
+    std::vector<BasicBlock *> outside;
+
+    for (BasicBlock *pred : header->predecessors) {
+        if (!loop.contains(pred))
+            outside.push_back(pred);
+    }
+
+    if (outside.size() == 1 && outside[0]->getSuccessors().size() == 1)
+        return outside[0];
+
+    // Place the preheader in front of the header.
+    auto &blocks = function.blocks;
+    auto position = std::find_if(
+        std::begin(blocks), std::end(blocks),
+        [&](const std::unique_ptr<BasicBlock> &b) {
+            return b.get() == header;
+        });
+    BasicBlock *preheader =
+        function.createBlock("preheader", std::prev(position)->get());
+
+    for (BasicBlock *pred : outside) {
+        auto &targets = pred->getTerminator()->blocks;
+        std::replace(std::begin(targets), std::end(targets), header,
+                     preheader);
+    }
+
+    preheader->predecessors = outside;
+
+    // The edges from outside the loop are replaced by a single edge from the
+    // preheader, where the first of them was. Phis of the header take their
+    // value from a phi in the preheader, unless it is the same on all edges.
+    auto rewrite = [&](auto &values, auto preheader_value) {
+        auto list = values;
+        values.clear();
+        bool first = true;
+
+        for (std::size_t i = 0; i < header->predecessors.size(); ++i) {
+            if (loop.contains(header->predecessors[i])) {
+                values.push_back(list[i]);
+            } else if (first) {
+                values.push_back(preheader_value);
+                first = false;
+            }
+        }
+    };
+
+    for (const auto &ins : header->instructions) {
+        if (ins->opcode != Opcode::Phi)
+            break;
+
+        std::vector<Instruction *> incoming;
+        for (std::size_t i = 0; i < ins->operands.size(); ++i) {
+            if (!loop.contains(ins->blocks[i]))
+                incoming.push_back(ins->operands[i]);
+        }
+
+        Instruction *value = incoming[0];
+
+        if (std::any_of(std::begin(incoming), std::end(incoming),
+                        [&](Instruction *v) { return v != incoming[0]; })) {
+            auto phi = std::make_unique<Instruction>(Opcode::Phi, ins->type,
+                                                     incoming);
+            phi->blocks = outside;
+            phi->name = ins->name;
+            value = preheader->append(std::move(phi));
+        }
+
+        rewrite(ins->operands, value);
+        rewrite(ins->blocks, preheader);
+    }
+
+    rewrite(header->predecessors, preheader);
+
+    auto branch = std::make_unique<Instruction>(Opcode::Br, Type::Void);
+    branch->blocks = {header};
+    preheader->append(std::move(branch));
+
+    ++NumPreheaders;
+    return preheader;
+}
+
+bool ssa::LICMPass::hoist(const Loop &loop, BasicBlock *preheader,
+                          const DominatorTree &dominators) {
+    bool changed = false;
+
+    // Definitions are visited before their uses, except for phis, which are
+    // never moved.
+    for (BasicBlock *block : dominators.getReversePostOrder()) {
+        if (!loop.contains(block))
+            continue;
+
+        auto &instructions = block->instructions;
+        bool moved = false;
+
+        for (auto &ins : instructions) {
+            if (!isHoistable(*ins) ||
+                std::any_of(std::begin(ins->operands), std::end(ins->operands),
+                            [&](Instruction *operand) {
+                                return loop.contains(operand->parent);
+                            }))
+                continue;
+
+            preheader->insertBeforeTerminator(std::move(ins));
+            moved = true;
+            ++NumHoisted;
+        }
+
+        if (moved) {
+            instructions.erase(std::remove(std::begin(instructions),
+                                           std::end(instructions), nullptr),
+                               std::end(instructions));
+            changed = true;
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,31 @@
+#ifndef SSA_LICMPASS_HPP
+#define SSA_LICMPASS_HPP
+
+#include "ssa/dominators.hpp"
+#include "ssa/passmanager.hpp"
+
+namespace ssa {
+// Loop-invariant code motion. Every loop first gets a preheader: a block
+// that is the only predecessor of the header outside the loop, and that only
+// branches to the header. Pure instructions whose operands are all defined
+// outside the loop are then moved to the end of the preheader, inner loops
+// first, so that they can move out of several loops. The instructions are
+// moved even if the loop body would not run, which is harmless for pure
+// instructions, except for integer divisions: those are only moved if their
+// divisor is a constant that cannot trap.
+class LICMPass : public FunctionPass {
+  public:
+    const char *getName() const override { return "licm"; }
+    bool run(Function &function) override;
+
+  private:
+    // Returns the preheader of a loop, creating it if needed.
+    BasicBlock *getPreheader(Function &function, const Loop &loop);
+
+    // Moves the invariant instructions of a loop to its preheader.
+    bool hoist(const Loop &loop, BasicBlock *preheader,
+               const DominatorTree &dominators);
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_LICMPASS_HPP */
@@ -0,0 +1,77 @@
+#include "ssa/passmanager.hpp"
+#include "ssa/constantfoldingpass.hpp"
+#include "ssa/copypropagationpass.hpp"
+#include "ssa/deadcodeeliminationpass.hpp"
+#include "ssa/gvnpass.hpp"
+#include "ssa/licmpass.hpp"
+#include "ssa/ssaexception.hpp"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fmt/core.h>
+
+#define DEBUG_TYPE "ssa-pass-manager"
+
+llvm::cl::opt<bool> VerifySSA(
+    "ssa-verify",
+    llvm::cl::desc("Verify the SSA form after every pass that changes it "
+                   "(default: true)"),
+    llvm::cl::init(true));
+
+void ssa::PassManager::addPass(std::unique_ptr<FunctionPass> pass) {
+    passes.push_back(std::move(pass));
+}
+
+void ssa::PassManager::addPipeline(const std::string &pipeline) {
+    llvm::SmallVector<llvm::StringRef, 8> names;
+    llvm::StringRef(pipeline).split(names, ',', -1, false);
+
+    for (llvm::StringRef name : names) {
+        name = name.trim();
+
+        if (name == "copy-propagation")
+            addPass(std::make_unique<CopyPropagationPass>());
+        else if (name == "constant-folding")
+            addPass(std::make_unique<ConstantFoldingPass>());
+        else if (name == "dce")
+            addPass(std::make_unique<DeadCodeEliminationPass>());
+        else if (name == "gvn")
+            addPass(std::make_unique<GVNPass>());
+        else if (name == "licm")
+            addPass(std::make_unique<LICMPass>());
+        else
+            throw SSAException(
+                fmt::format("Unknown SSA pass '{}'", name.str()));
+    }
+}
+
+const char *ssa::PassManager::getDefaultPipeline() {
+    // Folding and copy propagation expose dead code and redundancies, and
+    // are repeated after GVN and LICM, which leave copies of their own.
+    return "copy-propagation,constant-folding,dce,gvn,licm,"
+           "copy-propagation,constant-folding,dce";
+}
+
+void ssa::PassManager::run(Module &module) {
+    for (const auto &pass : passes) {
+        llvm::NamedRegionTimer timer(pass->getName(), pass->getName(), "ssa",
+                                     "SSA optimiser",
+                                     llvm::TimePassesIsEnabled);
+
+        for (const auto &function : module.functions) {
+            bool changed = pass->run(*function);
+
+            LLVM_DEBUG(if (changed) llvm::dbgs()
+                       << "*** After " << pass->getName() << " ***\n"
+                       << *function);
+
+            if (changed && VerifySSA)
+                function->verify();
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SSA_PASSMANAGER_HPP
+#define SSA_PASSMANAGER_HPP
+
+#include "ssa/ir.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ssa {
+// A transformation of one function in SSA form.
+class FunctionPass {
+  public:
+    virtual ~FunctionPass() = default;
+
+    // Returns the name of the pass in pipelines, e.g. "gvn".
+    virtual const char *getName() const = 0;
+
+    // Runs the pass, and returns true if it changed the function.
+    virtual bool run(Function &function) = 0;
+};
+
+// Runs a pipeline of function passes on every function of a module, in
+// order. Each pass is timed with -time-passes, and the functions are verified
+// after every pass that changed them, unless -ssa-verify=false is given.
+class PassManager {
+  public:
+    void addPass(std::unique_ptr<FunctionPass> pass);
+
+    // Adds the passes of a comma-separated list of pass names, e.g.
+    // "copy-propagation,gvn,dce". Throws an SSAException for unknown names.
+    void addPipeline(const std::string &pipeline);
+
+    // Returns the pipeline that the driver runs by default.
+    static const char *getDefaultPipeline();
+
+    void run(Module &module);
+
+  private:
+    std::vector<std::unique_ptr<FunctionPass>> passes;
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSA_PASSMANAGER_HPP */
@@ -0,0 +1,13 @@
+#ifndef SSAEXCEPTION_HPP
+#define SSAEXCEPTION_HPP
+
+#include <stdexcept>
+
+namespace ssa {
+struct SSAException : public std::runtime_error {
+    SSAException(const std::string &message)
+        : std::runtime_error(message) {}
+};
+} // namespace ssa
+
+#endif /* end of include guard: SSAEXCEPTION_HPP */
@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# Compiles a program with the x64 backend, links it with the runtime, runs it
+# on an input, and checks that its output is the expected one.
+#
+# usage: tests/run-example.sh microcc libruntime.a program.c input expected
+#                             [microcc flags ...]
+#
+# Environment variables:
+#   CXX  compiler driver used to assemble and link (default: c++)
+set -Eeuo pipefail
+
+if [ $# -lt 5 ]; then
+	echo "usage: $0 microcc libruntime.a program.c input expected" \
+		"[microcc flags ...]" >&2
+	exit 2
+fi
+
+MICROCC="$1"
+RUNTIME="$2"
+PROGRAM="$3"
+INPUT="$4"
+EXPECTED="$5"
+shift 5
+
+CXX="${CXX:-c++}"
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+name="$(basename "${PROGRAM}" .c)"
+
+"${MICROCC}" "$@" "${PROGRAM}" > "${WORK_DIR}/${name}.s"
+"${CXX}" -no-pie "${WORK_DIR}/${name}.s" "${RUNTIME}" -o "${WORK_DIR}/${name}"
+"${WORK_DIR}/${name}" < "${INPUT}" > "${WORK_DIR}/${name}.out"
+
+if ! diff -u "${EXPECTED}" "${WORK_DIR}/${name}.out"; then
+	echo "$0: ${name}: unexpected output" >&2
+	exit 1
+fi
@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+# Throughput benchmark of batch mode: compiles a corpus of small generated
+# micro-C programs, once with one process per file, and once in a single
+# process with an increasing number of worker threads. Prints files/second.
+#
+# usage: bench/batch-throughput.sh [build-dir]
+#
+# Environment variables:
+#   FILES          number of programs in the corpus (default: 2000)
+#   JOBS           worker thread counts to measure (default: 1 2 4 ... nproc)
+#   MICROCC_FLAGS  extra flags for microcc (e.g. "-ast-opt")
+#   GEN_FLAGS      extra flags for microcc-gen (default: "-functions 4")
+set -Eeuo pipefail
+
+BUILD_DIR="${1:-build}"
+FILES="${FILES:-2000}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+GEN_FLAGS="${GEN_FLAGS:--functions 4}"
+
+if [ -z "${JOBS:-}" ]; then
+	JOBS=""
+	for ((j = 1; j < $(nproc); j *= 2)); do
+		JOBS="${JOBS} ${j}"
+	done
+	JOBS="${JOBS} $(nproc)"
+fi
+
+MICROCC="${BUILD_DIR}/microcc"
+GENERATOR="${BUILD_DIR}/microcc-gen"
+
+for tool in "${MICROCC}" "${GENERATOR}"; do
+	if [ ! -x "${tool}" ]; then
+		echo "$0: ${tool} not found, build it first" >&2
+		exit 2
+	fi
+done
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+mkdir -p "${WORK_DIR}/corpus" "${WORK_DIR}/out"
+
+for ((i = 0; i < FILES; i++)); do
+	# shellcheck disable=SC2086
+	"${GENERATOR}" -seed "${i}" ${GEN_FLAGS} -o "${WORK_DIR}/corpus/${i}.c"
+	echo "${WORK_DIR}/corpus/${i}.c"
+done > "${WORK_DIR}/corpus.rsp"
+
+# Prints the throughput of a run, given its start and end time in ns.
+report() {
+	awk -v name="$1" -v files="${FILES}" -v begin="$2" -v end="$3" 'BEGIN {
+		seconds = (end - begin) / 1e9
+		printf "%-24s %8.2f s %10.1f files/s\n", name, seconds, files / seconds
+	}'
+}
+
+begin="$(date +%s%N)"
+while read -r file; do
+	# shellcheck disable=SC2086
+	"${MICROCC}" ${MICROCC_FLAGS} "${file}" > "${WORK_DIR}/out/$(basename "${file}" .c).ll"
+done < "${WORK_DIR}/corpus.rsp"
+report "process per file" "${begin}" "$(date +%s%N)"
+
+for jobs in ${JOBS}; do
+	rm -f "${WORK_DIR}"/out/*
+	begin="$(date +%s%N)"
+	# shellcheck disable=SC2086
+	"${MICROCC}" ${MICROCC_FLAGS} -j "${jobs}" -output-dir "${WORK_DIR}/out" \
+		"@${WORK_DIR}/corpus.rsp"
+	report "batch, -j ${jobs}" "${begin}" "$(date +%s%N)"
+done
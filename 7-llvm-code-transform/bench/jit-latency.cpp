@@ -0,0 +1,190 @@
+// Benchmark of libmicrocc: measures the time to create a Compiler (startup),
+// and the latency of compiling a program and calling one of its functions,
+// optionally with several threads compiling concurrently.
+
+#include "libmicrocc/compiler.hpp"
+#include "libmicrocc/compilerexception.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/WithColor.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+llvm::cl::opt<std::string>
+    InputFilename(llvm::cl::Positional,
+                  llvm::cl::desc("<input file> (default: built-in program)"),
+                  llvm::cl::init(""));
+
+llvm::cl::opt<std::string>
+    Function("function",
+             llvm::cl::desc("Function to call, of type int(int, int)"),
+             llvm::cl::init("f"));
+
+llvm::cl::opt<unsigned int>
+    Iterations("iterations", llvm::cl::desc("Number of compilations"),
+               llvm::cl::init(200));
+
+llvm::cl::opt<unsigned int>
+    Threads("threads", llvm::cl::desc("Number of compiling threads"),
+            llvm::cl::init(1));
+
+llvm::cl::opt<bool> AstOpt("ast-opt",
+                           llvm::cl::desc("Run the AST-level optimisations"),
+                           llvm::cl::init(false));
+
+llvm::cl::opt<unsigned int>
+    OptLevel("O", llvm::cl::desc("Native code generator optimisation level"),
+             llvm::cl::Prefix, llvm::cl::init(2));
+
+static const char *const default_program = R"(
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+
+    return fib(n - 1) + fib(n - 2);
+}
+
+int f(int a, int b)
+{
+    int s = 0;
+    int i = 0;
+
+    while (i < b)
+    {
+        s = s + fib(a) * i;
+        i = i + 1;
+    }
+
+    return s;
+}
+)";
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - begin)
+        .count();
+}
+
+static void printLatencies(const std::string &what,
+                           std::vector<double> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+
+    double total = 0;
+    for (double latency : latencies)
+        total += latency;
+
+    auto percentile = [&](double p) {
+        return latencies[std::min(
+            latencies.size() - 1,
+            static_cast<std::size_t>(p * latencies.size()))];
+    };
+
+    fmt::print("{:24}mean {:8.3f} ms   p50 {:8.3f} ms   p99 {:8.3f} ms   "
+               "max {:8.3f} ms\n",
+               what, total / latencies.size(), percentile(0.5),
+               percentile(0.99), latencies.back());
+}
+
+int main(int argc, char *argv[]) {
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "libmicrocc latency benchmark\n");
+
+    std::string source = default_program;
+    if (!InputFilename.empty()) {
+        std::ifstream inputFile{InputFilename};
+        source = std::string{std::istreambuf_iterator<char>(inputFile),
+                             std::istreambuf_iterator<char>()};
+    }
+
+    microcc::Compiler::Options options;
+    options.ast_opt = AstOpt;
+    options.opt_level = OptLevel;
+
+    // Startup: the first Compiler also initialises the LLVM targets.
+    auto begin = Clock::now();
+    auto compiler = std::make_unique<microcc::Compiler>(options);
+    fmt::print("{:24}{:8.3f} ms\n", "first Compiler", elapsedMs(begin));
+
+    begin = Clock::now();
+    compiler = std::make_unique<microcc::Compiler>(options);
+    fmt::print("{:24}{:8.3f} ms\n", "next Compiler", elapsedMs(begin));
+
+    unsigned int threads = std::max(Threads.getValue(), 1u);
+    unsigned int iterations = std::max(Iterations.getValue(), threads);
+
+    // Per-thread latencies of compiling a program, looking up the function
+    // (which generates native code), and of the first call.
+    std::vector<std::vector<double>> compileLatencies(threads);
+    std::vector<std::vector<double>> lookupLatencies(threads);
+    std::vector<std::vector<double>> callLatencies(threads);
+    std::vector<std::int64_t> results(threads);
+    std::vector<std::string> errors(threads);
+
+    auto worker = [&](unsigned int thread) {
+        try {
+            for (unsigned int i = thread; i < iterations; i += threads) {
+                auto begin = Clock::now();
+                auto program = compiler->compile(source, "bench.c");
+                compileLatencies[thread].push_back(elapsedMs(begin));
+
+                begin = Clock::now();
+                auto *f = program->getFunction<std::int64_t(std::int64_t,
+                                                            std::int64_t)>(
+                    Function);
+                lookupLatencies[thread].push_back(elapsedMs(begin));
+
+                begin = Clock::now();
+                results[thread] = f(10, 3);
+                callLatencies[thread].push_back(elapsedMs(begin));
+            }
+        } catch (const microcc::CompilerException &e) {
+            errors[thread] = e.what();
+        }
+    };
+
+    begin = Clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int thread = 0; thread < threads; ++thread)
+        workers.emplace_back(worker, thread);
+    for (std::thread &t : workers)
+        t.join();
+    double totalMs = elapsedMs(begin);
+
+    for (const std::string &error : errors) {
+        if (!error.empty()) {
+            llvm::WithColor::error(llvm::errs(), "microcc-jit-bench")
+                << error << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto flatten = [](const std::vector<std::vector<double>> &perThread) {
+        std::vector<double> all;
+        for (const auto &latencies : perThread)
+            all.insert(all.end(), latencies.begin(), latencies.end());
+        return all;
+    };
+
+    printLatencies("compile", flatten(compileLatencies));
+    printLatencies("lookup (native code)", flatten(lookupLatencies));
+    printLatencies("first call", flatten(callLatencies));
+    fmt::print("{:24}{} compilations on {} threads in {:.1f} ms "
+               "({:.1f} compilations/s)\n",
+               "throughput", iterations, threads, totalMs,
+               iterations * 1000.0 / totalMs);
+    fmt::print("{:24}{}\n", "result", results[0]);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+# Build time benchmark of native code emission: compiles generated micro-C
+# programs of increasing size to an object file and to an executable, once
+# through the text pipeline (microcc prints IR, llc parses it and emits
+# assembly or an object file, and c++ assembles and links), and once
+# in-process with 'microcc -c' and 'microcc -o'. Prints the median wall-clock
+# time of each, and the fastest and slowest run, as the differences between
+# the two pipelines can be smaller than the run-to-run variation.
+#
+# usage: bench/native-build.sh [build-dir]
+#
+# Environment variables:
+#   SIZES          program sizes in lines (default: 100 1000 10000 100000)
+#   OPT            optimisation level of microcc and llc (default: 2)
+#   RUNS           runs per measurement (default: 5)
+#   LLC            llc of the LLVM that microcc is built with (default: llc)
+#   MICROCC_FLAGS  extra flags for microcc (e.g. "-march=native")
+set -Eeuo pipefail
+
+BUILD_DIR="${1:-build}"
+SIZES="${SIZES:-100 1000 10000 100000}"
+OPT="${OPT:-2}"
+RUNS="${RUNS:-5}"
+LLC="${LLC:-llc}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+
+MICROCC="${BUILD_DIR}/microcc"
+GENERATOR="${BUILD_DIR}/microcc-gen"
+RUNTIME="${BUILD_DIR}/libruntime.a"
+
+for tool in "${MICROCC}" "${GENERATOR}"; do
+	if [ ! -x "${tool}" ]; then
+		echo "$0: ${tool} not found, build it first" >&2
+		exit 2
+	fi
+done
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+# Runs a command RUNS times, and prints its median, fastest and slowest time
+# in seconds.
+measure() {
+	local times=()
+	for ((run = 0; run < RUNS; run++)); do
+		local begin end
+		begin="$(date +%s%N)"
+		"$@"
+		end="$(date +%s%N)"
+		times+=($((end - begin)))
+	done
+	printf "%s\n" "${times[@]}" | sort -n | awk '
+		{ ns[NR] = $1 }
+		END {
+			median = NR % 2 ? ns[(NR + 1) / 2] : (ns[NR / 2] + ns[NR / 2 + 1]) / 2
+			printf "%.3f (%.3f-%.3f)", median / 1e9, ns[1] / 1e9, ns[NR] / 1e9
+		}'
+}
+
+text_object() {
+	# shellcheck disable=SC2086
+	"${MICROCC}" -O"${OPT}" ${MICROCC_FLAGS} "$1" > "${WORK_DIR}/text.ll"
+	"${LLC}" -O"${OPT}" -relocation-model=pic -filetype=obj \
+		"${WORK_DIR}/text.ll" -o "${WORK_DIR}/text.o"
+}
+
+text_executable() {
+	# shellcheck disable=SC2086
+	"${MICROCC}" -O"${OPT}" ${MICROCC_FLAGS} "$1" > "${WORK_DIR}/text.ll"
+	"${LLC}" -O"${OPT}" -relocation-model=pic "${WORK_DIR}/text.ll" \
+		-o "${WORK_DIR}/text.s"
+	c++ "${WORK_DIR}/text.s" "${RUNTIME}" -o "${WORK_DIR}/text"
+}
+
+native_object() {
+	# shellcheck disable=SC2086
+	"${MICROCC}" -O"${OPT}" ${MICROCC_FLAGS} -c "$1" \
+		-o "${WORK_DIR}/native.o"
+}
+
+native_executable() {
+	# shellcheck disable=SC2086
+	"${MICROCC}" -O"${OPT}" ${MICROCC_FLAGS} "$1" -o "${WORK_DIR}/native"
+}
+
+printf "%-10s %21s %21s %21s %21s\n" "lines" "text -c" "native -c" \
+	"text exe" "native exe"
+
+for size in ${SIZES}; do
+	program="${WORK_DIR}/${size}.c"
+	"${GENERATOR}" -seed 1 -lines "${size}" -o "${program}"
+
+	printf "%-10s %21s %21s %21s %21s\n" "${size}" \
+		"$(measure text_object "${program}")" \
+		"$(measure native_object "${program}")" \
+		"$(measure text_executable "${program}")" \
+		"$(measure native_executable "${program}")"
+done
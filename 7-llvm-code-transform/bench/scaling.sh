@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+# Scaling suite: compiles generated micro-C programs of increasing size, and
+# records the time and peak RSS of each compilation phase. A phase whose time
+# or memory grows faster than linearly with the input size is reported as a
+# regression, and makes the script exit with a non-zero status.
+#
+# usage: bench/scaling.sh [build-dir]
+#
+# Environment variables:
+#   SIZES          program sizes in lines (default: 1000 ... 10000000)
+#   MICROCC_FLAGS  extra flags for microcc (e.g. "-stream -ast-opt")
+#   GEN_FLAGS      extra flags for microcc-gen (e.g. "-call-graph=chain")
+#   THRESHOLD      maximum allowed scaling exponent (default: 1.25)
+#   MIN_TIME       phases faster than this (in seconds) are not checked
+#   MIN_RSS        RSS growth below this (in KiB) is not checked
+set -Eeuo pipefail
+
+BUILD_DIR="${1:-build}"
+SIZES="${SIZES:-1000 10000 100000 1000000 10000000}"
+MICROCC_FLAGS="${MICROCC_FLAGS:-}"
+GEN_FLAGS="${GEN_FLAGS:-}"
+THRESHOLD="${THRESHOLD:-1.25}"
+MIN_TIME="${MIN_TIME:-0.05}"
+MIN_RSS="${MIN_RSS:-65536}"
+
+MICROCC="${BUILD_DIR}/microcc"
+GENERATOR="${BUILD_DIR}/microcc-gen"
+
+for tool in "${MICROCC}" "${GENERATOR}"; do
+	if [ ! -x "${tool}" ]; then
+		echo "$0: ${tool} not found, build it first" >&2
+		exit 2
+	fi
+done
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "${WORK_DIR}"' EXIT
+
+RESULTS="${WORK_DIR}/results.tsv"
+: > "${RESULTS}"
+
+printf "%-10s %-12s %12s %16s\n" "lines" "phase" "time (s)" "peak RSS (KiB)"
+
+for size in ${SIZES}; do
+	input="${WORK_DIR}/input.c"
+	"${GENERATOR}" -lines "${size}" ${GEN_FLAGS} -o "${input}"
+	lines="$(wc -l < "${input}")"
+
+	# shellcheck disable=SC2086
+	"${MICROCC}" -time-phases -emit-llvm=false ${MICROCC_FLAGS} "${input}" \
+		2> "${WORK_DIR}/phases.tsv"
+
+	grep -v '^#' "${WORK_DIR}/phases.tsv" | while IFS=$'\t' read -r phase time rss; do
+		printf "%-10s %-12s %12s %16s\n" "${lines}" "${phase}" "${time}" "${rss}"
+		printf "%s\t%s\t%s\t%s\n" "${lines}" "${phase}" "${time}" "${rss}" >> "${RESULTS}"
+	done
+
+	rm -f "${input}"
+done
+
+# For each phase and each pair of consecutive sizes, compute the exponent k in
+# cost ~ lines^k. Linear scaling gives k = 1.
+awk -F '\t' -v threshold="${THRESHOLD}" -v min_time="${MIN_TIME}" \
+	-v min_rss="${MIN_RSS}" '
+function check(what, phase, n1, n2, c1, c2, floor) {
+	if (c1 <= 0 || c2 <= floor || n2 <= n1)
+		return
+	k = log(c2 / c1) / log(n2 / n1)
+	if (k > threshold) {
+		printf "REGRESSION: %s of phase %s scales as lines^%.2f between %d and %d lines\n", \
+			what, phase, k, n1, n2
+		failed = 1
+	}
+}
+{
+	phase = $2
+	if (phase in last_lines) {
+		check("time", phase, last_lines[phase], $1, last_time[phase], $3, min_time)
+		# This is the peak RSS of the whole process at the end of the phase.
+		check("peak RSS", phase, last_lines[phase], $1, last_rss[phase], $4, min_rss)
+	}
+	last_lines[phase] = $1
+	last_time[phase] = $3
+	last_rss[phase] = $4
+}
+END {
+	if (failed)
+		exit 1
+	print "No super-linear scaling detected."
+}' "${RESULTS}"
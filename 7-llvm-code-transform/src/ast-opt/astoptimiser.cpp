@@ -0,0 +1,21 @@
+#include "ast-opt/astoptimiser.hpp"
+#include "ast-opt/commonsubexpressionpass.hpp"
+#include "ast-opt/constantfoldingpass.hpp"
+#include "ast-opt/deadcodeeliminationpass.hpp"
+
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "ast-opt"
+
+void ast_opt::ASTOptimiser::optimise(ast::Base &root) {
+    // Folding first: it turns conditions into literals for dead code
+    // elimination, and leaves fewer (but larger) common subexpressions.
+    ConstantFoldingPass constantFoldingPass{symbol_table, type_table};
+    constantFoldingPass.visit(root);
+
+    DeadCodeEliminationPass deadCodeEliminationPass{symbol_table};
+    deadCodeEliminationPass.visit(root);
+
+    CommonSubexpressionPass commonSubexpressionPass{symbol_table, type_table};
+    commonSubexpressionPass.visit(root);
+}
@@ -0,0 +1,320 @@
+#include "ast-opt/constantfoldingpass.hpp"
+#include "ast-opt/util.hpp"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/Debug.h"
+
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#define DEBUG_TYPE "constantfoldingpass"
+
+STATISTIC(NumConstantsFolded, "The number of operators that were folded");
+STATISTIC(NumConstantsPropagated,
+          "The number of variable references replaced by a literal");
+STATISTIC(NumAlgebraicSimplifications,
+          "The number of algebraic simplifications that were applied");
+
+namespace {
+bool isLiteral(const ast::Expr &expr) {
+    return expr.kind == ast::Base::Kind::IntLiteral ||
+           expr.kind == ast::Base::Kind::FloatLiteral;
+}
+
+bool isIntLiteral(const ast::Expr &expr, int value) {
+    return expr.kind == ast::Base::Kind::IntLiteral &&
+           static_cast<const ast::IntLiteral &>(expr).value == value;
+}
+
+bool isFloatLiteral(const ast::Expr &expr, float value) {
+    return expr.kind == ast::Base::Kind::FloatLiteral &&
+           static_cast<const ast::FloatLiteral &>(expr).value == value;
+}
+
+bool isCommutative(TokenType op) {
+    return op == TokenType::PLUS || op == TokenType::STAR ||
+           op == TokenType::EQUALS_EQUALS || op == TokenType::BANG_EQUALS;
+}
+} // namespace
+
+void ast_opt::ConstantFoldingPass::fold(ast::Ptr<ast::Expr> &expr) {
+    if (ast::Ptr<ast::Expr> replacement = visit(*expr))
+        expr = replacement;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitFuncDecl(ast::FuncDecl &node) {
+    // Only variables that are never assigned to can be propagated.
+    assigned = Util::collectAssignedDeclarations(node, symbol_table);
+    constants.clear();
+
+    visit(*node.body);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitIfStmt(ast::IfStmt &node) {
+    fold(node.condition);
+    visit(*node.if_clause);
+    if (node.else_clause)
+        visit(*node.else_clause);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitWhileStmt(ast::WhileStmt &node) {
+    fold(node.condition);
+    visit(*node.body);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitReturnStmt(ast::ReturnStmt &node) {
+    if (node.value)
+        fold(node.value);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitExprStmt(ast::ExprStmt &node) {
+    fold(node.expr);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitVarDecl(ast::VarDecl &node) {
+    if (!node.init)
+        return nullptr;
+
+    fold(node.init);
+
+    // Remember the value of variables that are never assigned to.
+    if (isLiteral(*node.init) && assigned.find(&node) == std::end(assigned))
+        constants[&node] = node.init;
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitBinaryOpExpr(ast::BinaryOpExpr &node) {
+    fold(node.lhs);
+    fold(node.rhs);
+
+    if (node.op.type == TokenType::EQUALS)
+        return nullptr;
+
+    if (isLiteral(*node.lhs) && isLiteral(*node.rhs)) {
+        ast::Ptr<ast::Expr> folded = foldBinaryOp(node);
+        if (folded)
+            ++NumConstantsFolded;
+        return folded;
+    }
+
+    // Canonicalise: constant operands of commutative operators go to the
+    // right-hand side. Literals have no side effects, so the evaluation order
+    // does not matter.
+    if (isCommutative(node.op.type) && isLiteral(*node.lhs))
+        std::swap(node.lhs, node.rhs);
+
+    if (isLiteral(*node.rhs)) {
+        ast::Ptr<ast::Expr> simplified = simplifyBinaryOp(node);
+        if (simplified)
+            ++NumAlgebraicSimplifications;
+        return simplified;
+    }
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitUnaryOpExpr(ast::UnaryOpExpr &node) {
+    fold(node.operand);
+
+    // Unary plus is the identity.
+    if (node.op.type == TokenType::PLUS) {
+        ++NumAlgebraicSimplifications;
+        return node.operand;
+    }
+
+    if (node.op.type != TokenType::MINUS)
+        return nullptr;
+
+    ast::Ptr<ast::Expr> folded = nullptr;
+
+    if (node.operand->kind == ast::Base::Kind::IntLiteral)
+        folded = makeIntLiteral(
+            node,
+            -static_cast<long long>(
+                static_cast<ast::IntLiteral &>(*node.operand).value));
+    else if (node.operand->kind == ast::Base::Kind::FloatLiteral)
+        folded = makeFloatLiteral(
+            node, -static_cast<ast::FloatLiteral &>(*node.operand).value);
+
+    if (folded)
+        ++NumConstantsFolded;
+
+    return folded;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitVarRefExpr(ast::VarRefExpr &node) {
+    auto it = constants.find(symbol_table[&node]);
+    if (it == std::end(constants))
+        return nullptr;
+
+    ++NumConstantsPropagated;
+    return copyLiteral(node, *it->second);
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitArrayRefExpr(ast::ArrayRefExpr &node) {
+    fold(node.index);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::visitFuncCallExpr(ast::FuncCallExpr &node) {
+    for (auto &arg : node.arguments)
+        fold(arg);
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::foldBinaryOp(ast::BinaryOpExpr &node) {
+    if (node.lhs->kind == ast::Base::Kind::IntLiteral &&
+        node.rhs->kind == ast::Base::Kind::IntLiteral) {
+        // micro-C integers are 64 bits wide, but literals only hold 32 bits:
+        // compute in 64 bits and give up if the result does not fit.
+        long long lhs = static_cast<ast::IntLiteral &>(*node.lhs).value;
+        long long rhs = static_cast<ast::IntLiteral &>(*node.rhs).value;
+
+        switch (node.op.type) {
+        case TokenType::PLUS:
+            return makeIntLiteral(node, lhs + rhs);
+        case TokenType::MINUS:
+            return makeIntLiteral(node, lhs - rhs);
+        case TokenType::STAR:
+            return makeIntLiteral(node, lhs * rhs);
+        case TokenType::SLASH:
+            return rhs == 0 ? nullptr : makeIntLiteral(node, lhs / rhs);
+        case TokenType::PERCENT:
+            return rhs == 0 ? nullptr : makeIntLiteral(node, lhs % rhs);
+        case TokenType::EQUALS_EQUALS:
+            return makeIntLiteral(node, lhs == rhs);
+        case TokenType::BANG_EQUALS:
+            return makeIntLiteral(node, lhs != rhs);
+        case TokenType::LESS_THAN:
+            return makeIntLiteral(node, lhs < rhs);
+        case TokenType::LESS_THAN_EQUALS:
+            return makeIntLiteral(node, lhs <= rhs);
+        case TokenType::GREATER_THAN:
+            return makeIntLiteral(node, lhs > rhs);
+        case TokenType::GREATER_THAN_EQUALS:
+            return makeIntLiteral(node, lhs >= rhs);
+        default:
+            return nullptr;
+        }
+    }
+
+    if (node.lhs->kind == ast::Base::Kind::FloatLiteral &&
+        node.rhs->kind == ast::Base::Kind::FloatLiteral) {
+        float lhs = static_cast<ast::FloatLiteral &>(*node.lhs).value;
+        float rhs = static_cast<ast::FloatLiteral &>(*node.rhs).value;
+
+        switch (node.op.type) {
+        case TokenType::PLUS:
+            return makeFloatLiteral(node, lhs + rhs);
+        case TokenType::MINUS:
+            return makeFloatLiteral(node, lhs - rhs);
+        case TokenType::STAR:
+            return makeFloatLiteral(node, lhs * rhs);
+        case TokenType::SLASH:
+            return makeFloatLiteral(node, lhs / rhs);
+        case TokenType::PERCENT:
+            return makeFloatLiteral(node, std::fmod(lhs, rhs));
+        case TokenType::EQUALS_EQUALS:
+            return makeIntLiteral(node, lhs == rhs);
+        case TokenType::BANG_EQUALS:
+            return makeIntLiteral(node, lhs != rhs);
+        case TokenType::LESS_THAN:
+            return makeIntLiteral(node, lhs < rhs);
+        case TokenType::LESS_THAN_EQUALS:
+            return makeIntLiteral(node, lhs <= rhs);
+        case TokenType::GREATER_THAN:
+            return makeIntLiteral(node, lhs > rhs);
+        case TokenType::GREATER_THAN_EQUALS:
+            return makeIntLiteral(node, lhs >= rhs);
+        default:
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::simplifyBinaryOp(ast::BinaryOpExpr &node) {
+    const ast::Expr &rhs = *node.rhs;
+
+    switch (node.op.type) {
+    case TokenType::PLUS:
+    case TokenType::MINUS:
+        // x + 0, x - 0
+        if (isIntLiteral(rhs, 0))
+            return node.lhs;
+        break;
+    case TokenType::STAR:
+        // x * 1
+        if (isIntLiteral(rhs, 1) || isFloatLiteral(rhs, 1.0f))
+            return node.lhs;
+        // x * 0, only if evaluating x has no side effects
+        if (isIntLiteral(rhs, 0) && Util::isPure(*node.lhs))
+            return makeIntLiteral(node, 0);
+        break;
+    case TokenType::SLASH:
+        // x / 1
+        if (isIntLiteral(rhs, 1) || isFloatLiteral(rhs, 1.0f))
+            return node.lhs;
+        break;
+    default:
+        break;
+    }
+
+    return nullptr;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::makeIntLiteral(ast::Base &node, long long value) {
+    if (value < std::numeric_limits<int>::min() ||
+        value > std::numeric_limits<int>::max())
+        return nullptr;
+
+    auto literal = std::make_shared<ast::IntLiteral>(static_cast<int>(value));
+    type_table[literal.get()] = type_table[&node];
+    return literal;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::makeFloatLiteral(ast::Base &node, float value) {
+    auto literal = std::make_shared<ast::FloatLiteral>(value);
+    type_table[literal.get()] = type_table[&node];
+    return literal;
+}
+
+ast::Ptr<ast::Expr>
+ast_opt::ConstantFoldingPass::copyLiteral(ast::Base &node, ast::Expr &literal) {
+    if (literal.kind == ast::Base::Kind::IntLiteral)
+        return makeIntLiteral(node,
+                              static_cast<ast::IntLiteral &>(literal).value);
+
+    return makeFloatLiteral(node,
+                            static_cast<ast::FloatLiteral &>(literal).value);
+}
@@ -0,0 +1,75 @@
+#ifndef CONSTANTFOLDINGPASS_HPP
+#define CONSTANTFOLDINGPASS_HPP
+
+#include "ast/ast.hpp"
+#include "ast/visitor.hpp"
+#include "sema/scoperesolutionpass.hpp"
+#include "sema/typecheckingpass.hpp"
+
+#include <map>
+#include <set>
+
+namespace ast_opt {
+// AST pass that folds operators applied to literals, propagates the value of
+// variables that are initialised with a literal and never assigned to, and
+// applies algebraic simplifications (x + 0, x * 1, ...). Constant operands of
+// commutative operators are moved to the right-hand side, so that the code
+// generators only need to look there (e.g. to turn x * 2^k into a shift).
+//
+// Each visit method returns the expression that should replace the visited
+// node, or nullptr if the node should be kept.
+class ConstantFoldingPass
+    : public ast::Visitor<ConstantFoldingPass, ast::Ptr<ast::Expr>> {
+  public:
+    ConstantFoldingPass(sema::ScopeResolutionPass::SymbolTable &symbol_table,
+                        sema::TypeCheckingPass::TypeTable &type_table)
+        : symbol_table(symbol_table), type_table(type_table) {}
+
+    ast::Ptr<ast::Expr> visitFuncDecl(ast::FuncDecl &node);
+    ast::Ptr<ast::Expr> visitIfStmt(ast::IfStmt &node);
+    ast::Ptr<ast::Expr> visitWhileStmt(ast::WhileStmt &node);
+    ast::Ptr<ast::Expr> visitReturnStmt(ast::ReturnStmt &node);
+    ast::Ptr<ast::Expr> visitExprStmt(ast::ExprStmt &node);
+    ast::Ptr<ast::Expr> visitVarDecl(ast::VarDecl &node);
+    ast::Ptr<ast::Expr> visitBinaryOpExpr(ast::BinaryOpExpr &node);
+    ast::Ptr<ast::Expr> visitUnaryOpExpr(ast::UnaryOpExpr &node);
+    ast::Ptr<ast::Expr> visitVarRefExpr(ast::VarRefExpr &node);
+    ast::Ptr<ast::Expr> visitArrayRefExpr(ast::ArrayRefExpr &node);
+    ast::Ptr<ast::Expr> visitFuncCallExpr(ast::FuncCallExpr &node);
+
+  private:
+    // Maps each use of a variable to its definition.
+    sema::ScopeResolutionPass::SymbolTable &symbol_table;
+
+    // Maps each expression to its type. Literals created by this pass are
+    // added to it.
+    sema::TypeCheckingPass::TypeTable &type_table;
+
+    // Declarations that are assigned to in the current function.
+    std::set<ast::Base *> assigned;
+
+    // Maps variables that are never assigned to the literal they are
+    // initialised with.
+    std::map<ast::Base *, ast::Ptr<ast::Expr>> constants;
+
+    // Visits 'expr' and replaces it if the visit returns a replacement.
+    void fold(ast::Ptr<ast::Expr> &expr);
+
+    // Folds a binary operator whose operands are both literals. Returns
+    // nullptr if the operator cannot be folded (e.g. division by zero).
+    ast::Ptr<ast::Expr> foldBinaryOp(ast::BinaryOpExpr &node);
+
+    // Applies algebraic identities to a binary operator with one literal
+    // operand. Returns nullptr if no identity applies.
+    ast::Ptr<ast::Expr> simplifyBinaryOp(ast::BinaryOpExpr &node);
+
+    // Creates a literal that replaces 'node', with the same type.
+    ast::Ptr<ast::Expr> makeIntLiteral(ast::Base &node, long long value);
+    ast::Ptr<ast::Expr> makeFloatLiteral(ast::Base &node, float value);
+
+    // Returns a fresh copy of a literal.
+    ast::Ptr<ast::Expr> copyLiteral(ast::Base &node, ast::Expr &literal);
+};
+} // namespace ast_opt
+
+#endif /* end of include guard: CONSTANTFOLDINGPASS_HPP */
@@ -0,0 +1,44 @@
+#ifndef DEADCODEELIMINATIONPASS_HPP
+#define DEADCODEELIMINATIONPASS_HPP
+
+#include "ast/ast.hpp"
+#include "ast/visitor.hpp"
+#include "sema/scoperesolutionpass.hpp"
+
+#include <set>
+
+namespace ast_opt {
+// AST pass that removes statements that can never execute or that have no
+// effect: statements following a return, if statements with a constant
+// condition, while loops with a constant false condition, and declarations of
+// variables that are never referenced.
+//
+// Each visit method returns the statement that should replace the visited
+// node, or nullptr if the node should be kept.
+class DeadCodeEliminationPass
+    : public ast::Visitor<DeadCodeEliminationPass, ast::Ptr<ast::Stmt>> {
+  public:
+    DeadCodeEliminationPass(
+        const sema::ScopeResolutionPass::SymbolTable &symbol_table)
+        : symbol_table(symbol_table) {}
+
+    ast::Ptr<ast::Stmt> visitFuncDecl(ast::FuncDecl &node);
+    ast::Ptr<ast::Stmt> visitIfStmt(ast::IfStmt &node);
+    ast::Ptr<ast::Stmt> visitWhileStmt(ast::WhileStmt &node);
+    ast::Ptr<ast::Stmt> visitVarDecl(ast::VarDecl &node);
+    ast::Ptr<ast::Stmt> visitArrayDecl(ast::ArrayDecl &node);
+    ast::Ptr<ast::Stmt> visitCompoundStmt(ast::CompoundStmt &node);
+
+  private:
+    // Maps each use of a variable to its definition.
+    const sema::ScopeResolutionPass::SymbolTable &symbol_table;
+
+    // Declarations that are referenced in the current function.
+    std::set<ast::Base *> referenced;
+
+    // Visits 'stmt' and replaces it if the visit returns a replacement.
+    void eliminate(ast::Ptr<ast::Stmt> &stmt);
+};
+} // namespace ast_opt
+
+#endif /* end of include guard: DEADCODEELIMINATIONPASS_HPP */
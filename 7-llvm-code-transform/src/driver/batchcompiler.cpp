@@ -0,0 +1,388 @@
+#include "driver/batchcompiler.hpp"
+#include "ast-opt/astoptimiser.hpp"
+#include "codegen-llvm/codegen-llvm.hpp"
+#include "codegen-llvm/codegenexception.hpp"
+#include "lexer/lexer.hpp"
+#include "llvm-opt/llvmoptimiser.hpp"
+#include "llvm-opt/optimiserexception.hpp"
+#include "parser/parser.hpp"
+#include "sema/collectfuncdeclspass.hpp"
+#include "sema/scoperesolutionpass.hpp"
+#include "sema/semanticexception.hpp"
+#include "sema/typecheckingpass.hpp"
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <fmt/format.h>
+
+#include <fstream>
+#include <map>
+#include <streambuf>
+#include <thread>
+
+#include <unistd.h>
+
+namespace driver {
+BatchCompiler::BatchCompiler(const Options &options) : options(options) {
+    if (this->options.jobs == 0) {
+        this->options.jobs =
+            llvm::hardware_concurrency().compute_thread_count();
+    }
+
+    queue_capacity = 2 * this->options.jobs;
+}
+
+std::string
+BatchCompiler::getOutputFilename(const std::string &filename) const {
+    llvm::SmallString<128> path;
+
+    if (options.output_dir.empty()) {
+        path = filename;
+    } else {
+        path = options.output_dir;
+        llvm::sys::path::append(path, llvm::sys::path::filename(filename));
+    }
+
+    llvm::sys::path::replace_extension(path, "ll");
+    return std::string(path);
+}
+
+bool BatchCompiler::checkOutputFilenames(
+    const std::vector<std::string> &filenames) const {
+    std::map<std::string, const std::string *> inputFilenames;
+    bool success = true;
+
+    for (const std::string &filename : filenames) {
+        std::string outputFilename = getOutputFilename(filename);
+        auto inserted = inputFilenames.emplace(outputFilename, &filename);
+
+        if (!inserted.second) {
+            llvm::WithColor::error(llvm::errs())
+                << fmt::format("'{}' and '{}' would both be written to '{}'\n",
+                               *inserted.first->second, filename,
+                               outputFilename);
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+// The lexer and parser do not know the name of the file, so add a note after
+// their diagnostics.
+static void reportInputFile(llvm::raw_ostream &os,
+                            const std::string &filename) {
+    llvm::WithColor::note(os) << fmt::format("in file '{}'\n", filename);
+}
+
+namespace {
+// Collects what is written to stderr in a temporary file. The lexer and
+// parser print their diagnostics to stderr, so they are captured to be printed
+// in input order with those of the later phases. Stderr is redirected for the
+// whole process, so anything another thread prints meanwhile is captured as
+// well. Hence it is only used while no worker is running.
+class StderrCapture {
+  public:
+    ~StderrCapture() {
+        if (fd != -1)
+            llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+    }
+
+    // Creates the temporary file. Returns false after printing an error if it
+    // cannot be created.
+    bool open() {
+        llvm::SmallString<128> path;
+
+        if (std::error_code error = llvm::sys::fs::createTemporaryFile(
+                "microcc", "txt", fd, path)) {
+            llvm::WithColor::error(llvm::errs())
+                << fmt::format("cannot create a temporary file: {}\n",
+                               error.message());
+            return false;
+        }
+
+        // The file is only accessed through its descriptor.
+        llvm::sys::fs::remove(path);
+        return true;
+    }
+
+    // Runs a function, and returns what it wrote to stderr.
+    std::string capture(llvm::function_ref<void()> function) {
+        off_t begin = ::lseek(fd, 0, SEEK_END);
+
+        {
+            Redirect redirect{fd};
+            function();
+        }
+
+        std::string text;
+        char buffer[4096];
+        ssize_t size;
+
+        while ((size = ::pread(fd, buffer, sizeof(buffer),
+                               begin + text.size())) > 0)
+            text.append(buffer, size);
+
+        return text;
+    }
+
+  private:
+    // Points stderr to a file for the lifetime of the object.
+    class Redirect {
+      public:
+        Redirect(int fd) : saved_fd(::dup(STDERR_FILENO)) {
+            llvm::errs().flush();
+            ::dup2(fd, STDERR_FILENO);
+        }
+
+        ~Redirect() {
+            llvm::errs().flush();
+            ::dup2(saved_fd, STDERR_FILENO);
+            ::close(saved_fd);
+        }
+
+      private:
+        int saved_fd;
+    };
+
+    int fd = -1;
+};
+} // namespace
+
+// Phases 1 and 2: lexical analysis and parsing. Returns nullptr if either
+// found errors.
+static ast::Ptr<ast::Base> parse(const std::string &source) {
+    std::vector<Token> tokens;
+    {
+        Lexer lexer{source};
+        tokens = lexer.getTokens();
+
+        if (lexer.hadError())
+            return nullptr;
+    }
+
+    Parser parser{tokens};
+    auto root = parser.parse();
+
+    if (parser.hadError())
+        return nullptr;
+
+    return root;
+}
+
+bool BatchCompiler::compile(const std::vector<std::string> &filenames) {
+    if (options.emit_llvm && !checkOutputFilenames(filenames))
+        return false;
+
+    StderrCapture stderrCapture;
+
+    if (!stderrCapture.open())
+        return false;
+
+    this->filenames = &filenames;
+    diagnostics.assign(filenames.size(), "");
+    failed.assign(filenames.size(), false);
+    done = false;
+
+    // Lex and parse every file before the workers are started, so that no
+    // other thread prints to stderr while it is redirected. The ASTs are not
+    // kept, so that memory does not grow with the number of files. Only the
+    // sources of the files that parse are kept, and parsed again below, which
+    // prints nothing.
+    std::vector<std::string> sources(filenames.size());
+
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        std::ifstream inputFile{filenames[i]};
+
+        if (!inputFile) {
+            llvm::raw_string_ostream diagnosticStream{diagnostics[i]};
+            llvm::WithColor::error(diagnosticStream)
+                << fmt::format("cannot open '{}'\n", filenames[i]);
+            failed[i] = true;
+            continue;
+        }
+
+        sources[i].assign(std::istreambuf_iterator<char>(inputFile),
+                          std::istreambuf_iterator<char>());
+
+        bool parsed = false;
+        diagnostics[i] = stderrCapture.capture(
+            [&] { parsed = parse(sources[i]) != nullptr; });
+
+        if (!parsed) {
+            llvm::raw_string_ostream diagnosticStream{diagnostics[i]};
+            reportInputFile(diagnosticStream, filenames[i]);
+            failed[i] = true;
+            sources[i].clear();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < options.jobs; ++i)
+        workers.emplace_back([this] { work(); });
+
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        if (failed[i])
+            continue;
+
+        ast::Ptr<ast::Base> root;
+        {
+            std::lock_guard<std::mutex> lock{ast_mutex};
+            root = parse(sources[i]);
+        }
+        std::string().swap(sources[i]);
+
+        std::unique_lock<std::mutex> lock{queue_mutex};
+        queue_not_full.wait(lock,
+                            [this] { return queue.size() < queue_capacity; });
+        queue.push_back(Job{i, std::move(root)});
+        queue_not_empty.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{queue_mutex};
+        done = true;
+    }
+    queue_not_empty.notify_all();
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    bool success = true;
+
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        llvm::errs() << diagnostics[i];
+        success &= !failed[i];
+    }
+
+    return success;
+}
+
+void BatchCompiler::work() {
+    llvm::LLVMContext ctx;
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock{queue_mutex};
+            queue_not_empty.wait(lock,
+                                 [this] { return done || !queue.empty(); });
+
+            if (queue.empty())
+                return;
+
+            job = std::move(queue.front());
+            queue.pop_front();
+            queue_not_full.notify_one();
+        }
+
+        compileJob(ctx, job);
+    }
+}
+
+void BatchCompiler::compileJob(llvm::LLVMContext &ctx, Job &job) {
+    const std::string &filename = (*filenames)[job.index];
+    std::string &diagnostic = diagnostics[job.index];
+    llvm::raw_string_ostream diagnosticStream{diagnostic};
+
+    ast::Base &root = *job.root;
+
+    // Phase 3: semantic analysis
+    sema::CollectFuncDeclsPass collectFuncDeclsPass{ctx};
+    sema::ScopeResolutionPass scopeResolutionPass;
+    sema::TypeCheckingPass typeCheckingPass{ctx};
+
+    try {
+        collectFuncDeclsPass.visit(root);
+        scopeResolutionPass.visit(root);
+
+        typeCheckingPass.setFunctionTable(
+            collectFuncDeclsPass.getFunctionTable());
+        typeCheckingPass.setSymbolTable(scopeResolutionPass.getSymbolTable());
+
+        typeCheckingPass.visit(root);
+    } catch (const sema::SemanticException &e) {
+        std::string location = filename + ": ";
+
+        if (e.location.line != 0 && e.location.col != 0) {
+            location = fmt::format("{}:{}:{}: ", filename, e.location.line,
+                                   e.location.col);
+        }
+
+        llvm::WithColor::error(diagnosticStream, "sema")
+            << fmt::format("{}{}\n", location, e.what());
+        failed[job.index] = true;
+        return;
+    }
+
+    // Phase 3b: AST-level optimisation
+    ast_opt::ASTOptimiser astOptimiser{scopeResolutionPass.getSymbolTable(),
+                                       typeCheckingPass.getTypeTable()};
+
+    if (options.ast_opt) {
+        std::lock_guard<std::mutex> lock{ast_mutex};
+        astOptimiser.optimise(root);
+    }
+
+    // Phase 4: code generation
+    codegen_llvm::CodeGeneratorLLVM codeGenerator{
+        ctx, filename, collectFuncDeclsPass.getFunctionTable(),
+        astOptimiser.getSymbolTable(), astOptimiser.getTypeTable()};
+    try {
+        codeGenerator.visit(root);
+        codeGenerator.finalize();
+    } catch (codegen_llvm::CodegenException &e) {
+        llvm::WithColor::error(diagnosticStream, "codegen")
+            << filename << ": " << e.what() << "\n";
+        failed[job.index] = true;
+        return;
+    }
+
+    // The AST is no longer needed.
+    job.root.reset();
+
+    // Phase 5: LLVM IR optimisation
+    if (options.opt_level != 0 || !options.pass_plugins.empty()) {
+        try {
+            auto targetMachine = llvm_opt::createTargetMachine(
+                options.cpu, options.opt_level);
+            llvm_opt::LLVMOptimiser optimiser{options.opt_level,
+                                              targetMachine.get()};
+
+            for (const std::string &plugin : options.pass_plugins)
+                optimiser.loadPlugin(plugin);
+
+            optimiser.optimise(codeGenerator.getModule());
+        } catch (const llvm_opt::OptimiserException &e) {
+            llvm::WithColor::error(diagnosticStream, "llvm-opt")
+                << filename << ": " << e.what() << "\n";
+            failed[job.index] = true;
+            return;
+        }
+    }
+
+    if (!options.emit_llvm)
+        return;
+
+    std::string outputFilename = getOutputFilename(filename);
+    std::error_code error;
+    llvm::raw_fd_ostream output{outputFilename, error};
+
+    if (error) {
+        llvm::WithColor::error(diagnosticStream)
+            << fmt::format("cannot write '{}': {}\n", outputFilename,
+                           error.message());
+        failed[job.index] = true;
+        return;
+    }
+
+    output << codeGenerator.getModule();
+}
+} // namespace driver
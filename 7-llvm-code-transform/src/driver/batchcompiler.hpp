@@ -0,0 +1,102 @@
+#ifndef BATCHCOMPILER_HPP
+#define BATCHCOMPILER_HPP
+
+#include "ast/ast.hpp"
+
+#include "llvm/IR/LLVMContext.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace driver {
+// Compiles many input files in one process. The files are lexed and parsed in
+// input order on the calling thread, and the remaining phases run on a fixed
+// number of worker threads, each with its own LLVMContext. The AST-level
+// optimisations create AST nodes, and do not run concurrently with parsing.
+//
+// The diagnostics of every phase are collected per file, and are printed in
+// input order after all files are compiled. The output is thus deterministic,
+// regardless of the number of workers. The lexer and parser print their
+// diagnostics to stderr, so every file is first parsed with stderr redirected,
+// before the workers are started, and the files without errors are parsed
+// again when they are handed to the workers.
+class BatchCompiler {
+  public:
+    struct Options {
+        // Number of worker threads. If 0, the number of hardware threads.
+        unsigned int jobs = 0;
+
+        // Run the AST-level optimisations.
+        bool ast_opt = false;
+
+        // Level of the LLVM optimisation pipeline, the CPU that it optimises
+        // for, and the pass plugins that add passes to it (see
+        // llvm_opt::LLVMOptimiser).
+        unsigned int opt_level = 0;
+        std::string cpu = "generic";
+        std::vector<std::string> pass_plugins;
+
+        // Write the LLVM IR of each input file.
+        bool emit_llvm = true;
+
+        // Directory of the output files. If empty, each output file is written
+        // next to its input file.
+        std::string output_dir;
+    };
+
+    BatchCompiler(const Options &options);
+
+    // Compile the given files. Returns true if all files compiled without
+    // errors.
+    bool compile(const std::vector<std::string> &filenames);
+
+    // Returns the path of the LLVM IR file for the given input file.
+    std::string getOutputFilename(const std::string &filename) const;
+
+    // Checks that no two input files are written to the same output file,
+    // e.g. 'a/x.c' and 'b/x.c' with an output directory. Returns false after
+    // printing an error for each collision.
+    bool checkOutputFilenames(const std::vector<std::string> &filenames) const;
+
+  private:
+    // A parsed input file, waiting for a worker.
+    struct Job {
+        std::size_t index;
+        ast::Ptr<ast::Base> root;
+    };
+
+    Options options;
+
+    // Bounded queue of jobs, so that the parsed ASTs waiting for a worker do
+    // not grow with the number of input files.
+    std::deque<Job> queue;
+    std::size_t queue_capacity;
+    bool done = false;
+    std::mutex queue_mutex;
+    std::condition_variable queue_not_empty;
+    std::condition_variable queue_not_full;
+
+    // The AST nodes take their ids from a counter in ast::Base that is not
+    // thread-safe. Parsing on the calling thread and the AST-level
+    // optimisations on the workers both create nodes, so they hold this lock.
+    std::mutex ast_mutex;
+
+    // Input files, and the diagnostics and status of each file.
+    const std::vector<std::string> *filenames;
+    std::vector<std::string> diagnostics;
+    std::vector<char> failed;
+
+    // Worker thread: compiles jobs until the queue is closed.
+    void work();
+
+    // Runs semantic analysis, optimisation and code generation for one file,
+    // and writes its output.
+    void compileJob(llvm::LLVMContext &ctx, Job &job);
+};
+} // namespace driver
+
+#endif /* end of include guard: BATCHCOMPILER_HPP */
@@ -0,0 +1,128 @@
+#include "driver/functionsplitter.hpp"
+
+#include <cctype>
+#include <streambuf>
+
+namespace driver {
+FunctionSplitter::FunctionSplitter(std::istream &input) : input(input) {}
+
+std::vector<FunctionChunk> FunctionSplitter::split() {
+    std::vector<FunctionChunk> chunks;
+
+    input.clear();
+    input.seekg(0);
+    std::streambuf *buf = input.rdbuf();
+
+    std::streamoff offset = 0;
+    Location location{1, 1};
+
+    FunctionChunk chunk{0, 0, location, ""};
+    unsigned int depth = 0;
+    bool in_body = false;
+
+    // Set when the current chunk contains something other than whitespace and
+    // comments.
+    bool significant = false;
+
+    // Appends a character of the current chunk to its header, if the body has
+    // not started yet.
+    auto consume = [&](char c) {
+        if (!in_body)
+            chunk.header += c;
+
+        ++offset;
+
+        if (c == '\n') {
+            ++location.line;
+            location.col = 1;
+        } else {
+            ++location.col;
+        }
+    };
+
+    for (int c = buf->sbumpc(); c != std::streambuf::traits_type::eof();
+         c = buf->sbumpc()) {
+        char ch = static_cast<char>(c);
+
+        if (ch == '/' && buf->sgetc() == '/') {
+            // Comment: skip to the end of the line.
+            for (; c != std::streambuf::traits_type::eof() && c != '\n';
+                 c = buf->sbumpc())
+                consume(static_cast<char>(c));
+
+            if (c == '\n')
+                consume('\n');
+
+            continue;
+        }
+
+        if (!std::isspace(static_cast<unsigned char>(ch)))
+            significant = true;
+
+        if (ch == '"') {
+            // String literal: braces inside it do not count.
+            consume(ch);
+
+            for (c = buf->sbumpc();
+                 c != std::streambuf::traits_type::eof() && c != '"';
+                 c = buf->sbumpc())
+                consume(static_cast<char>(c));
+
+            if (c == '"')
+                consume('"');
+
+            continue;
+        }
+
+        if (ch == '{') {
+            ++depth;
+            in_body = true;
+        }
+
+        consume(ch);
+
+        if (ch == '}' && (depth == 0 || --depth == 0)) {
+            // End of the function body: start a new chunk after the brace.
+            chunk.length = static_cast<std::size_t>(offset - chunk.offset);
+            chunks.push_back(std::move(chunk));
+
+            chunk = FunctionChunk{offset, 0, location, ""};
+            in_body = false;
+            significant = false;
+        }
+    }
+
+    // Trailing text that is not a complete function is kept, so that the
+    // parser can report it.
+    if (significant) {
+        chunk.length = static_cast<std::size_t>(offset - chunk.offset);
+        chunks.push_back(std::move(chunk));
+    }
+
+    return chunks;
+}
+
+std::string FunctionSplitter::read(const FunctionChunk &chunk) {
+    std::string text(chunk.length, '\0');
+
+    input.clear();
+    input.seekg(chunk.offset);
+    input.read(&text[0], static_cast<std::streamsize>(chunk.length));
+
+    return text;
+}
+
+void relocateTokens(std::vector<Token> &tokens, const Location &chunk_begin) {
+    auto relocate = [&](Location &location) {
+        if (location.line == 1)
+            location.col += chunk_begin.col - 1;
+
+        location.line += chunk_begin.line - 1;
+    };
+
+    for (Token &token : tokens) {
+        relocate(token.begin);
+        relocate(token.end);
+    }
+}
+} // namespace driver
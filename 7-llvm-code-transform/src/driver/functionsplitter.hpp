@@ -0,0 +1,57 @@
+#ifndef FUNCTIONSPLITTER_HPP
+#define FUNCTIONSPLITTER_HPP
+
+#include "lexer/token.hpp"
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace driver {
+// A top-level function definition in the source file.
+struct FunctionChunk {
+    // Offset of the first character of the chunk in the input stream.
+    std::streamoff offset;
+
+    // Number of characters in the chunk.
+    std::size_t length;
+
+    // Location of the first character of the chunk in the source file.
+    Location begin;
+
+    // Text of the function header, i.e. everything before the opening brace of
+    // the function body.
+    std::string header;
+};
+
+// Splits a micro-C source file into its top-level function definitions,
+// without lexing or parsing the function bodies. Only the function headers are
+// kept in memory, so that a caller can collect all function signatures before
+// compiling the functions one at a time.
+//
+// This is a light-weight scan that only knows about braces, comments and
+// string literals. Each chunk starts right after the closing brace of the
+// previous function, so leading comments and whitespace belong to the next
+// function. Malformed input is still split into chunks: the lexer and parser
+// report the actual errors when the chunk is compiled.
+class FunctionSplitter {
+  public:
+    FunctionSplitter(std::istream &input);
+
+    std::vector<FunctionChunk> split();
+
+    // Reads the text of a chunk from the input stream.
+    std::string read(const FunctionChunk &chunk);
+
+  private:
+    // Input stream. This must be seekable.
+    std::istream &input;
+};
+
+// Shifts the location of tokens lexed from a chunk, so that they refer to the
+// location of the chunk in the original source file.
+void relocateTokens(std::vector<Token> &tokens, const Location &chunk_begin);
+} // namespace driver
+
+#endif /* end of include guard: FUNCTIONSPLITTER_HPP */
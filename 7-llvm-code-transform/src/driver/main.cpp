@@ -1,9 +1,17 @@
+#include "ast-opt/astoptimiser.hpp"
 #include "ast/ast.hpp"
 #include "ast/prettyprinter.hpp"
 #include "codegen-llvm/codegen-llvm.hpp"
 #include "codegen-llvm/codegenexception.hpp"
+#include "driver/batchcompiler.hpp"
+#include "driver/functionsplitter.hpp"
+#include "driver/modulelinker.hpp"
+#include "driver/objectemitter.hpp"
+#include "driver/phasetimer.hpp"
 #include "lexer/lexer.hpp"
 #include "lexer/token.hpp"
+#include "llvm-opt/llvmoptimiser.hpp"
+#include "llvm-opt/optimiserexception.hpp"
 #include "parser/parser.hpp"
 #include "sema/collectfuncdeclspass.hpp"
 #include "sema/scoperesolutionpass.hpp"
@@ -14,8 +22,12 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/WithColor.h"
 
 #include <cstdlib>
 #include <fmt/core.h>
@@ -23,14 +35,15 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <streambuf>
 #include <string>
 #include <vector>
 
-llvm::cl::opt<std::string> InputFilename(llvm::cl::Positional,
-                                         llvm::cl::desc("<input file>"),
-                                         llvm::cl::init("-"));
+llvm::cl::list<std::string> InputFilenames(
+    llvm::cl::Positional,
+    llvm::cl::desc("<input files> (or @<response file> listing them)"));
 
 llvm::cl::opt<bool>
     DumpTokens("dump-tokens",
@@ -67,11 +80,428 @@ llvm::cl::opt<bool>
                   llvm::cl::desc("Dump the type table after semantic analysis"),
                   llvm::cl::init(false));
 
+llvm::cl::opt<bool>
+    AstOpt("ast-opt",
+           llvm::cl::desc("Run the AST-level optimisation pipeline (constant "
+                          "folding, dead code elimination, common "
+                          "subexpression elimination) before code generation"),
+           llvm::cl::init(false));
+
+llvm::cl::opt<unsigned int>
+    OptLevel("O",
+             llvm::cl::desc("Optimise the LLVM IR with the default pipeline "
+                            "of LLVM's pass manager at this level, from 0 to "
+                            "3 (default: 0)"),
+             llvm::cl::Prefix, llvm::cl::init(0));
+
+llvm::cl::opt<std::string>
+    MArch("march",
+          llvm::cl::desc("CPU to optimise and generate code for: the name of "
+                         "a CPU known to LLVM, or 'native' for the host's CPU "
+                         "(default: generic)"),
+          llvm::cl::init("generic"));
+
+llvm::cl::list<std::string> PassPlugins(
+    "load-pass-plugin",
+    llvm::cl::desc("Load a pass plugin, which adds its passes at the "
+                   "extension points of the optimisation pipeline"),
+    llvm::cl::value_desc("filename"));
+
+llvm::cl::opt<bool> Streaming(
+    "stream",
+    llvm::cl::desc("Compile the input one function at a time, so that only a "
+                   "single function's tokens, AST and tables are kept in "
+                   "memory"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> TimePhases(
+    "time-phases",
+    llvm::cl::desc("Print the time and peak memory usage of each compilation "
+                   "phase to stderr"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned int>
+    Jobs("j",
+         llvm::cl::desc("Number of files compiled concurrently when there are "
+                        "multiple input files (default: number of hardware "
+                        "threads)"),
+         llvm::cl::Prefix, llvm::cl::init(0));
+
+llvm::cl::opt<std::string> OutputDir(
+    "output-dir",
+    llvm::cl::desc("Directory of the .ll files written when there are "
+                   "multiple input files (default: next to each input file)"),
+    llvm::cl::init(""));
+
 llvm::cl::opt<bool>
     EmitLLVM("emit-llvm",
              llvm::cl::desc("Emit the generated LLVM IR after code generation"),
              llvm::cl::init(true));
 
+llvm::cl::opt<bool>
+    EmitObject("c",
+               llvm::cl::desc("Write an ELF object file instead of the LLVM "
+                              "IR"),
+               llvm::cl::init(false));
+
+llvm::cl::opt<std::string> OutputFilename(
+    "o",
+    llvm::cl::desc("Write the object file of -c to this file (default: the "
+                   "input file's name with '.o'), or, without -c, link an "
+                   "executable with the runtime library"),
+    llvm::cl::value_desc("filename"), llvm::cl::init(""));
+
+#ifndef MICROCC_RUNTIME_LIBRARY
+#define MICROCC_RUNTIME_LIBRARY "libruntime.a"
+#endif
+
+llvm::cl::opt<std::string> RuntimeLibrary(
+    "runtime",
+    llvm::cl::desc("Runtime library linked into executables (default: the "
+                   "library built with microcc)"),
+    llvm::cl::value_desc("filename"), llvm::cl::init(MICROCC_RUNTIME_LIBRARY));
+
+static void dumpTokens(const std::vector<Token> &tokens) {
+    for (const Token &token : tokens) {
+        std::string location =
+            fmt::format("{}:{} -> {}:{}", token.begin.line, token.begin.col,
+                        token.end.line, token.end.col);
+
+        fmt::print("{:20}{:20}{:20}\n", location, token.lexeme,
+                   token_type_to_string(token.type));
+    }
+}
+
+static void dumpAst(ast::Base &root) {
+    ast::PrettyPrinter printer(std::cout, AsciiMode, DumpAstIds);
+    printer.visit(root, "", true);
+}
+
+static void
+dumpFunctionTable(const sema::CollectFuncDeclsPass::FunctionTable &table) {
+    std::cout << "Function table:\n";
+
+    for (const auto &func : table) {
+        fmt::print("{:20}{}\n", func.first,
+                   sema::Util::llvm_type_to_string(func.second));
+    }
+}
+
+static void
+dumpSymbolTable(const sema::ScopeResolutionPass::SymbolTable &table) {
+    std::cout << "Symbol table:\n";
+
+    for (const auto &symbol : table) {
+        fmt::print("{:<20}{:<20}\n", symbol.first->id, symbol.second->id);
+    }
+}
+
+static void dumpTypeTable(const sema::TypeCheckingPass::TypeTable &table) {
+    std::cout << "Type table:\n";
+
+    for (const auto &entry : table) {
+        fmt::print("{:<20}{}\n", entry.first->id,
+                   sema::Util::llvm_type_to_string(entry.second));
+    }
+}
+
+static void reportSemanticError(const sema::SemanticException &e) {
+    std::string location = "";
+
+    if (e.location.line != 0 && e.location.col != 0) {
+        location = fmt::format("{}:{}: ", e.location.line, e.location.col);
+    }
+
+    llvm::WithColor::error(llvm::errs(), "sema")
+        << fmt::format("{}{}\n", location, e.what());
+}
+
+// Returns the target machine of -march and -O, which is created on first
+// use. Throws an OptimiserException if it cannot be created.
+static llvm::TargetMachine &getTargetMachine() {
+    static std::unique_ptr<llvm::TargetMachine> targetMachine;
+
+    if (!targetMachine)
+        targetMachine = llvm_opt::createTargetMachine(MArch, OptLevel);
+
+    return *targetMachine;
+}
+
+// Runs the LLVM optimisation pipeline on a generated module, unless it is
+// empty, i.e. at -O0 without plugins. Returns false on errors.
+static bool optimiseModule(llvm::Module &module) {
+    if (OptLevel == 0 && PassPlugins.empty())
+        return true;
+
+    try {
+        llvm_opt::LLVMOptimiser optimiser{OptLevel, &getTargetMachine()};
+
+        for (const std::string &plugin : PassPlugins)
+            optimiser.loadPlugin(plugin);
+
+        optimiser.optimise(module);
+    } catch (const llvm_opt::OptimiserException &e) {
+        llvm::WithColor::error(llvm::errs(), "llvm-opt") << e.what() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+// Emits a compiled module: its LLVM IR on stdout, or, with -c, an object file,
+// or, with -o, an executable. Returns false on errors.
+static bool emitModule(llvm::Module &module, const std::string &inputFilename,
+                       driver::PhaseTimer &timer) {
+    if (!EmitObject && OutputFilename.empty()) {
+        if (EmitLLVM)
+            llvm::outs() << module;
+
+        return true;
+    }
+
+    llvm::TargetMachine *targetMachine;
+
+    try {
+        targetMachine = &getTargetMachine();
+    } catch (const llvm_opt::OptimiserException &e) {
+        llvm::WithColor::error(llvm::errs(), "llvm-opt") << e.what() << "\n";
+        return false;
+    }
+
+    if (EmitObject) {
+        std::string objectFilename = OutputFilename;
+
+        if (objectFilename.empty())
+            objectFilename =
+                (llvm::sys::path::stem(inputFilename) + ".o").str();
+
+        return driver::writeObjectFile(module, *targetMachine, objectFilename,
+                                       llvm::errs());
+    }
+
+    // The object file of an executable is removed once it is linked.
+    llvm::SmallString<128> objectFilename;
+
+    if (std::error_code error = llvm::sys::fs::createTemporaryFile(
+            "microcc", "o", objectFilename)) {
+        llvm::WithColor::error(llvm::errs())
+            << fmt::format("cannot create a temporary file: {}\n",
+                           error.message());
+        return false;
+    }
+
+    llvm::FileRemover objectRemover{objectFilename};
+
+    if (!driver::writeObjectFile(module, *targetMachine,
+                                 std::string(objectFilename), llvm::errs()))
+        return false;
+
+    timer.start("link");
+    return driver::linkExecutable(std::string(objectFilename), RuntimeLibrary,
+                                  OutputFilename, llvm::errs());
+}
+
+// The lexer reports locations relative to the text it is given. In streaming
+// mode, point the user to the function the lexer was looking at.
+static void reportChunkLocation(const driver::FunctionChunk &chunk) {
+    llvm::WithColor::note(llvm::errs(), "lexer")
+        << fmt::format("locations above are relative to the function starting "
+                       "at {}:{}\n",
+                       chunk.begin.line, chunk.begin.col);
+}
+
+// Returns the entries of the function table that the tokens of a function
+// refer to: the function itself and the functions it calls. The passes that
+// compile a function get these rather than a copy of the whole table, which
+// would make streaming quadratic in the number of functions.
+static sema::CollectFuncDeclsPass::FunctionTable referencedFunctions(
+    const std::vector<Token> &tokens,
+    const sema::CollectFuncDeclsPass::FunctionTable &function_table) {
+    sema::CollectFuncDeclsPass::FunctionTable referenced;
+
+    for (const Token &token : tokens) {
+        if (token.type != TokenType::IDENTIFIER)
+            continue;
+
+        auto it = function_table.find(token.lexeme);
+        if (it != function_table.end())
+            referenced.insert(*it);
+    }
+
+    return referenced;
+}
+
+// Compiles the input one function at a time. A first pass only collects the
+// function signatures from the function headers. Afterwards, each function is
+// lexed, parsed, analysed and lowered to LLVM IR on its own, and its tokens,
+// AST, tables and module are freed before the next function is read, once the
+// module is linked into the program's module. Only that module grows with the
+// size of the input.
+static int compileStreaming(llvm::LLVMContext &ctx, std::istream &input,
+                            const std::string &inputFilename,
+                            driver::PhaseTimer &timer) {
+    timer.start("split");
+    driver::FunctionSplitter splitter{input};
+    std::vector<driver::FunctionChunk> chunks = splitter.split();
+
+    // Pass 1: collect the signatures of all functions.
+    timer.start("signatures");
+    sema::CollectFuncDeclsPass collectFuncDeclsPass{ctx};
+
+    for (driver::FunctionChunk &chunk : chunks) {
+        Lexer lexer{chunk.header + "{}"};
+        std::vector<Token> tokens = lexer.getTokens();
+
+        if (lexer.hadError()) {
+            reportChunkLocation(chunk);
+            return EXIT_FAILURE;
+        }
+
+        driver::relocateTokens(tokens, chunk.begin);
+
+        Parser parser{tokens};
+        auto root = parser.parse();
+
+        if (parser.hadError())
+            return EXIT_FAILURE;
+
+        try {
+            collectFuncDeclsPass.visit(*root);
+        } catch (const sema::SemanticException &e) {
+            reportSemanticError(e);
+            return EXIT_FAILURE;
+        }
+
+        chunk.header = std::string{};
+    }
+
+    if (DumpFunctionTable)
+        dumpFunctionTable(collectFuncDeclsPass.getFunctionTable());
+
+    // The program's module declares every function, and the module of each
+    // function is linked into it.
+    const sema::CollectFuncDeclsPass::FunctionTable functionTable =
+        collectFuncDeclsPass.getFunctionTable();
+    codegen_llvm::CodeGeneratorLLVM programGenerator{ctx, inputFilename,
+                                                     functionTable, {}, {}};
+    driver::ModuleLinker moduleLinker{programGenerator.getModule()};
+
+    // Pass 2: compile each function on its own.
+    for (const driver::FunctionChunk &chunk : chunks) {
+        // Phase 1: lexical analysis
+        timer.start("lexer");
+        std::vector<Token> tokens;
+        {
+            Lexer lexer{splitter.read(chunk)};
+            tokens = lexer.getTokens();
+
+            if (lexer.hadError()) {
+                reportChunkLocation(chunk);
+                return EXIT_FAILURE;
+            }
+        }
+
+        driver::relocateTokens(tokens, chunk.begin);
+
+        if (DumpTokens)
+            dumpTokens(tokens);
+
+        sema::CollectFuncDeclsPass::FunctionTable referenced =
+            referencedFunctions(tokens, functionTable);
+
+        // Phase 2: parsing
+        timer.start("parser");
+        ast::Ptr<ast::Base> root;
+        {
+            Parser parser{tokens};
+            root = parser.parse();
+
+            if (parser.hadError())
+                return EXIT_FAILURE;
+        }
+
+        tokens = std::vector<Token>{};
+
+        if (DumpAst)
+            dumpAst(*root);
+
+        // Phase 3: semantic analysis
+        timer.start("sema");
+        sema::ScopeResolutionPass scopeResolutionPass;
+        sema::TypeCheckingPass typeCheckingPass{ctx};
+
+        try {
+            typeCheckingPass.setFunctionTable(referenced);
+            scopeResolutionPass.visit(*root);
+
+            typeCheckingPass.setSymbolTable(
+                scopeResolutionPass.getSymbolTable());
+
+            typeCheckingPass.visit(*root);
+        } catch (const sema::SemanticException &e) {
+            reportSemanticError(e);
+            return EXIT_FAILURE;
+        }
+
+        if (DumpSymbolTable)
+            dumpSymbolTable(scopeResolutionPass.getSymbolTable());
+
+        if (DumpTypeTable)
+            dumpTypeTable(typeCheckingPass.getTypeTable());
+
+        // Phase 3b: AST-level optimisation
+        timer.start("ast-opt");
+        ast_opt::ASTOptimiser astOptimiser{
+            scopeResolutionPass.getSymbolTable(),
+            typeCheckingPass.getTypeTable()};
+
+        if (AstOpt) {
+            astOptimiser.optimise(*root);
+
+            if (DumpAst)
+                dumpAst(*root);
+        }
+
+        // Phase 4: code generation
+        timer.start("codegen");
+        try {
+            codegen_llvm::CodeGeneratorLLVM codeGenerator{
+                ctx, inputFilename, referenced, astOptimiser.getSymbolTable(),
+                astOptimiser.getTypeTable()};
+            codeGenerator.visit(*root);
+            codeGenerator.finalize();
+
+            if (!moduleLinker.link(codeGenerator.getModule(), llvm::errs()))
+                return EXIT_FAILURE;
+        } catch (codegen_llvm::CodegenException &e) {
+            llvm::WithColor::error(llvm::errs(), "codegen") << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    timer.start("codegen");
+    try {
+        programGenerator.finalize();
+    } catch (codegen_llvm::CodegenException &e) {
+        llvm::WithColor::error(llvm::errs(), "codegen") << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    moduleLinker.sortFunctions(functionTable);
+
+    // Phase 5: LLVM IR optimisation
+    timer.start("llvm-opt");
+    if (!optimiseModule(programGenerator.getModule()))
+        return EXIT_FAILURE;
+
+    timer.start("emit");
+    if (!emitModule(programGenerator.getModule(), inputFilename, timer))
+        return EXIT_FAILURE;
+    timer.stop();
+
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     // Create an LLVM context
     llvm::LLVMContext ctx;
@@ -79,36 +509,95 @@ int main(int argc, char *argv[]) {
     // Parse command-line arguments
     llvm::cl::ParseCommandLineOptions(argc, argv);
 
+    if (InputFilenames.empty())
+        InputFilenames.push_back("-");
+
+    if (OptLevel > 3) {
+        llvm::WithColor::error(llvm::errs())
+            << "the optimisation level must be between 0 and 3\n";
+        return EXIT_FAILURE;
+    }
+
+    if (InputFilenames.size() > 1) {
+        if (Streaming || DumpTokens || DumpAst || DumpFunctionTable ||
+            DumpSymbolTable || DumpTypeTable || TimePhases || EmitObject ||
+            !OutputFilename.empty()) {
+            llvm::WithColor::error(llvm::errs())
+                << "-stream, -time-phases, -c, -o and the dump options need a "
+                   "single input file\n";
+            return EXIT_FAILURE;
+        }
+
+        driver::BatchCompiler::Options options;
+        options.jobs = Jobs;
+        options.ast_opt = AstOpt;
+        options.opt_level = OptLevel;
+        options.cpu = MArch;
+        options.pass_plugins = PassPlugins;
+        options.emit_llvm = EmitLLVM;
+        options.output_dir = OutputDir;
+
+        driver::BatchCompiler batchCompiler{options};
+        bool success = batchCompiler.compile(InputFilenames);
+
+        llvm::llvm_shutdown();
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const std::string &inputFilename = InputFilenames.front();
+    driver::PhaseTimer timer;
+
+    if (EmitObject && OutputFilename.empty() && inputFilename == "-") {
+        llvm::WithColor::error(llvm::errs())
+            << "-c needs -o when the input is read from stdin\n";
+        return EXIT_FAILURE;
+    }
+
+    if (Streaming) {
+        // The input is read twice, so stdin is buffered in memory.
+        int result;
+
+        if (inputFilename == "-") {
+            std::stringstream input;
+            input << std::cin.rdbuf();
+            result = compileStreaming(ctx, input, inputFilename, timer);
+        } else {
+            std::ifstream input{inputFilename, std::ios::binary};
+            result = compileStreaming(ctx, input, inputFilename, timer);
+        }
+
+        if (result == EXIT_SUCCESS && TimePhases)
+            timer.print(llvm::errs());
+
+        llvm::llvm_shutdown();
+        return result;
+    }
+
     // Convert input file/stdin to string
+    timer.start("read");
     std::string inputContents;
-    if (InputFilename == "-") {
+    if (inputFilename == "-") {
         inputContents = std::string{std::istreambuf_iterator<char>(std::cin),
                                     std::istreambuf_iterator<char>()};
     } else {
-        std::ifstream inputFile{InputFilename};
+        std::ifstream inputFile{inputFilename};
         inputContents = std::string{std::istreambuf_iterator<char>(inputFile),
                                     std::istreambuf_iterator<char>()};
     }
 
     // Phase 1: lexical analysis
+    timer.start("lexer");
     Lexer lexer{inputContents};
     std::vector<Token> tokens = lexer.getTokens();
 
-    if (DumpTokens) {
-        for (const Token &token : tokens) {
-            std::string location =
-                fmt::format("{}:{} -> {}:{}", token.begin.line, token.begin.col,
-                            token.end.line, token.end.col);
-
-            fmt::print("{:20}{:20}{:20}\n", location, token.lexeme,
-                       token_type_to_string(token.type));
-        }
-    }
+    if (DumpTokens)
+        dumpTokens(tokens);
 
     if (lexer.hadError())
         return EXIT_FAILURE;
 
     // Phase 2: parsing
+    timer.start("parser");
     Parser parser{tokens};
 
     auto root = parser.parse();
@@ -116,12 +605,11 @@ int main(int argc, char *argv[]) {
     if (parser.hadError())
         return EXIT_FAILURE;
 
-    if (DumpAst) {
-        ast::PrettyPrinter printer(std::cout, AsciiMode, DumpAstIds);
-        printer.visit(*root, "", true);
-    }
+    if (DumpAst)
+        dumpAst(*root);
 
     // Phase 3: semantic analysis
+    timer.start("sema");
     sema::CollectFuncDeclsPass collectFuncDeclsPass{ctx};
     sema::ScopeResolutionPass scopeResolutionPass;
     sema::TypeCheckingPass typeCheckingPass{ctx};
@@ -137,50 +625,36 @@ int main(int argc, char *argv[]) {
 
         typeCheckingPass.visit(*root);
     } catch (const sema::SemanticException &e) {
-        std::string location = "";
-
-        if (e.location.line != 0 && e.location.col != 0) {
-            location = fmt::format("{}:{}: ", e.location.line, e.location.col);
-        }
-
-        llvm::WithColor::error(llvm::errs(), "sema")
-            << fmt::format("{}{}\n", location, e.what());
+        reportSemanticError(e);
         return EXIT_FAILURE;
     }
 
-    if (DumpFunctionTable) {
-        std::cout << "Function table:\n";
-        auto functionTable = collectFuncDeclsPass.getFunctionTable();
+    if (DumpFunctionTable)
+        dumpFunctionTable(collectFuncDeclsPass.getFunctionTable());
 
-        for (const auto &func : functionTable) {
-            fmt::print("{:20}{}\n", func.first,
-                       sema::Util::llvm_type_to_string(func.second));
-        }
-    }
+    if (DumpSymbolTable)
+        dumpSymbolTable(scopeResolutionPass.getSymbolTable());
 
-    if (DumpSymbolTable) {
-        std::cout << "Symbol table:\n";
-        auto symbolTable = scopeResolutionPass.getSymbolTable();
+    if (DumpTypeTable)
+        dumpTypeTable(typeCheckingPass.getTypeTable());
 
-        for (const auto &symbol : symbolTable) {
-            fmt::print("{:<20}{:<20}\n", symbol.first->id, symbol.second->id);
-        }
-    }
+    // Phase 3b: AST-level optimisation
+    timer.start("ast-opt");
+    ast_opt::ASTOptimiser astOptimiser{scopeResolutionPass.getSymbolTable(),
+                                       typeCheckingPass.getTypeTable()};
 
-    if (DumpTypeTable) {
-        std::cout << "Type table:\n";
-        auto typeTable = typeCheckingPass.getTypeTable();
+    if (AstOpt) {
+        astOptimiser.optimise(*root);
 
-        for (const auto &entry : typeTable) {
-            fmt::print("{:<20}{}\n", entry.first->id,
-                       sema::Util::llvm_type_to_string(entry.second));
-        }
+        if (DumpAst)
+            dumpAst(*root);
     }
 
     // Phase 4: code generation
+    timer.start("codegen");
     codegen_llvm::CodeGeneratorLLVM codeGenerator{
-        ctx, InputFilename, collectFuncDeclsPass.getFunctionTable(),
-        scopeResolutionPass.getSymbolTable(), typeCheckingPass.getTypeTable()};
+        ctx, inputFilename, collectFuncDeclsPass.getFunctionTable(),
+        astOptimiser.getSymbolTable(), astOptimiser.getTypeTable()};
     try {
         codeGenerator.visit(*root);
         codeGenerator.finalize();
@@ -189,10 +663,18 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    if (EmitLLVM) {
-        llvm::Module &module = codeGenerator.getModule();
-        llvm::outs() << module;
-    }
+    // Phase 5: LLVM IR optimisation
+    timer.start("llvm-opt");
+    if (!optimiseModule(codeGenerator.getModule()))
+        return EXIT_FAILURE;
+
+    timer.start("emit");
+    if (!emitModule(codeGenerator.getModule(), inputFilename, timer))
+        return EXIT_FAILURE;
+    timer.stop();
+
+    if (TimePhases)
+        timer.print(llvm::errs());
 
     // We need to call this to print statistics using -stats.
     llvm::llvm_shutdown();
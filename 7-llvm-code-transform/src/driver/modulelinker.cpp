@@ -0,0 +1,75 @@
+#include "driver/modulelinker.hpp"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <string>
+#include <vector>
+
+driver::ModuleLinker::ModuleLinker(llvm::Module &module)
+    : module(module), linker(module) {
+    if (llvm::NamedMDNode *units = module.getNamedMetadata("llvm.dbg.cu")) {
+        if (units->getNumOperands() != 0)
+            compile_unit =
+                llvm::dyn_cast<llvm::DICompileUnit>(units->getOperand(0));
+    }
+}
+
+bool driver::ModuleLinker::link(const llvm::Module &function_module,
+                                llvm::raw_ostream &errs) {
+    std::vector<std::string> defined;
+
+    for (const llvm::Function &function : function_module) {
+        if (!function.isDeclaration())
+            defined.push_back(function.getName().str());
+    }
+
+    // The linker takes ownership of the modules it links in, while the
+    // function's module belongs to its code generator.
+    if (linker.linkInModule(llvm::CloneModule(function_module))) {
+        llvm::WithColor::error(errs, "codegen")
+            << "cannot link the module of a function into the program\n";
+        return false;
+    }
+
+    if (!compile_unit)
+        return true;
+
+    for (const std::string &name : defined) {
+        if (llvm::DISubprogram *subprogram =
+                module.getFunction(name)->getSubprogram())
+            subprogram->replaceUnit(compile_unit);
+    }
+
+    // The linker appends the compile units of the modules it links in.
+    llvm::NamedMDNode *units = module.getNamedMetadata("llvm.dbg.cu");
+    units->clearOperands();
+    units->addOperand(compile_unit);
+
+    return true;
+}
+
+void driver::ModuleLinker::sortFunctions(
+    const sema::CollectFuncDeclsPass::FunctionTable &function_table) {
+    std::vector<llvm::Function *> others;
+
+    for (llvm::Function &function : module) {
+        if (function_table.count(function.getName().str()) == 0)
+            others.push_back(&function);
+    }
+
+    auto moveToEnd = [&](llvm::Function *function) {
+        function->removeFromParent();
+        module.getFunctionList().push_back(function);
+    };
+
+    for (const auto &entry : function_table) {
+        if (llvm::Function *function = module.getFunction(entry.first))
+            moveToEnd(function);
+    }
+
+    for (llvm::Function *function : others)
+        moveToEnd(function);
+}
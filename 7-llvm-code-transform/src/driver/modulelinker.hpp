@@ -0,0 +1,48 @@
+#ifndef MODULELINKER_HPP
+#define MODULELINKER_HPP
+
+#include "sema/collectfuncdeclspass.hpp"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace driver {
+// Builds the module of a program that is compiled one function at a time. The
+// program's module is created by a code generator that declares every function
+// of the program but defines none. Each function is lowered by a code
+// generator of its own, which only knows the tables of that function, and its
+// module is then linked into the program's module.
+//
+// Every code generator creates a debug information compile unit. The
+// functions that are linked in are moved to the compile unit of the program's
+// module, so that the program has a single compile unit, as when it is lowered
+// by a single code generator.
+class ModuleLinker {
+  public:
+    ModuleLinker(llvm::Module &module);
+
+    // Links a copy of the module of a function into the program's module.
+    // Returns false after printing an error to 'errs' if linking fails.
+    bool link(const llvm::Module &function_module, llvm::raw_ostream &errs);
+
+    // Puts the functions of the program's module in the order of the function
+    // table, followed by the other functions (e.g. intrinsics) in the order in
+    // which they were linked in. This is the order in which a single code
+    // generator creates them.
+    void sortFunctions(
+        const sema::CollectFuncDeclsPass::FunctionTable &function_table);
+
+  private:
+    // Module of the program.
+    llvm::Module &module;
+
+    llvm::Linker linker;
+
+    // Debug information compile unit of the program's module, if any.
+    llvm::DICompileUnit *compile_unit = nullptr;
+};
+} // namespace driver
+
+#endif /* end of include guard: MODULELINKER_HPP */
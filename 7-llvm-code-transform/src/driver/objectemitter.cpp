@@ -0,0 +1,68 @@
+#include "driver/objectemitter.hpp"
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/WithColor.h"
+
+#include <fmt/format.h>
+
+namespace driver {
+bool writeObjectFile(llvm::Module &module, llvm::TargetMachine &target_machine,
+                     const std::string &filename, llvm::raw_ostream &errs) {
+    module.setTargetTriple(target_machine.getTargetTriple().str());
+    module.setDataLayout(target_machine.createDataLayout());
+
+    std::error_code error;
+    llvm::raw_fd_ostream output{filename, error, llvm::sys::fs::OF_None};
+
+    if (error) {
+        llvm::WithColor::error(errs)
+            << fmt::format("cannot write '{}': {}\n", filename,
+                           error.message());
+        return false;
+    }
+
+    // LLVM's code generator still runs on the legacy pass manager.
+    llvm::legacy::PassManager passes;
+
+    if (target_machine.addPassesToEmitFile(passes, output, nullptr,
+                                           llvm::CGFT_ObjectFile)) {
+        llvm::WithColor::error(errs)
+            << "the target machine cannot emit object files\n";
+        return false;
+    }
+
+    passes.run(module);
+    return true;
+}
+
+bool linkExecutable(const std::string &object, const std::string &runtime,
+                    const std::string &filename, llvm::raw_ostream &errs) {
+    auto linker = llvm::sys::findProgramByName("c++");
+
+    if (!linker) {
+        llvm::WithColor::error(errs)
+            << fmt::format("cannot find the linker 'c++': {}\n",
+                           linker.getError().message());
+        return false;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 6> arguments{*linker, "-o", filename,
+                                                    object, runtime};
+    std::string message;
+    int status = llvm::sys::ExecuteAndWait(*linker, arguments, llvm::None, {},
+                                           0, 0, &message);
+
+    if (status != 0) {
+        llvm::WithColor::error(errs)
+            << (message.empty()
+                    ? fmt::format("linking '{}' failed with status {}\n",
+                                  filename, status)
+                    : fmt::format("cannot run the linker: {}\n", message));
+        return false;
+    }
+
+    return true;
+}
+} // namespace driver
@@ -0,0 +1,27 @@
+#ifndef OBJECTEMITTER_HPP
+#define OBJECTEMITTER_HPP
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <string>
+
+namespace driver {
+// Writes the machine code of a module to an ELF object file in-process, with
+// the given target machine, instead of printing the IR for llc and an
+// assembler to parse again. The module's target triple and data layout are
+// set to the target machine's first. Returns false after printing an error to
+// 'errs' if the object file cannot be written.
+bool writeObjectFile(llvm::Module &module, llvm::TargetMachine &target_machine,
+                     const std::string &filename, llvm::raw_ostream &errs);
+
+// Links an object file with the micro-C runtime library into an executable.
+// The system's C++ compiler driver is used as the linker, as it knows the C
+// start files and adds the C++ standard library that the runtime needs.
+// Returns false after printing an error to 'errs' if linking fails.
+bool linkExecutable(const std::string &object, const std::string &runtime,
+                    const std::string &filename, llvm::raw_ostream &errs);
+} // namespace driver
+
+#endif /* end of include guard: OBJECTEMITTER_HPP */
@@ -0,0 +1,57 @@
+#include "driver/phasetimer.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <iterator>
+#include <sys/resource.h>
+
+namespace {
+// Returns the peak resident set size of this process so far, in KiB.
+long getPeakRSS() {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return usage.ru_maxrss;
+}
+} // namespace
+
+namespace driver {
+void PhaseTimer::start(const std::string &name) {
+    stop();
+
+    auto it = std::find_if(phases.begin(), phases.end(),
+                           [&](const Phase &p) { return p.name == name; });
+
+    if (it == phases.end()) {
+        phases.push_back(Phase{name, 0.0, 0});
+        it = std::prev(phases.end());
+    }
+
+    current = static_cast<int>(it - phases.begin());
+    start_time = Clock::now();
+}
+
+void PhaseTimer::stop() {
+    if (current == -1)
+        return;
+
+    Phase &phase = phases[current];
+    std::chrono::duration<double> elapsed = Clock::now() - start_time;
+
+    phase.seconds += elapsed.count();
+    phase.peak_rss = std::max(phase.peak_rss, getPeakRSS());
+    current = -1;
+}
+
+void PhaseTimer::print(llvm::raw_ostream &os) const {
+    os << "# phase\ttime (s)\tpeak RSS (KiB)\n";
+
+    for (const Phase &phase : phases) {
+        os << fmt::format("{}\t{:.6f}\t{}\n", phase.name, phase.seconds,
+                          phase.peak_rss);
+    }
+}
+} // namespace driver
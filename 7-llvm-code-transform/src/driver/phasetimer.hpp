@@ -0,0 +1,47 @@
+#ifndef PHASETIMER_HPP
+#define PHASETIMER_HPP
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace driver {
+// Records the wall-clock time and the peak resident set size of each
+// compilation phase. A phase may be entered multiple times (e.g. once per
+// function in streaming mode), in which case its times are accumulated.
+class PhaseTimer {
+  public:
+    // Start timing the given phase. The running phase, if any, is stopped.
+    void start(const std::string &name);
+
+    // Stop timing the running phase.
+    void stop();
+
+    // Print a report with one line per phase, in the order in which the phases
+    // were first entered. Each line contains the name of the phase, its time
+    // in seconds, and the peak RSS of the process in KiB at the end of the
+    // phase, separated by tabs. This is meant to be read by scripts.
+    void print(llvm::raw_ostream &os) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Phase {
+        std::string name;
+        double seconds;
+        long peak_rss;
+    };
+
+    std::vector<Phase> phases;
+
+    // Index of the running phase in 'phases', or -1 if no phase is running.
+    int current = -1;
+
+    // Time at which the running phase was (re)entered.
+    Clock::time_point start_time;
+};
+} // namespace driver
+
+#endif /* end of include guard: PHASETIMER_HPP */
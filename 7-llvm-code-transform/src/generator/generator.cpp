@@ -0,0 +1,308 @@
+#include "generator/generator.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace generator {
+ProgramGenerator::ProgramGenerator(const Options &options)
+    : options(options), rng(options.seed), os(nullptr), lines(0),
+      num_functions(options.functions), next_variable(0) {}
+
+std::uint64_t ProgramGenerator::generate(std::ostream &out) {
+    if (options.lines != 0) {
+        // Generate a sample function to estimate the number of lines per
+        // function. The tree shape needs the number of functions up front.
+        std::ostringstream sample;
+        os = &sample;
+        lines = 0;
+        num_functions = 3;
+        uncalled.clear();
+        generateFunction(0);
+
+        std::uint64_t per_function = std::max<std::uint64_t>(lines, 1);
+        num_functions = static_cast<unsigned int>(std::max<std::uint64_t>(
+            (options.lines + per_function - 1) / per_function, 1));
+    }
+
+    rng.seed(options.seed);
+    os = &out;
+    lines = 0;
+    uncalled.clear();
+
+    for (unsigned int i = 0; i < num_functions; ++i)
+        generateFunction(i);
+
+    generateMain();
+
+    return lines;
+}
+
+unsigned int ProgramGenerator::random(unsigned int n) {
+    // Not using std::uniform_int_distribution, as its output differs between
+    // standard library implementations.
+    return n == 0 ? 0 : static_cast<unsigned int>(rng() % n);
+}
+
+void ProgramGenerator::line(unsigned int indent, const std::string &text) {
+    *os << std::string(4 * indent, ' ') << text << '\n';
+    ++lines;
+}
+
+std::vector<unsigned int> ProgramGenerator::callees(unsigned int function) {
+    std::vector<unsigned int> result;
+
+    switch (options.call_graph) {
+    case CallGraphShape::None:
+        break;
+    case CallGraphShape::Chain:
+        if (function > 0)
+            result.push_back(function - 1);
+        break;
+    case CallGraphShape::Tree:
+        for (unsigned int child = 2 * function + 1;
+             child <= 2 * function + 2 && child < num_functions; ++child)
+            result.push_back(child);
+        break;
+    case CallGraphShape::Random:
+        // Callees are taken out of the pool of uncalled functions, as a
+        // function with several callers could run exponentially often.
+        for (unsigned int n = std::min<std::size_t>(uncalled.size(), random(3));
+             n > 0; --n) {
+            unsigned int i = random(static_cast<unsigned int>(uncalled.size()));
+            result.push_back(uncalled[i]);
+            uncalled[i] = uncalled.back();
+            uncalled.pop_back();
+        }
+        break;
+    }
+
+    return result;
+}
+
+void ProgramGenerator::generateFunction(unsigned int function) {
+    line(0, fmt::format("int f{}(int p0, int p1)", function));
+    line(0, "{");
+
+    scopes = {{{"p0", true}, {"p1", true}}};
+    next_variable = 0;
+    array.clear();
+
+    if (options.array_size != 0) {
+        // Initialise the array, so that its elements are never read before
+        // they are written.
+        array = "a";
+        std::string counter = declare(false);
+
+        line(1, fmt::format("int {}[{}];", array, options.array_size));
+        line(1, fmt::format("int {} = 0;", counter));
+        line(1, fmt::format("while ({} < {})", counter, options.array_size));
+        line(1, "{");
+        line(2, fmt::format("{}[{}] = {};", array, counter, counter));
+        line(2, fmt::format("{} = {} + 1;", counter, counter));
+        line(1, "}");
+    }
+
+    pending_calls = callees(function);
+    uncalled.push_back(function);
+
+    unsigned int budget = options.statements;
+    generateBlock(budget, 1, 0);
+
+    // Emit the calls that did not fit in the statement budget.
+    while (!pending_calls.empty())
+        generateCall(1);
+
+    line(1, fmt::format("return {};",
+                        generateExpression(options.expression_length)));
+    line(0, "}");
+    line(0, "");
+}
+
+void ProgramGenerator::generateMain() {
+    unsigned int root = options.call_graph == CallGraphShape::Chain ||
+                                options.call_graph == CallGraphShape::Random
+                            ? num_functions - 1
+                            : 0;
+
+    line(0, "int main()");
+    line(0, "{");
+    if (num_functions != 0)
+        line(1, fmt::format("print(f{}(1, 2));", root));
+    line(1, "return 0;");
+    line(0, "}");
+}
+
+void ProgramGenerator::generateBlock(unsigned int &budget, unsigned int indent,
+                                     unsigned int depth) {
+    while (budget > 0)
+        generateStatement(budget, indent, depth);
+}
+
+void ProgramGenerator::generateStatement(unsigned int &budget,
+                                         unsigned int indent,
+                                         unsigned int depth) {
+    --budget;
+
+    // Calls are only emitted at the top level of a function, so that each
+    // callee is called once per call of its caller.
+    if (depth == 0 && !pending_calls.empty() && random(4) == 0) {
+        generateCall(indent);
+        return;
+    }
+
+    // The body of a compound statement takes a part of the remaining budget.
+    auto takeBudget = [&]() {
+        unsigned int body = std::min(budget, 1 + random(budget / 2 + 1));
+        budget -= body;
+        return std::max(body, 1u);
+    };
+
+    switch (random(depth < options.depth ? 6 : 4)) {
+    case 0: {
+        std::string init = generateExpression(options.expression_length);
+        line(indent, fmt::format("int {} = {};", declare(true), init));
+        break;
+    }
+    case 1: {
+        std::string var = pickVariable(true);
+        line(indent,
+             fmt::format("{} = {};", var,
+                         generateExpression(options.expression_length)));
+        break;
+    }
+    case 2:
+        if (!array.empty()) {
+            line(indent, fmt::format(
+                             "{}[{}] = {};", array, random(options.array_size),
+                             generateExpression(options.expression_length)));
+        } else {
+            line(indent,
+                 fmt::format("print({});",
+                             generateExpression(options.expression_length)));
+        }
+        break;
+    case 3:
+        line(indent,
+             fmt::format("print({});",
+                         generateExpression(options.expression_length)));
+        break;
+    case 4: {
+        line(indent, fmt::format("if ({})", generateCondition()));
+        line(indent, "{");
+        scopes.emplace_back();
+        unsigned int then_budget = takeBudget();
+        generateBlock(then_budget, indent + 1, depth + 1);
+        scopes.pop_back();
+        line(indent, "}");
+
+        if (budget > 0 && random(2) == 0) {
+            line(indent, "else");
+            line(indent, "{");
+            scopes.emplace_back();
+            unsigned int else_budget = takeBudget();
+            generateBlock(else_budget, indent + 1, depth + 1);
+            scopes.pop_back();
+            line(indent, "}");
+        }
+        break;
+    }
+    case 5: {
+        std::string counter = declare(false);
+
+        line(indent, fmt::format("int {} = 0;", counter));
+        line(indent, fmt::format("while ({} < {})", counter, 1 + random(8)));
+        line(indent, "{");
+        scopes.emplace_back();
+        unsigned int body_budget = takeBudget();
+        generateBlock(body_budget, indent + 1, depth + 1);
+        scopes.pop_back();
+        line(indent + 1, fmt::format("{} = {} + 1;", counter, counter));
+        line(indent, "}");
+        break;
+    }
+    }
+}
+
+void ProgramGenerator::generateCall(unsigned int indent) {
+    unsigned int callee = pending_calls.back();
+    pending_calls.pop_back();
+
+    std::string lhs = generateExpression(options.expression_length);
+    std::string rhs = generateExpression(options.expression_length);
+    std::string name = declare(true);
+
+    line(indent, fmt::format("int {} = f{}({}, {});", name, callee, lhs, rhs));
+}
+
+std::string ProgramGenerator::generateExpression(unsigned int length) {
+    if (length <= 1)
+        return generateOperand();
+
+    // Divide and modulo only by non-zero literals.
+    switch (random(8)) {
+    case 0:
+        return fmt::format("{} / {}", generateExpression(length - 1),
+                           1 + random(9));
+    case 1:
+        return fmt::format("{} % {}", generateExpression(length - 1),
+                           1 + random(9));
+    default:
+        break;
+    }
+
+    static const char *const ops[] = {"+", "-", "*"};
+    unsigned int lhs_length = 1 + random(length - 1);
+    std::string lhs = generateExpression(lhs_length);
+    std::string rhs = generateExpression(length - lhs_length);
+
+    if (random(2) == 0)
+        return fmt::format("({}) {} {}", lhs, ops[random(3)], rhs);
+
+    return fmt::format("{} {} {}", lhs, ops[random(3)], rhs);
+}
+
+std::string ProgramGenerator::generateCondition() {
+    static const char *const ops[] = {"<", "<=", ">", ">=", "==", "!="};
+    unsigned int length = std::max(options.expression_length / 2, 1u);
+
+    return fmt::format("{} {} {}", generateExpression(length), ops[random(6)],
+                       generateExpression(length));
+}
+
+std::string ProgramGenerator::generateOperand() {
+    switch (random(4)) {
+    case 0:
+        return std::to_string(random(100));
+    case 1:
+        if (!array.empty())
+            return fmt::format("{}[{}]", array, random(options.array_size));
+        break;
+    default:
+        break;
+    }
+
+    return pickVariable(false);
+}
+
+std::string ProgramGenerator::declare(bool assignable) {
+    std::string name = fmt::format("v{}", next_variable++);
+    scopes.back().push_back(Variable{name, assignable});
+    return name;
+}
+
+std::string ProgramGenerator::pickVariable(bool assignable) {
+    std::vector<const Variable *> candidates;
+
+    for (const auto &scope : scopes) {
+        for (const Variable &var : scope) {
+            if (var.assignable || !assignable)
+                candidates.push_back(&var);
+        }
+    }
+
+    // The parameters are always in scope and assignable.
+    return candidates[random(candidates.size())]->name;
+}
+} // namespace generator
@@ -0,0 +1,131 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace generator {
+// Shape of the call graph of a generated program.
+enum class CallGraphShape {
+    None,   // Functions do not call each other.
+    Chain,  // Function i calls function i - 1.
+    Tree,   // Function i calls functions 2i + 1 and 2i + 2.
+    Random, // Function i calls up to two random functions with a lower
+            // index, which no other function calls.
+};
+
+struct Options {
+    // Number of functions, excluding main.
+    unsigned int functions = 10;
+
+    // Number of statements in each function, including nested statements.
+    unsigned int statements = 20;
+
+    // Maximum nesting depth of if and while statements.
+    unsigned int depth = 2;
+
+    // Number of operands in each expression.
+    unsigned int expression_length = 4;
+
+    // Number of elements of the local array of each function. No arrays are
+    // generated if this is 0.
+    unsigned int array_size = 16;
+
+    // Shape of the call graph.
+    CallGraphShape call_graph = CallGraphShape::Random;
+
+    // If this is not 0, the number of functions is chosen so that the program
+    // has (approximately) this many lines, and 'functions' is ignored.
+    std::uint64_t lines = 0;
+
+    // Seed of the random number generator. The same options and seed always
+    // produce the same program.
+    unsigned int seed = 1;
+};
+
+// Generates a random, valid micro-C program. Every function uses only
+// variables that are in scope, loops are bounded, array indices are in bounds,
+// and only literals other than 0 are used as divisors, so that the generated
+// programs also run to completion. Each function is called by at most one
+// other function, once per call of its caller, so running time is linear in
+// the size of the program for every call graph shape.
+class ProgramGenerator {
+  public:
+    ProgramGenerator(const Options &options);
+
+    // Write the program to the given stream, and return its number of lines.
+    std::uint64_t generate(std::ostream &os);
+
+  private:
+    // A variable that is in scope.
+    struct Variable {
+        std::string name;
+
+        // Loop counters are read, but never assigned.
+        bool assignable;
+    };
+
+    Options options;
+
+    std::mt19937 rng;
+
+    // Output stream and number of lines written so far.
+    std::ostream *os;
+    std::uint64_t lines;
+
+    // Number of functions in the program, excluding main.
+    unsigned int num_functions;
+
+    // Variables that are in scope, per nested scope.
+    std::vector<std::vector<Variable>> scopes;
+
+    // Name of the local array of the current function, if any.
+    std::string array;
+
+    // Counter used to create unique variable names within a function.
+    unsigned int next_variable;
+
+    // Calls that still need to be emitted in the current function.
+    std::vector<unsigned int> pending_calls;
+
+    // Functions that no function calls yet, for random call graphs.
+    std::vector<unsigned int> uncalled;
+
+    // Returns a random number in [0, n).
+    unsigned int random(unsigned int n);
+
+    // Writes a line with the given indentation level.
+    void line(unsigned int indent, const std::string &text);
+
+    // Returns the functions called by the given function.
+    std::vector<unsigned int> callees(unsigned int function);
+
+    void generateFunction(unsigned int function);
+    void generateMain();
+
+    // Generates statements until the budget is used up.
+    void generateBlock(unsigned int &budget, unsigned int indent,
+                       unsigned int depth);
+    void generateStatement(unsigned int &budget, unsigned int indent,
+                           unsigned int depth);
+
+    // Emits a declaration initialised with the next pending call.
+    void generateCall(unsigned int indent);
+
+    std::string generateExpression(unsigned int length);
+    std::string generateCondition();
+    std::string generateOperand();
+
+    // Returns a fresh variable name, and brings it in scope.
+    std::string declare(bool assignable);
+
+    // Returns a random variable in scope. Loop counters are only returned if
+    // 'assignable' is false.
+    std::string pickVariable(bool assignable);
+};
+} // namespace generator
+
+#endif /* end of include guard: GENERATOR_HPP */
@@ -0,0 +1,97 @@
+#include "generator/generator.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/WithColor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+llvm::cl::opt<std::string>
+    OutputFilename("o", llvm::cl::desc("Write the program to <file>"),
+                   llvm::cl::value_desc("file"), llvm::cl::init("-"));
+
+llvm::cl::opt<unsigned int>
+    Functions("functions",
+              llvm::cl::desc("Number of functions, excluding main"),
+              llvm::cl::init(10));
+
+llvm::cl::opt<unsigned int> Statements(
+    "statements",
+    llvm::cl::desc("Number of statements per function, including nested ones"),
+    llvm::cl::init(20));
+
+llvm::cl::opt<unsigned int>
+    Depth("depth",
+          llvm::cl::desc("Maximum nesting depth of if and while statements"),
+          llvm::cl::init(2));
+
+llvm::cl::opt<unsigned int>
+    ExpressionLength("expression-length",
+                     llvm::cl::desc("Number of operands per expression"),
+                     llvm::cl::init(4));
+
+llvm::cl::opt<unsigned int> ArraySize(
+    "array-size",
+    llvm::cl::desc("Size of the local array of each function (0: no arrays)"),
+    llvm::cl::init(16));
+
+llvm::cl::opt<generator::CallGraphShape> CallGraph(
+    "call-graph", llvm::cl::desc("Shape of the call graph"),
+    llvm::cl::values(
+        clEnumValN(generator::CallGraphShape::None, "none", "No calls"),
+        clEnumValN(generator::CallGraphShape::Chain, "chain",
+                   "Function i calls function i - 1"),
+        clEnumValN(generator::CallGraphShape::Tree, "tree",
+                   "Function i calls functions 2i + 1 and 2i + 2"),
+        clEnumValN(generator::CallGraphShape::Random, "random",
+                   "Function i calls up to two random functions with a "
+                   "lower index, which no other function calls")),
+    llvm::cl::init(generator::CallGraphShape::Random));
+
+llvm::cl::opt<std::uint64_t>
+    Lines("lines",
+          llvm::cl::desc("Approximate number of lines of the program. This "
+                         "overrides -functions"),
+          llvm::cl::init(0));
+
+llvm::cl::opt<unsigned int>
+    Seed("seed", llvm::cl::desc("Seed of the random number generator"),
+         llvm::cl::init(1));
+
+int main(int argc, char *argv[]) {
+    llvm::cl::ParseCommandLineOptions(
+        argc, argv, "Generator of random, valid micro-C programs\n");
+
+    generator::Options options;
+    options.functions = Functions;
+    options.statements = Statements;
+    options.depth = Depth;
+    options.expression_length = std::max(ExpressionLength.getValue(), 1u);
+    options.array_size = ArraySize;
+    options.call_graph = CallGraph;
+    options.lines = Lines;
+    options.seed = Seed;
+
+    generator::ProgramGenerator programGenerator{options};
+
+    if (OutputFilename == "-") {
+        programGenerator.generate(std::cout);
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream output{OutputFilename};
+
+    if (!output) {
+        llvm::WithColor::error(llvm::errs(), "microcc-gen")
+            << "cannot open '" << OutputFilename << "'\n";
+        return EXIT_FAILURE;
+    }
+
+    programGenerator.generate(output);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+#include "libmicrocc/compiler.hpp"
+#include "ast-opt/astoptimiser.hpp"
+#include "codegen-llvm/codegen-llvm.hpp"
+#include "codegen-llvm/codegenexception.hpp"
+#include "lexer/lexer.hpp"
+#include "libmicrocc/compilerexception.hpp"
+#include "parser/parser.hpp"
+#include "runtime/runtime.hpp"
+#include "sema/collectfuncdeclspass.hpp"
+#include "sema/scoperesolutionpass.hpp"
+#include "sema/semanticexception.hpp"
+#include "sema/typecheckingpass.hpp"
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace {
+// The AST nodes take their ids from a counter in ast::Base that is not
+// thread-safe, and whose code is inlined in the prebuilt parser. Hence the
+// phases that create AST nodes, i.e. parsing and the AST-level optimisations,
+// run for one program at a time.
+std::mutex ast_mutex;
+
+// Converts an LLVM error to a CompilerException.
+[[noreturn]] void throwError(llvm::Error error) {
+    throw microcc::CompilerException(llvm::toString(std::move(error)));
+}
+
+template <typename T> T unwrap(llvm::Expected<T> value) {
+    if (!value)
+        throwError(value.takeError());
+
+    return std::move(*value);
+}
+
+llvm::CodeGenOpt::Level getCodeGenOptLevel(unsigned int level) {
+    switch (level) {
+    case 0:
+        return llvm::CodeGenOpt::None;
+    case 1:
+        return llvm::CodeGenOpt::Less;
+    case 2:
+        return llvm::CodeGenOpt::Default;
+    default:
+        return llvm::CodeGenOpt::Aggressive;
+    }
+}
+} // namespace
+
+namespace microcc {
+Program::Program(Compiler &compiler, llvm::orc::JITDylib &dylib)
+    : compiler(compiler), dylib(dylib) {}
+
+Program::~Program() {
+    std::unique_lock<std::shared_mutex> lock{compiler.removal_mutex};
+    llvm::consumeError(
+        compiler.jit->getExecutionSession().removeJITDylib(dylib));
+}
+
+void *Program::lookup(const std::string &name) const {
+    std::shared_lock<std::shared_mutex> lock{compiler.removal_mutex};
+    llvm::JITEvaluatedSymbol symbol =
+        unwrap(compiler.jit->lookup(dylib, name));
+    return llvm::jitTargetAddressToPointer<void *>(symbol.getAddress());
+}
+
+Compiler::Compiler() : Compiler(Options{}) {}
+
+Compiler::Compiler(const Options &options) : options(options) {
+    static const bool initialised = [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        return true;
+    }();
+    (void)initialised;
+
+    auto machineBuilder =
+        unwrap(llvm::orc::JITTargetMachineBuilder::detectHost());
+    machineBuilder.setCodeGenOptLevel(getCodeGenOptLevel(options.opt_level));
+
+    // The concurrent compiler creates a target machine per compilation, so
+    // that modules can be compiled on several threads at once.
+    jit = unwrap(
+        llvm::orc::LLJITBuilder()
+            .setJITTargetMachineBuilder(std::move(machineBuilder))
+            .setCompileFunctionCreator(
+                [](llvm::orc::JITTargetMachineBuilder builder)
+                    -> llvm::Expected<std::unique_ptr<
+                        llvm::orc::IRCompileLayer::IRCompiler>> {
+                    return std::make_unique<llvm::orc::ConcurrentIRCompiler>(
+                        std::move(builder));
+                })
+            .create());
+
+    // The runtime is defined in the main JITDylib, which every program links
+    // against.
+    llvm::orc::SymbolMap symbols;
+    auto addRuntimeSymbol = [&](const char *name, auto *function) {
+        symbols[jit->mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(function),
+            llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    };
+
+    addRuntimeSymbol("print", &runtime::print);
+    addRuntimeSymbol("read", &runtime::read);
+    addRuntimeSymbol("print8", &runtime::print8);
+    addRuntimeSymbol("sum8", &runtime::sum8);
+    addRuntimeSymbol("print_f", &runtime::print_f);
+    addRuntimeSymbol("print_s", &runtime::print_s);
+    addRuntimeSymbol("read_f", &runtime::read_f);
+
+    if (auto error = jit->getMainJITDylib().define(
+            llvm::orc::absoluteSymbols(std::move(symbols))))
+        throwError(std::move(error));
+}
+
+Compiler::~Compiler() = default;
+
+std::unique_ptr<Program> Compiler::compile(const std::string &source,
+                                           const std::string &name) {
+    auto context = std::make_unique<llvm::LLVMContext>();
+
+    std::unique_lock<std::mutex> parse_lock{ast_mutex};
+
+    // Phase 1: lexical analysis
+    std::vector<Token> tokens;
+    {
+        Lexer lexer{source};
+        tokens = lexer.getTokens();
+
+        if (lexer.hadError())
+            throw CompilerException(
+                fmt::format("{}: lexical analysis failed", name));
+    }
+
+    // Phase 2: parsing
+    ast::Ptr<ast::Base> root;
+    {
+        Parser parser{tokens};
+        root = parser.parse();
+
+        if (parser.hadError())
+            throw CompilerException(fmt::format("{}: parsing failed", name));
+    }
+
+    parse_lock.unlock();
+
+    // Phase 3: semantic analysis
+    sema::CollectFuncDeclsPass collectFuncDeclsPass{*context};
+    sema::ScopeResolutionPass scopeResolutionPass;
+    sema::TypeCheckingPass typeCheckingPass{*context};
+
+    try {
+        collectFuncDeclsPass.visit(*root);
+        scopeResolutionPass.visit(*root);
+
+        typeCheckingPass.setFunctionTable(
+            collectFuncDeclsPass.getFunctionTable());
+        typeCheckingPass.setSymbolTable(scopeResolutionPass.getSymbolTable());
+
+        typeCheckingPass.visit(*root);
+    } catch (const sema::SemanticException &e) {
+        throw CompilerException(fmt::format("{}: {}", name, e.what()),
+                                e.location);
+    }
+
+    // Phase 3b: AST-level optimisation
+    ast_opt::ASTOptimiser astOptimiser{scopeResolutionPass.getSymbolTable(),
+                                       typeCheckingPass.getTypeTable()};
+
+    if (options.ast_opt) {
+        std::lock_guard<std::mutex> lock{ast_mutex};
+        astOptimiser.optimise(*root);
+    }
+
+    // Phase 4: code generation
+    std::unique_ptr<llvm::Module> module;
+    {
+        codegen_llvm::CodeGeneratorLLVM codeGenerator{
+            *context, name, collectFuncDeclsPass.getFunctionTable(),
+            astOptimiser.getSymbolTable(), astOptimiser.getTypeTable()};
+
+        try {
+            codeGenerator.visit(*root);
+            codeGenerator.finalize();
+        } catch (codegen_llvm::CodegenException &e) {
+            throw CompilerException(fmt::format("{}: {}", name, e.what()));
+        }
+
+        // The module belongs to the code generator, so the JIT gets a copy.
+        module = llvm::CloneModule(codeGenerator.getModule());
+    }
+
+    // Phase 5: hand the module to the JIT. The native code is generated
+    // when a function of the program is first looked up.
+    static std::atomic<unsigned int> next_program{0};
+
+    auto dylib =
+        jit->createJITDylib(fmt::format("program.{}", next_program++));
+    if (!dylib)
+        throwError(dylib.takeError());
+
+    dylib->addToLinkOrder(jit->getMainJITDylib());
+
+    // Create the Program first, so that the JITDylib is removed if adding
+    // the module fails.
+    std::unique_ptr<Program> program{new Program(*this, *dylib)};
+
+    if (auto error = jit->addIRModule(
+            *dylib, llvm::orc::ThreadSafeModule(std::move(module),
+                                               std::move(context))))
+        throwError(std::move(error));
+
+    return program;
+}
+} // namespace microcc
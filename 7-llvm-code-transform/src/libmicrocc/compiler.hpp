@@ -0,0 +1,97 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+
+namespace llvm {
+namespace orc {
+class JITDylib;
+class LLJIT;
+} // namespace orc
+} // namespace llvm
+
+namespace microcc {
+class Compiler;
+
+// A compiled micro-C program, loaded in the address space of this process.
+// The program's code is freed when the Program is destroyed. A Program must
+// not outlive the Compiler that created it.
+class Program {
+  public:
+    ~Program();
+
+    Program(const Program &) = delete;
+    Program &operator=(const Program &) = delete;
+
+    // Returns the address of the function with the given name. Throws a
+    // CompilerException if there is no such function.
+    void *lookup(const std::string &name) const;
+
+    // Returns a pointer to the function with the given name, e.g.
+    //   auto *f = program->getFunction<std::int64_t(std::int64_t)>("f");
+    // micro-C's int is a 64-bit integer, and its float is a float.
+    template <typename FunctionType>
+    FunctionType *getFunction(const std::string &name) const {
+        return reinterpret_cast<FunctionType *>(lookup(name));
+    }
+
+  private:
+    friend class Compiler;
+
+    Program(Compiler &compiler, llvm::orc::JITDylib &dylib);
+
+    Compiler &compiler;
+    llvm::orc::JITDylib &dylib;
+};
+
+// Compiles micro-C source text to native code in the current process, using
+// the LLVM ORC JIT.
+//
+// A Compiler is thread-safe: compile() may be called concurrently from
+// several threads, and each compilation uses its own LLVM context. Lexing,
+// parsing and the AST-level optimisations are serialised across all
+// Compilers, while the other phases run concurrently. Programs may be used
+// and destroyed from any thread.
+//
+// Errors found during semantic analysis and code generation are reported by
+// throwing a CompilerException. The lexer and parser print their diagnostics
+// to stderr, after which a CompilerException is thrown as well.
+class Compiler {
+  public:
+    struct Options {
+        // Run the AST-level optimisations before code generation.
+        bool ast_opt = false;
+
+        // Optimisation level (0-3) of the native code generator.
+        unsigned int opt_level = 2;
+    };
+
+    Compiler();
+    Compiler(const Options &options);
+    ~Compiler();
+
+    Compiler(const Compiler &) = delete;
+    Compiler &operator=(const Compiler &) = delete;
+
+    // Compile a program. The name is used as the file name in diagnostics and
+    // debug information.
+    std::unique_ptr<Program> compile(const std::string &source,
+                                     const std::string &name = "<input>");
+
+  private:
+    friend class Program;
+
+    Options options;
+
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+
+    // A lookup may generate code for the programs of other threads, which
+    // must not be removed meanwhile. Lookups hold this lock shared, while
+    // removing a program holds it exclusively.
+    std::shared_mutex removal_mutex;
+};
+} // namespace microcc
+
+#endif /* end of include guard: COMPILER_HPP */
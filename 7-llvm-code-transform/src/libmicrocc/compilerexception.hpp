@@ -0,0 +1,22 @@
+#ifndef COMPILEREXCEPTION_HPP
+#define COMPILEREXCEPTION_HPP
+
+#include "lexer/token.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace microcc {
+// Thrown when a program cannot be compiled, or when the JIT fails.
+struct CompilerException : public std::runtime_error {
+    // Location of the error in the source, if known. Otherwise, line and
+    // column are 0.
+    Location location;
+
+    CompilerException(const std::string &message,
+                      const Location &location = Location())
+        : std::runtime_error(message), location(location) {}
+};
+} // namespace microcc
+
+#endif /* end of include guard: COMPILEREXCEPTION_HPP */
@@ -0,0 +1,161 @@
+#include "llvm-opt/llvmoptimiser.hpp"
+#include "llvm-opt/optimiserexception.hpp"
+
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <fmt/core.h>
+
+namespace {
+llvm::OptimizationLevel getOptimizationLevel(unsigned int level) {
+    switch (level) {
+    case 0:
+        return llvm::OptimizationLevel::O0;
+    case 1:
+        return llvm::OptimizationLevel::O1;
+    case 2:
+        return llvm::OptimizationLevel::O2;
+    default:
+        return llvm::OptimizationLevel::O3;
+    }
+}
+
+llvm::CodeGenOpt::Level getCodeGenOptLevel(unsigned int level) {
+    switch (level) {
+    case 0:
+        return llvm::CodeGenOpt::None;
+    case 1:
+        return llvm::CodeGenOpt::Less;
+    case 2:
+        return llvm::CodeGenOpt::Default;
+    default:
+        return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+// The options of the pipeline at an optimisation level, as clang chooses
+// them: the vectorisers run from -O2 on.
+llvm::PipelineTuningOptions getTuningOptions(unsigned int level) {
+    llvm::PipelineTuningOptions options;
+    options.LoopVectorization = level >= 2;
+    options.SLPVectorization = level >= 2;
+
+    return options;
+}
+} // namespace
+
+llvm_opt::LLVMOptimiser::LLVMOptimiser(unsigned int level,
+                                       llvm::TargetMachine *target_machine)
+    : level(level), target_machine(target_machine),
+      pass_builder(target_machine, getTuningOptions(level)) {}
+
+void llvm_opt::LLVMOptimiser::addPipelineStartPasses(
+    Callback<llvm::ModulePassManager> callback) {
+    pass_builder.registerPipelineStartEPCallback(callback);
+}
+
+void llvm_opt::LLVMOptimiser::addPeepholePasses(
+    Callback<llvm::FunctionPassManager> callback) {
+    pass_builder.registerPeepholeEPCallback(callback);
+}
+
+void llvm_opt::LLVMOptimiser::addLoopOptimizerEndPasses(
+    Callback<llvm::LoopPassManager> callback) {
+    pass_builder.registerLoopOptimizerEndEPCallback(callback);
+}
+
+void llvm_opt::LLVMOptimiser::addScalarOptimizerLatePasses(
+    Callback<llvm::FunctionPassManager> callback) {
+    pass_builder.registerScalarOptimizerLateEPCallback(callback);
+}
+
+void llvm_opt::LLVMOptimiser::addVectorizerStartPasses(
+    Callback<llvm::FunctionPassManager> callback) {
+    pass_builder.registerVectorizerStartEPCallback(callback);
+}
+
+void llvm_opt::LLVMOptimiser::addOptimizerLastPasses(
+    Callback<llvm::ModulePassManager> callback) {
+    pass_builder.registerOptimizerLastEPCallback(callback);
+}
+
+void llvm_opt::LLVMOptimiser::loadPlugin(const std::string &filename) {
+    auto plugin = llvm::PassPlugin::Load(filename);
+
+    if (!plugin)
+        throw OptimiserException(
+            fmt::format("cannot load pass plugin '{}': {}", filename,
+                        llvm::toString(plugin.takeError())));
+
+    plugin->registerPassBuilderCallbacks(pass_builder);
+}
+
+void llvm_opt::LLVMOptimiser::optimise(llvm::Module &module) {
+    if (target_machine) {
+        module.setTargetTriple(target_machine->getTargetTriple().str());
+        module.setDataLayout(target_machine->createDataLayout());
+    }
+
+    llvm::LoopAnalysisManager loop_analyses;
+    llvm::FunctionAnalysisManager function_analyses;
+    llvm::CGSCCAnalysisManager cgscc_analyses;
+    llvm::ModuleAnalysisManager module_analyses;
+
+    pass_builder.registerModuleAnalyses(module_analyses);
+    pass_builder.registerCGSCCAnalyses(cgscc_analyses);
+    pass_builder.registerFunctionAnalyses(function_analyses);
+    pass_builder.registerLoopAnalyses(loop_analyses);
+    pass_builder.crossRegisterProxies(loop_analyses, function_analyses,
+                                      cgscc_analyses, module_analyses);
+
+    llvm::OptimizationLevel optimization_level = getOptimizationLevel(level);
+    llvm::ModulePassManager passes =
+        level == 0
+            ? pass_builder.buildO0DefaultPipeline(optimization_level)
+            : pass_builder.buildPerModuleDefaultPipeline(optimization_level);
+
+    passes.run(module, module_analyses);
+}
+
+std::unique_ptr<llvm::TargetMachine>
+llvm_opt::createTargetMachine(const std::string &cpu, unsigned int level) {
+    // Batch mode creates target machines on several threads at once.
+    static const bool initialised = [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        return true;
+    }();
+    (void)initialised;
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target *target =
+        llvm::TargetRegistry::lookupTarget(triple, error);
+
+    if (!target)
+        throw OptimiserException(
+            fmt::format("no target for '{}': {}", triple, error));
+
+    std::string cpu_name = cpu;
+    llvm::SubtargetFeatures features;
+
+    if (cpu == "native") {
+        cpu_name = llvm::sys::getHostCPUName().str();
+
+        llvm::StringMap<bool> host_features;
+        if (llvm::sys::getHostCPUFeatures(host_features)) {
+            for (const auto &feature : host_features)
+                features.AddFeature(feature.first(), feature.second);
+        }
+    }
+
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple, cpu_name, features.getString(), llvm::TargetOptions(),
+        llvm::Reloc::PIC_, llvm::None, getCodeGenOptLevel(level)));
+}
@@ -0,0 +1,72 @@
+#ifndef LLVMOPTIMISER_HPP
+#define LLVMOPTIMISER_HPP
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Scalar/LoopPassManager.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace llvm_opt {
+// Runs the default optimisation pipeline of LLVM's new pass manager on the
+// module of a code generator, in-process, as 'opt -O<level>' would. From -O1
+// on, SROA and mem2reg promote the allocas of the variables to SSA values,
+// InstCombine folds the 'zext'/'icmp ne 0' pairs of the conditions, and GVN
+// and LICM follow. -O2 and -O3 add the loop and SLP vectorisers. -O0 only
+// runs the passes added at the extension points.
+//
+// The vectorisers and the other cost models query the target. Without a
+// target machine, the module is optimised for LLVM's generic target, which
+// has no vector registers.
+class LLVMOptimiser {
+  public:
+    template <typename PassManager>
+    using Callback =
+        std::function<void(PassManager &, llvm::OptimizationLevel)>;
+
+    // 'level' is the optimisation level, from 0 to 3.
+    LLVMOptimiser(unsigned int level,
+                  llvm::TargetMachine *target_machine = nullptr);
+
+    // Add passes at the extension points of the pipeline (see
+    // llvm::PassBuilder): at its start, after every InstCombine, at the end
+    // of the loop passes, after the scalar passes of a function, before the
+    // vectorisers, and at its end. The callback is called with the pass
+    // manager of the pipeline each time the pipeline is built.
+    void addPipelineStartPasses(Callback<llvm::ModulePassManager> callback);
+    void addPeepholePasses(Callback<llvm::FunctionPassManager> callback);
+    void addLoopOptimizerEndPasses(Callback<llvm::LoopPassManager> callback);
+    void
+    addScalarOptimizerLatePasses(Callback<llvm::FunctionPassManager> callback);
+    void addVectorizerStartPasses(Callback<llvm::FunctionPassManager> callback);
+    void addOptimizerLastPasses(Callback<llvm::ModulePassManager> callback);
+
+    // Loads a plugin built for 'opt -load-pass-plugin', which adds its passes
+    // at the extension points. Throws an OptimiserException if the plugin
+    // cannot be loaded.
+    void loadPlugin(const std::string &filename);
+
+    // Optimise the module. If there is a target machine, the module's target
+    // triple and data layout are set to its own first.
+    void optimise(llvm::Module &module);
+
+  private:
+    unsigned int level;
+    llvm::TargetMachine *target_machine;
+    llvm::PassBuilder pass_builder;
+};
+
+// Returns a target machine for the host's target triple. 'cpu' is the name
+// of a CPU, e.g. "generic" or "skylake", or "native" for the host's CPU and
+// the features that LLVM detects on it. The machine code is optimised at
+// 'level', from 0 to 3. Throws an OptimiserException if LLVM was built
+// without the host's target.
+std::unique_ptr<llvm::TargetMachine>
+createTargetMachine(const std::string &cpu = "generic", unsigned int level = 2);
+} // namespace llvm_opt
+
+#endif /* end of include guard: LLVMOPTIMISER_HPP */
@@ -0,0 +1,13 @@
+#ifndef OPTIMISEREXCEPTION_HPP
+#define OPTIMISEREXCEPTION_HPP
+
+#include <stdexcept>
+
+namespace llvm_opt {
+struct OptimiserException : public std::runtime_error {
+    OptimiserException(const std::string &message)
+        : std::runtime_error(message) {}
+};
+} // namespace llvm_opt
+
+#endif /* end of include guard: OPTIMISEREXCEPTION_HPP */
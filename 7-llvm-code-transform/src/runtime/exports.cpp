@@ -0,0 +1,28 @@
+#include "runtime/runtime.hpp"
+
+// The C names under which compiled programs call the micro-C standard library
+
+extern "C" {
+
+void print(std::int64_t i) { runtime::print(i); }
+
+std::int64_t read() { return runtime::read(); }
+
+void print8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
+            std::int64_t arg3, std::int64_t arg4, std::int64_t arg5,
+            std::int64_t arg6, std::int64_t arg7) {
+    runtime::print8(arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7);
+}
+
+std::int64_t sum8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
+                  std::int64_t arg3, std::int64_t arg4, std::int64_t arg5,
+                  std::int64_t arg6, std::int64_t arg7) {
+    return runtime::sum8(arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7);
+}
+
+void print_f(float f) { runtime::print_f(f); }
+
+void print_s(const char *s) { runtime::print_s(s); }
+
+float read_f() { return runtime::read_f(); }
+}
@@ -0,0 +1,30 @@
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include <cstdint>
+
+// Micro-C standard library. Compiled programs call these functions by their C
+// names, which are defined in exports.cpp. libmicrocc maps the same names to
+// these functions instead, as e.g. 'read' would clash with the C library of
+// the embedding process.
+namespace runtime {
+void print(std::int64_t i);
+
+std::int64_t read();
+
+void print8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
+            std::int64_t arg3, std::int64_t arg4, std::int64_t arg5,
+            std::int64_t arg6, std::int64_t arg7);
+
+std::int64_t sum8(std::int64_t arg0, std::int64_t arg1, std::int64_t arg2,
+                  std::int64_t arg3, std::int64_t arg4, std::int64_t arg5,
+                  std::int64_t arg6, std::int64_t arg7);
+
+void print_f(float f);
+
+void print_s(const char *s);
+
+float read_f();
+} // namespace runtime
+
+#endif /* end of include guard: RUNTIME_HPP */